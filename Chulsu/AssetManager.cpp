@@ -3,6 +3,13 @@
 #include "Texture.h"
 #include "Instance.h"
 #include "Mesh.h"
+#include "Profiler.h"
+#include "MeshImporter.h"
+#include "OpacityClassifier.h"
+#include "VertexOcclusion.h"
+#include "TextureLOD.h"
+#include "CpuTexture.h"
+#include "UploadBuffer.h"
 
 void AssetManager::Init(ID3D12Device* device, int numDescriptor)
 {
@@ -95,152 +102,87 @@ ComPtr<D3D12MA::Allocation> AssetManager::CreateResource(
 void AssetManager::LoadAssimpScene(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList,
 	D3D12MA::Allocator* alloc, ResourceStateTracker& tracker, const std::string& path)
 {
-	//Hard coded, fix it later.
-	aiString dirPath = aiString("Contents/Sponza/");
-
-	Assimp::Importer Importer;
-	constexpr uint32_t ImporterFlags =
-		aiProcess_ConvertToLeftHanded |
-		aiProcess_JoinIdenticalVertices |
-		aiProcess_Triangulate |
-		aiProcess_SortByPType |
-		aiProcess_GenNormals |
-		aiProcess_GenUVCoords |
-		aiProcess_OptimizeMeshes |
-		aiProcess_ValidateDataStructure |
-		aiProcess_CalcTangentSpace;
-
-	const aiScene* pAiScene = Importer.ReadFile(path.data(), ImporterFlags);
-
-	if (!pAiScene || !pAiScene->HasMeshes())
+	ImportedMesh imported;
+	if (!ImportAssimpMesh(path, imported))
 	{
 		__debugbreak();
 	}
 
-	vector<SubMesh> subMeshes;
-	std::vector<Vertex> Vertices;
-	std::vector<uint32_t> Indices;
-
-	UINT vertexOffset = 0;
-	UINT IndexOffset = 0;
-
-	subMeshes.reserve(pAiScene->mNumMeshes);
-	for (unsigned m = 0; m < pAiScene->mNumMeshes; ++m)
-	{
-		// Assimp object
-		const aiMesh* pAiMesh = pAiScene->mMeshes[m];
-
-		for (unsigned int v = 0; v < pAiMesh->mNumVertices; ++v)
-		{
-			Vertex& vertex = Vertices.emplace_back();
-			vertex.position = { pAiMesh->mVertices[v].x, pAiMesh->mVertices[v].y, pAiMesh->mVertices[v].z };
-
-			if (pAiMesh->HasTextureCoords(0))
-			{
-				vertex.texCoord = { pAiMesh->mTextureCoords[0][v].x, pAiMesh->mTextureCoords[0][v].y };
-			}
-
-			if (pAiMesh->HasNormals())
-			{
-				vertex.normal = { pAiMesh->mNormals[v].x, pAiMesh->mNormals[v].y, pAiMesh->mNormals[v].z };
-			}
-
-			if (pAiMesh->HasTangentsAndBitangents())
-			{
-				vertex.biTangent = { pAiMesh->mBitangents[v].x, pAiMesh->mBitangents[v].y, pAiMesh->mBitangents[v].z };
-				vertex.tangent = { pAiMesh->mTangents[v].x, pAiMesh->mTangents[v].y, pAiMesh->mTangents[v].z };
-			}
-		}
-
-		Indices.reserve(static_cast<size_t>(pAiMesh->mNumFaces) * 3);
-		std::span Faces = { pAiMesh->mFaces, pAiMesh->mNumFaces };
-		for (const auto& Face : Faces)
-		{
-			Indices.push_back(Face.mIndices[0]);
-			Indices.push_back(Face.mIndices[1]);
-			Indices.push_back(Face.mIndices[2]);
-		}
-
-		auto matIndex = pAiMesh->mMaterialIndex;
-		aiMaterial* pAiMaterial = pAiScene->mMaterials[matIndex];
-
-		if(!mTextureIndices[matIndex].init)
+	// Only triangles that straddle the alpha cutoff keep going through the any-hit shader.
+	ClassifyOpacity(imported, [](const wstring& path)
 		{
-			mTextureIndices[matIndex].init = true;
-			int textureNum = 0;
-			for (int i = 1; i < aiTextureType_UNKNOWN + 1; ++i)
-			{
-				aiString path;
-				if (pAiMaterial->GetTexture((aiTextureType)i, 0, &path) == AI_SUCCESS)
-				{
-					textureNum++;
-					aiString fullPath = dirPath;
-					fullPath.Append(path.data);
-
-					wstring wPath = stringTowstring(string(fullPath.C_Str()));
-
-					if (mTextures[wPath] == nullptr)
-					{
-						LoadTexture(device, cmdList, alloc, tracker, wPath,
-							D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_SRV_DIMENSION_TEXTURE2D, D3D12_UAV_DIMENSION_UNKNOWN, true, false, FLAG_WIC);
-
-						switch (aiTextureType(i))
-						{
-						case aiTextureType_DIFFUSE:
-							mTextureIndices[matIndex].AlbedoTextureIndex = mHeapCurrentIndex - 1;
-							break;
-
-						case aiTextureType_AMBIENT:
-							mTextureIndices[matIndex].MetalicTextureIndex = mHeapCurrentIndex - 1;
-							break;
-
-						case aiTextureType_HEIGHT:
-							mTextureIndices[matIndex].NormalMapTextureIndex = mHeapCurrentIndex - 1;
-							break;
-
-						case aiTextureType_SHININESS:
-							mTextureIndices[matIndex].RoughnessTextureIndex = mHeapCurrentIndex - 1;
-							break;
-
-						case aiTextureType_OPACITY:
-							mTextureIndices[matIndex].OpacityMapTextureIndex = mHeapCurrentIndex - 1;
-							break;
-
-						}
-					}
-				}
-			}
-		}
-
-		SubMesh subMesh;
-		subMesh.SetMaterialIndex(matIndex);
-		subMesh.SetName(pAiMesh->mName.C_Str());
-
-		subMesh.SetVertexOffset(vertexOffset);
-		subMesh.SetIndexOffset(IndexOffset);
-
-		subMesh.SetVertexCount(pAiMesh->mNumVertices);
-		subMesh.SetIndexCount(pAiMesh->mNumFaces * 3);
-
-		subMeshes.push_back(subMesh);
+			auto texture = make_shared<CpuTexture>();
+			return texture->LoadFromFile(path) ? texture : nullptr;
+		});
+	BakeVertexOcclusion(imported, stringTowstring(path) + L".ao");
+	ComputeTriangleLOD(imported);
+
+	// Materials go into the scene wide table, from here on the submeshes hold table indices instead of assimp ones
+	map<UINT, UINT> materialIndices;
+	for (auto& [matIndex, material] : imported.Materials)
+	{
+		Material entry;
+		entry.BaseColor = material.BaseColor;
+		entry.AlbedoTextureIndex = LoadMaterialTexture(device, cmdList, alloc, tracker, material.AlbedoTexturePath);
+		entry.Metalic = material.Metalic;
+		entry.Roughness = material.Roughness;
+		entry.MetalicTextureIndex = LoadMaterialTexture(device, cmdList, alloc, tracker, material.MetalicTexturePath);
+		entry.RoughnessTextureIndex = LoadMaterialTexture(device, cmdList, alloc, tracker, material.RoughnessTexturePath);
+		entry.NormalMapTextureIndex = LoadMaterialTexture(device, cmdList, alloc, tracker, material.NormalMapTexturePath);
+		entry.OpacityMapTextureIndex = LoadMaterialTexture(device, cmdList, alloc, tracker, material.OpacityMapTexturePath);
+		entry.AlphaMode = material.AlphaMode;
+		entry.AlphaCutoff = material.AlphaCutoff;
+		materialIndices[matIndex] = mMaterialTable.Add(entry);
+	}
 
-		vertexOffset = Vertices.size();
-		IndexOffset = Indices.size();
+	for (SubMesh& subMesh : imported.SubMeshes)
+	{
+		auto found = materialIndices.find(subMesh.GetMaterialIndex());
+		subMesh.SetMaterialIndex(found != materialIndices.end() ? found->second : mMaterialTable.Add(Material()));
 	}
-	shared_ptr<Mesh> mesh = make_shared<Mesh>(subMeshes);
+
+	shared_ptr<Mesh> mesh = make_shared<Mesh>(imported.SubMeshes);
 	mesh->InitializeBuffers(device, cmdList, alloc, tracker, *this, sizeof(Vertex), sizeof(UINT),
-		D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, Vertices.data(), (UINT)Vertices.size(), Indices.data(), (UINT)Indices.size());
+		D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, imported.Vertices.data(), (UINT)imported.Vertices.size(), imported.Indices.data(), (UINT)imported.Indices.size());
+	mesh->InitializeTriangleLODBuffer(device, cmdList, alloc, tracker, *this, imported.TriangleLOD);
 
 	UINT vertexBufferIndex = SetShaderResource(device, cmdList, mesh->GetVertexBufferAlloc(), mesh->VertexShaderResourceView());
 	mHeapCurrentIndex++;
 	UINT IndexBufferIndex = SetShaderResource(device, cmdList, mesh->GetIndexBufferAlloc(), mesh->IndexShaderResourceView());
 	mHeapCurrentIndex++;
 
+	// A mesh without triangles has no buffer to view and is never hit, its index stays UINT_MAX
+	if (mesh->GetTriangleLODBufferAlloc())
+	{
+		mesh->SetTriangleLODIndex(SetShaderResource(device, cmdList, mesh->GetTriangleLODBufferAlloc(), mesh->TriangleLODShaderResourceView()));
+		mHeapCurrentIndex++;
+	}
+
 	mesh->SetVertexAttribIndex(vertexBufferIndex);
 	mesh->SetIndexBufferIndex(IndexBufferIndex);
+	mesh->BuildGeometryInfo(device, cmdList, alloc, tracker, *this);
+
+	// Keep the CPU copy around for CPU side consumers (BVH, bakes, ...).
+	mesh->SetGeometry(std::move(imported.Vertices), std::move(imported.Indices));
 	mMeshMap[path] = mesh;
 }
 
+UINT AssetManager::LoadMaterialTexture(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList,
+	D3D12MA::Allocator* alloc, ResourceStateTracker& tracker, const wstring& path)
+{
+	if (path.empty())
+		return UINT_MAX;
+
+	if (mTextures[path] == nullptr)
+	{
+		PROFILE_ZONE("Texture Decode");
+		LoadTexture(device, cmdList, alloc, tracker, path,
+			D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_SRV_DIMENSION_TEXTURE2D, D3D12_UAV_DIMENSION_UNKNOWN, true, false, FLAG_WIC);
+	}
+
+	return mTextures[path]->GetSRVDescriptorHeapIndex();
+}
+
 
 void AssetManager::CreateInstance(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, D3D12MA::Allocator* alloc,
 	ResourceStateTracker& tracker, const std::string& path,
@@ -251,8 +193,6 @@ void AssetManager::CreateInstance(ID3D12Device5* device, ID3D12GraphicsCommandLi
 
 	shared_ptr<Instance> instance = make_shared<Instance>(position, rotation, scale);
 	instance->SetMesh(mMeshMap[path]);
-	instance->BuildConstantBuffer(device, cmdList, alloc, tracker, *this);
-	instance->BuildStructuredBuffer(device, cmdList, alloc, tracker, *this);
 	instance->Update();
 
 	mInstances.push_back(instance);
@@ -428,6 +368,68 @@ void AssetManager::SetTexture(ID3D12Device5* device,
 	mTextures[textureName] = newTexture;
 }
 
+void AssetManager::BuildMaterialTable(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker)
+{
+	const UINT count = mMaterialTable.GetCount();
+	if (count == 0 || (mMaterialSB && mMaterialSB->GetCount() == count))
+		return;
+
+	// The table only grows, a new buffer replaces the old one which the GPU must not be using anymore
+	mMaterialSB = std::make_shared<UploadBuffer<Material>>(device, cmdList, count, alloc, tracker, *this, false);
+	for (UINT i = 0; i < count; ++i)
+		mMaterialSB->CopyData(i, mMaterialTable.Get(i));
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = count;
+	srvDesc.Buffer.StructureByteStride = sizeof(Material);
+	srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+
+	mMaterialTableIndex = SetShaderResource(device, cmdList, mMaterialSB->GetUploadAllocation(), srvDesc);
+	mHeapCurrentIndex++;
+
+	DebugLog("Material table: " + to_string(count) + " materials, " + to_string(count * sizeof(Material)) + " bytes");
+}
+
+void AssetManager::BuildInstanceBuffer(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker)
+{
+	const UINT count = static_cast<UINT>(mInstances.size());
+	if (count == 0)
+		return;
+
+	// InstanceID of the TLAS only has 24 bits
+	assert(count <= (1u << 24));
+
+	if (!mInstanceSB || mInstanceSB->GetCount() != count)
+	{
+		// A new buffer replaces the old one which the GPU must not be using anymore
+		mInstanceSB = std::make_shared<UploadBuffer<InstanceData>>(device, cmdList, count, alloc, tracker, *this, false);
+
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = count;
+		srvDesc.Buffer.StructureByteStride = sizeof(InstanceData);
+		srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+
+		mInstanceBufferIndex = SetShaderResource(device, cmdList, mInstanceSB->GetUploadAllocation(), srvDesc);
+		mHeapCurrentIndex++;
+
+		DebugLog("Instance buffer: " + to_string(count) + " instances, " + to_string(count * sizeof(InstanceData)) + " bytes");
+	}
+
+	// The same order BuildTLAS assigns the InstanceIDs in
+	for (UINT i = 0; i < count; ++i)
+		mInstanceSB->CopyData(i, mInstances[i]->GetInstanceData());
+}
+
 UINT AssetManager::SetShaderResource(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocation> alloc, const D3D12_SHADER_RESOURCE_VIEW_DESC& desc)
 {
 	auto bufferCPUHandle = GetIndexedCPUHandle(mHeapCurrentIndex);
@@ -454,6 +456,8 @@ void AssetManager::BuildAccelerationStructure(ID3D12Device5* device, ID3D12Graph
 
 void AssetManager::BuildBLAS(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker)
 {
+	PROFILE_ZONE("BLAS Prep");
+
 	UINT vertexBufferOffset = 0;
 	UINT indexBufferOffset = 0;
 	for (auto i = mMeshMap.begin(); i != mMeshMap.end(); ++i)
@@ -484,7 +488,7 @@ void AssetManager::BuildBLAS(ID3D12Device5* device, ID3D12GraphicsCommandList4*
 				geomDesc.Triangles.IndexCount = (*j).GetIndexCount();
 			}
 
-			if (GetMaterialIndices(j->GetMaterialIndex()).OpacityMapTextureIndex == UINT_MAX)
+			if (!j->IsAlphaTested())
 				geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
 			else
 				geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
@@ -554,14 +558,17 @@ void AssetManager::BuildTLAS(ID3D12Device5* device, ID3D12GraphicsCommandList4*
 	buffers.mInstanceDesc->GetResource()->Map(0, nullptr, (void**)&instanceDescs);
 	ZeroMemory(instanceDescs, sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * mInstances.size());
 
+	// Every geometry has its own record per ray type, so an instance starts after all records of the previous ones
+	UINT hitGroupIndex = 0;
 	for (uint32_t i = 0; i < mInstances.size(); i++)
 	{
 		XMFLOAT4X4 transform;
 		transform = mInstances[i]->GetWorldMatrix();
 
 		instanceDescs[i].InstanceID = i;
-		mInstances[i]->SetHitGroup(i * 2);
-		instanceDescs[i].InstanceContributionToHitGroupIndex = i * 2;
+		mInstances[i]->SetHitGroup(hitGroupIndex);
+		instanceDescs[i].InstanceContributionToHitGroupIndex = hitGroupIndex;
+		hitGroupIndex += mInstances[i]->GetMesh()->GetSubMeshCount() * RAY_TYPE_COUNT;
 		instanceDescs[i].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
 		XMFLOAT4X4 m = Matrix4x4::Transpose(transform);
 		memcpy(instanceDescs[i].Transform, &m, sizeof(instanceDescs[i].Transform));
@@ -1,23 +1,15 @@
 #pragma once
 #include "stdafx.h"
+#include "Material.h"
 
+template<typename Cnst> class UploadBuffer;
 class Texture;
 class Instance;
+struct InstanceData;
 class SubMesh;
 class Mesh;
 struct Vertex;
 
-struct TextureHeapIndex
-{
-	bool init = false;
-
-	UINT AlbedoTextureIndex = UINT_MAX;
-	UINT MetalicTextureIndex = UINT_MAX;
-	UINT RoughnessTextureIndex = UINT_MAX;
-	UINT NormalMapTextureIndex = UINT_MAX;
-	UINT OpacityMapTextureIndex = UINT_MAX;
-};
-
 struct AccelerationStructureBuffers
 {
 	ComPtr<D3D12MA::Allocation> mScratch = NULL;
@@ -48,6 +40,9 @@ public:
 
 	void LoadAssimpScene(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, D3D12MA::Allocator* alloc, ResourceStateTracker& tracker, const std::string& path);
 
+	// Returns the descriptor heap index of the texture, UINT_MAX for an empty path.
+	UINT LoadMaterialTexture(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, D3D12MA::Allocator* alloc, ResourceStateTracker& tracker, const wstring& path);
+
 	void CreateInstance(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList,
 		D3D12MA::Allocator* alloc, ResourceStateTracker& tracker, const std::string& path,
 		XMFLOAT3 position, XMFLOAT3 rotation, XMFLOAT3 scale);
@@ -99,7 +94,17 @@ public:
 
 	void AddCurrentHeapIndex() { mHeapCurrentIndex++; }
 
-	const TextureHeapIndex& GetMaterialIndices(UINT key) { return mTextureIndices[key]; }
+	// Submeshes of loaded meshes hold indices into this table.
+	const Material& GetMaterial(UINT index) const { return mMaterialTable.Get(index); }
+
+	// Uploads the material table to one structured buffer, again only when materials were added since the last call.
+	void BuildMaterialTable(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker);
+	UINT GetMaterialTableIndex() const { return mMaterialTableIndex; }
+
+	// Writes the InstanceData of every instance to one structured buffer, indexed by the InstanceID of the TLAS.
+	// Call it after instances were added or got another mesh, the buffer is replaced only when the count changed.
+	void BuildInstanceBuffer(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker);
+	UINT GetInstanceBufferIndex() const { return mInstanceBufferIndex; }
 
 	UINT mCbvSrvUavDescriptorSize = 0;
 
@@ -117,7 +122,12 @@ private:
 	ComPtr<ID3D12DescriptorHeap> mDescriptorHeap;
 	UINT mHeapCurrentIndex = 0;
 
-	unordered_map<UINT, TextureHeapIndex> mTextureIndices;
+	MaterialTable mMaterialTable;
+	shared_ptr<UploadBuffer<Material>> mMaterialSB;
+	UINT mMaterialTableIndex = UINT_MAX;
+
+	shared_ptr<UploadBuffer<InstanceData>> mInstanceSB;
+	UINT mInstanceBufferIndex = UINT_MAX;
 
 	ComPtr<IDStorageQueue> mTextureQueue;
 	ComPtr<IDStorageFactory> mTextureFactory;
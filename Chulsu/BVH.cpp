@@ -0,0 +1,215 @@
+#include "BVH.h"
+
+namespace
+{
+	struct Bounds
+	{
+		XMFLOAT3 Min = { FLT_MAX, FLT_MAX, FLT_MAX };
+		XMFLOAT3 Max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const XMFLOAT3& p)
+		{
+			Min = { min(Min.x, p.x), min(Min.y, p.y), min(Min.z, p.z) };
+			Max = { max(Max.x, p.x), max(Max.y, p.y), max(Max.z, p.z) };
+		}
+
+		// Growing by an empty box must leave the bounds untouched, so min and max are merged separately.
+		void Grow(const Bounds& b)
+		{
+			Min = { min(Min.x, b.Min.x), min(Min.y, b.Min.y), min(Min.z, b.Min.z) };
+			Max = { max(Max.x, b.Max.x), max(Max.y, b.Max.y), max(Max.z, b.Max.z) };
+		}
+
+		float SurfaceArea() const
+		{
+			float dx = Max.x - Min.x;
+			float dy = Max.y - Min.y;
+			float dz = Max.z - Min.z;
+			if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+				return 0.0f;
+			return 2.0f * (dx * dy + dy * dz + dz * dx);
+		}
+	};
+
+	float Axis(const XMFLOAT3& v, UINT axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	struct Bin
+	{
+		Bounds Box;
+		UINT Count = 0;
+	};
+}
+
+void BVH::Build(const vector<BVHTriangle>& triangles)
+{
+	const UINT primCount = static_cast<UINT>(triangles.size());
+
+	mOwner = nullptr;
+	mNodeStorage.clear();
+	mPrimIndexStorage.resize(primCount);
+	iota(mPrimIndexStorage.begin(), mPrimIndexStorage.end(), 0);
+	mDepth = 0;
+
+	if (primCount == 0)
+	{
+		mTriangleStorage.clear();
+		mNodes = mNodeStorage;
+		mPrimIndices = mPrimIndexStorage;
+		mTriangles = mTriangleStorage;
+		return;
+	}
+
+	vector<Bounds> primBounds(primCount);
+	vector<XMFLOAT3> centroids(primCount);
+	for (UINT i = 0; i < primCount; ++i)
+	{
+		primBounds[i].Grow(triangles[i].V0);
+		primBounds[i].Grow(triangles[i].V1);
+		primBounds[i].Grow(triangles[i].V2);
+
+		centroids[i] = Vector3::ScalarProduct(Vector3::Add(primBounds[i].Min, primBounds[i].Max), 0.5f);
+	}
+
+	mNodeStorage.reserve(static_cast<size_t>(primCount) * 2);
+	mNodeStorage.push_back({ {}, 0, {}, primCount });
+
+	struct BuildTask
+	{
+		UINT Node;
+		UINT Depth;
+	};
+	vector<BuildTask> tasks;
+	tasks.push_back({ 0, 0 });
+
+	while (!tasks.empty())
+	{
+		BuildTask task = tasks.back();
+		tasks.pop_back();
+
+		const UINT first = mNodeStorage[task.Node].LeftFirst;
+		const UINT count = mNodeStorage[task.Node].Count;
+
+		Bounds nodeBounds, centroidBounds;
+		for (UINT i = first; i < first + count; ++i)
+		{
+			nodeBounds.Grow(primBounds[mPrimIndexStorage[i]]);
+			centroidBounds.Grow(centroids[mPrimIndexStorage[i]]);
+		}
+
+		mNodeStorage[task.Node].BoundsMin = nodeBounds.Min;
+		mNodeStorage[task.Node].BoundsMax = nodeBounds.Max;
+		mDepth = max(mDepth, task.Depth);
+
+		if (count <= 2 || task.Depth >= mMaxDepth)
+			continue;
+
+		// Binned SAH over all three axes.
+		float bestCost = FLT_MAX;
+		UINT bestAxis = 0;
+		UINT bestSplit = 0;
+
+		for (UINT axis = 0; axis < 3; ++axis)
+		{
+			float axisMin = Axis(centroidBounds.Min, axis);
+			float axisMax = Axis(centroidBounds.Max, axis);
+			if (axisMax <= axisMin)
+				continue;
+
+			Bin bins[mBinCount];
+			float scale = mBinCount / (axisMax - axisMin);
+			for (UINT i = first; i < first + count; ++i)
+			{
+				UINT prim = mPrimIndexStorage[i];
+				UINT b = min(mBinCount - 1, static_cast<UINT>((Axis(centroids[prim], axis) - axisMin) * scale));
+				bins[b].Count++;
+				bins[b].Box.Grow(primBounds[prim]);
+			}
+
+			// Sweep from both sides to get the cost of every split plane.
+			float leftArea[mBinCount - 1], rightArea[mBinCount - 1];
+			UINT leftCount[mBinCount - 1], rightCount[mBinCount - 1];
+
+			Bounds leftBox, rightBox;
+			UINT leftSum = 0, rightSum = 0;
+			for (UINT i = 0; i < mBinCount - 1; ++i)
+			{
+				leftSum += bins[i].Count;
+				leftCount[i] = leftSum;
+				leftBox.Grow(bins[i].Box);
+				leftArea[i] = leftBox.SurfaceArea();
+
+				rightSum += bins[mBinCount - 1 - i].Count;
+				rightCount[mBinCount - 2 - i] = rightSum;
+				rightBox.Grow(bins[mBinCount - 1 - i].Box);
+				rightArea[mBinCount - 2 - i] = rightBox.SurfaceArea();
+			}
+
+			for (UINT i = 0; i < mBinCount - 1; ++i)
+			{
+				if (leftCount[i] == 0 || rightCount[i] == 0)
+					continue;
+
+				float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i;
+				}
+			}
+		}
+
+		// Compare against the leaf cost, traversal step is weighted as one triangle test.
+		float nodeArea = nodeBounds.SurfaceArea();
+		float splitCost = 1.0f + (nodeArea > 0.0f ? bestCost / nodeArea : FLT_MAX);
+		if (bestCost == FLT_MAX || (splitCost >= count && count <= mMaxLeafSize))
+			continue;
+
+		float axisMin = Axis(centroidBounds.Min, bestAxis);
+		float scale = mBinCount / (Axis(centroidBounds.Max, bestAxis) - axisMin);
+		auto middle = partition(mPrimIndexStorage.begin() + first, mPrimIndexStorage.begin() + first + count, [&](UINT prim)
+			{
+				UINT b = min(mBinCount - 1, static_cast<UINT>((Axis(centroids[prim], bestAxis) - axisMin) * scale));
+				return b <= bestSplit;
+			});
+
+		UINT leftCountFinal = static_cast<UINT>(middle - (mPrimIndexStorage.begin() + first));
+		if (leftCountFinal == 0 || leftCountFinal == count)
+			continue;
+
+		UINT leftChild = static_cast<UINT>(mNodeStorage.size());
+		mNodeStorage.push_back({ {}, first, {}, leftCountFinal });
+		mNodeStorage.push_back({ {}, first + leftCountFinal, {}, count - leftCountFinal });
+
+		mNodeStorage[task.Node].LeftFirst = leftChild;
+		mNodeStorage[task.Node].Count = 0;
+
+		tasks.push_back({ leftChild, task.Depth + 1 });
+		tasks.push_back({ leftChild + 1, task.Depth + 1 });
+	}
+
+	mTriangleStorage.resize(primCount);
+	for (UINT i = 0; i < primCount; ++i)
+		mTriangleStorage[i] = triangles[mPrimIndexStorage[i]];
+
+	mNodes = mNodeStorage;
+	mPrimIndices = mPrimIndexStorage;
+	mTriangles = mTriangleStorage;
+}
+
+void BVH::Attach(span<const BVHNode> nodes, span<const UINT> primIndices, span<const BVHTriangle> triangles,
+	UINT depth, shared_ptr<const void> owner)
+{
+	mNodeStorage.clear();
+	mPrimIndexStorage.clear();
+	mTriangleStorage.clear();
+
+	mOwner = std::move(owner);
+	mNodes = nodes;
+	mPrimIndices = primIndices;
+	mTriangles = triangles;
+	mDepth = depth;
+}
@@ -0,0 +1,233 @@
+#pragma once
+#include "stdafx.h"
+
+struct BVHTriangle
+{
+	XMFLOAT3 V0;
+	XMFLOAT3 V1;
+	XMFLOAT3 V2;
+};
+
+struct BVHNode
+{
+	XMFLOAT3 BoundsMin;
+	UINT LeftFirst;		// First child when Count is 0, first primitive otherwise. Children are stored adjacently.
+	XMFLOAT3 BoundsMax;
+	UINT Count;
+};
+
+// Same layout and meaning as the HLSL RayDesc.
+struct RayDesc
+{
+	XMFLOAT3 Origin;
+	float TMin;
+	XMFLOAT3 Direction;
+	float TMax;
+};
+
+struct RayHit
+{
+	float T = FLT_MAX;
+	XMFLOAT2 Barycentrics = { 0.0f, 0.0f };		// Weights of V1 and V2, like BuiltInTriangleIntersectionAttributes.
+	UINT PrimitiveIndex = UINT_MAX;				// Index into the triangle array passed to Build.
+};
+
+// Binary BVH built with binned SAH over world space triangles.
+class BVH
+{
+public:
+	BVH() = default;
+	~BVH() = default;
+
+	// The views may point into the owned storage, copying would leave them dangling.
+	BVH(const BVH&) = delete;
+	BVH& operator=(const BVH&) = delete;
+	BVH(BVH&&) = default;
+	BVH& operator=(BVH&&) = default;
+
+	void Build(const vector<BVHTriangle>& triangles);
+
+	// Traverses data owned by someone else, e.g. a mapped cache file, without copying it.
+	// owner is kept alive for as long as the BVH uses the data.
+	void Attach(span<const BVHNode> nodes, span<const UINT> primIndices, span<const BVHTriangle> triangles,
+		UINT depth, shared_ptr<const void> owner);
+
+	// The any-hit callback gets (primitiveIndex, barycentrics, t) and returns false to ignore the hit.
+	template<typename AnyHit>
+	bool TraceRay(const RayDesc& ray, RayHit& hit, bool acceptFirstHit, AnyHit&& anyHit) const;
+
+	bool TraceRay(const RayDesc& ray, RayHit& hit) const
+	{
+		return TraceRay(ray, hit, false, [](UINT, const XMFLOAT2&, float) { return true; });
+	}
+
+	span<const BVHNode> GetNodes() const { return mNodes; }
+	span<const UINT> GetPrimitiveIndices() const { return mPrimIndices; }
+	span<const BVHTriangle> GetTriangles() const { return mTriangles; }
+
+	UINT GetDepth() const { return mDepth; }
+	static constexpr UINT GetMaxDepth() { return mMaxDepth; }
+
+	static bool IntersectTriangle(const BVHTriangle& tri, FXMVECTOR origin, FXMVECTOR direction,
+		float tMin, float tMax, float& t, XMFLOAT2& barycentrics);
+
+	static bool IntersectBounds(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax,
+		const XMFLOAT3& origin, const XMFLOAT3& invDirection, float tMin, float tMax, float& tEntry);
+
+private:
+	static const UINT mBinCount = 16;
+	static const UINT mMaxLeafSize = 8;
+
+	// Bounds the traversal stack. Nodes at this depth become leaves regardless of their size.
+	static const UINT mMaxDepth = 48;
+
+	// Filled by Build, empty when the BVH is attached to external data.
+	vector<BVHNode> mNodeStorage;
+	vector<UINT> mPrimIndexStorage;
+	vector<BVHTriangle> mTriangleStorage;
+	shared_ptr<const void> mOwner;
+
+	// What traversal reads, either the storage above or attached data.
+	span<const BVHNode> mNodes;
+	span<const UINT> mPrimIndices;
+
+	// Triangles reordered by mPrimIndices so leaves are contiguous in memory.
+	span<const BVHTriangle> mTriangles;
+
+	UINT mDepth = 0;
+};
+
+inline bool BVH::IntersectTriangle(const BVHTriangle& tri, FXMVECTOR origin, FXMVECTOR direction,
+	float tMin, float tMax, float& t, XMFLOAT2& barycentrics)
+{
+	// Moller-Trumbore
+	XMVECTOR v0 = XMLoadFloat3(&tri.V0);
+	XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&tri.V1), v0);
+	XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&tri.V2), v0);
+
+	XMVECTOR p = XMVector3Cross(direction, e2);
+	float det = XMVectorGetX(XMVector3Dot(e1, p));
+	if (fabsf(det) < 1e-12f)
+		return false;
+
+	float invDet = 1.0f / det;
+	XMVECTOR s = XMVectorSubtract(origin, v0);
+	float u = XMVectorGetX(XMVector3Dot(s, p)) * invDet;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	XMVECTOR q = XMVector3Cross(s, e1);
+	float v = XMVectorGetX(XMVector3Dot(direction, q)) * invDet;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	float hitT = XMVectorGetX(XMVector3Dot(e2, q)) * invDet;
+	if (hitT < tMin || hitT >= tMax)
+		return false;
+
+	t = hitT;
+	barycentrics = XMFLOAT2(u, v);
+	return true;
+}
+
+inline bool BVH::IntersectBounds(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax,
+	const XMFLOAT3& origin, const XMFLOAT3& invDirection, float tMin, float tMax, float& tEntry)
+{
+	float tx0 = (boundsMin.x - origin.x) * invDirection.x;
+	float tx1 = (boundsMax.x - origin.x) * invDirection.x;
+	float ty0 = (boundsMin.y - origin.y) * invDirection.y;
+	float ty1 = (boundsMax.y - origin.y) * invDirection.y;
+	float tz0 = (boundsMin.z - origin.z) * invDirection.z;
+	float tz1 = (boundsMax.z - origin.z) * invDirection.z;
+
+	float tNear = max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), tMin));
+	float tFar = min(min(max(tx0, tx1), max(ty0, ty1)), min(max(tz0, tz1), tMax));
+
+	tEntry = tNear;
+	return tNear <= tFar;
+}
+
+template<typename AnyHit>
+bool BVH::TraceRay(const RayDesc& ray, RayHit& hit, bool acceptFirstHit, AnyHit&& anyHit) const
+{
+	if (mNodes.empty())
+		return false;
+
+	XMVECTOR origin = XMLoadFloat3(&ray.Origin);
+	XMVECTOR direction = XMLoadFloat3(&ray.Direction);
+	XMFLOAT3 invDirection = { 1.0f / ray.Direction.x, 1.0f / ray.Direction.y, 1.0f / ray.Direction.z };
+
+	float tMax = min(ray.TMax, hit.T);
+	bool found = false;
+
+	float tRoot;
+	if (!IntersectBounds(mNodes[0].BoundsMin, mNodes[0].BoundsMax, ray.Origin, invDirection, ray.TMin, tMax, tRoot))
+		return false;
+
+	// Entries keep their entry distance so nodes behind a closer hit are skipped without a retest.
+	struct StackEntry
+	{
+		UINT Node;
+		float T;
+	};
+	StackEntry stack[mMaxDepth + 1];
+	UINT stackSize = 0;
+	stack[stackSize++] = { 0, tRoot };
+
+	while (stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		if (entry.T > tMax)
+			continue;
+
+		const BVHNode& node = mNodes[entry.Node];
+		if (node.Count > 0)
+		{
+			for (UINT i = node.LeftFirst; i < node.LeftFirst + node.Count; ++i)
+			{
+				float t;
+				XMFLOAT2 barycentrics;
+				if (!IntersectTriangle(mTriangles[i], origin, direction, ray.TMin, tMax, t, barycentrics))
+					continue;
+
+				if (!anyHit(mPrimIndices[i], barycentrics, t))
+					continue;
+
+				tMax = t;
+				hit.T = t;
+				hit.Barycentrics = barycentrics;
+				hit.PrimitiveIndex = mPrimIndices[i];
+				found = true;
+
+				if (acceptFirstHit)
+					return true;
+			}
+			continue;
+		}
+
+		// Visit the nearer child first.
+		UINT left = node.LeftFirst;
+		UINT right = node.LeftFirst + 1;
+
+		float tLeft, tRight;
+		bool hitLeft = IntersectBounds(mNodes[left].BoundsMin, mNodes[left].BoundsMax, ray.Origin, invDirection, ray.TMin, tMax, tLeft);
+		bool hitRight = IntersectBounds(mNodes[right].BoundsMin, mNodes[right].BoundsMax, ray.Origin, invDirection, ray.TMin, tMax, tRight);
+
+		if (hitLeft && hitRight)
+		{
+			if (tLeft > tRight)
+			{
+				swap(left, right);
+				swap(tLeft, tRight);
+			}
+			stack[stackSize++] = { right, tRight };
+			stack[stackSize++] = { left, tLeft };
+		}
+		else if (hitLeft)
+			stack[stackSize++] = { left, tLeft };
+		else if (hitRight)
+			stack[stackSize++] = { right, tRight };
+	}
+
+	return found;
+}
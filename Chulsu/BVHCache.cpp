@@ -0,0 +1,106 @@
+#include "BVHCache.h"
+#include "MappedFile.h"
+
+uint64_t HashTriangles(const vector<BVHTriangle>& triangles)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(triangles.data());
+	const size_t size = triangles.size() * sizeof(BVHTriangle);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+namespace
+{
+	typedef WideBVHNode<NativeWideBVH::Width> NativeWideBVHNode;
+
+	// Offset of the wide nodes, the mapping itself starts on a page.
+	size_t WideNodeOffset(UINT nodeCount, UINT primitiveCount)
+	{
+		size_t offset = sizeof(BVHCacheHeader) + static_cast<size_t>(nodeCount) * sizeof(BVHNode)
+			+ static_cast<size_t>(primitiveCount) * (sizeof(UINT) + sizeof(BVHTriangle));
+		return (offset + alignof(NativeWideBVHNode) - 1) & ~(alignof(NativeWideBVHNode) - 1);
+	}
+}
+
+bool SaveBVHCache(const wstring& path, const BVH& bvh, const NativeWideBVH& wideBVH, uint64_t geometryHash)
+{
+	span<const BVHNode> nodes = bvh.GetNodes();
+	span<const UINT> primIndices = bvh.GetPrimitiveIndices();
+	span<const BVHTriangle> triangles = bvh.GetTriangles();
+	span<const NativeWideBVHNode> wideNodes = wideBVH.GetNodes();
+	assert(wideBVH.GetPrimitiveIndices().size() == primIndices.size());
+
+	BVHCacheHeader header = {};
+	header.Magic = BVHCacheMagic;
+	header.Version = BVHCacheVersion;
+	header.GeometryHash = geometryHash;
+	header.NodeCount = static_cast<UINT>(nodes.size());
+	header.PrimitiveCount = static_cast<UINT>(primIndices.size());
+	header.Depth = bvh.GetDepth();
+	header.WideWidth = NativeWideBVH::Width;
+	header.WideNodeCount = static_cast<UINT>(wideNodes.size());
+	header.WideDepth = wideBVH.GetDepth();
+
+	// Written under a temporary name so an interrupted run never leaves a truncated cache behind.
+	filesystem::path tempPath = path + L".tmp";
+	{
+		ofstream file(tempPath, ios::binary | ios::trunc);
+		if (!file)
+			return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(nodes.data()), nodes.size_bytes());
+		file.write(reinterpret_cast<const char*>(primIndices.data()), primIndices.size_bytes());
+		file.write(reinterpret_cast<const char*>(triangles.data()), triangles.size_bytes());
+
+		const char padding[alignof(NativeWideBVHNode)] = {};
+		size_t written = sizeof(header) + nodes.size_bytes() + primIndices.size_bytes() + triangles.size_bytes();
+		file.write(padding, WideNodeOffset(header.NodeCount, header.PrimitiveCount) - written);
+		file.write(reinterpret_cast<const char*>(wideNodes.data()), wideNodes.size_bytes());
+
+		if (!file)
+			return false;
+	}
+
+	error_code ec;
+	filesystem::rename(tempPath, path, ec);
+	return !ec;
+}
+
+bool LoadBVHCache(const wstring& path, uint64_t geometryHash, BVH& bvh, NativeWideBVH& wideBVH)
+{
+	auto file = make_shared<MappedFile>();
+	if (!file->Open(path) || file->GetSize() < sizeof(BVHCacheHeader))
+		return false;
+
+	const BVHCacheHeader* header = reinterpret_cast<const BVHCacheHeader*>(file->GetData());
+	if (header->Magic != BVHCacheMagic || header->Version != BVHCacheVersion || header->GeometryHash != geometryHash
+		|| header->WideWidth != NativeWideBVH::Width)
+		return false;
+
+	const size_t nodeBytes = static_cast<size_t>(header->NodeCount) * sizeof(BVHNode);
+	const size_t primIndexBytes = static_cast<size_t>(header->PrimitiveCount) * sizeof(UINT);
+	const size_t wideNodeOffset = WideNodeOffset(header->NodeCount, header->PrimitiveCount);
+	if (file->GetSize() != wideNodeOffset + static_cast<size_t>(header->WideNodeCount) * sizeof(NativeWideBVHNode))
+		return false;
+
+	const uint8_t* data = file->GetData() + sizeof(BVHCacheHeader);
+	span<const BVHNode> nodes(reinterpret_cast<const BVHNode*>(data), header->NodeCount);
+	data += nodeBytes;
+	span<const UINT> primIndices(reinterpret_cast<const UINT*>(data), header->PrimitiveCount);
+	data += primIndexBytes;
+	span<const BVHTriangle> triangles(reinterpret_cast<const BVHTriangle*>(data), header->PrimitiveCount);
+	span<const NativeWideBVHNode> wideNodes(reinterpret_cast<const NativeWideBVHNode*>(file->GetData() + wideNodeOffset), header->WideNodeCount);
+
+	// Both traverse the mapping in place and keep it alive
+	bvh.Attach(nodes, primIndices, triangles, header->Depth, file);
+	wideBVH.Attach(wideNodes, primIndices, triangles, header->WideDepth, file);
+	return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "stdafx.h"
+#include "BVH.h"
+#include "WideBVH.h"
+
+// On disk BVH, laid out so a mapped file can be traversed in place:
+//   BVHCacheHeader
+//   BVHNode[NodeCount]
+//   UINT[PrimitiveCount]          primitive permutation, shared by both BVHs
+//   BVHTriangle[PrimitiveCount]   triangles in leaf order, shared by both BVHs
+//   padding to alignof(WideBVHNode)
+//   WideBVHNode<WideWidth>[WideNodeCount]
+// The wide nodes are the NativeWideBVH of the build that wrote the file, a build for another instruction set rebuilds it.
+struct BVHCacheHeader
+{
+	UINT Magic;
+	UINT Version;
+	uint64_t GeometryHash;		// HashTriangles of the triangles the BVH was built from.
+	UINT NodeCount;
+	UINT PrimitiveCount;
+	UINT Depth;
+	UINT WideWidth;
+	UINT WideNodeCount;
+	UINT WideDepth;
+};
+
+const UINT BVHCacheMagic = 0x48564243;		// "CBVH" in the file.
+
+// Bump whenever BVHNode, WideBVHNode, BVHTriangle or either builder changes, old files are then rebuilt.
+const UINT BVHCacheVersion = 2;
+
+// 64 bit FNV-1a over the triangle data, order and count included.
+uint64_t HashTriangles(const vector<BVHTriangle>& triangles);
+
+// wideBVH must be collapsed from bvh, so both share its primitive order.
+bool SaveBVHCache(const wstring& path, const BVH& bvh, const NativeWideBVH& wideBVH, uint64_t geometryHash);
+
+// Maps the file and attaches both BVHs to it. Fails if the file is missing, from another version or
+// instruction set, or built from other geometry.
+bool LoadBVHCache(const wstring& path, uint64_t geometryHash, BVH& bvh, NativeWideBVH& wideBVH);
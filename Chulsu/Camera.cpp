@@ -1,5 +1,87 @@
 #include "Camera.h"
 
+void FrustumPlanes::Set(const XMFLOAT4X4& viewProj)
+{
+	// Gribb and Hartmann: clip space x, y and z bounds are planes made from the columns of the matrix
+	const XMFLOAT4X4& m = viewProj;
+	XMVECTOR col0 = XMVectorSet(m(0, 0), m(1, 0), m(2, 0), m(3, 0));
+	XMVECTOR col1 = XMVectorSet(m(0, 1), m(1, 1), m(2, 1), m(3, 1));
+	XMVECTOR col2 = XMVectorSet(m(0, 2), m(1, 2), m(2, 2), m(3, 2));
+	XMVECTOR col3 = XMVectorSet(m(0, 3), m(1, 3), m(2, 3), m(3, 3));
+
+	XMVECTOR planes[6] =
+	{
+		XMVectorAdd(col3, col0),		// left
+		XMVectorSubtract(col3, col0),	// right
+		XMVectorAdd(col3, col1),		// bottom
+		XMVectorSubtract(col3, col1),	// top
+		col2,							// near
+		XMVectorSubtract(col3, col2),	// far
+	};
+
+	for (UINT group = 0; group < 2; ++group)
+	{
+		// Padding plane 0x + 0y + 0z + 1, everything is in front of it
+		XMFLOAT4 p[4] = {};
+		for (UINT i = 0; i < 4; ++i)
+		{
+			if (group * 4 + i < 6)
+				XMStoreFloat4(&p[i], XMPlaneNormalize(planes[group * 4 + i]));
+			else
+				p[i] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+
+		X[group] = XMFLOAT4(p[0].x, p[1].x, p[2].x, p[3].x);
+		Y[group] = XMFLOAT4(p[0].y, p[1].y, p[2].y, p[3].y);
+		Z[group] = XMFLOAT4(p[0].z, p[1].z, p[2].z, p[3].z);
+		W[group] = XMFLOAT4(p[0].w, p[1].w, p[2].w, p[3].w);
+	}
+}
+
+bool FrustumPlanes::IntersectsSphere(FXMVECTOR center, float radius) const
+{
+	XMVECTOR cx = XMVectorSplatX(center);
+	XMVECTOR cy = XMVectorSplatY(center);
+	XMVECTOR cz = XMVectorSplatZ(center);
+	XMVECTOR negRadius = XMVectorReplicate(-radius);
+
+	for (UINT group = 0; group < 2; ++group)
+	{
+		XMVECTOR distance = XMVectorMultiplyAdd(cx, XMLoadFloat4(&X[group]),
+			XMVectorMultiplyAdd(cy, XMLoadFloat4(&Y[group]),
+			XMVectorMultiplyAdd(cz, XMLoadFloat4(&Z[group]), XMLoadFloat4(&W[group]))));
+
+		if (!XMVector4GreaterOrEqual(distance, negRadius))
+			return false;
+	}
+	return true;
+}
+
+bool FrustumPlanes::IntersectsBox(FXMVECTOR center, FXMVECTOR extents) const
+{
+	XMVECTOR cx = XMVectorSplatX(center);
+	XMVECTOR cy = XMVectorSplatY(center);
+	XMVECTOR cz = XMVectorSplatZ(center);
+	XMVECTOR ex = XMVectorSplatX(extents);
+	XMVECTOR ey = XMVectorSplatY(extents);
+	XMVECTOR ez = XMVectorSplatZ(extents);
+
+	for (UINT group = 0; group < 2; ++group)
+	{
+		XMVECTOR px = XMLoadFloat4(&X[group]);
+		XMVECTOR py = XMLoadFloat4(&Y[group]);
+		XMVECTOR pz = XMLoadFloat4(&Z[group]);
+
+		// Signed distance of the center against the projected half size of the box on each plane normal
+		XMVECTOR distance = XMVectorMultiplyAdd(cx, px, XMVectorMultiplyAdd(cy, py, XMVectorMultiplyAdd(cz, pz, XMLoadFloat4(&W[group]))));
+		XMVECTOR radius = XMVectorMultiplyAdd(ex, XMVectorAbs(px), XMVectorMultiplyAdd(ey, XMVectorAbs(py), XMVectorMultiply(ez, XMVectorAbs(pz))));
+
+		if (!XMVector4GreaterOrEqual(XMVectorAdd(distance, radius), XMVectorZero()))
+			return false;
+	}
+	return true;
+}
+
 Camera::Camera()
 {
 }
@@ -26,6 +108,29 @@ void Camera::SetRotation(const XMFLOAT4& quat)
 	mLook = Vector3::TransformNormal(mLook, mat);
 	mRight = Vector3::TransformNormal(mRight, mat);
 	mUp = Vector3::TransformNormal(mUp, mat);
+	mViewDirty = true;
+}
+
+void Camera::SetOrientation(const XMFLOAT4& quat)
+{
+	XMVECTOR q = XMQuaternionNormalize(XMLoadFloat4(&quat));
+	XMStoreFloat3(&mRight, XMVector3Rotate(XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), q));
+	XMStoreFloat3(&mUp, XMVector3Rotate(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), q));
+	XMStoreFloat3(&mLook, XMVector3Rotate(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), q));
+	mViewDirty = true;
+}
+
+XMFLOAT4 Camera::GetOrientation() const
+{
+	// Rows are the camera axes, the same rotation the view matrix undoes
+	XMMATRIX basis = XMMatrixIdentity();
+	basis.r[0] = XMVectorSetW(XMLoadFloat3(&mRight), 0.0f);
+	basis.r[1] = XMVectorSetW(XMLoadFloat3(&mUp), 0.0f);
+	basis.r[2] = XMVectorSetW(XMLoadFloat3(&mLook), 0.0f);
+
+	XMFLOAT4 quat;
+	XMStoreFloat4(&quat, XMQuaternionNormalize(XMQuaternionRotationMatrix(basis)));
+	return quat;
 }
 
 void Camera::SetLook(const XMFLOAT3& look)
@@ -61,8 +166,7 @@ void Camera::SetLens(float fovY, float aspect, float zn, float zf)
 	mFarZ = zf;
 
 	XMMATRIX P = XMMatrixPerspectiveFovLH(mFov.y * mFovCoefficient, mAspect * mFovCoefficient, mNearZ * mFovCoefficient, mFarZ * mFovCoefficient);
-	XMStoreFloat4x4(&mProj, P);
-	BoundingFrustum::CreateFromMatrix(mFrustumView, P);
+	SetProj(P);
 }
 
 void Camera::SetOrthographicLens(XMFLOAT3& center, float range)
@@ -74,8 +178,19 @@ void Camera::SetOrthographicLens(XMFLOAT3& center, float range)
 		C.x - range, C.x + range,
 		C.y - range, C.y + range,
 		C.z - range, C.z + range);
-	XMStoreFloat4x4(&mProj, P);
-	BoundingFrustum::CreateFromMatrix(mFrustumView, P);
+	SetProj(P);
+}
+
+void Camera::SetProj(FXMMATRIX proj)
+{
+	XMStoreFloat4x4(&mProj, proj);
+	BoundingFrustum::CreateFromMatrix(mFrustumView, proj);
+
+	auto determinant = XMMatrixDeterminant(proj);
+	XMStoreFloat4x4(&mInvProj, XMMatrixInverse(&determinant, proj));
+
+	// The combined matrices follow in the next UpdateViewMatrix
+	mProjDirty = true;
 }
 
 void Camera::SetFovCoefficient(float FovCoefficient)
@@ -119,15 +234,16 @@ const XMFLOAT4X4& Camera::GetInverseView() const
 	return mInvView;
 }
 
-const XMFLOAT4X4 Camera::GetInverseProj() const
+const XMFLOAT4X4& Camera::GetViewProj() const
 {
-	auto Proj = XMLoadFloat4x4(&GetProj());
-
-	XMFLOAT4X4 invProj;
-	auto determinant = XMMatrixDeterminant(Proj);
-	XMStoreFloat4x4(&invProj, XMMatrixInverse(&determinant, Proj));
+	assert(!mViewDirty && !mProjDirty && "Camera -> mViewProj is not updated!!");
+	return mViewProj;
+}
 
-	return invProj;
+const XMFLOAT4X4& Camera::GetInverseViewProj() const
+{
+	assert(!mViewDirty && !mProjDirty && "Camera -> mInvViewProj is not updated!!");
+	return mInvViewProj;
 }
 
 void Camera::Move(float dx, float dy, float dz)
@@ -182,7 +298,12 @@ void Camera::RotateY(float angle)
 void Camera::Update(const float elapsedTime)
 {
 	mOldView = mView;
+	mOldViewProj = mViewProj;
 	UpdateViewMatrix();
+
+	// Rebuilds from UpdateViewMatrix calls between two frames count towards the next frame as well
+	mChanged = mMatricesRebuilt;
+	mMatricesRebuilt = false;
 }
 
 void Camera::UpdateViewMatrix()
@@ -205,8 +326,22 @@ void Camera::UpdateViewMatrix()
 		XMMATRIX invViewMat = XMMatrixInverse(&determinant, viewMat);
 		XMStoreFloat4x4(&mInvView, invViewMat);
 
+		mViewDirty = false;
+		mProjDirty = true;
+	}
+
+	if (mProjDirty)
+	{
+		XMMATRIX viewProj = XMMatrixMultiply(XMLoadFloat4x4(&mView), XMLoadFloat4x4(&mProj));
+		XMStoreFloat4x4(&mViewProj, viewProj);
+
+		auto determinant = XMMatrixDeterminant(viewProj);
+		XMStoreFloat4x4(&mInvViewProj, XMMatrixInverse(&determinant, viewProj));
+
 		mFrustumView.Transform(mFrustumWorld, XMLoadFloat4x4(&mInvView));
+		mFrustumPlanes.Set(mViewProj);
 
-		mViewDirty = false;
+		mProjDirty = false;
+		mMatricesRebuilt = true;
 	}
 }
\ No newline at end of file
@@ -1,5 +1,22 @@
 #pragma once
 #include "stdafx.h"
+
+// The six frustum planes transposed into structure of arrays form, so one XMVECTOR operation tests four planes.
+// Planes face inward and are normalized, the two lanes past the sixth plane never reject.
+struct FrustumPlanes
+{
+	XMFLOAT4 X[2];
+	XMFLOAT4 Y[2];
+	XMFLOAT4 Z[2];
+	XMFLOAT4 W[2];
+
+	// Extracted from a row vector view projection matrix with a 0 to 1 depth range.
+	void Set(const XMFLOAT4X4& viewProj);
+
+	bool IntersectsSphere(FXMVECTOR center, float radius) const;
+	bool IntersectsBox(FXMVECTOR center, FXMVECTOR extents) const;
+};
+
 class Camera
 {
 public:
@@ -12,6 +29,8 @@ public:
 	void SetPosition(const XMFLOAT3& pos);
 
 	void SetRotation(const XMFLOAT4& quat);
+	// Absolute orientation, the quaternion that rotates the +X, +Y, +Z axes onto right, up and look.
+	void SetOrientation(const XMFLOAT4& quat);
 
 	void SetOffset(float x, float y, float z) { mOffset = { x,y,z }; }
 	void SetOffset(const XMFLOAT3& offset) { mOffset = offset; }
@@ -52,6 +71,8 @@ public:
 
 	const XMFLOAT3& GetOffset() const { return mOffset; }
 
+	XMFLOAT4 GetOrientation() const;
+
 	float GetNearZ() const { return mNearZ; }
 	float GetFarZ() const { return mFarZ; }
 	float GetAspect() const { return mAspect; }
@@ -60,17 +81,30 @@ public:
 	const XMFLOAT2& GetNearWindow() const { return mNearWindow; }
 	const XMFLOAT2& GetFarWindow() const { return mFarWindow; }
 
+	// Derived matrices are cached and rebuilt by UpdateViewMatrix only when the view or the lens changed.
 	const XMFLOAT4X4& GetView() const;
 	const XMFLOAT4X4& GetOldView() const;
 	const XMFLOAT4X4& GetInverseView() const;
 	const XMFLOAT4X4& GetProj() const { return mProj; }
-	const XMFLOAT4X4 GetInverseProj() const;
+	const XMFLOAT4X4& GetInverseProj() const { return mInvProj; }
+	const XMFLOAT4X4& GetViewProj() const;
+	const XMFLOAT4X4& GetOldViewProj() const { return mOldViewProj; }
+	const XMFLOAT4X4& GetInverseViewProj() const;
 
 	const BoundingFrustum& GetWorldFrustum() const { return mFrustumWorld; }
 	const BoundingFrustum& GetViewFrustum() const { return mFrustumView; }
+	const FrustumPlanes& GetFrustumPlanes() const { return mFrustumPlanes; }
+
+	// True when the last Update rebuilt the matrices, i.e. the camera moved or the lens changed since the frame before.
+	bool HasChanged() const { return mChanged; }
 
 protected:
+	void SetProj(FXMMATRIX proj);
+
 	bool mViewDirty = false;
+	bool mProjDirty = false;
+	bool mMatricesRebuilt = false;
+	bool mChanged = false;
 
 	XMFLOAT3 mPosition = { 0.0f, 0.0f, 0.0f };
 	XMFLOAT3 mRight = { 1.0f, 0.0f, 0.0f };
@@ -92,9 +126,14 @@ protected:
 	XMFLOAT4X4 mProj = Matrix4x4::Identity4x4();
 	XMFLOAT4X4 mInvView = Matrix4x4::Identity4x4();
 	XMFLOAT4X4 mOldView = Matrix4x4::Identity4x4();
+	XMFLOAT4X4 mInvProj = Matrix4x4::Identity4x4();
+	XMFLOAT4X4 mViewProj = Matrix4x4::Identity4x4();
+	XMFLOAT4X4 mInvViewProj = Matrix4x4::Identity4x4();
+	XMFLOAT4X4 mOldViewProj = Matrix4x4::Identity4x4();
 
 	BoundingFrustum mFrustumView;
 	BoundingFrustum mFrustumWorld;
+	FrustumPlanes mFrustumPlanes = {};
 
 	float mFovYNeutral = 0.0f;
 	float mFarZNeutral = 0.0f;
@@ -0,0 +1,133 @@
+#include "CameraPath.h"
+#include "Camera.h"
+
+void CameraPath::AddKeyframe(float time, const Camera& camera)
+{
+	CameraKeyframe keyframe;
+	keyframe.Time = time;
+	keyframe.Position = camera.GetPosition();
+	keyframe.Orientation = camera.GetOrientation();
+	AddKeyframe(keyframe);
+}
+
+void CameraPath::AddKeyframe(const CameraKeyframe& keyframe)
+{
+	assert(mKeyframes.empty() || keyframe.Time >= mKeyframes.back().Time);
+	mKeyframes.push_back(keyframe);
+}
+
+CameraKeyframe CameraPath::Sample(float time) const
+{
+	assert(!mKeyframes.empty());
+
+	if (time <= mKeyframes.front().Time)
+		return mKeyframes.front();
+	if (time >= mKeyframes.back().Time)
+		return mKeyframes.back();
+
+	// First keyframe after time, the one before it is the start of the segment
+	auto next = upper_bound(mKeyframes.begin(), mKeyframes.end(), time,
+		[](float t, const CameraKeyframe& keyframe) { return t < keyframe.Time; });
+	const CameraKeyframe& from = *(next - 1);
+	const CameraKeyframe& to = *next;
+
+	float span = to.Time - from.Time;
+	float t = span > 0.0f ? (time - from.Time) / span : 1.0f;
+
+	CameraKeyframe keyframe;
+	keyframe.Time = time;
+	keyframe.Position = Vector3::Lerp(from.Position, to.Position, t);
+	keyframe.Orientation = Vector4::Slerp(from.Orientation, to.Orientation, t);
+	return keyframe;
+}
+
+void CameraPath::Apply(float time, Camera& camera) const
+{
+	if (mKeyframes.empty())
+		return;
+
+	CameraKeyframe keyframe = Sample(time);
+	camera.SetPosition(keyframe.Position);
+	camera.SetOrientation(keyframe.Orientation);
+}
+
+bool CameraPath::Save(const filesystem::path& path) const
+{
+	ofstream file(path, ios::trunc);
+	if (!file)
+		return false;
+
+	// Enough digits that a saved path plays back exactly like the recorded one
+	file << setprecision(9);
+	for (const auto& keyframe : mKeyframes)
+	{
+		file << keyframe.Time << " "
+			<< keyframe.Position.x << " " << keyframe.Position.y << " " << keyframe.Position.z << " "
+			<< keyframe.Orientation.x << " " << keyframe.Orientation.y << " " << keyframe.Orientation.z << " " << keyframe.Orientation.w << "\n";
+	}
+
+	return static_cast<bool>(file);
+}
+
+bool CameraPath::Load(const filesystem::path& path)
+{
+	ifstream file(path);
+	if (!file)
+		return false;
+
+	vector<CameraKeyframe> keyframes;
+	string line;
+	while (getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		istringstream values(line);
+		CameraKeyframe keyframe;
+		values >> keyframe.Time
+			>> keyframe.Position.x >> keyframe.Position.y >> keyframe.Position.z
+			>> keyframe.Orientation.x >> keyframe.Orientation.y >> keyframe.Orientation.z >> keyframe.Orientation.w;
+
+		if (values.fail() || (!keyframes.empty() && keyframe.Time < keyframes.back().Time))
+		{
+			DebugLog("CameraPath: invalid keyframe in " + path.string() + ": " + line);
+			return false;
+		}
+		keyframes.push_back(keyframe);
+	}
+
+	mKeyframes = std::move(keyframes);
+	return true;
+}
+
+void CameraPathRecorder::Start(const Camera& camera)
+{
+	mPath.Clear();
+	mTime = 0.0f;
+	mLastKeyframeTime = 0.0f;
+	mRecording = true;
+
+	mPath.AddKeyframe(0.0f, camera);
+}
+
+CameraPath CameraPathRecorder::Stop(const Camera& camera)
+{
+	if (mRecording && mTime > mLastKeyframeTime)
+		mPath.AddKeyframe(mTime, camera);
+
+	mRecording = false;
+	return std::move(mPath);
+}
+
+void CameraPathRecorder::Update(float elapsedTime, const Camera& camera)
+{
+	if (!mRecording)
+		return;
+
+	mTime += elapsedTime;
+	if (mTime - mLastKeyframeTime >= mInterval)
+	{
+		mPath.AddKeyframe(mTime, camera);
+		mLastKeyframeTime = mTime;
+	}
+}
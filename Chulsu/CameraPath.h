@@ -0,0 +1,63 @@
+#pragma once
+#include "stdafx.h"
+
+class Camera;
+
+struct CameraKeyframe
+{
+	float Time = 0.0f;
+	XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+	XMFLOAT4 Orientation = { 0.0f, 0.0f, 0.0f, 1.0f };
+};
+
+// Camera poses over time. Positions are interpolated linearly and orientations with slerp,
+// times before the first or after the last keyframe clamp to it.
+class CameraPath
+{
+public:
+	CameraPath() = default;
+	~CameraPath() = default;
+
+	// Keyframes must be added in increasing time.
+	void AddKeyframe(float time, const Camera& camera);
+	void AddKeyframe(const CameraKeyframe& keyframe);
+	void Clear() { mKeyframes.clear(); }
+
+	bool Empty() const { return mKeyframes.empty(); }
+	float GetDuration() const { return mKeyframes.empty() ? 0.0f : mKeyframes.back().Time; }
+	const vector<CameraKeyframe>& GetKeyframes() const { return mKeyframes; }
+
+	CameraKeyframe Sample(float time) const;
+	// Moves the camera to the pose at time, the view matrix is rebuilt by the next Camera::Update.
+	void Apply(float time, Camera& camera) const;
+
+	// Text file, one "time px py pz qx qy qz qw" line per keyframe.
+	bool Save(const filesystem::path& path) const;
+	bool Load(const filesystem::path& path);
+
+private:
+	vector<CameraKeyframe> mKeyframes;
+};
+
+// Samples the camera into a path at a fixed interval while recording.
+class CameraPathRecorder
+{
+public:
+	CameraPathRecorder(float interval = 0.1f) : mInterval(interval) {}
+	~CameraPathRecorder() = default;
+
+	void Start(const Camera& camera);
+	// Adds the final pose and returns the recorded path.
+	CameraPath Stop(const Camera& camera);
+	bool IsRecording() const { return mRecording; }
+
+	void Update(float elapsedTime, const Camera& camera);
+
+private:
+	float mInterval;
+	float mTime = 0.0f;
+	float mLastKeyframeTime = 0.0f;
+	bool mRecording = false;
+
+	CameraPath mPath;
+};
@@ -0,0 +1,768 @@
+#include "CpuRayTracer.h"
+#include "Camera.h"
+#include "BVHCache.h"
+#include "OpacityClassifier.h"
+#include "VertexOcclusion.h"
+#include "TextureLOD.h"
+#include "Parallel.h"
+
+namespace
+{
+	// Same fit as linearToSrgb in DefaultRayTrace.hlsl.
+	XMVECTOR LinearToSrgb(FXMVECTOR c)
+	{
+		XMVECTOR sq1 = XMVectorSqrt(c);
+		XMVECTOR sq2 = XMVectorSqrt(sq1);
+		XMVECTOR sq3 = XMVectorSqrt(sq2);
+		return 0.662002687f * sq1 + 0.684122060f * sq2 - 0.323583601f * sq3 - 0.0225411470f * c;
+	}
+
+	const float kShadowFactor = 0.1f;
+
+	// Binary PPM, plain iostreams so the output path does not depend on WIC or DirectXTex.
+	bool WritePPM(const wstring& path, UINT width, UINT height, const vector<XMUBYTEN4>& pixels)
+	{
+		ofstream file(filesystem::path(path), ios::binary | ios::trunc);
+		if (!file)
+			return false;
+
+		file << "P6\n" << width << " " << height << "\n255\n";
+		for (const XMUBYTEN4& pixel : pixels)
+		{
+			const char rgb[3] = { static_cast<char>(pixel.x), static_cast<char>(pixel.y), static_cast<char>(pixel.z) };
+			file.write(rgb, sizeof(rgb));
+		}
+		return static_cast<bool>(file);
+	}
+
+	// Same generator as PcgHash, InitRandom and NextRandom in DefaultRayTrace.hlsl.
+	UINT PcgHash(UINT v)
+	{
+		UINT state = v * 747796405u + 2891336453u;
+		UINT word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	UINT InitRandom(XMUINT2 pixel, UINT frameIndex)
+	{
+		return PcgHash(pixel.x + PcgHash(pixel.y + PcgHash(frameIndex)));
+	}
+
+	float NextRandom(UINT& state)
+	{
+		state = PcgHash(state);
+		return (state >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// Same falloff as LocalLightRadiance in DefaultRayTrace.hlsl.
+	XMVECTOR LocalLightRadiance(const Light& light, FXMVECTOR position, XMVECTOR& L, float& distance)
+	{
+		XMVECTOR toLight = XMVectorSubtract(XMLoadFloat3(&light.position), position);
+		distance = XMVectorGetX(XMVector3Length(toLight));
+		L = XMVectorScale(toLight, 1.0f / max(distance, 0.0001f));
+
+		float attenuation = 1.0f / max(distance * distance, 0.0001f);
+
+		if (light.range > 0.0f)
+		{
+			float r = distance / light.range;
+			float window = clamp(1.0f - r * r * r * r, 0.0f, 1.0f);
+			attenuation *= window * window;
+		}
+
+		if (light.type == LightType::SPOT_LIGHT)
+		{
+			float cosAngle = XMVectorGetX(XMVector3Dot(XMVectorNegate(L), XMVector3Normalize(XMLoadFloat3(&light.direction))));
+			float t = clamp((cosAngle - light.outerCosine) / (light.innerCosine - light.outerCosine), 0.0f, 1.0f);
+			attenuation *= t * t * (3.0f - 2.0f * t);
+		}
+
+		return XMVectorScale(XMLoadFloat3(&light.color), attenuation);
+	}
+
+	// Same sequence as Halton and PixelJitter in DefaultRayTrace.hlsl.
+	float Halton(UINT index, UINT base)
+	{
+		float f = 1.0f;
+		float result = 0.0f;
+		while (index > 0)
+		{
+			f /= base;
+			result += f * (index % base);
+			index /= base;
+		}
+		return result;
+	}
+
+	XMFLOAT2 PixelJitter(UINT frameIndex)
+	{
+		if (frameIndex == 0)
+			return XMFLOAT2(0.5f, 0.5f);
+		return XMFLOAT2(Halton(frameIndex, 2), Halton(frameIndex, 3));
+	}
+}
+
+void CpuRayTracer::CreateInstance(const string& path, XMFLOAT3 position, XMFLOAT3 rotation, XMFLOAT3 scale)
+{
+	if (mMeshMap[path] == nullptr)
+	{
+		auto mesh = make_shared<CpuMesh>();
+		if (!ImportAssimpMesh(path, mesh->Data))
+		{
+			DebugLog("CpuRayTracer: failed to import " + path);
+			mMeshMap.erase(path);
+			return;
+		}
+
+		// Only the textures the hit shaders read are decoded.
+		for (auto& [matIndex, material] : mesh->Data.Materials)
+		{
+			CpuMaterial& cpuMaterial = mesh->Materials[matIndex];
+			cpuMaterial.Albedo = LoadTexture(material.AlbedoTexturePath);
+			cpuMaterial.Opacity = LoadTexture(material.OpacityMapTexturePath);
+			cpuMaterial.BaseColor = material.BaseColor;
+			cpuMaterial.AlphaCutoff = material.AlphaCutoff;
+		}
+
+		ClassifyOpacity(mesh->Data, [this](const wstring& texturePath) { return LoadTexture(texturePath); });
+		BakeVertexOcclusion(mesh->Data, stringTowstring(path) + L".ao");
+		ComputeTriangleLOD(mesh->Data);
+		mMeshMap[path] = mesh;
+	}
+
+	mInstances.push_back({ mMeshMap[path], Matrix4x4::CalulateWorldTransform(position, rotation, scale) });
+}
+
+shared_ptr<CpuTexture> CpuRayTracer::LoadTexture(const wstring& path)
+{
+	if (path.empty())
+		return nullptr;
+
+	auto found = mTextures.find(path);
+	if (found != mTextures.end())
+		return found->second;
+
+	auto texture = make_shared<CpuTexture>();
+	if (!texture->LoadFromFile(path))
+	{
+		DebugLog("CpuRayTracer: failed to load " + wstringTostring(path));
+		texture = nullptr;
+	}
+
+	mTextures[path] = texture;
+	return texture;
+}
+
+void CpuRayTracer::SetLights(const vector<Light>& lights)
+{
+	mLights = lights;
+	if (mLightBVH.Update(mLights))
+	{
+		mLightGrid.Build(mLights);
+		ResetAccumulation();
+	}
+}
+
+void CpuRayTracer::SetEnvironmentMap(shared_ptr<const EnvironmentMap> environmentMap)
+{
+	mEnvironmentMap = environmentMap;
+	mAmbientSH = environmentMap ? ComputeAmbientSHConstants(ProjectSH9(*environmentMap)) : AmbientSHConstants{};
+	ResetAccumulation();
+}
+
+void CpuRayTracer::BuildAccelerationStructure(const wstring& cachePath)
+{
+	auto start = chrono::steady_clock::now();
+
+	// New geometry invalidates the accumulated frames like a dirty instance does on the GPU
+	ResetAccumulation();
+
+	vector<BVHTriangle> triangles;
+	mGeometries.clear();
+	mPrimitives.clear();
+
+	// Flatten every instance into world space, one geometry per submesh like the BLAS geometry descs.
+	for (auto& instance : mInstances)
+	{
+		XMMATRIX world = XMLoadFloat4x4(&instance.World);
+		auto& data = instance.Mesh->Data;
+		float lodBias = ComputeInstanceLODBias(instance.World);
+
+		for (auto& subMesh : data.SubMeshes)
+		{
+			UINT geometryIndex = static_cast<UINT>(mGeometries.size());
+
+			CpuGeometry geometry;
+			geometry.Vertices = data.Vertices.data() + subMesh.GetVertexOffset();
+			geometry.Indices = data.Indices.data() + subMesh.GetIndexOffset();
+			auto material = instance.Mesh->Materials.find(subMesh.GetMaterialIndex());
+			geometry.Material = material != instance.Mesh->Materials.end() ? &material->second : nullptr;
+			geometry.TriangleLOD = data.TriangleLOD.data() + subMesh.GetIndexOffset() / 3;
+			geometry.LODBias = lodBias;
+			geometry.AlphaTested = subMesh.IsAlphaTested();
+			mGeometries.push_back(geometry);
+
+			for (UINT prim = 0; prim < subMesh.GetIndexCount() / 3; ++prim)
+			{
+				BVHTriangle tri;
+				XMStoreFloat3(&tri.V0, XMVector3Transform(XMLoadFloat3(&geometry.Vertices[geometry.Indices[prim * 3 + 0]].position), world));
+				XMStoreFloat3(&tri.V1, XMVector3Transform(XMLoadFloat3(&geometry.Vertices[geometry.Indices[prim * 3 + 1]].position), world));
+				XMStoreFloat3(&tri.V2, XMVector3Transform(XMLoadFloat3(&geometry.Vertices[geometry.Indices[prim * 3 + 2]].position), world));
+
+				triangles.push_back(tri);
+				mPrimitives.push_back({ geometryIndex, prim });
+			}
+		}
+	}
+
+	uint64_t geometryHash = HashTriangles(triangles);
+	// A cached BVH is traversed straight from the mapped file, neither BVH is rebuilt or copied
+	bool cached = !cachePath.empty() && LoadBVHCache(cachePath, geometryHash, mBVH, mWideBVH);
+	if (!cached)
+	{
+		mBVH.Build(triangles);
+		mWideBVH.Build(mBVH);
+		if (!cachePath.empty() && !SaveBVHCache(cachePath, mBVH, mWideBVH, geometryHash))
+			DebugLog("CpuRayTracer: failed to write " + wstringTostring(cachePath));
+	}
+
+	auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	DebugLog("CpuRayTracer: " + string(cached ? "loaded cached" : "built") + " BVH over " + to_string(triangles.size()) + " triangles, "
+		+ to_string(mBVH.GetNodes().size()) + " nodes, depth " + to_string(mBVH.GetDepth()) + ", "
+		+ to_string(mWideBVH.GetNodes().size()) + " wide nodes, depth " + to_string(mWideBVH.GetDepth()) + " in " + to_string(elapsed) + " ms");
+}
+
+void CpuRayTracer::SetFrameConstants(const Camera& camera, const XMFLOAT3& sunDirection, UINT width, UINT height, UINT frameIndex)
+{
+	mFrame.InvViewProj = camera.GetInverseViewProj();
+	mFrame.CameraPos = camera.GetPosition();
+	mFrame.SunDirection = sunDirection;
+	mFrame.ScreenResolution = XMUINT2(width, height);
+	mFrame.FrameIndex = frameIndex;
+	mFrame.PixelSpreadAngle = ComputePixelSpreadAngle(camera.GetProj(), height);
+}
+
+void CpuRayTracer::Render(const Camera& camera, const XMFLOAT3& sunDirection, UINT width, UINT height)
+{
+	auto start = chrono::steady_clock::now();
+
+	// Anything that changes what a pixel sees invalidates the samples accumulated so far
+	if (camera.HasChanged() || !XMVector3Equal(XMLoadFloat3(&sunDirection), XMLoadFloat3(&mFrame.SunDirection))
+		|| width != mFrame.ScreenResolution.x || height != mFrame.ScreenResolution.y)
+		ResetAccumulation();
+
+	SetFrameConstants(camera, sunDirection, width, height, mAccumulationEnabled ? mAccumulationFrame : 0);
+	mImage.assign(static_cast<size_t>(width) * height, XMUBYTEN4());
+	mAccumulation.resize(static_cast<size_t>(width) * height);
+
+	const UINT tilesX = (width + mTileSize - 1) / mTileSize;
+	const UINT tilesY = (height + mTileSize - 1) / mTileSize;
+
+	UINT threadCount = ParallelFor(tilesX * tilesY, [&](UINT tile)
+		{
+			UINT x0 = (tile % tilesX) * mTileSize;
+			UINT y0 = (tile / tilesX) * mTileSize;
+			UINT x1 = min(x0 + mTileSize, width);
+			UINT y1 = min(y0 + mTileSize, height);
+
+			for (UINT y = y0; y < y1; y += mPacketWidth)
+				for (UINT x = x0; x < x1; x += mPacketWidth)
+					RayGen(x, y, min(x + mPacketWidth, x1), min(y + mPacketWidth, y1));
+		});
+
+	if (mAccumulationEnabled)
+		mAccumulationFrame++;
+
+	auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	DebugLog("CpuRayTracer: rendered " + to_string(width) + "x" + to_string(height) + " on "
+		+ to_string(threadCount) + " threads in " + to_string(elapsed) + " ms");
+}
+
+void CpuRayTracer::Benchmark(const Camera& camera, const XMFLOAT3& sunDirection, UINT width, UINT height)
+{
+	SetFrameConstants(camera, sunDirection, width, height, 0);
+
+	auto buildStart = chrono::steady_clock::now();
+	BVH4 bvh4;
+	bvh4.Build(mBVH);
+	auto bvh4Time = chrono::duration<double, milli>(chrono::steady_clock::now() - buildStart).count();
+
+	buildStart = chrono::steady_clock::now();
+	BVH8 bvh8;
+	bvh8.Build(mBVH);
+	auto bvh8Time = chrono::duration<double, milli>(chrono::steady_clock::now() - buildStart).count();
+
+	DebugLog("CpuRayTracer benchmark: binary " + to_string(mBVH.GetNodes().size()) + " nodes, BVH4 "
+		+ to_string(bvh4.GetNodes().size()) + " nodes in " + to_string(bvh4Time) + " ms, BVH8 "
+		+ to_string(bvh8.GetNodes().size()) + " nodes in " + to_string(bvh8Time) + " ms");
+
+	// Primary rays in the same 4x4 block order Render uses, so every RayPacketSize run is one packet.
+	vector<RayDesc> primaryRays;
+	primaryRays.reserve(static_cast<size_t>(width) * height);
+	for (UINT by = 0; by < height; by += mPacketWidth)
+		for (UINT bx = 0; bx < width; bx += mPacketWidth)
+			for (UINT y = by; y < min(by + mPacketWidth, height); ++y)
+				for (UINT x = bx; x < min(bx + mPacketWidth, width); ++x)
+					primaryRays.push_back(GenerateCameraRay(x, y));
+
+	auto anyHit = [this](UINT prim, const XMFLOAT2& barycentrics, float) { return AnyHit(prim, barycentrics); };
+
+	// Runs trace over the rays in batches of RayPacketSize on all cores and logs the throughput.
+	auto measure = [&](const string& name, const vector<RayDesc>& rays, vector<RayHit>& hits,
+		const function<void(const RayDesc*, RayHit*, UINT)>& trace)
+	{
+		hits.assign(rays.size(), RayHit());
+		const UINT rayCount = static_cast<UINT>(rays.size());
+		const UINT batchCount = (rayCount + RayPacketSize - 1) / RayPacketSize;
+
+		auto start = chrono::steady_clock::now();
+		ParallelFor(batchCount, [&](UINT batch)
+			{
+				UINT first = batch * RayPacketSize;
+				trace(&rays[first], &hits[first], min(RayPacketSize, rayCount - first));
+			});
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		DebugLog("  " + name + ": " + to_string(rayCount / seconds / 1e6) + " Mrays/s");
+	};
+
+	// Counts rays whose result differs from the binary BVH, the wide layouts must not change the image.
+	auto compare = [](const string& name, const vector<RayHit>& reference, const vector<RayHit>& hits, bool closest)
+	{
+		size_t mismatches = 0;
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			bool refHit = reference[i].PrimitiveIndex != UINT_MAX;
+			bool hit = hits[i].PrimitiveIndex != UINT_MAX;
+			if (refHit != hit || (closest && hit && fabsf(reference[i].T - hits[i].T) > 1e-3f * reference[i].T))
+				++mismatches;
+		}
+		if (mismatches > 0)
+			DebugLog("  " + name + ": " + to_string(mismatches) + " rays differ from the binary BVH");
+	};
+
+	auto singleRay = [&](const auto& bvh, bool acceptFirstHit)
+	{
+		return [&bvh, &anyHit, acceptFirstHit](const RayDesc* rays, RayHit* hits, UINT count)
+		{
+			for (UINT i = 0; i < count; ++i)
+				bvh.TraceRay(rays[i], hits[i], acceptFirstHit, anyHit);
+		};
+	};
+
+	auto packet = [&](const auto& bvh)
+	{
+		return [&bvh, &anyHit](const RayDesc* rays, RayHit* hits, UINT count)
+		{
+			bvh.TracePacket(rays, hits, count, anyHit);
+		};
+	};
+
+	DebugLog("Primary rays (" + to_string(primaryRays.size()) + "):");
+	vector<RayHit> primaryHits, hits;
+	measure("binary single ray", primaryRays, primaryHits, singleRay(mBVH, false));
+	measure("BVH4 single ray", primaryRays, hits, singleRay(bvh4, false));
+	compare("BVH4 single ray", primaryHits, hits, true);
+	measure("BVH8 single ray", primaryRays, hits, singleRay(bvh8, false));
+	compare("BVH8 single ray", primaryHits, hits, true);
+	measure("BVH4 packet", primaryRays, hits, packet(bvh4));
+	compare("BVH4 packet", primaryHits, hits, true);
+	measure("BVH8 packet", primaryRays, hits, packet(bvh8));
+	compare("BVH8 packet", primaryHits, hits, true);
+
+	// Shadow rays start on the primary hits and only need any occluder.
+	vector<RayDesc> shadowRays;
+	for (size_t i = 0; i < primaryRays.size(); ++i)
+	{
+		if (primaryHits[i].PrimitiveIndex == UINT_MAX)
+			continue;
+
+		RayDesc shadowRay;
+		XMStoreFloat3(&shadowRay.Origin, XMVectorAdd(XMLoadFloat3(&primaryRays[i].Origin),
+			XMVectorScale(XMLoadFloat3(&primaryRays[i].Direction), primaryHits[i].T)));
+		shadowRay.Direction = mFrame.SunDirection;
+		shadowRay.TMin = 0.01f;
+		shadowRay.TMax = 100000;
+		shadowRays.push_back(shadowRay);
+	}
+
+	DebugLog("Shadow rays (" + to_string(shadowRays.size()) + "):");
+	vector<RayHit> shadowHits;
+	measure("binary single ray", shadowRays, shadowHits, singleRay(mBVH, true));
+	measure("BVH4 single ray", shadowRays, hits, singleRay(bvh4, true));
+	compare("BVH4 single ray", shadowHits, hits, false);
+	measure("BVH8 single ray", shadowRays, hits, singleRay(bvh8, true));
+	compare("BVH8 single ray", shadowHits, hits, false);
+}
+
+bool CpuRayTracer::CompareLightCulling(const Camera& camera, const XMFLOAT3& sunDirection, UINT width, UINT height)
+{
+	SetFrameConstants(camera, sunDirection, width, height, 0);
+
+	// Primary hits of the pixel centers, the same surfaces ClosestHit shades
+	struct Surface
+	{
+		XMFLOAT3 Position;
+		XMFLOAT3 Normal;
+	};
+	vector<Surface> surfaces(static_cast<size_t>(width) * height);
+	vector<bool> hit(surfaces.size());
+	ParallelFor(height, [&](UINT y)
+		{
+			for (UINT x = 0; x < width; ++x)
+			{
+				RayDesc ray = GenerateCameraRay(x, y);
+				RayHit rayHit;
+				mWideBVH.TraceRay(ray, rayHit, false, [this](UINT prim, const XMFLOAT2& barycentrics, float) { return AnyHit(prim, barycentrics); });
+
+				size_t pixel = static_cast<size_t>(y) * width + x;
+				if (rayHit.PrimitiveIndex == UINT_MAX)
+					continue;
+
+				Vertex v = GetHitSurface(rayHit.PrimitiveIndex, rayHit.Barycentrics);
+				XMVECTOR N = XMLoadFloat3(&v.normal);
+				if (XMVectorGetX(XMVector3Dot(N, XMLoadFloat3(&ray.Direction))) > 0.0f)
+					N = XMVectorNegate(N);
+
+				XMStoreFloat3(&surfaces[pixel].Position, XMVectorAdd(XMLoadFloat3(&ray.Origin), XMVectorScale(XMLoadFloat3(&ray.Direction), rayHit.T)));
+				XMStoreFloat3(&surfaces[pixel].Normal, N);
+				hit[pixel] = true;
+			}
+		});
+
+	// In the order of the grid's lists, the lights without a range first
+	vector<UINT> allLights;
+	for (UINT i = 0; i < mLights.size(); ++i)
+		if (LightBVH::IsSampled(mLights[i]) && mLights[i].range <= 0.0f)
+			allLights.push_back(i);
+	for (UINT i = 0; i < mLights.size(); ++i)
+		if (LightBVH::IsSampled(mLights[i]) && mLights[i].range > 0.0f)
+			allLights.push_back(i);
+
+	// Sums every light of the list in order, without the cap the hit shader falls back to the light BVH at
+	auto shade = [&](const string& name, vector<XMFLOAT3>& result, const function<void(const XMFLOAT3&, vector<UINT>&)>& gather)
+	{
+		result.assign(surfaces.size(), XMFLOAT3(0, 0, 0));
+		atomic<uint64_t> shadedLights = 0;
+		UINT hitCount = static_cast<UINT>(count(hit.begin(), hit.end(), true));
+
+		auto start = chrono::steady_clock::now();
+		ParallelFor(height, [&](UINT y)
+			{
+				vector<UINT> lightIndices;
+				uint64_t rowLights = 0;
+				for (UINT x = 0; x < width; ++x)
+				{
+					size_t pixel = static_cast<size_t>(y) * width + x;
+					if (!hit[pixel])
+						continue;
+
+					gather(surfaces[pixel].Position, lightIndices);
+					rowLights += lightIndices.size();
+
+					XMVECTOR posW = XMLoadFloat3(&surfaces[pixel].Position);
+					XMVECTOR N = XMLoadFloat3(&surfaces[pixel].Normal);
+					XMVECTOR sum = XMVectorZero();
+					for (UINT index : lightIndices)
+						sum = XMVectorAdd(sum, ShadeLocalLight(mLights[index], posW, N));
+					XMStoreFloat3(&result[pixel], sum);
+				}
+				shadedLights += rowLights;
+			});
+		double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		DebugLog("  " + name + ": " + to_string(elapsed) + " ms, " + to_string(hitCount > 0 ? static_cast<double>(shadedLights) / hitCount : 0.0)
+			+ " lights per hit");
+	};
+
+	DebugLog("Light culling (" + to_string(allLights.size()) + " lights, grid " + to_string(mLightGrid.GetHeader().Dimensions.x) + "x"
+		+ to_string(mLightGrid.GetHeader().Dimensions.y) + "x" + to_string(mLightGrid.GetHeader().Dimensions.z) + "):");
+
+	vector<XMFLOAT3> culled, bruteForce;
+	shade("grid", culled, [this](const XMFLOAT3& position, vector<UINT>& lightIndices) { mLightGrid.GetLights(position, lightIndices); });
+	shade("brute force", bruteForce, [&allLights](const XMFLOAT3&, vector<UINT>& lightIndices) { lightIndices = allLights; });
+
+	// Lists keep the light order, so any difference at all is a light the grid wrongly culled
+	float maxError = 0.0f;
+	size_t mismatches = 0;
+	for (size_t i = 0; i < culled.size(); ++i)
+	{
+		float error = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&culled[i]), XMLoadFloat3(&bruteForce[i]))));
+		if (error > 0.0f)
+			mismatches++;
+		maxError = max(maxError, error);
+	}
+
+	DebugLog("  " + to_string(mismatches) + " pixels differ, largest difference " + to_string(maxError));
+	return mismatches == 0;
+}
+
+bool CpuRayTracer::SaveImage(const wstring& path) const
+{
+	if (mImage.empty())
+		return false;
+
+	wstring extension = filesystem::path(path).extension().wstring();
+	transform(extension.begin(), extension.end(), extension.begin(), ::towlower);
+
+	if (extension == L".ppm")
+		return WritePPM(path, mFrame.ScreenResolution.x, mFrame.ScreenResolution.y, mImage);
+
+	Image image = {};
+	image.width = mFrame.ScreenResolution.x;
+	image.height = mFrame.ScreenResolution.y;
+	image.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	image.rowPitch = image.width * sizeof(XMUBYTEN4);
+	image.slicePitch = image.rowPitch * image.height;
+	image.pixels = reinterpret_cast<uint8_t*>(const_cast<XMUBYTEN4*>(mImage.data()));
+
+	HRESULT hr;
+	if (extension == L".dds")
+		hr = SaveToDDSFile(image, DDS_FLAGS_NONE, path.c_str());
+	else if (extension == L".tga")
+		hr = SaveToTGAFile(image, TGA_FLAGS_NONE, path.c_str());
+	else
+		hr = SaveToWICFile(image, WIC_FLAGS_NONE, GetWICCodec(WIC_CODEC_PNG), path.c_str());
+
+	return SUCCEEDED(hr);
+}
+
+Vertex CpuRayTracer::GetHitSurface(UINT primitiveIndex, const XMFLOAT2& barycentrics) const
+{
+	const CpuPrimitive& prim = mPrimitives[primitiveIndex];
+	const CpuGeometry& geometry = mGeometries[prim.GeometryIndex];
+
+	const Vertex& v0 = geometry.Vertices[geometry.Indices[prim.PrimitiveIndex * 3 + 0]];
+	const Vertex& v1 = geometry.Vertices[geometry.Indices[prim.PrimitiveIndex * 3 + 1]];
+	const Vertex& v2 = geometry.Vertices[geometry.Indices[prim.PrimitiveIndex * 3 + 2]];
+
+	float w0 = 1.0f - barycentrics.x - barycentrics.y;
+	float w1 = barycentrics.x;
+	float w2 = barycentrics.y;
+
+	// Only the attributes the hit shaders read are interpolated.
+	Vertex v;
+	v.position = Vector3::Add(Vector3::Add(Vector3::Multiply(w0, v0.position), Vector3::Multiply(w1, v1.position)), Vector3::Multiply(w2, v2.position));
+	v.normal = Vector3::Normalize(Vector3::Add(Vector3::Add(Vector3::Multiply(w0, v0.normal), Vector3::Multiply(w1, v1.normal)), Vector3::Multiply(w2, v2.normal)));
+	v.texCoord.x = w0 * v0.texCoord.x + w1 * v1.texCoord.x + w2 * v2.texCoord.x;
+	v.texCoord.y = w0 * v0.texCoord.y + w1 * v1.texCoord.y + w2 * v2.texCoord.y;
+	v.occlusion = w0 * v0.occlusion + w1 * v1.occlusion + w2 * v2.occlusion;
+
+	return v;
+}
+
+RayDesc CpuRayTracer::GenerateCameraRay(UINT x, UINT y) const
+{
+	XMFLOAT2 jitter = PixelJitter(mFrame.FrameIndex);
+	float screenX = (x + jitter.x) / mFrame.ScreenResolution.x * 2.0f - 1.0f;
+	float screenY = -((y + jitter.y) / mFrame.ScreenResolution.y * 2.0f - 1.0f);
+
+	XMVECTOR world = XMVector3TransformCoord(XMVectorSet(screenX, screenY, 0.0f, 1.0f), XMLoadFloat4x4(&mFrame.InvViewProj));
+
+	RayDesc ray;
+	ray.Origin = mFrame.CameraPos;
+	XMStoreFloat3(&ray.Direction, XMVector3Normalize(XMVectorSubtract(world, XMLoadFloat3(&ray.Origin))));
+	ray.TMin = 0;
+	ray.TMax = 100000;
+	return ray;
+}
+
+void CpuRayTracer::RayGen(UINT x0, UINT y0, UINT x1, UINT y1)
+{
+	RayDesc rays[RayPacketSize];
+	RayHit hits[RayPacketSize];
+
+	UINT count = 0;
+	for (UINT y = y0; y < y1; ++y)
+		for (UINT x = x0; x < x1; ++x)
+			rays[count++] = GenerateCameraRay(x, y);
+
+	// Camera rays of a block are coherent enough to share one traversal.
+	mWideBVH.TracePacket(rays, hits, count, [this](UINT prim, const XMFLOAT2& barycentrics, float) { return AnyHit(prim, barycentrics); });
+
+	// Pinhole camera, the cones start at a point and widen by one pixel per unit of distance
+	RayCone cone = { 0.0f, mFrame.PixelSpreadAngle };
+
+	count = 0;
+	for (UINT y = y0; y < y1; ++y)
+	{
+		for (UINT x = x0; x < x1; ++x, ++count)
+		{
+			size_t pixel = static_cast<size_t>(y) * mFrame.ScreenResolution.x + x;
+			XMVECTOR col = hits[count].PrimitiveIndex != UINT_MAX ? ClosestHit(rays[count], hits[count], XMUINT2(x, y), cone) : Miss(rays[count]);
+
+			// Running average of every frame since the last reset, kept in linear HDR
+			if (mFrame.FrameIndex > 0)
+				col = XMVectorLerp(XMLoadFloat4(&mAccumulation[pixel]), col, 1.0f / (mFrame.FrameIndex + 1));
+			XMStoreFloat4(&mAccumulation[pixel], XMVectorSetW(col, 1.0f));
+
+			col = LinearToSrgb(col);
+			XMStoreUByteN4(&mImage[pixel], XMVectorSetW(XMVectorSaturate(col), 1.0f));
+		}
+	}
+}
+
+XMVECTOR CpuRayTracer::TraceRadiance(const RayDesc& ray, XMUINT2 seed, const RayCone& cone, bool* backFace) const
+{
+	RayHit hit;
+	mWideBVH.TraceRay(ray, hit, false, [this](UINT prim, const XMFLOAT2& barycentrics, float) { return AnyHit(prim, barycentrics); });
+
+	if (backFace)
+		*backFace = false;
+	if (hit.PrimitiveIndex == UINT_MAX)
+		return Miss(ray);
+
+	if (backFace)
+	{
+		Vertex v = GetHitSurface(hit.PrimitiveIndex, hit.Barycentrics);
+		*backFace = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&v.normal), XMLoadFloat3(&ray.Direction))) > 0.0f;
+	}
+	return ClosestHit(ray, hit, seed, cone);
+}
+
+XMVECTOR CpuRayTracer::Miss(const RayDesc& ray) const
+{
+	if (!mEnvironmentMap)
+		return XMVectorSet(0.4f, 0.6f, 0.2f, 0.0f);
+
+	return XMVectorSetW(mEnvironmentMap->Sample(ray.Direction), 0.0f);
+}
+
+XMVECTOR CpuRayTracer::ClosestHit(const RayDesc& ray, const RayHit& hit, XMUINT2 pixel, const RayCone& cone) const
+{
+	const CpuPrimitive& prim = mPrimitives[hit.PrimitiveIndex];
+	const CpuGeometry& geometry = mGeometries[prim.GeometryIndex];
+	Vertex v = GetHitSurface(hit.PrimitiveIndex, hit.Barycentrics);
+
+	// Find the world-space hit position
+	XMVECTOR posW = XMVectorAdd(XMLoadFloat3(&ray.Origin), XMVectorScale(XMLoadFloat3(&ray.Direction), hit.T));
+
+	// Footprint of the ray cone against the texel density of the triangle, every texture adds its own size
+	float triangleLOD = geometry.TriangleLOD[prim.PrimitiveIndex] + geometry.LODBias;
+	float rayConeLOD = ComputeRayConeLOD(triangleLOD, PropagateRayCone(cone, hit.T),
+		XMVectorGetX(XMVector3Dot(XMLoadFloat3(&ray.Direction), XMLoadFloat3(&v.normal))));
+
+	RayDesc shadowRay;
+	XMStoreFloat3(&shadowRay.Origin, posW);
+	shadowRay.Direction = mFrame.SunDirection;
+	shadowRay.TMin = 0.01f;
+	shadowRay.TMax = 100000;
+
+	float factor = TraceShadowRay(shadowRay) ? kShadowFactor : 1.0f;
+
+	// Point and spot lights, every light of the grid cell when there are few, otherwise one picked from the light BVH
+	XMVECTOR N = XMLoadFloat3(&v.normal);
+	if (XMVectorGetX(XMVector3Dot(N, XMLoadFloat3(&ray.Direction))) > 0.0f)
+		N = XMVectorNegate(N);
+
+	XMVECTOR localLight = XMVectorZero();
+	UINT rng = InitRandom(pixel, mFrame.FrameIndex);
+	if (mLightBVH.GetLightCount() > 0)
+	{
+		XMFLOAT3 position, normal;
+		XMStoreFloat3(&position, posW);
+		XMStoreFloat3(&normal, N);
+
+		const LightGridHeader& grid = mLightGrid.GetHeader();
+		const vector<UINT>& gridIndices = mLightGrid.GetLightIndices();
+		LightGridCell cell = mLightGrid.FindCell(position);
+		if (grid.GlobalCount + cell.Count <= mLightGridMaxShaded)
+		{
+			for (UINT i = 0; i < grid.GlobalCount; ++i)
+				localLight = XMVectorAdd(localLight, ShadeLocalLight(mLights[gridIndices[i]], posW, N));
+			for (UINT j = 0; j < cell.Count; ++j)
+				localLight = XMVectorAdd(localLight, ShadeLocalLight(mLights[gridIndices[cell.Offset + j]], posW, N));
+		}
+		else
+		{
+			LightSample sample = mLightBVH.Sample(position, normal, NextRandom(rng));
+			if (sample.LightIndex != UINT_MAX)
+				localLight = XMVectorScale(ShadeLocalLight(mLights[sample.LightIndex], posW, N), 1.0f / sample.Pdf);
+		}
+	}
+
+	// Sky, the baked probes or the unshadowed SH ambient darkened by the baked vertex occlusion by default,
+	// or one traced direction picked in proportion to the environment map's luminance
+	XMVECTOR skyLight = XMVectorZero();
+	if (!mTraceSky && mProbeVolume)
+	{
+		skyLight = XMVectorScale(mProbeVolume->Sample(posW, N), v.occlusion);
+	}
+	else if (!mTraceSky && mEnvironmentMap)
+	{
+		skyLight = XMVectorScale(EvaluateAmbientSH(mAmbientSH, N), v.occlusion);
+	}
+	else if (mTraceSky && mEnvironmentMap)
+	{
+		float u1 = NextRandom(rng);
+		float u2 = NextRandom(rng);
+		EnvironmentSample skySample = mEnvironmentMap->SampleDirection(u1, u2);
+		float NdotL = XMVectorGetX(XMVector3Dot(N, XMLoadFloat3(&skySample.Direction)));
+		if (skySample.Pdf > 0.0f && NdotL > 0.0f)
+		{
+			RayDesc skyRay;
+			XMStoreFloat3(&skyRay.Origin, posW);
+			skyRay.Direction = skySample.Direction;
+			skyRay.TMin = 0.01f;
+			skyRay.TMax = 100000;
+			if (!TraceShadowRay(skyRay))
+				skyLight = XMVectorScale(mEnvironmentMap->Sample(skySample.Direction), NdotL / (PI * skySample.Pdf));
+		}
+	}
+
+	// Submeshes without a material get the defaults of Material, like the GPU table entry they point to
+	static const CpuMaterial defaultMaterial;
+	const CpuMaterial& material = geometry.Material ? *geometry.Material : defaultMaterial;
+
+	XMVECTOR albedo = XMLoadFloat3(&material.BaseColor);
+	if (material.Albedo)
+	{
+		const CpuTexture& albedoMap = *material.Albedo;
+		albedo = albedoMap.SampleLevel(v.texCoord, ComputeTextureLOD(rayConeLOD, albedoMap.GetWidth(), albedoMap.GetHeight()));
+	}
+
+	return XMVectorAdd(XMVectorScale(albedo, factor), XMVectorMultiply(albedo, XMVectorAdd(localLight, skyLight)));
+}
+
+XMVECTOR CpuRayTracer::ShadeLocalLight(const Light& light, FXMVECTOR posW, FXMVECTOR N) const
+{
+	XMVECTOR L;
+	float distance;
+	XMVECTOR radiance = LocalLightRadiance(light, posW, L, distance);
+	float NdotL = clamp(XMVectorGetX(XMVector3Dot(N, L)), 0.0f, 1.0f);
+	if (NdotL <= 0.0f || XMVector3LessOrEqual(radiance, XMVectorZero()))
+		return XMVectorZero();
+
+	if (light.castShadows)
+	{
+		RayDesc lightRay;
+		XMStoreFloat3(&lightRay.Origin, posW);
+		XMStoreFloat3(&lightRay.Direction, L);
+		lightRay.TMin = 0.01f;
+		lightRay.TMax = distance - 0.01f;
+		if (TraceShadowRay(lightRay))
+			return XMVectorZero();
+	}
+
+	return XMVectorScale(radiance, NdotL / PI);
+}
+
+bool CpuRayTracer::AnyHit(UINT primitiveIndex, const XMFLOAT2& barycentrics) const
+{
+	const CpuGeometry& geometry = mGeometries[mPrimitives[primitiveIndex].GeometryIndex];
+
+	// Opaque geometry never reaches the any-hit shader.
+	if (!geometry.AlphaTested || !geometry.Material || !geometry.Material->Opacity)
+		return true;
+
+	Vertex v = GetHitSurface(primitiveIndex, barycentrics);
+	return XMVectorGetX(geometry.Material->Opacity->Sample(v.texCoord)) >= geometry.Material->AlphaCutoff;
+}
+
+bool CpuRayTracer::TraceShadowRay(const RayDesc& ray) const
+{
+	// RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, ShadowClosestHit sets hit, ShadowMiss clears it.
+	// Shadow rays of neighbouring pixels diverge after the first bounce, so they are traced one by one.
+	RayHit hit;
+	return mWideBVH.TraceRay(ray, hit, true, [this](UINT prim, const XMFLOAT2& barycentrics, float) { return AnyHit(prim, barycentrics); });
+}
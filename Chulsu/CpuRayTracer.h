@@ -0,0 +1,168 @@
+#pragma once
+#include "stdafx.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "CpuTexture.h"
+#include "MeshImporter.h"
+#include "LightBVH.h"
+#include "LightGrid.h"
+#include "EnvironmentMap.h"
+#include "SphericalHarmonics.h"
+#include "ProbeVolume.h"
+#include "TextureLOD.h"
+
+class Camera;
+
+// CPU mirror of the FrameCB root constants.
+struct CpuFrameConstants
+{
+	XMFLOAT4X4 InvViewProj;
+	XMFLOAT3 CameraPos;
+	XMFLOAT3 SunDirection;
+	XMUINT2 ScreenResolution;
+	UINT FrameIndex;
+	float PixelSpreadAngle;
+};
+
+// The scalars of Material the CPU shaders read, BaseColor stands in for a missing albedo map.
+struct CpuMaterial
+{
+	shared_ptr<CpuTexture> Albedo;
+	shared_ptr<CpuTexture> Opacity;
+	XMFLOAT3 BaseColor = { 1.0f, 1.0f, 1.0f };
+	float AlphaCutoff = DefaultAlphaCutoff;
+};
+
+struct CpuMesh
+{
+	ImportedMesh Data;
+	unordered_map<UINT, CpuMaterial> Materials;
+};
+
+// One entry per (instance, submesh) pair, the CPU counterpart of GeometryInfo.
+struct CpuGeometry
+{
+	const Vertex* Vertices = nullptr;
+	const UINT* Indices = nullptr;
+	const CpuMaterial* Material = nullptr;
+	const float* TriangleLOD = nullptr;
+	float LODBias = 0.0f;		// InstanceLODBias of the instance's transform.
+	bool AlphaTested = false;
+};
+
+struct CpuPrimitive
+{
+	UINT GeometryIndex;
+	UINT PrimitiveIndex;
+};
+
+// Software implementation of DefaultRayTrace.hlsl.
+// Used for golden images and as a fallback on machines without a DXR capable GPU.
+class CpuRayTracer
+{
+public:
+	CpuRayTracer() = default;
+	~CpuRayTracer() = default;
+
+	void CreateInstance(const string& path, XMFLOAT3 position, XMFLOAT3 rotation, XMFLOAT3 scale);
+	// Reuses the BVH stored at cachePath when it was built from the same geometry, otherwise builds and writes it.
+	void BuildAccelerationStructure(const wstring& cachePath = L"");
+
+	// With accumulation enabled every call adds one jittered frame to the running average, which starts over
+	// when the camera, the sun, the resolution or the scene changed. Disabled, every frame traces the pixel centers.
+	void Render(const Camera& camera, const XMFLOAT3& sunDirection, UINT width, UINT height);
+	// .dds, .tga and .ppm by extension, PNG otherwise. PPM is written without WIC or DirectXTex.
+	bool SaveImage(const wstring& path) const;
+
+	// Point and spot lights, shaded through the same light grid and light BVH as the hit shader. Directional lights are ignored,
+	// the sun direction is passed to Render. Lights that changed reset the accumulation.
+	void SetLights(const vector<Light>& lights);
+
+	// Sky seen by missing rays and lighting hits like the hit shader does, nullptr for the constant miss color.
+	// Its SH ambient is projected here.
+	void SetEnvironmentMap(shared_ptr<const EnvironmentMap> environmentMap);
+	// Shadowed samples of the sky instead of the SH ambient or the probe volume, F7 in DX12Renderer.
+	void SetSkyTracing(bool enable) { mTraceSky = enable; ResetAccumulation(); }
+	// Indirect diffuse light from baked probes instead of the SH ambient of the sky, nullptr to go back to it.
+	void SetProbeVolume(shared_ptr<const ProbeVolume> probeVolume) { mProbeVolume = probeVolume; ResetAccumulation(); }
+	// For TraceRadiance, Render sets the sun direction it is given.
+	void SetSunDirection(const XMFLOAT3& sunDirection) { mFrame.SunDirection = sunDirection; ResetAccumulation(); }
+
+	// Radiance arriving along ray, shaded like a primary ray. seed stands in for DispatchRaysIndex, cone picks the texture mips.
+	// backFace is set when the ray hit the back of a surface, which rays starting inside geometry mostly do.
+	XMVECTOR TraceRadiance(const RayDesc& ray, XMUINT2 seed, const RayCone& cone, bool* backFace = nullptr) const;
+
+	void SetAccumulation(bool enable) { mAccumulationEnabled = enable; ResetAccumulation(); }
+	void ResetAccumulation() { mAccumulationFrame = 0; }
+	UINT GetAccumulatedFrameCount() const { return mAccumulationFrame; }
+
+	// Traces the primary and shadow rays of one frame through the binary BVH, BVH4 and BVH8
+	// with single ray and packet traversal and logs the rays per second of each.
+	void Benchmark(const Camera& camera, const XMFLOAT3& sunDirection, UINT width, UINT height);
+
+	// Shades the primary hits of one frame once with the lights of their grid cell and once with every light,
+	// and logs the largest difference and the time each took. Culling must not change the image, returns false when it did.
+	bool CompareLightCulling(const Camera& camera, const XMFLOAT3& sunDirection, UINT width, UINT height);
+
+	const vector<XMUBYTEN4>& GetImage() const { return mImage; }
+	// Linear HDR average of the frames since the last reset, the CPU counterpart of the accumulation texture.
+	const vector<XMFLOAT4>& GetAccumulation() const { return mAccumulation; }
+	const BVH& GetBVH() const { return mBVH; }
+	const NativeWideBVH& GetWideBVH() const { return mWideBVH; }
+	const LightBVH& GetLightBVH() const { return mLightBVH; }
+	const LightGrid& GetLightGrid() const { return mLightGrid; }
+
+private:
+	shared_ptr<CpuTexture> LoadTexture(const wstring& path);
+
+	void SetFrameConstants(const Camera& camera, const XMFLOAT3& sunDirection, UINT width, UINT height, UINT frameIndex);
+	RayDesc GenerateCameraRay(UINT x, UINT y) const;
+
+	// Shader stages, named after their HLSL counterparts.
+	// RayGen shades a block of at most RayPacketSize pixels whose primary rays are traced as one packet.
+	void RayGen(UINT x0, UINT y0, UINT x1, UINT y1);
+	XMVECTOR Miss(const RayDesc& ray) const;
+	// pixel stands in for DispatchRaysIndex, it seeds the random numbers of the hit. cone is the ray cone of the payload.
+	XMVECTOR ClosestHit(const RayDesc& ray, const RayHit& hit, XMUINT2 pixel, const RayCone& cone) const;
+	bool AnyHit(UINT primitiveIndex, const XMFLOAT2& barycentrics) const;
+	bool TraceShadowRay(const RayDesc& ray) const;
+	// Same as ShadeLocalLight in DefaultRayTrace.hlsl.
+	XMVECTOR ShadeLocalLight(const Light& light, FXMVECTOR posW, FXMVECTOR N) const;
+
+	Vertex GetHitSurface(UINT primitiveIndex, const XMFLOAT2& barycentrics) const;
+
+	static const UINT mTileSize = 16;
+	static const UINT mPacketWidth = 4;		// RayPacketSize as a square block of pixels.
+	static const UINT mLightGridMaxShaded = 16;	// LIGHT_GRID_MAX_SHADED in DefaultRayTrace.hlsl.
+
+	map<string, shared_ptr<CpuMesh>> mMeshMap;
+	unordered_map<wstring, shared_ptr<CpuTexture>> mTextures;
+
+	struct CpuInstance
+	{
+		shared_ptr<CpuMesh> Mesh;
+		XMFLOAT4X4 World;
+	};
+	vector<CpuInstance> mInstances;
+
+	vector<CpuGeometry> mGeometries;
+	vector<CpuPrimitive> mPrimitives;
+	BVH mBVH;
+	NativeWideBVH mWideBVH;
+
+	vector<Light> mLights;
+	LightBVH mLightBVH;
+	LightGrid mLightGrid;
+
+	shared_ptr<const EnvironmentMap> mEnvironmentMap;
+	AmbientSHConstants mAmbientSH = {};
+	shared_ptr<const ProbeVolume> mProbeVolume;
+	bool mTraceSky = false;
+
+	CpuFrameConstants mFrame = {};
+	vector<XMUBYTEN4> mImage;
+	vector<XMFLOAT4> mAccumulation;
+
+	bool mAccumulationEnabled = false;
+	UINT mAccumulationFrame = 0;
+};
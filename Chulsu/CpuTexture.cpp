@@ -0,0 +1,164 @@
+#include "CpuTexture.h"
+#include "Profiler.h"
+
+HRESULT GenerateMipChain(const Image& image, ScratchImage& mipChain)
+{
+	// DirectXTex's own filter rather than the WIC scaler, so the chain does not depend on the installed codecs
+	return GenerateMipMaps(image, TEX_FILTER_BOX | TEX_FILTER_FORCE_NON_WIC, 0, mipChain);
+}
+
+bool CpuTexture::LoadFromFile(const wstring& filePath)
+{
+	PROFILE_ZONE("Texture Decode");
+
+	wstring extension = filesystem::path(filePath).extension().wstring();
+	transform(extension.begin(), extension.end(), extension.begin(), ::towlower);
+
+	TexMetadata metaData = {};
+	ScratchImage scratch;
+	HRESULT hr = E_FAIL;
+
+	if (extension == L".dds")
+		hr = LoadFromDDSFile(filePath.c_str(), DDS_FLAGS_NONE, &metaData, scratch);
+	else if (extension == L".tga")
+		hr = LoadFromTGAFile(filePath.c_str(), TGA_FLAGS_NONE, &metaData, scratch);
+	else
+		hr = LoadFromWICFile(filePath.c_str(), WIC_FLAGS_NONE, &metaData, scratch);
+
+	if (FAILED(hr))
+		return false;
+
+	// The GPU upload builds the same chain for files without mips, DDS mips are used as stored on both sides
+	if (extension != L".dds" && metaData.mipLevels == 1)
+	{
+		ScratchImage mipChain;
+		if (FAILED(GenerateMipChain(*scratch.GetImage(0, 0, 0), mipChain)))
+			return false;
+
+		scratch = std::move(mipChain);
+		metaData = scratch.GetMetadata();
+	}
+
+	// Bring every mip to RGBA8, the same layout the WIC loader uploads.
+	ScratchImage converted;
+	const ScratchImage* source = &scratch;
+	if (IsCompressed(metaData.format))
+	{
+		if (FAILED(Decompress(scratch.GetImages(), scratch.GetImageCount(), metaData, DXGI_FORMAT_R8G8B8A8_UNORM, converted)))
+			return false;
+		source = &converted;
+	}
+	else if (metaData.format != DXGI_FORMAT_R8G8B8A8_UNORM)
+	{
+		if (FAILED(Convert(scratch.GetImages(), scratch.GetImageCount(), metaData, DXGI_FORMAT_R8G8B8A8_UNORM, TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, converted)))
+			return false;
+		source = &converted;
+	}
+
+	return CopyMips(*source);
+}
+
+void CpuTexture::Create(UINT width, UINT height, vector<XMUBYTEN4> texels)
+{
+	assert(texels.size() == static_cast<size_t>(width) * height);
+
+	Image image = {};
+	image.width = width;
+	image.height = height;
+	image.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	image.rowPitch = width * sizeof(XMUBYTEN4);
+	image.slicePitch = texels.size() * sizeof(XMUBYTEN4);
+	image.pixels = reinterpret_cast<uint8_t*>(texels.data());
+
+	ScratchImage mipChain;
+	ThrowIfFailed(GenerateMipChain(image, mipChain));
+	CopyMips(mipChain);
+}
+
+bool CpuTexture::CopyMips(const ScratchImage& source)
+{
+	mMips.clear();
+	for (size_t level = 0; level < source.GetMetadata().mipLevels; ++level)
+	{
+		const Image* image = source.GetImage(level, 0, 0);
+		if (!image)
+			break;
+
+		MipLevel mip;
+		mip.Width = static_cast<UINT>(image->width);
+		mip.Height = static_cast<UINT>(image->height);
+		mip.Texels.resize(static_cast<size_t>(mip.Width) * mip.Height);
+
+		for (UINT y = 0; y < mip.Height; ++y)
+			memcpy(&mip.Texels[static_cast<size_t>(y) * mip.Width], image->pixels + y * image->rowPitch, mip.Width * sizeof(XMUBYTEN4));
+
+		mMips.push_back(std::move(mip));
+	}
+
+	if (mMips.empty())
+		return false;
+
+	mWidth = mMips[0].Width;
+	mHeight = mMips[0].Height;
+	return true;
+}
+
+XMVECTOR CpuTexture::Load(int x, int y) const
+{
+	return LoadMip(mMips[0], x, y);
+}
+
+XMVECTOR CpuTexture::Sample(const XMFLOAT2& uv) const
+{
+	if (mMips.empty())
+		return XMVectorZero();
+
+	return SampleMip(mMips[0], uv);
+}
+
+XMVECTOR CpuTexture::SampleLevel(const XMFLOAT2& uv, float lod) const
+{
+	if (mMips.empty())
+		return XMVectorZero();
+
+	// NaN falls to the top mip like a negative LOD
+	float level = lod > 0.0f ? min(lod, static_cast<float>(mMips.size() - 1)) : 0.0f;
+	UINT level0 = static_cast<UINT>(level);
+	UINT level1 = min(level0 + 1, static_cast<UINT>(mMips.size() - 1));
+
+	XMVECTOR sample = SampleMip(mMips[level0], uv);
+	float fraction = level - level0;
+	if (fraction > 0.0f)
+		sample = XMVectorLerp(sample, SampleMip(mMips[level1], uv), fraction);
+	return sample;
+}
+
+XMVECTOR CpuTexture::LoadMip(const MipLevel& mip, int x, int y) const
+{
+	x %= (int)mip.Width;
+	y %= (int)mip.Height;
+	if (x < 0) x += mip.Width;
+	if (y < 0) y += mip.Height;
+
+	return XMLoadUByteN4(&mip.Texels[static_cast<size_t>(y) * mip.Width + x]);
+}
+
+XMVECTOR CpuTexture::SampleMip(const MipLevel& mip, const XMFLOAT2& uv) const
+{
+	// Texel centers sit at half integer coordinates.
+	float x = uv.x * mip.Width - 0.5f;
+	float y = uv.y * mip.Height - 0.5f;
+
+	float x0 = floorf(x);
+	float y0 = floorf(y);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	int ix = static_cast<int>(x0);
+	int iy = static_cast<int>(y0);
+
+	XMVECTOR top = XMVectorLerp(LoadMip(mip, ix, iy), LoadMip(mip, ix + 1, iy), fx);
+	XMVECTOR bottom = XMVectorLerp(LoadMip(mip, ix, iy + 1), LoadMip(mip, ix + 1, iy + 1), fx);
+
+	return XMVectorLerp(top, bottom, fy);
+}
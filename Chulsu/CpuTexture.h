@@ -0,0 +1,51 @@
+#pragma once
+#include "stdafx.h"
+
+// Box filtered mips down to 1x1 for an image stored without them. Texture::LoadTextureFromWIC uploads this chain and
+// CpuTexture builds the same one, so both sides filter the same texels at any LOD.
+HRESULT GenerateMipChain(const Image& image, ScratchImage& mipChain);
+
+// CPU side copy of a texture, decoded to RGBA8 so it mirrors what the GPU samples from the UNORM SRV.
+// Keeps the mip chain stored in DDS files like the DDS loader does, other files get the chain of GenerateMipChain.
+class CpuTexture
+{
+public:
+	CpuTexture() = default;
+	virtual ~CpuTexture() { }
+
+	bool LoadFromFile(const wstring& filePath);
+	// Top mip from width * height RGBA8 texels in memory, row major, the rest of the chain from GenerateMipChain.
+	void Create(UINT width, UINT height, vector<XMUBYTEN4> texels);
+
+	UINT GetWidth() const { return mWidth; }
+	UINT GetHeight() const { return mHeight; }
+	UINT GetMipCount() const { return static_cast<UINT>(mMips.size()); }
+
+	// Point load from the top mip with wrap addressing.
+	XMVECTOR Load(int x, int y) const;
+
+	// Bilinear filtered sample of the top mip with wrap addressing, like SampleLevel(..., 0.0f).
+	XMVECTOR Sample(const XMFLOAT2& uv) const;
+
+	// Trilinear filtered sample with wrap addressing, like SampleLevel(..., lod). The LOD is clamped to the mip chain.
+	XMVECTOR SampleLevel(const XMFLOAT2& uv, float lod) const;
+
+private:
+	struct MipLevel
+	{
+		UINT Width;
+		UINT Height;
+		vector<XMUBYTEN4> Texels;
+	};
+
+	// Copies every mip of an RGBA8 image, false when it has none.
+	bool CopyMips(const ScratchImage& source);
+
+	XMVECTOR LoadMip(const MipLevel& mip, int x, int y) const;
+	XMVECTOR SampleMip(const MipLevel& mip, const XMFLOAT2& uv) const;
+
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+
+	vector<MipLevel> mMips;
+};
@@ -1,5 +1,7 @@
 #include "DX12Renderer.h"
 #include "Pipeline.h"
+#include "Profiler.h"
+#include "TextureLOD.h"
 
 DX12Renderer::DX12Renderer()
 {
@@ -159,14 +161,21 @@ void DX12Renderer::Init(HWND winHandle, uint32_t winWidth, uint32_t winHeight)
     mAssetMgr.mCbvSrvUavDescriptorSize = mDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
     mLightMgr.Init(mDevice.Get(), mCmdList.Get(), mAllocator.Get(), mResourceTracker, mAssetMgr, 10);
+
+    mGpuProfiler.Init(mDevice.Get(), mCmdQueue.Get(), mAllocator, "GPU Direct Queue");
 }
 
 void DX12Renderer::BuildObjects()
 {
+    // Uploads and acceleration structure builds are recorded here and run with the first frame
+    mGpuProfiler.BeginZone(mCmdList.Get(), "Upload & AS Build");
+
     mCamera.SetLens(0.25f * PI, mSwapChainSize.x / mSwapChainSize.y, 1.0f, 20000.0f);
     mCamera.LookAt(XMFLOAT3(0.0f, 100.0f, 0.0f), XMFLOAT3(0.0f, 100.0f, 150.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
 
     mAssetMgr.CreateInstance(mDevice.Get(), mCmdList.Get(), mAllocator.Get(), mResourceTracker, "Contents/Sponza/Sponza.fbx", XMFLOAT3(), XMFLOAT3(), XMFLOAT3(1, 1, 1));
+    mAssetMgr.BuildMaterialTable(mDevice.Get(), mCmdList.Get(), mAllocator, mResourceTracker);
+    mAssetMgr.BuildInstanceBuffer(mDevice.Get(), mCmdList.Get(), mAllocator, mResourceTracker);
     
     mAssetMgr.BuildAccelerationStructure(mDevice.Get(), mCmdList.Get(), mAllocator, mResourceTracker);
 
@@ -180,25 +189,91 @@ void DX12Renderer::BuildObjects()
 
     mOutputTextureIndex = mAssetMgr.GetCurrentHeapIndex() - 1;
 
+    // Linear HDR running average of the jittered frames, the output texture only holds the sRGB result
+    mAccumulationTexture = mAssetMgr.CreateResource(mDevice.Get(), mCmdList.Get(), mAllocator, mResourceTracker,
+        NULL, mSwapChainSize.x, mSwapChainSize.y,
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+        DXGI_FORMAT_R32G32B32A32_FLOAT, D3D12_TEXTURE_LAYOUT_UNKNOWN, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+    mAssetMgr.SetTexture(mDevice.Get(), mCmdList.Get(), mAccumulationTexture,
+        L"AccumulationResource", {}, D3D12_UAV_DIMENSION_TEXTURE2D, false, true);
+
+    mAccumulationTextureIndex = mAssetMgr.GetCurrentHeapIndex() - 1;
+
     Pipeline pipeline;
-    pipeline.CreatePipelineState(mDevice, L"Shaders/DefaultRayTrace.hlsl");
+    pipeline.CreatePipelineState(mDevice, L"Shaders/DefaultRayTrace.hlsl", mAssetMgr);
     pipeline.CreateShaderTable(mDevice.Get(), mCmdList.Get(), mAllocator, mResourceTracker, mAssetMgr);
     mPipelines["RayTracing"] = pipeline;
+    mShaderHotReload.Start(mDevice, L"Shaders/DefaultRayTrace.hlsl", pipeline);
 
     mLightMgr.AddLight(XMFLOAT3(), XMFLOAT3(0, -1, 0), XMFLOAT3(1, 1, 1), true, 0, LightType::DIRECTIONAL_LIGHT, 0, 0, true);
 
-    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
-    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+    if (filesystem::exists(DefaultEnvironmentMapPath) && mEnvironmentMap.LoadFromFile(DefaultEnvironmentMapPath))
+    {
+        mAssetMgr.LoadTexture(mDevice.Get(), mCmdList.Get(), mAllocator.Get(), mResourceTracker, DefaultEnvironmentMapPath,
+            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_SRV_DIMENSION_TEXTURE2D, D3D12_UAV_DIMENSION_UNKNOWN, true, false, FLAG_DDS);
+        mEnvironmentMapIndex = mAssetMgr.GetCurrentHeapIndex() - 1;
+
+        const vector<float>& distribution = mEnvironmentMap.GetDistribution();
+        mEnvironmentDistributionSB = std::make_shared<UploadBuffer<float>>(mDevice.Get(), mCmdList.Get(), static_cast<UINT>(distribution.size()),
+            mAllocator, mResourceTracker, mAssetMgr, false);
+        mEnvironmentDistributionSB->CopyData(0, distribution.data(), static_cast<UINT>(distribution.size()));
+
+        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.FirstElement = 0;
+        srvDesc.Buffer.NumElements = static_cast<UINT>(distribution.size());
+        srvDesc.Buffer.StructureByteStride = sizeof(float);
+        srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+
+        mEnvironmentDistributionIndex = mAssetMgr.SetShaderResource(mDevice.Get(), mCmdList.Get(), mEnvironmentDistributionSB->GetUploadAllocation(), srvDesc);
+        mAssetMgr.AddCurrentHeapIndex();
+
+        // Static sky, the SH ambient is projected once and never rewritten
+        mAmbientSHCB = std::make_shared<UploadBuffer<AmbientSHConstants>>(mDevice.Get(), mCmdList.Get(), 1,
+            mAllocator, mResourceTracker, mAssetMgr, true);
+        mAmbientSHCB->CopyData(0, ComputeAmbientSHConstants(ProjectSH9(mEnvironmentMap)));
+
+        D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc{};
+        cbvDesc.BufferLocation = mAmbientSHCB->GetGPUVirtualAddress(0);
+        cbvDesc.SizeInBytes = mAmbientSHCB->GetByteSize();
+
+        mAmbientSHIndex = mAssetMgr.GetCurrentHeapIndex();
+        mAssetMgr.SetConstantBuffer(mDevice.Get(), cbvDesc);
+    }
 
-    srvDesc.Buffer.FirstElement = 0;
-    srvDesc.Buffer.NumElements = mLightMgr.GetLights().size();
-    srvDesc.Buffer.StructureByteStride = sizeof(Light);
-    srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+    // Baked with --bake-probes, the header and the probes take two consecutive descriptors
+    if (filesystem::exists(DefaultProbeVolumePath) && mProbeVolume.Load(DefaultProbeVolumePath))
+    {
+        const vector<AmbientSHConstants>& probes = mProbeVolume.GetProbes();
+        mProbeVolumeHeaderSB = std::make_shared<UploadBuffer<ProbeVolumeHeader>>(mDevice.Get(), mCmdList.Get(), 1,
+            mAllocator, mResourceTracker, mAssetMgr, false);
+        mProbeVolumeHeaderSB->CopyData(0, mProbeVolume.GetHeader());
+        mProbeSB = std::make_shared<UploadBuffer<AmbientSHConstants>>(mDevice.Get(), mCmdList.Get(), static_cast<UINT>(probes.size()),
+            mAllocator, mResourceTracker, mAssetMgr, false);
+        mProbeSB->CopyData(0, probes.data(), static_cast<UINT>(probes.size()));
+
+        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.FirstElement = 0;
+        srvDesc.Buffer.NumElements = 1;
+        srvDesc.Buffer.StructureByteStride = sizeof(ProbeVolumeHeader);
+        srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+
+        mProbeVolumeIndex = mAssetMgr.SetShaderResource(mDevice.Get(), mCmdList.Get(), mProbeVolumeHeaderSB->GetUploadAllocation(), srvDesc);
+        mAssetMgr.AddCurrentHeapIndex();
+
+        srvDesc.Buffer.NumElements = static_cast<UINT>(probes.size());
+        srvDesc.Buffer.StructureByteStride = sizeof(AmbientSHConstants);
+        mAssetMgr.SetShaderResource(mDevice.Get(), mCmdList.Get(), mProbeSB->GetUploadAllocation(), srvDesc);
+        mAssetMgr.AddCurrentHeapIndex();
+    }
 
-    mLightIndex = mAssetMgr.SetShaderResource(mDevice.Get(), mCmdList.Get(), mLightMgr.GetLightSB()->GetUploadAllocation(), srvDesc);
-    mAssetMgr.AddCurrentHeapIndex();
+    mGpuProfiler.EndZone(mCmdList.Get());
 }
 
 LRESULT DX12Renderer::OnProcessMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
@@ -312,6 +387,35 @@ void DX12Renderer::OnProcessKeyInput(UINT uMsg, WPARAM wParam, LPARAM lParam)
             PostQuitMessage(0);
             return;
             break;
+
+        // F5 starts recording the camera, pressing it again writes the path for --benchmark
+        case VK_F5:
+            if (mCameraPathRecorder.IsRecording())
+            {
+                CameraPath path = mCameraPathRecorder.Stop(mCamera);
+                if (path.Save("CameraPath.txt"))
+                    DebugLog("Camera path with " + to_string(path.GetKeyframes().size()) + " keyframes written to CameraPath.txt");
+            }
+            else
+            {
+                mCameraPathRecorder.Start(mCamera);
+                DebugLog("Recording camera path");
+            }
+            break;
+
+        // F6 switches progressive accumulation on and off, with it off every frame traces the pixel centers
+        case VK_F6:
+            mAccumulationEnabled = !mAccumulationEnabled;
+            ResetAccumulation();
+            DebugLog(string("Accumulation ") + (mAccumulationEnabled ? "enabled" : "disabled"));
+            break;
+
+        // F7 switches the sky between the SH ambient, or the probe volume when one is baked, and shadowed samples of the environment map
+        case VK_F7:
+            mTraceSky = !mTraceSky;
+            ResetAccumulation();
+            DebugLog(string("Sky lighting: ") + (mTraceSky ? "traced" : mProbeVolume.IsLoaded() ? "probe volume" : "SH ambient"));
+            break;
         }
         break;
     }
@@ -344,24 +448,76 @@ void DX12Renderer::OnPreciseKeyInput()
 
 
     if (GetAsyncKeyState('Q') & 0x8000)
+    {
         mSunDirection = Vector3::Transform(mSunDirection, XMMatrixRotationX(0.001f));
+        ResetAccumulation();
+    }
 
     if (GetAsyncKeyState('E') & 0x8000)
+    {
         mSunDirection = Vector3::Transform(mSunDirection, XMMatrixRotationX(-0.001f));
+        ResetAccumulation();
+    }
 }
 
 void DX12Renderer::Update()
 {
-    OnPreciseKeyInput();
+    PROFILE_ZONE("Frame Update");
+
+    if (mCameraPath)
+    {
+        mCameraPath->Apply(mCameraPathTime, mCamera);
+        mCameraPathTime += mDeltaTime;
+    }
+    else
+    {
+        OnPreciseKeyInput();
+    }
+
     mCamera.Update(mDeltaTime);
-    mLightMgr.Update();
+    mCameraPathRecorder.Update(mDeltaTime, mCamera);
+    // Anything that changes what a pixel sees invalidates the samples accumulated so far
+    if (mLightMgr.Update())
+        ResetAccumulation();
+
+    if (mCamera.HasChanged())
+        ResetAccumulation();
+
+    // The mesh of a dirty instance may have changed, so its shader table records are rewritten in the next Draw
+    Pipeline& pipeline = mPipelines["RayTracing"];
+    const auto& instances = mAssetMgr.GetInstances();
+    for (UINT i = 0; i < instances.size(); i++)
+    {
+        if (instances[i]->IsDirty())
+        {
+            ResetAccumulation();
+            pipeline.MarkInstanceDirty(i);
+            instances[i]->ClearDirty();
+        }
+    }
 }
 
 void DX12Renderer::Draw()
 {
+    PROFILE_ZONE("Frame Draw");
+
     const float clearColor[4] = { 0.4f, 0.6f, 0.2f, 1.0f };
     auto rtvIndex = mSwapChain->GetCurrentBackBufferIndex();
 
+    // The previous frame has been waited on, so the old state object and shader table are no longer in use
+    Pipeline reloaded;
+    // A reloaded pipeline that cannot cover the scene's feature sets is dropped, the current one keeps drawing
+    if (mShaderHotReload.TakePipeline(reloaded) && reloaded.CreateShaderTable(mDevice.Get(), mCmdList.Get(), mAllocator, mResourceTracker, mAssetMgr))
+    {
+        mPipelines["RayTracing"] = reloaded;
+        ResetAccumulation();
+    }
+
+    // Only the records of instances marked in Update or added since are written
+    Pipeline& pipeline = mPipelines["RayTracing"];
+    if (pipeline.IsShaderTableDirty((UINT)mAssetMgr.GetInstances().size()))
+        pipeline.UpdateShaderTable(mDevice.Get(), mCmdList.Get(), mAllocator, mResourceTracker, mAssetMgr);
+
     mResourceTracker.TransitionBarrier(mCmdList, mFrameObjects[rtvIndex].pSwapChainBuffer.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
     mCmdList->ClearRenderTargetView(mFrameObjects[rtvIndex].rtvHandle, clearColor, 0, nullptr);
     mResourceTracker.TransitionBarrier(mCmdList, mFrameObjects[rtvIndex].pSwapChainBuffer.Get(), D3D12_RESOURCE_STATE_PRESENT);
@@ -376,57 +532,64 @@ void DX12Renderer::Draw()
     raytraceDesc.Height = mSwapChainSize.y;
     raytraceDesc.Depth = 1;
 
-    UINT entrySize = mPipelines["RayTracing"].GetShaderTableEntrySize();
-    auto shaderTable = mPipelines["RayTracing"].GetShaderTable()->GetResource();
-
-    // RayGen is the first entry in the shader-table
-    raytraceDesc.RayGenerationShaderRecord.StartAddress = shaderTable->GetGPUVirtualAddress() + 0 * entrySize;
-    raytraceDesc.RayGenerationShaderRecord.SizeInBytes = entrySize;
-
-    // Miss is the second entry in the shader-table
-    size_t missOffset = 1 * entrySize;
-    raytraceDesc.MissShaderTable.StartAddress = shaderTable->GetGPUVirtualAddress() + missOffset;
-    raytraceDesc.MissShaderTable.StrideInBytes = entrySize;
-    raytraceDesc.MissShaderTable.SizeInBytes = entrySize * 2;
-
-    // Hit is the third entry in the shader-table
-    size_t hitOffset = 3 * entrySize;
-    raytraceDesc.HitGroupTable.StartAddress = shaderTable->GetGPUVirtualAddress() + hitOffset;
-    raytraceDesc.HitGroupTable.StrideInBytes = entrySize;
-    raytraceDesc.HitGroupTable.SizeInBytes = entrySize * mAssetMgr.GetInstances().size() * 2;
+    mPipelines["RayTracing"].GetShaderTable().FillDispatchRaysDesc(raytraceDesc);
 
     mCmdList->SetComputeRootSignature(mPipelines["RayTracing"].GetGlobalRootSignature().Get());
 
     mCmdList->SetComputeRoot32BitConstant(0, mOutputTextureIndex, 0);
     mCmdList->SetComputeRoot32BitConstants(0, 2, &mSwapChainSize, 1);
-    mCmdList->SetComputeRoot32BitConstant(0, mLightIndex, 3);
+    mCmdList->SetComputeRoot32BitConstant(0, mLightMgr.GetLightIndex(), 3);
 
-    auto mat = Matrix4x4::Transpose(Matrix4x4::Inverse(Matrix4x4::Multiply(mCamera.GetView(), mCamera.GetProj())));
+    auto mat = Matrix4x4::Transpose(mCamera.GetInverseViewProj());
     mCmdList->SetComputeRoot32BitConstants(0, 16, &mat, 4);
     mCmdList->SetComputeRoot32BitConstants(0, 3, &mCamera.GetPosition(), 20);
     mCmdList->SetComputeRoot32BitConstant(0, mLightMgr.GetLights().size(), 23);
     mCmdList->SetComputeRoot32BitConstants(0, 3, &mSunDirection, 24);
+    mCmdList->SetComputeRoot32BitConstant(0, mAccumulationEnabled ? mAccumulationFrame : 0, 27);
+    mCmdList->SetComputeRoot32BitConstant(0, mAccumulationTextureIndex, 28);
+    mCmdList->SetComputeRoot32BitConstant(0, mLightMgr.GetLightBVHIndex(), 29);
+    mCmdList->SetComputeRoot32BitConstant(0, mLightMgr.GetLightBVH().GetLightCount(), 30);
+    mCmdList->SetComputeRoot32BitConstant(0, mLightMgr.GetLightGridIndex(), 31);
+    mCmdList->SetComputeRoot32BitConstant(0, mEnvironmentMapIndex, 32);
+    mCmdList->SetComputeRoot32BitConstant(0, mEnvironmentDistributionIndex, 33);
+    mCmdList->SetComputeRoot32BitConstant(0, mAmbientSHIndex, 34);
+    mCmdList->SetComputeRoot32BitConstant(0, mTraceSky ? 1 : 0, 35);
+    mCmdList->SetComputeRoot32BitConstant(0, mProbeVolumeIndex, 36);
+    float pixelSpreadAngle = ComputePixelSpreadAngle(mCamera.GetProj(), mSwapChainSize.y);
+    mCmdList->SetComputeRoot32BitConstants(0, 1, &pixelSpreadAngle, 37);
+    mCmdList->SetComputeRoot32BitConstant(0, mAssetMgr.GetMaterialTableIndex(), 38);
+    mCmdList->SetComputeRoot32BitConstant(0, mAssetMgr.GetInstanceBufferIndex(), 39);
 
     mCmdList->SetComputeRootShaderResourceView(1, mAssetMgr.GetTLAS().mResult->GetResource()->GetGPUVirtualAddress());
 
     // Dispatch
     mCmdList->SetPipelineState1(mPipelines["RayTracing"].GetStateObject().Get());
 
+    mGpuProfiler.BeginZone(mCmdList.Get(), "DispatchRays");
     if(raytraceDesc.Width > 0 && raytraceDesc.Height > 0)
         mCmdList->DispatchRays(&raytraceDesc);
+    mGpuProfiler.EndZone(mCmdList.Get());
+
+    if (mAccumulationEnabled)
+        mAccumulationFrame++;
 
     mResourceTracker.TransitionBarrier(mCmdList, mOutputTexture->GetResource(), D3D12_RESOURCE_STATE_COPY_SOURCE);
     mResourceTracker.TransitionBarrier(mCmdList, mFrameObjects[rtvIndex].pSwapChainBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST);
 
+    mGpuProfiler.BeginZone(mCmdList.Get(), "Copy To Back Buffer");
     mCmdList->CopyResource(mFrameObjects[rtvIndex].pSwapChainBuffer.Get(), mOutputTexture->GetResource());
+    mGpuProfiler.EndZone(mCmdList.Get());
 
     mResourceTracker.TransitionBarrier(mCmdList, mFrameObjects[rtvIndex].pSwapChainBuffer.Get(), D3D12_RESOURCE_STATE_PRESENT);
 
+    mGpuProfiler.Resolve(mCmdList.Get());
+
     mCmdList->Close();
     ID3D12CommandList* cmdList[] = { mCmdList.Get() };
     mCmdQueue->ExecuteCommandLists(_countof(cmdList), cmdList);
 
     WaitUntilGPUComplete();
+    mGpuProfiler.Collect();
 
     mSwapChain->Present(0, 0);
 
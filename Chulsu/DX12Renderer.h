@@ -4,6 +4,11 @@
 #include "AssetManager.h"
 #include "Camera.h"
 #include "LightManager.h"
+#include "EnvironmentMap.h"
+#include "SphericalHarmonics.h"
+#include "ProbeVolume.h"
+#include "ShaderHotReload.h"
+#include "GpuProfiler.h"
 
 class Pipeline;
 
@@ -32,6 +37,8 @@ protected:
 
 private:
 	void WaitUntilGPUComplete();
+	// Starts the running average over, the next frame is traced through the pixel centers again.
+	void ResetAccumulation() { mAccumulationFrame = 0; }
 	ComPtr<IDXGISwapChain3> CreateDxgiSwapChain(ComPtr<IDXGIFactory4> pFactory, HWND hwnd, uint32_t width, uint32_t height, DXGI_FORMAT format, ComPtr<ID3D12CommandQueue> pCommandQueue);
 	ComPtr<ID3D12Device5> CreateDevice(ComPtr<IDXGIFactory4> pDxgiFactory);
 	ComPtr<ID3D12CommandQueue> CreateCommandQueue(ComPtr<ID3D12Device5> pDevice);
@@ -75,13 +82,38 @@ private:
 	LightManager mLightMgr;
 
 	unordered_map<string, Pipeline> mPipelines;
+	ShaderHotReload mShaderHotReload;
+
+	GpuProfiler mGpuProfiler;
 
 	ComPtr<D3D12MA::Allocation> mOutputTexture;
+	ComPtr<D3D12MA::Allocation> mAccumulationTexture;
 
 	UINT mOutputTextureIndex = UINT_MAX;
-	UINT mLightIndex = UINT_MAX;
+	UINT mAccumulationTextureIndex = UINT_MAX;
+
+	// Sky texture from the DDS loader and the sampling tables built from a CPU copy of it, UINT_MAX without one
+	EnvironmentMap mEnvironmentMap;
+	shared_ptr<UploadBuffer<float>> mEnvironmentDistributionSB;
+	UINT mEnvironmentMapIndex = UINT_MAX;
+	UINT mEnvironmentDistributionIndex = UINT_MAX;
+
+	// Ambient projected from mEnvironmentMap, used instead of tracing the sky unless mTraceSky is set with F7
+	shared_ptr<UploadBuffer<AmbientSHConstants>> mAmbientSHCB;
+	UINT mAmbientSHIndex = UINT_MAX;
+	bool mTraceSky = false;
+
+	// Indirect diffuse light baked by --bake-probes, replaces the SH ambient when the file exists
+	ProbeVolume mProbeVolume;
+	shared_ptr<UploadBuffer<ProbeVolumeHeader>> mProbeVolumeHeaderSB;
+	shared_ptr<UploadBuffer<AmbientSHConstants>> mProbeSB;
+	UINT mProbeVolumeIndex = UINT_MAX;
 
 	Camera mCamera;
 
 	XMFLOAT3 mSunDirection = {0, 1, 0};
+
+	// Frames blended into mAccumulationTexture since the camera or the scene last changed
+	bool mAccumulationEnabled = true;
+	UINT mAccumulationFrame = 0;
 };
\ No newline at end of file
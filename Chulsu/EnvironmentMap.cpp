@@ -0,0 +1,214 @@
+#include "EnvironmentMap.h"
+#include "Parallel.h"
+#include "Profiler.h"
+
+namespace
+{
+	const float kOneMinusEpsilon = 0.99999994f;
+
+	float Luminance(const XMFLOAT4& color)
+	{
+		float luminance = 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+		return isfinite(luminance) ? max(luminance, 0.0f) : 0.0f;
+	}
+
+	// Same search as FindInterval in Shaders/EnvironmentMap.hlsli, the last i in [0, count) with cdf[i] <= u.
+	// Empty intervals are never returned for u < 1.
+	UINT FindInterval(const float* cdf, UINT count, float u)
+	{
+		UINT low = 0;
+		UINT high = count;
+		while (low + 1 < high)
+		{
+			UINT middle = (low + high) / 2;
+			if (cdf[middle] <= u)
+				low = middle;
+			else
+				high = middle;
+		}
+		return low;
+	}
+
+	// Position of u inside the interval, in [0, 1).
+	float IntervalOffset(const float* cdf, UINT index, float u)
+	{
+		float width = cdf[index + 1] - cdf[index];
+		return width > 0.0f ? min((u - cdf[index]) / width, kOneMinusEpsilon) : 0.5f;
+	}
+}
+
+bool EnvironmentMap::LoadFromFile(const wstring& filePath)
+{
+	PROFILE_ZONE("Environment Map Load");
+
+	TexMetadata metaData = {};
+	ScratchImage scratch;
+	if (FAILED(LoadFromDDSFile(filePath.c_str(), DDS_FLAGS_NONE, &metaData, scratch)))
+		return false;
+
+	const Image* image = scratch.GetImage(0, 0, 0);
+
+	// Float texels whatever the file stores, the GPU reads the same values from the DDS texture.
+	ScratchImage converted;
+	if (IsCompressed(image->format))
+	{
+		if (FAILED(Decompress(*image, DXGI_FORMAT_R32G32B32A32_FLOAT, converted)))
+			return false;
+		image = converted.GetImage(0, 0, 0);
+	}
+	else if (image->format != DXGI_FORMAT_R32G32B32A32_FLOAT)
+	{
+		if (FAILED(Convert(*image, DXGI_FORMAT_R32G32B32A32_FLOAT, TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, converted)))
+			return false;
+		image = converted.GetImage(0, 0, 0);
+	}
+
+	UINT width = static_cast<UINT>(image->width);
+	UINT height = static_cast<UINT>(image->height);
+	vector<XMFLOAT4> texels(static_cast<size_t>(width) * height);
+	for (UINT y = 0; y < height; ++y)
+		memcpy(&texels[static_cast<size_t>(y) * width], image->pixels + y * image->rowPitch, width * sizeof(XMFLOAT4));
+
+	SetTexels(width, height, std::move(texels));
+	return true;
+}
+
+void EnvironmentMap::SetTexels(UINT width, UINT height, vector<XMFLOAT4> texels)
+{
+	assert(texels.size() == static_cast<size_t>(width) * height);
+
+	mWidth = width;
+	mHeight = height;
+	mTexels = std::move(texels);
+	BuildDistribution();
+}
+
+void EnvironmentMap::BuildDistribution()
+{
+	PROFILE_ZONE("Environment Map Distribution");
+
+	const UINT rowStride = mWidth + 1;
+	mDistribution.assign(static_cast<size_t>(mHeight) * rowStride + mHeight + 1, 0.0f);
+
+	// Rows near the poles cover less solid angle, so texels are weighted by sin(theta) of their row
+	vector<float> rowSums(mHeight);
+	ParallelFor(mHeight, [&](UINT y)
+		{
+			float sinTheta = sinf(PI * (y + 0.5f) / mHeight);
+			float* cdf = &mDistribution[static_cast<size_t>(y) * rowStride];
+			const XMFLOAT4* row = &mTexels[static_cast<size_t>(y) * mWidth];
+
+			double sum = 0.0;
+			for (UINT x = 0; x < mWidth; ++x)
+			{
+				cdf[x] = static_cast<float>(sum);
+				sum += Luminance(row[x]) * sinTheta;
+			}
+			rowSums[y] = static_cast<float>(sum);
+
+			// A black row is never picked by the marginal, a uniform CDF keeps its lookups valid
+			for (UINT x = 0; x < mWidth; ++x)
+				cdf[x] = sum > 0.0 ? static_cast<float>(cdf[x] / sum) : static_cast<float>(x) / mWidth;
+			cdf[mWidth] = 1.0f;
+		});
+
+	float* marginal = &mDistribution[static_cast<size_t>(mHeight) * rowStride];
+	double total = ParallelPrefixSum(rowSums, span<float>(marginal, mHeight + 1));
+	for (UINT y = 0; y < mHeight; ++y)
+		marginal[y] = total > 0.0 ? static_cast<float>(marginal[y] / total) : static_cast<float>(y) / mHeight;
+	marginal[mHeight] = 1.0f;
+}
+
+XMVECTOR EnvironmentMap::Load(int x, int y) const
+{
+	x %= (int)mWidth;
+	y %= (int)mHeight;
+	if (x < 0) x += mWidth;
+	if (y < 0) y += mHeight;
+
+	return XMLoadFloat4(&mTexels[static_cast<size_t>(y) * mWidth + x]);
+}
+
+XMVECTOR EnvironmentMap::Sample(const XMFLOAT3& direction) const
+{
+	if (mTexels.empty())
+		return XMVectorZero();
+
+	XMFLOAT2 uv = DirectionToUV(direction);
+
+	// Texel centers sit at half integer coordinates.
+	float x = uv.x * mWidth - 0.5f;
+	float y = uv.y * mHeight - 0.5f;
+
+	float x0 = floorf(x);
+	float y0 = floorf(y);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	int ix = static_cast<int>(x0);
+	int iy = static_cast<int>(y0);
+
+	XMVECTOR top = XMVectorLerp(Load(ix, iy), Load(ix + 1, iy), fx);
+	XMVECTOR bottom = XMVectorLerp(Load(ix, iy + 1), Load(ix + 1, iy + 1), fx);
+
+	return XMVectorLerp(top, bottom, fy);
+}
+
+EnvironmentSample EnvironmentMap::SampleDirection(float u1, float u2) const
+{
+	EnvironmentSample sample;
+	if (mTexels.empty())
+		return sample;
+
+	const float* marginal = &mDistribution[static_cast<size_t>(mHeight) * (mWidth + 1)];
+	UINT y = FindInterval(marginal, mHeight, u1);
+	float v = (y + IntervalOffset(marginal, y, u1)) / mHeight;
+
+	const float* conditional = &mDistribution[static_cast<size_t>(y) * (mWidth + 1)];
+	UINT x = FindInterval(conditional, mWidth, u2);
+	float u = (x + IntervalOffset(conditional, x, u2)) / mWidth;
+
+	// Constant density over the texel in uv, divided by the area the uv to sphere mapping stretches it to
+	float pdfUV = (conditional[x + 1] - conditional[x]) * mWidth * (marginal[y + 1] - marginal[y]) * mHeight;
+	float sinTheta = sinf(v * PI);
+	if (pdfUV <= 0.0f || sinTheta <= 0.0f)
+		return sample;
+
+	sample.Direction = UVToDirection(XMFLOAT2(u, v));
+	sample.Pdf = pdfUV / (2.0f * PI * PI * sinTheta);
+	return sample;
+}
+
+float EnvironmentMap::Pdf(const XMFLOAT3& direction) const
+{
+	if (mTexels.empty())
+		return 0.0f;
+
+	XMFLOAT2 uv = DirectionToUV(direction);
+	UINT x = min(static_cast<UINT>(uv.x * mWidth), mWidth - 1);
+	UINT y = min(static_cast<UINT>(uv.y * mHeight), mHeight - 1);
+
+	const float* marginal = &mDistribution[static_cast<size_t>(mHeight) * (mWidth + 1)];
+	const float* conditional = &mDistribution[static_cast<size_t>(y) * (mWidth + 1)];
+	float pdfUV = (conditional[x + 1] - conditional[x]) * mWidth * (marginal[y + 1] - marginal[y]) * mHeight;
+
+	float sinTheta = sinf(uv.y * PI);
+	return sinTheta > 0.0f ? pdfUV / (2.0f * PI * PI * sinTheta) : 0.0f;
+}
+
+XMFLOAT2 EnvironmentMap::DirectionToUV(const XMFLOAT3& direction)
+{
+	float u = atan2f(direction.z, direction.x) / (2.0f * PI);
+	if (u < 0.0f)
+		u += 1.0f;
+	float v = acosf(clamp(direction.y, -1.0f, 1.0f)) / PI;
+	return XMFLOAT2(u, v);
+}
+
+XMFLOAT3 EnvironmentMap::UVToDirection(const XMFLOAT2& uv)
+{
+	float phi = uv.x * 2.0f * PI;
+	float theta = uv.y * PI;
+	float sinTheta = sinf(theta);
+	return XMFLOAT3(sinTheta * cosf(phi), cosf(theta), sinTheta * sinf(phi));
+}
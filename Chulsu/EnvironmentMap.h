@@ -0,0 +1,57 @@
+#pragma once
+#include "stdafx.h"
+
+// Looked up by DX12Renderer and the software renderer, the scene keeps the constant miss color without it.
+const wchar_t* const DefaultEnvironmentMapPath = L"Contents/Environment.dds";
+
+struct EnvironmentSample
+{
+	XMFLOAT3 Direction = {};
+	float Pdf = 0.0f;		// Solid angle density, zero when the sample has to be skipped.
+};
+
+// HDR equirectangular sky with the tables to sample directions in proportion to their luminance.
+// The texture maps u to the azimuth around +y and v from +y (top row) to -y, the same as Shaders/EnvironmentMap.hlsli.
+// The distribution is piecewise constant over the texels: a conditional CDF per row and a marginal CDF over the rows,
+// all stored in one float array so it can be uploaded as is.
+class EnvironmentMap
+{
+public:
+	EnvironmentMap() = default;
+	~EnvironmentMap() = default;
+
+	// Reads a DDS file in any format DirectXTex can convert to RGBA32F and builds the sampling tables.
+	bool LoadFromFile(const wstring& filePath);
+	void SetTexels(UINT width, UINT height, vector<XMFLOAT4> texels);
+
+	// Bilinear filtered radiance with wrap addressing, like SampleLevel(gAnisotropicWrap, ..., 0.0f) in the miss shader.
+	XMVECTOR Sample(const XMFLOAT3& direction) const;
+
+	// u1 picks the row, u2 the texel within it, both in [0, 1).
+	EnvironmentSample SampleDirection(float u1, float u2) const;
+	// Density SampleDirection produces direction with.
+	float Pdf(const XMFLOAT3& direction) const;
+
+	static XMFLOAT2 DirectionToUV(const XMFLOAT3& direction);
+	static XMFLOAT3 UVToDirection(const XMFLOAT2& uv);
+
+	bool IsLoaded() const { return !mTexels.empty(); }
+	UINT GetWidth() const { return mWidth; }
+	UINT GetHeight() const { return mHeight; }
+	// Row major RGBA radiance, the top row first.
+	const vector<XMFLOAT4>& GetTexels() const { return mTexels; }
+
+	// Height rows of width + 1 conditional CDF values, then height + 1 marginal CDF values.
+	const vector<float>& GetDistribution() const { return mDistribution; }
+
+private:
+	// Row conditionals are scanned in parallel, the marginal with ParallelPrefixSum.
+	void BuildDistribution();
+	XMVECTOR Load(int x, int y) const;
+
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+	vector<XMFLOAT4> mTexels;
+
+	vector<float> mDistribution;
+};
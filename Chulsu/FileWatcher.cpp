@@ -0,0 +1,36 @@
+#include "FileWatcher.h"
+
+void FileWatcher::Watch(const filesystem::path& directory)
+{
+	mDirectory = directory;
+	mTimestamps = Scan();
+}
+
+bool FileWatcher::PollChanges()
+{
+	auto timestamps = Scan();
+	if (timestamps == mTimestamps)
+		return false;
+
+	mTimestamps = std::move(timestamps);
+	return true;
+}
+
+map<filesystem::path, filesystem::file_time_type> FileWatcher::Scan() const
+{
+	map<filesystem::path, filesystem::file_time_type> timestamps;
+
+	// Files can disappear between listing and reading the timestamp while an editor saves, those are skipped
+	error_code ec;
+	for (filesystem::recursive_directory_iterator it(mDirectory, ec), end; !ec && it != end; it.increment(ec))
+	{
+		if (!it->is_regular_file(ec))
+			continue;
+
+		auto time = it->last_write_time(ec);
+		if (!ec)
+			timestamps[it->path()] = time;
+	}
+
+	return timestamps;
+}
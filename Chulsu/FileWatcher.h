@@ -0,0 +1,22 @@
+#pragma once
+#include "stdafx.h"
+
+// Detects modified, added and removed files under a directory by polling their timestamps.
+// Only uses std::filesystem, so it runs on every platform the shaders can be compiled on.
+class FileWatcher
+{
+public:
+	FileWatcher() = default;
+	~FileWatcher() = default;
+
+	void Watch(const filesystem::path& directory);
+
+	// True when anything changed since the previous call, or since Watch for the first one.
+	bool PollChanges();
+
+private:
+	map<filesystem::path, filesystem::file_time_type> Scan() const;
+
+	filesystem::path mDirectory;
+	map<filesystem::path, filesystem::file_time_type> mTimestamps;
+};
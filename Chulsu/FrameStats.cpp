@@ -0,0 +1,125 @@
+#include "FrameStats.h"
+
+FrameStats::FrameStats(double stutterThresholdMs)
+	: mStutterThreshold(static_cast<uint64_t>(stutterThresholdMs * 1000.0))
+{
+}
+
+UINT FrameStats::GetBucketIndex(uint64_t microseconds)
+{
+	// Values below 2 * SubBucketCount get a bucket each, above that every power of two
+	// is split into SubBucketCount buckets by the bits right below the leading one
+	if (microseconds < 2 * SubBucketCount)
+		return static_cast<UINT>(microseconds);
+
+	UINT shift = static_cast<UINT>(bit_width(microseconds)) - 1 - SubBucketBits;
+	if (shift > MaxShift)
+		return BucketCount - 1;
+
+	UINT subBucket = static_cast<UINT>(microseconds >> shift) - SubBucketCount;
+	return 2 * SubBucketCount + (shift - 1) * SubBucketCount + subBucket;
+}
+
+uint64_t FrameStats::GetBucketUpperBound(UINT index)
+{
+	if (index < 2 * SubBucketCount)
+		return index;
+
+	UINT shift = (index - 2 * SubBucketCount) / SubBucketCount + 1;
+	uint64_t subBucket = (index - 2 * SubBucketCount) % SubBucketCount + SubBucketCount;
+	return ((subBucket + 1) << shift) - 1;
+}
+
+void FrameStats::AddFrame(float elapsedSeconds)
+{
+	uint64_t microseconds = static_cast<uint64_t>(max(elapsedSeconds, 0.0f) * 1000000.0f + 0.5f);
+
+	++mCounts[GetBucketIndex(microseconds)];
+	++mFrameCount;
+	mTotal += microseconds;
+	mMin = min(mMin, microseconds);
+	mMax = max(mMax, microseconds);
+
+	if (microseconds > mStutterThreshold)
+		++mStutterCount;
+}
+
+void FrameStats::Reset()
+{
+	mCounts.fill(0);
+	mFrameCount = 0;
+	mStutterCount = 0;
+	mTotal = 0;
+	mMin = UINT64_MAX;
+	mMax = 0;
+}
+
+double FrameStats::GetPercentile(double percentile) const
+{
+	if (mFrameCount == 0)
+		return 0.0;
+
+	// Nearest rank, reported as the highest value of its bucket but never above the largest frame
+	UINT64 rank = max<UINT64>(1, static_cast<UINT64>(ceil(percentile / 100.0 * mFrameCount)));
+	UINT64 count = 0;
+	for (UINT i = 0; i < BucketCount; ++i)
+	{
+		count += mCounts[i];
+		if (count >= rank)
+			return min(GetBucketUpperBound(i), mMax) / 1000.0;
+	}
+
+	return mMax / 1000.0;
+}
+
+double FrameStats::GetMean() const
+{
+	return mFrameCount > 0 ? static_cast<double>(mTotal) / mFrameCount / 1000.0 : 0.0;
+}
+
+double FrameStats::GetMin() const
+{
+	return mFrameCount > 0 ? mMin / 1000.0 : 0.0;
+}
+
+double FrameStats::GetMax() const
+{
+	return mMax / 1000.0;
+}
+
+void FrameStats::Report() const
+{
+	if (mFrameCount == 0)
+		return;
+
+	ostringstream line;
+	line << fixed << setprecision(3) << "FrameStats: " << mFrameCount << " frames, mean " << GetMean()
+		<< " ms, p50 " << GetPercentile(50.0) << " ms, p95 " << GetPercentile(95.0) << " ms, p99 " << GetPercentile(99.0)
+		<< " ms, max " << GetMax() << " ms, " << mStutterCount << " stutters over " << mStutterThreshold / 1000.0 << " ms";
+	DebugLog(line.str());
+}
+
+bool FrameStats::WriteCsv(const filesystem::path& path) const
+{
+	ofstream file(path, ios::trunc);
+	if (!file)
+	{
+		DebugLog("FrameStats: failed to open " + path.string());
+		return false;
+	}
+
+	file << fixed << setprecision(3) << "FrameTimeMs,Count,Percentile\n";
+
+	UINT64 count = 0;
+	for (UINT i = 0; i < BucketCount; ++i)
+	{
+		if (mCounts[i] == 0)
+			continue;
+
+		count += mCounts[i];
+		file << min(GetBucketUpperBound(i), mMax) / 1000.0 << "," << mCounts[i] << ","
+			<< setprecision(4) << 100.0 * count / mFrameCount << setprecision(3) << "\n";
+	}
+
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "stdafx.h"
+
+// Frame time distribution in a fixed size log-linear histogram, like HdrHistogram.
+// Times are counted in microseconds, exact below 128 us and within 1/64 (1.6%) above, up to 2^32 us.
+// Adding a frame is a few integer operations, so it can stay enabled in every build.
+class FrameStats
+{
+public:
+	// Frames longer than the threshold count as stutters.
+	FrameStats(double stutterThresholdMs = 1000.0 / 30.0);
+	~FrameStats() = default;
+
+	void AddFrame(float elapsedSeconds);
+	void Reset();
+
+	UINT64 GetFrameCount() const { return mFrameCount; }
+	UINT64 GetStutterCount() const { return mStutterCount; }
+
+	// Milliseconds, zero when no frame was added.
+	double GetPercentile(double percentile) const;
+	double GetMean() const;
+	double GetMin() const;
+	double GetMax() const;
+
+	void Report() const;
+
+	// One row per non-empty bucket: upper bound in ms, frame count and the cumulative percentile.
+	bool WriteCsv(const filesystem::path& path) const;
+
+private:
+	static const UINT SubBucketBits = 6;
+	static const UINT SubBucketCount = 1 << SubBucketBits;
+	static const UINT MaxShift = 32 - SubBucketBits - 1;
+	static const UINT BucketCount = 2 * SubBucketCount + MaxShift * SubBucketCount;
+
+	static UINT GetBucketIndex(uint64_t microseconds);
+	static uint64_t GetBucketUpperBound(UINT index);
+
+	array<uint32_t, BucketCount> mCounts = {};
+
+	uint64_t mStutterThreshold;
+	UINT64 mFrameCount = 0;
+	UINT64 mStutterCount = 0;
+	uint64_t mTotal = 0;
+	uint64_t mMin = UINT64_MAX;
+	uint64_t mMax = 0;
+};
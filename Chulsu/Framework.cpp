@@ -1,4 +1,14 @@
 #include "Framework.h"
+#include "CpuRayTracer.h"
+#include "Profiler.h"
+#include "CameraPath.h"
+#include "SphericalHarmonics.h"
+
+namespace
+{
+    // Benchmarks advance the camera path by this much per frame, whatever the frame actually took.
+    const float kBenchmarkDeltaTime = 1.0f / 60.0f;
+}
 
 LRESULT CALLBACK Framework::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
@@ -55,9 +65,300 @@ void Framework::Run()
 
     MsgLoop();
 
+    WriteProfile();
+
     DestroyWindow(mWinHandle);
 }
 
+void Framework::BuildSoftwareScene(CpuRayTracer& tracer, Camera& camera)
+{
+    // Same scene and view as DX12Renderer::BuildObjects.
+    tracer.CreateInstance("Contents/Sponza/Sponza.fbx", XMFLOAT3(), XMFLOAT3(), XMFLOAT3(1, 1, 1));
+    tracer.BuildAccelerationStructure(L"Contents/Sponza/Sponza.fbx.bvh");
+
+    auto environmentMap = make_shared<EnvironmentMap>();
+    if (filesystem::exists(DefaultEnvironmentMapPath) && environmentMap->LoadFromFile(DefaultEnvironmentMapPath))
+        tracer.SetEnvironmentMap(environmentMap);
+
+    auto probeVolume = make_shared<ProbeVolume>();
+    if (filesystem::exists(DefaultProbeVolumePath) && probeVolume->Load(DefaultProbeVolumePath))
+        tracer.SetProbeVolume(probeVolume);
+
+    camera.SetLens(0.25f * PI, static_cast<float>(mWidth) / mHeight, 1.0f, 20000.0f);
+    camera.LookAt(XMFLOAT3(0.0f, 100.0f, 0.0f), XMFLOAT3(0.0f, 100.0f, 150.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
+    camera.Update(0.0f);
+}
+
+bool Framework::RunSoftware(const wstring& outputPath, uint32_t sampleCount, uint32_t width, uint32_t height)
+{
+    mWidth = width;
+    mHeight = height;
+
+    CpuRayTracer tracer;
+    Camera camera;
+    BuildSoftwareScene(tracer, camera);
+
+    // More than one sample accumulates jittered frames of the static camera into one image
+    tracer.SetAccumulation(sampleCount > 1);
+    for (uint32_t i = 0; i < max(sampleCount, 1u); ++i)
+        tracer.Render(camera, XMFLOAT3(0, 1, 0), mWidth, mHeight);
+    WriteProfile();
+
+    if (!tracer.SaveImage(outputPath))
+    {
+        DebugLog("Failed to write " + wstringTostring(outputPath));
+        return false;
+    }
+    return true;
+}
+
+void Framework::RunBVHBenchmark(uint32_t width, uint32_t height)
+{
+    mWidth = width;
+    mHeight = height;
+
+    CpuRayTracer tracer;
+    Camera camera;
+    BuildSoftwareScene(tracer, camera);
+
+    tracer.Benchmark(camera, XMFLOAT3(0, 1, 0), mWidth, mHeight);
+    WriteProfile();
+}
+
+bool Framework::RunLightCullingTest(uint32_t lightCount, uint32_t width, uint32_t height)
+{
+    mWidth = width;
+    mHeight = height;
+
+    CpuRayTracer tracer;
+    Camera camera;
+    BuildSoftwareScene(tracer, camera);
+
+    // Fixed seed, every run places the same lights inside the scene bounds
+    const BVHNode& root = tracer.GetBVH().GetNodes()[0];
+    mt19937 rng(1);
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto randomIn = [&](float a, float b) { return a + (b - a) * unit(rng); };
+
+    vector<Light> lights;
+    for (uint32_t i = 0; i < lightCount; ++i)
+    {
+        Light light{};
+        light.position = XMFLOAT3(randomIn(root.BoundsMin.x, root.BoundsMax.x), randomIn(root.BoundsMin.y, root.BoundsMax.y), randomIn(root.BoundsMin.z, root.BoundsMax.z));
+        XMStoreFloat3(&light.direction, XMVector3Normalize(XMVectorSet(randomIn(-1, 1), randomIn(-1, 0), randomIn(-1, 1), 0)));
+        light.color = XMFLOAT3(randomIn(0, 5000), randomIn(0, 5000), randomIn(0, 5000));
+        light.active = true;
+        light.range = randomIn(100, 600);
+        light.type = unit(rng) < 0.5f ? LightType::POINT_LIGHT : LightType::SPOT_LIGHT;
+        light.outerCosine = cosf(randomIn(0.2f, 1.2f));
+        light.innerCosine = randomIn(light.outerCosine, 1.0f);
+        light.castShadows = true;
+        lights.push_back(light);
+    }
+    tracer.SetLights(lights);
+
+    bool matched = tracer.CompareLightCulling(camera, XMFLOAT3(0, 1, 0), mWidth, mHeight);
+    WriteProfile();
+    return matched;
+}
+
+bool Framework::RunProbeBake(float spacing, uint32_t rayCount)
+{
+    // Only the aspect ratio of the unused camera
+    mWidth = 1920;
+    mHeight = 1080;
+
+    CpuRayTracer tracer;
+    Camera camera;
+    BuildSoftwareScene(tracer, camera);
+
+    // Probes of an earlier bake would light the hits the new ones see, the sun is the one DX12Renderer starts with
+    tracer.SetProbeVolume(nullptr);
+    tracer.SetSunDirection(XMFLOAT3(0, 1, 0));
+
+    const BVHNode& root = tracer.GetBVH().GetNodes()[0];
+    ProbeVolume probeVolume;
+    probeVolume.Place(root.BoundsMin, root.BoundsMax, spacing);
+
+    double probesPerSecond = probeVolume.Bake(tracer, rayCount);
+
+    const ProbeVolumeHeader& header = probeVolume.GetHeader();
+    UINT validCount = 0;
+    for (const AmbientSHConstants& probe : probeVolume.GetProbes())
+        validCount += probe.Coefficients[0].w > 0.0f ? 1 : 0;
+
+    DebugLog("Probe bake: " + to_string(header.Dimensions.x) + "x" + to_string(header.Dimensions.y) + "x" + to_string(header.Dimensions.z)
+        + " probes, " + to_string(validCount) + " outside geometry, " + to_string(rayCount) + " rays each, "
+        + to_string(probesPerSecond) + " probes/s");
+    WriteProfile();
+
+    if (!probeVolume.Save(DefaultProbeVolumePath))
+    {
+        DebugLog("Failed to write " + wstringTostring(DefaultProbeVolumePath));
+        return false;
+    }
+    return true;
+}
+
+void Framework::RunSHBenchmark(uint32_t repeatCount)
+{
+    // The scene's sky when there is one, otherwise a noisy HDR sky with a few very bright texels
+    EnvironmentMap environmentMap;
+    if (!filesystem::exists(DefaultEnvironmentMapPath) || !environmentMap.LoadFromFile(DefaultEnvironmentMapPath))
+    {
+        const UINT width = 2048;
+        const UINT height = 1024;
+        mt19937 rng(1);
+        uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        vector<XMFLOAT4> texels(static_cast<size_t>(width) * height);
+        for (XMFLOAT4& texel : texels)
+        {
+            float scale = unit(rng) < 0.001f ? 1000.0f : 1.0f;
+            texel = XMFLOAT4(scale * unit(rng), scale * unit(rng), scale * unit(rng), 1.0f);
+        }
+        environmentMap.SetTexels(width, height, std::move(texels));
+    }
+
+    const double texelCount = static_cast<double>(environmentMap.GetWidth()) * environmentMap.GetHeight();
+    repeatCount = max(repeatCount, 1u);
+
+    SH9Color projected;
+    auto start = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < repeatCount; ++i)
+        projected = ProjectSH9(environmentMap);
+    double projectSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count() / repeatCount;
+
+    start = chrono::steady_clock::now();
+    SH9Color reference = ProjectSH9Reference(environmentMap);
+    double referenceSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // Relative to the DC term, higher order coefficients of a random sky are close to zero
+    float maxError = 0.0f;
+    for (UINT k = 0; k < 9; ++k)
+    {
+        XMVECTOR difference = XMVectorAbs(XMVectorSubtract(XMLoadFloat3(&projected.Coefficients[k]), XMLoadFloat3(&reference.Coefficients[k])));
+        maxError = max(maxError, max(XMVectorGetX(difference), max(XMVectorGetY(difference), XMVectorGetZ(difference))));
+    }
+    XMFLOAT3 dc = reference.Coefficients[0];
+    maxError /= max(max(dc.x, max(dc.y, dc.z)), FLT_MIN);
+
+    DebugLog("SH projection of " + to_string(environmentMap.GetWidth()) + "x" + to_string(environmentMap.GetHeight()) + ": "
+        + to_string(projectSeconds * 1000.0) + " ms (" + to_string(texelCount / projectSeconds / 1e6) + " Mtexels/s), reference "
+        + to_string(referenceSeconds * 1000.0) + " ms (" + to_string(texelCount / referenceSeconds / 1e6) + " Mtexels/s), max relative error "
+        + to_string(maxError));
+    WriteProfile();
+}
+
+bool Framework::RunBenchmark(const wstring& pathFile, uint32_t frameCount, bool software, uint32_t width, uint32_t height)
+{
+    auto path = make_shared<CameraPath>();
+    if (!path->Load(pathFile) || path->Empty())
+    {
+        DebugLog("Failed to load camera path " + wstringTostring(pathFile));
+        return false;
+    }
+
+    if (frameCount == 0)
+        frameCount = static_cast<uint32_t>(ceil(path->GetDuration() / kBenchmarkDeltaTime)) + 1;
+
+    vector<double> frameTimes;
+    frameTimes.reserve(frameCount);
+
+    if (software)
+    {
+        mWidth = width;
+        mHeight = height;
+
+        CpuRayTracer tracer;
+        Camera camera;
+        BuildSoftwareScene(tracer, camera);
+
+        for (uint32_t i = 0; i < frameCount; ++i)
+        {
+            auto start = chrono::steady_clock::now();
+
+            path->Apply(i * kBenchmarkDeltaTime, camera);
+            camera.Update(kBenchmarkDeltaTime);
+            tracer.Render(camera, XMFLOAT3(0, 1, 0), mWidth, mHeight);
+
+            frameTimes.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+    }
+    else
+    {
+        if (mWinHandle == nullptr)
+            return false;
+
+        RECT r;
+        GetClientRect(mWinHandle, &r);
+        mWidth = r.right - r.left;
+        mHeight = r.bottom - r.top;
+
+        mRenderer = make_shared<DX12Renderer>();
+        mRenderer->Init(mWinHandle, mWidth, mHeight);
+        mRenderer->BuildObjects();
+        mRenderer->PlayCameraPath(path);
+
+        MSG msg{};
+        for (uint32_t i = 0; i < frameCount; ++i)
+        {
+            // The window is never shown, its messages are still handled so it does not stop responding
+            while (PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
+            {
+                TranslateMessage(&msg);
+                DispatchMessage(&msg);
+            }
+
+            auto start = chrono::steady_clock::now();
+
+            mRenderer->SetDeltaTime(kBenchmarkDeltaTime);
+            mRenderer->Update();
+            mRenderer->Draw();
+
+            frameTimes.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+
+        mRenderer = nullptr;
+        DestroyWindow(mWinHandle);
+    }
+
+    WriteBenchmarkResults(frameTimes, kBenchmarkDeltaTime);
+    WriteProfile();
+    return true;
+}
+
+void Framework::WriteBenchmarkResults(const vector<double>& frameTimes, float deltaTime)
+{
+    ofstream file("Benchmark.csv", ios::trunc);
+    file << fixed << setprecision(3) << "Frame,PathTime,FrameTimeMs\n";
+
+    double total = 0.0;
+    for (size_t i = 0; i < frameTimes.size(); ++i)
+    {
+        mFrameStats.AddFrame(static_cast<float>(frameTimes[i]));
+        total += frameTimes[i];
+        file << i << "," << i * deltaTime << "," << frameTimes[i] * 1000.0 << "\n";
+    }
+
+    DebugLog("Benchmark: " + to_string(frameTimes.size()) + " frames in " + to_string(total) + " s, "
+        + to_string(frameTimes.size() / total) + " fps, per frame times written to Benchmark.csv");
+}
+
+void Framework::WriteProfile()
+{
+    Profiler::Report();
+
+    if (mFrameStats.GetFrameCount() > 0)
+    {
+        mFrameStats.Report();
+        mFrameStats.WriteCsv("FrameStats.csv");
+    }
+
+    if (!mTracePath.empty())
+        Profiler::ExportChromeTrace(mTracePath);
+}
+
 void Framework::Init(const string& winTitle, uint32_t width, uint32_t height)
 {
     const WCHAR* className = L"Main Window";
@@ -117,6 +418,7 @@ void Framework::MsgLoop()
         else
         {
             mTimer.Tick();
+            mFrameStats.AddFrame(mTimer.ElapsedTime());
 
             mRenderer->SetDeltaTime(mTimer.ElapsedTime());
             mRenderer->Update();
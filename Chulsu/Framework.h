@@ -1,13 +1,39 @@
 #pragma once
 #include "Timer.h"
+#include "FrameStats.h"
 #include "DX12Renderer.h"
 
+class CpuRayTracer;
+
 class Framework
 {
 public:
     void Run();
     void Init(const std::string& winTitle, uint32_t width = 1920, uint32_t height = 1080);
 
+    // Renders a single frame with the CPU ray tracer, no window or device is created.
+    bool RunSoftware(const std::wstring& outputPath, uint32_t sampleCount = 1, uint32_t width = 1920, uint32_t height = 1080);
+
+    // Compares binary and wide BVH traversal of the software scene, results go to the debug log.
+    void RunBVHBenchmark(uint32_t width = 1920, uint32_t height = 1080);
+
+    // Scatters point and spot lights over the software scene and compares light grid culling against shading every light, false when they differ.
+    bool RunLightCullingTest(uint32_t lightCount, uint32_t width = 1920, uint32_t height = 1080);
+
+    // Bakes irradiance probes spacing apart over the software scene with the CPU tracer and writes them to DefaultProbeVolumePath.
+    bool RunProbeBake(float spacing = 100.0f, uint32_t rayCount = 256);
+
+    // Projects the environment map, or a random sky without one, into SH repeatCount times and logs the throughput
+    // and the largest coefficient error against the scalar reference projection.
+    void RunSHBenchmark(uint32_t repeatCount = 10);
+
+    // Plays a recorded camera path at a fixed delta time without showing a window, frame times go to Benchmark.csv.
+    // A frame count of zero plays the whole path. With software the CPU ray tracer renders instead of DX12, Init is not needed then.
+    bool RunBenchmark(const std::wstring& pathFile, uint32_t frameCount = 0, bool software = false, uint32_t width = 1920, uint32_t height = 1080);
+
+    // Every run mode writes a Chrome trace of the profiler zones here on exit when set.
+    void SetTracePath(const std::wstring& path) { mTracePath = path; }
+
 private:
     HWND mWinHandle = nullptr;
     uint32_t mWidth = NULL;
@@ -21,5 +47,13 @@ private:
 
     void MsgLoop();
 
+    void BuildSoftwareScene(CpuRayTracer& tracer, Camera& camera);
+
+    void WriteProfile();
+    void WriteBenchmarkResults(const std::vector<double>& frameTimes, float deltaTime);
+
     Timer mTimer;
+    FrameStats mFrameStats;
+
+    std::wstring mTracePath;
 };
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "GpuProfiler.h"
+#include "Profiler.h"
+
+GpuProfiler::~GpuProfiler()
+{
+	if (mMappedReadback != nullptr)
+		mReadback->GetResource()->Unmap(0, nullptr);
+}
+
+void GpuProfiler::Init(ID3D12Device5* device, ID3D12CommandQueue* queue, ComPtr<D3D12MA::Allocator> alloc,
+	const string& laneName, UINT maxZones)
+{
+	mQueue = queue;
+	mMaxQueries = maxZones * 2;
+
+	D3D12_QUERY_HEAP_DESC heapDesc = {};
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = mMaxQueries;
+	ThrowIfFailed(device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&mQueryHeap)));
+
+	D3D12MA::ALLOCATION_DESC allocationDesc = {};
+	allocationDesc.HeapType = D3D12_HEAP_TYPE_READBACK;
+
+	auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(mMaxQueries * sizeof(UINT64));
+	ThrowIfFailed(alloc->CreateResource(&allocationDesc, &resourceDesc, D3D12_RESOURCE_STATE_COPY_DEST,
+		NULL, &mReadback, IID_NULL, NULL));
+
+	// Readback heaps can stay mapped, the CPU only reads after waiting on the queue
+	ThrowIfFailed(mReadback->GetResource()->Map(0, nullptr, (void**)&mMappedReadback));
+
+	ThrowIfFailed(mQueue->GetTimestampFrequency(&mFrequency));
+
+	mLane = Profiler::CreateLane(laneName);
+}
+
+void GpuProfiler::BeginZone(ID3D12GraphicsCommandList4* cmdList, const char* name)
+{
+	if (mQueryCount + 2 > mMaxQueries)
+	{
+		// Keeps EndZone balanced, the zone itself is not recorded
+		mOpenZones.push_back(SIZE_MAX);
+		return;
+	}
+
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, mQueryCount);
+	mOpenZones.push_back(mZones.size());
+	mZones.push_back({ name, mQueryCount });
+
+	// The end query is reserved now so nested zones can never leave a zone without one
+	mQueryCount += 2;
+}
+
+void GpuProfiler::EndZone(ID3D12GraphicsCommandList4* cmdList)
+{
+	assert(!mOpenZones.empty());
+
+	size_t zone = mOpenZones.back();
+	mOpenZones.pop_back();
+	if (zone == SIZE_MAX)
+		return;
+
+	mZones[zone].EndQuery = mZones[zone].BeginQuery + 1;
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, mZones[zone].EndQuery);
+}
+
+void GpuProfiler::Resolve(ID3D12GraphicsCommandList4* cmdList)
+{
+	assert(mOpenZones.empty());
+
+	if (mQueryCount > 0)
+		cmdList->ResolveQueryData(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 0, mQueryCount, mReadback->GetResource(), 0);
+
+	mResolved = true;
+}
+
+void GpuProfiler::Collect()
+{
+	if (!mResolved)
+		return;
+
+	// GPU and CPU clocks sampled at the same moment, the profiler timestamp is taken right after
+	UINT64 gpuCalibration = 0;
+	UINT64 cpuCalibration = 0;
+	ThrowIfFailed(mQueue->GetClockCalibration(&gpuCalibration, &cpuCalibration));
+	uint64_t profilerCalibration = Profiler::Timestamp();
+
+	double ticksPerGpuTick = Profiler::GetTicksPerSecond() / mFrequency;
+	auto toProfilerTicks = [&](UINT64 gpuTicks)
+	{
+		double offset = (static_cast<double>(gpuTicks) - static_cast<double>(gpuCalibration)) * ticksPerGpuTick;
+		return static_cast<uint64_t>(static_cast<int64_t>(profilerCalibration) + static_cast<int64_t>(offset));
+	};
+
+	for (const auto& zone : mZones)
+	{
+		UINT64 begin = mMappedReadback[zone.BeginQuery];
+		UINT64 end = mMappedReadback[zone.EndQuery];
+		if (end < begin)
+			continue;
+
+		mLane->Push(Profiler::RegisterZoneName(zone.Name), toProfilerTicks(begin), toProfilerTicks(end));
+	}
+
+	mZones.clear();
+	mQueryCount = 0;
+	mResolved = false;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "stdafx.h"
+
+class ProfileThreadBuffer;
+
+// Timestamp queries around command list ranges on one queue. Resolved ranges are moved onto the CPU profiler
+// timeline through the queue clock calibration and show up as their own lane in exported traces.
+class GpuProfiler
+{
+public:
+	GpuProfiler() = default;
+	~GpuProfiler();
+
+	void Init(ID3D12Device5* device, ID3D12CommandQueue* queue, ComPtr<D3D12MA::Allocator> alloc,
+		const string& laneName, UINT maxZones = 256);
+
+	// Zones may nest, the name must outlive the profiler. Zones past maxZones per collect are dropped.
+	void BeginZone(ID3D12GraphicsCommandList4* cmdList, const char* name);
+	void EndZone(ID3D12GraphicsCommandList4* cmdList);
+
+	// Copies the queries into the readback buffer, record last before closing the command list.
+	void Resolve(ID3D12GraphicsCommandList4* cmdList);
+
+	// Call once the command list with Resolve has finished on the GPU.
+	void Collect();
+
+private:
+	struct GpuZone
+	{
+		const char* Name;
+		UINT BeginQuery;
+		UINT EndQuery = UINT_MAX;
+	};
+
+	ComPtr<ID3D12CommandQueue> mQueue;
+	ComPtr<ID3D12QueryHeap> mQueryHeap;
+	ComPtr<D3D12MA::Allocation> mReadback;
+	UINT64* mMappedReadback = nullptr;
+	UINT64 mFrequency = 0;
+
+	UINT mMaxQueries = 0;
+	UINT mQueryCount = 0;
+	vector<GpuZone> mZones;
+	vector<size_t> mOpenZones;
+	bool mResolved = false;
+
+	ProfileThreadBuffer* mLane = nullptr;
+};
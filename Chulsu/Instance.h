@@ -2,26 +2,16 @@
 #include "stdafx.h"
 #include "Mesh.h"
 #include "SubMesh.h"
-#include "UploadBuffer.h"
 
-struct InstanceConstant
+// Same layout as InstanceData in DefaultRayTrace.hlsl, one entry of the scene's instance buffer.
+// The hit shaders read it through InstanceID(), the index of the instance in AssetManager.
+struct InstanceData
 {
-	UINT GeometryInfoIndex;
+	UINT GeometryInfoIndex;		// Shared by every instance of the mesh.
 
 	UINT VertexAttribIndex;
 	UINT IndexBufferIndex;
-};
-
-struct GeometryInfo
-{
-	UINT VertexOffset;
-	UINT IndexOffset;
-
-	UINT AlbedoTextureIndex;
-	UINT MetalicTextureIndex;
-	UINT RoughnessTextureIndex;
-	UINT NormalMapTextureIndex;
-	UINT OpacityMapTextureIndex;
+	UINT TriangleLODIndex;
 };
 
 class Instance
@@ -31,54 +21,34 @@ public:
 	Instance(XMFLOAT3 position, XMFLOAT3 rotation, XMFLOAT3 scale);
 
 	shared_ptr<Mesh>& GetMesh() { return mMesh; }
-	void SetMesh(shared_ptr<Mesh> mesh) { mMesh = mesh; }
+	void SetMesh(shared_ptr<Mesh> mesh) { mMesh = mesh; mDirty = true; }
 
-	void SetPosition(XMFLOAT3 position) { mPosition = position; }
-	void SetRotation(XMFLOAT3 rotation) { mRotation = rotation; }
-	void SetScale(XMFLOAT3 scale) { mScale = scale; }
+	void SetPosition(XMFLOAT3 position) { mPosition = position; mDirty = true; }
+	void SetRotation(XMFLOAT3 rotation) { mRotation = rotation; mDirty = true; }
+	void SetScale(XMFLOAT3 scale) { mScale = scale; mDirty = true; }
 	void SetHitGroup(UINT hitGroupIndex) { mHitGroupIndex = hitGroupIndex; }
 
 	void Update();
 
-	void BuildConstantBuffer(
-		ID3D12Device5* device,
-		ID3D12GraphicsCommandList4* cmdList,
-		ComPtr<D3D12MA::Allocator> alloc,
-		ResourceStateTracker& tracker,
-		AssetManager& assetMgr);
-
-	void BuildStructuredBuffer(
-		ID3D12Device5* device,
-		ID3D12GraphicsCommandList4* cmdList,
-		ComPtr<D3D12MA::Allocator> alloc,
-		ResourceStateTracker& tracker,
-		AssetManager& assetMgr);
-
-	std::shared_ptr<UploadBuffer<InstanceConstant>> GetInstanceCB() { return mInstanceCB; }
-	std::shared_ptr<UploadBuffer<GeometryInfo>> GetGeometrySB() { return mGeometrySB; }
+	InstanceData GetInstanceData() const;
 
 	const XMFLOAT4X4& GetWorldMatrix() { return mWorld; }
 	const UINT& GetHitGroupIndex() { return mHitGroupIndex; }
 
-private:
-	ComPtr<D3D12MA::Allocation> mConstantBufferAlloc;
-
-	std::shared_ptr<UploadBuffer<InstanceConstant>> mInstanceCB;
-	std::shared_ptr<UploadBuffer<GeometryInfo>> mGeometrySB;
+	// Set whenever the transform or mesh changes and on creation, cleared by whoever consumed the change.
+	bool IsDirty() const { return mDirty; }
+	void ClearDirty() { mDirty = false; }
 
+private:
 	XMFLOAT4X4 mWorld = {};
 
 	XMFLOAT3 mPosition = {0, 0, 0};
 	XMFLOAT3 mRotation = { 0, 0, 0 };
 	XMFLOAT3 mScale = { 1, 1, 1 };
 
-	UINT mAlbedoTextureIndex = UINT_MAX;
-	UINT mMetalicTextureIndex = UINT_MAX;
-	UINT mRoughnessTextureIndex = UINT_MAX;
-	UINT mNormalMapTextureIndex = UINT_MAX;
-	UINT mOpacityMapTextureIndex = UINT_MAX;
-
 	UINT mHitGroupIndex = UINT_MAX;
 
+	bool mDirty = true;
+
 	shared_ptr<Mesh> mMesh;
 };
\ No newline at end of file
@@ -0,0 +1,26 @@
+#pragma once
+#include "stdafx.h"
+
+enum class LightType : UINT
+{
+    DIRECTIONAL_LIGHT = 0,
+    SPOT_LIGHT,
+    POINT_LIGHT,
+};
+
+// Same layout as Light in DefaultRayTrace.hlsl.
+struct Light
+{
+    XMFLOAT3 position;
+    int active;
+
+    XMFLOAT3 direction;
+    float range;
+
+    XMFLOAT3 color;
+    LightType type = LightType::DIRECTIONAL_LIGHT;
+
+    float outerCosine;
+    float innerCosine;
+    int castShadows;
+};
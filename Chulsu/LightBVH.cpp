@@ -0,0 +1,489 @@
+#include "LightBVH.h"
+
+namespace
+{
+	const float kOneMinusEpsilon = 0.99999994f;
+
+	float Axis(const XMFLOAT3& v, UINT axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	float SafeSqrt(float x)
+	{
+		return sqrtf(max(x, 0.0f));
+	}
+
+	float SafeAcos(float x)
+	{
+		return acosf(clamp(x, -1.0f, 1.0f));
+	}
+
+	// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b.
+	float CosSubClamped(float sinA, float cosA, float sinB, float cosB)
+	{
+		if (cosA > cosB)
+			return 1.0f;
+		return cosA * cosB + sinA * sinB;
+	}
+
+	float SinSubClamped(float sinA, float cosA, float sinB, float cosB)
+	{
+		if (cosA > cosB)
+			return 0.0f;
+		return sinA * cosB - cosA * sinB;
+	}
+
+	// Solid angle weighted measure of the directions a cone of lights emits into, the orientation term of the SAOH.
+	float OrientationMeasure(float cosThetaO, float cosThetaE)
+	{
+		float thetaO = SafeAcos(cosThetaO);
+		float thetaE = SafeAcos(cosThetaE);
+		float thetaW = min(thetaO + thetaE, PI);
+		float sinThetaO = SafeSqrt(1.0f - cosThetaO * cosThetaO);
+		return 2.0f * PI * (1.0f - cosThetaO)
+			+ PI / 2.0f * (2.0f * thetaW * sinThetaO - cosf(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinThetaO + cosThetaO);
+	}
+
+	float Luminance(const XMFLOAT3& color)
+	{
+		return max(0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z, 0.0f);
+	}
+}
+
+bool LightBVH::IsSampled(const Light& light)
+{
+	return light.active && (light.type == LightType::POINT_LIGHT || light.type == LightType::SPOT_LIGHT);
+}
+
+LightBVHNode LightBVH::CreateLeaf(const Light& light, UINT lightIndex)
+{
+	LightBVHNode node = {};
+	node.BoundsMin = light.position;
+	node.BoundsMax = light.position;
+	node.LeftFirst = lightIndex;
+	node.Count = 1;
+	node.Range = light.range > 0.0f ? light.range : FLT_MAX;
+
+	float luminance = Luminance(light.color);
+	if (light.type == LightType::SPOT_LIGHT)
+	{
+		// Full intensity inside the inner cone, smoothstep to zero at the outer one
+		float cosInner = clamp(light.innerCosine, -1.0f, 1.0f);
+		float cosOuter = clamp(light.outerCosine, -1.0f, cosInner);
+
+		XMStoreFloat3(&node.Axis, XMVector3Normalize(XMLoadFloat3(&light.direction)));
+		node.CosThetaO = cosInner;
+		node.CosThetaE = cosf(SafeAcos(cosOuter) - SafeAcos(cosInner));
+		node.Flux = luminance * 2.0f * PI * (1.0f - 0.5f * (cosInner + cosOuter));
+	}
+	else
+	{
+		node.Axis = XMFLOAT3(0.0f, 0.0f, 1.0f);
+		node.CosThetaO = -1.0f;
+		node.CosThetaE = 0.0f;
+		node.Flux = luminance * 4.0f * PI;
+	}
+
+	return node;
+}
+
+void LightBVH::Merge(LightBVHNode& node, const LightBVHNode& left, const LightBVHNode& right)
+{
+	node.BoundsMin = XMFLOAT3(min(left.BoundsMin.x, right.BoundsMin.x), min(left.BoundsMin.y, right.BoundsMin.y), min(left.BoundsMin.z, right.BoundsMin.z));
+	node.BoundsMax = XMFLOAT3(max(left.BoundsMax.x, right.BoundsMax.x), max(left.BoundsMax.y, right.BoundsMax.y), max(left.BoundsMax.z, right.BoundsMax.z));
+	node.Flux = left.Flux + right.Flux;
+	node.Range = max(left.Range, right.Range);
+	node.CosThetaE = min(left.CosThetaE, right.CosThetaE);
+
+	// Smallest cone around both cones
+	float thetaA = SafeAcos(left.CosThetaO);
+	float thetaB = SafeAcos(right.CosThetaO);
+	XMVECTOR axisA = XMLoadFloat3(&left.Axis);
+	XMVECTOR axisB = XMLoadFloat3(&right.Axis);
+	float thetaD = SafeAcos(XMVectorGetX(XMVector3Dot(axisA, axisB)));
+
+	if (min(thetaD + thetaB, PI) <= thetaA)
+	{
+		node.Axis = left.Axis;
+		node.CosThetaO = left.CosThetaO;
+		return;
+	}
+	if (min(thetaD + thetaA, PI) <= thetaB)
+	{
+		node.Axis = right.Axis;
+		node.CosThetaO = right.CosThetaO;
+		return;
+	}
+
+	float thetaO = (thetaA + thetaD + thetaB) * 0.5f;
+	XMVECTOR rotationAxis = XMVector3Cross(axisA, axisB);
+	if (thetaO >= PI || XMVectorGetX(XMVector3LengthSq(rotationAxis)) == 0.0f)
+	{
+		node.Axis = left.Axis;
+		node.CosThetaO = -1.0f;
+		return;
+	}
+
+	XMVECTOR rotation = XMQuaternionRotationAxis(XMVector3Normalize(rotationAxis), thetaO - thetaA);
+	XMStoreFloat3(&node.Axis, XMVector3Normalize(XMVector3Rotate(axisA, rotation)));
+	node.CosThetaO = cosf(thetaO);
+}
+
+float LightBVH::SurfaceArea(const LightBVHNode& node)
+{
+	float dx = node.BoundsMax.x - node.BoundsMin.x;
+	float dy = node.BoundsMax.y - node.BoundsMin.y;
+	float dz = node.BoundsMax.z - node.BoundsMin.z;
+	return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+void LightBVH::Build(const vector<Light>& lights)
+{
+	mLights = lights;
+	mNodes.clear();
+	mParents.clear();
+	mLightLeaves.assign(lights.size(), UINT_MAX);
+	mRebuildCount++;
+
+	vector<UINT> indices;
+	for (UINT i = 0; i < lights.size(); ++i)
+		if (IsSampled(lights[i]))
+			indices.push_back(i);
+
+	mLightCount = static_cast<UINT>(indices.size());
+	mBuildArea = 0.0f;
+	mArea = 0.0f;
+	if (mLightCount == 0)
+		return;
+
+	vector<LightBVHNode> leaves(lights.size());
+	for (UINT i : indices)
+		leaves[i] = CreateLeaf(lights[i], i);
+
+	// A tree with one light per leaf always has 2n - 1 nodes
+	mNodes.reserve(static_cast<size_t>(mLightCount) * 2 - 1);
+	mParents.reserve(static_cast<size_t>(mLightCount) * 2 - 1);
+	mNodes.push_back({});
+	mParents.push_back(UINT_MAX);
+
+	struct BuildTask
+	{
+		UINT Node;
+		UINT First;
+		UINT Count;
+		UINT Depth;
+	};
+	vector<BuildTask> tasks;
+	tasks.push_back({ 0, 0, mLightCount, 0 });
+
+	while (!tasks.empty())
+	{
+		BuildTask task = tasks.back();
+		tasks.pop_back();
+
+		if (task.Count == 1)
+		{
+			UINT light = indices[task.First];
+			mNodes[task.Node] = leaves[light];
+			mLightLeaves[light] = task.Node;
+			continue;
+		}
+
+		XMFLOAT3 centroidMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+		XMFLOAT3 centroidMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (UINT i = task.First; i < task.First + task.Count; ++i)
+		{
+			const XMFLOAT3& p = lights[indices[i]].position;
+			centroidMin = XMFLOAT3(min(centroidMin.x, p.x), min(centroidMin.y, p.y), min(centroidMin.z, p.z));
+			centroidMax = XMFLOAT3(max(centroidMax.x, p.x), max(centroidMax.y, p.y), max(centroidMax.z, p.z));
+		}
+
+		float maxExtent = max(max(centroidMax.x - centroidMin.x, centroidMax.y - centroidMin.y), centroidMax.z - centroidMin.z);
+
+		// Binned surface area orientation heuristic over all three axes, bins hold the merged leaves that fall into them
+		float bestCost = FLT_MAX;
+		UINT bestAxis = 0;
+		UINT bestSplit = 0;
+
+		for (UINT axis = 0; axis < 3 && task.Depth < mMaxDepth; ++axis)
+		{
+			float axisMin = Axis(centroidMin, axis);
+			float axisMax = Axis(centroidMax, axis);
+			if (axisMax <= axisMin)
+				continue;
+
+			LightBVHNode bins[mBinCount];
+			UINT binCounts[mBinCount] = {};
+			float scale = mBinCount / (axisMax - axisMin);
+			for (UINT i = task.First; i < task.First + task.Count; ++i)
+			{
+				UINT light = indices[i];
+				UINT b = min(mBinCount - 1, static_cast<UINT>((Axis(lights[light].position, axis) - axisMin) * scale));
+				if (binCounts[b]++ == 0)
+					bins[b] = leaves[light];
+				else
+					Merge(bins[b], LightBVHNode(bins[b]), leaves[light]);
+			}
+
+			// Cost of a side is its power times the space and the directions it covers
+			auto cost = [](const LightBVHNode& node)
+			{
+				return node.Flux * SurfaceArea(node) * OrientationMeasure(node.CosThetaO, node.CosThetaE);
+			};
+
+			float leftCost[mBinCount - 1], rightCost[mBinCount - 1];
+			LightBVHNode leftNode = {}, rightNode = {};
+			UINT leftSum = 0, rightSum = 0;
+			for (UINT i = 0; i < mBinCount - 1; ++i)
+			{
+				if (binCounts[i] > 0)
+				{
+					if (leftSum == 0)
+						leftNode = bins[i];
+					else
+						Merge(leftNode, LightBVHNode(leftNode), bins[i]);
+					leftSum += binCounts[i];
+				}
+				leftCost[i] = leftSum > 0 ? cost(leftNode) : -1.0f;
+
+				UINT r = mBinCount - 1 - i;
+				if (binCounts[r] > 0)
+				{
+					if (rightSum == 0)
+						rightNode = bins[r];
+					else
+						Merge(rightNode, LightBVHNode(rightNode), bins[r]);
+					rightSum += binCounts[r];
+				}
+				rightCost[r - 1] = rightSum > 0 ? cost(rightNode) : -1.0f;
+			}
+
+			// Favours splitting the longest axis so thin clusters of lights are not cut lengthwise
+			float regularization = maxExtent / (axisMax - axisMin);
+			for (UINT i = 0; i < mBinCount - 1; ++i)
+			{
+				if (leftCost[i] < 0.0f || rightCost[i] < 0.0f)
+					continue;
+
+				float splitCost = regularization * (leftCost[i] + rightCost[i]);
+				if (splitCost < bestCost)
+				{
+					bestCost = splitCost;
+					bestAxis = axis;
+					bestSplit = i;
+				}
+			}
+		}
+
+		auto begin = indices.begin() + task.First;
+		auto end = begin + task.Count;
+		UINT leftCount = 0;
+		if (bestCost != FLT_MAX)
+		{
+			float axisMin = Axis(centroidMin, bestAxis);
+			float scale = mBinCount / (Axis(centroidMax, bestAxis) - axisMin);
+			auto middle = partition(begin, end, [&](UINT light)
+				{
+					UINT b = min(mBinCount - 1, static_cast<UINT>((Axis(lights[light].position, bestAxis) - axisMin) * scale));
+					return b <= bestSplit;
+				});
+			leftCount = static_cast<UINT>(middle - begin);
+		}
+
+		// Lights at the same position or past the depth limit are halved, every leaf must end up with a single light
+		if (leftCount == 0 || leftCount == task.Count)
+			leftCount = task.Count / 2;
+
+		UINT leftChild = static_cast<UINT>(mNodes.size());
+		mNodes.push_back({});
+		mNodes.push_back({});
+		mParents.push_back(task.Node);
+		mParents.push_back(task.Node);
+
+		mNodes[task.Node].LeftFirst = leftChild;
+		mNodes[task.Node].Count = 0;
+
+		tasks.push_back({ leftChild, task.First, leftCount, task.Depth + 1 });
+		tasks.push_back({ leftChild + 1, task.First + leftCount, task.Count - leftCount, task.Depth + 1 });
+	}
+
+	// Children always come after their parent, so a reverse sweep merges bottom up
+	for (size_t i = mNodes.size(); i-- > 0;)
+	{
+		LightBVHNode& node = mNodes[i];
+		if (node.Count == 0)
+			Merge(node, mNodes[node.LeftFirst], mNodes[node.LeftFirst + 1]);
+		mBuildArea += SurfaceArea(node);
+	}
+	mArea = mBuildArea;
+}
+
+bool LightBVH::Update(const vector<Light>& lights)
+{
+	if (lights.size() != mLights.size())
+	{
+		Build(lights);
+		return true;
+	}
+
+	vector<UINT> changed;
+	for (UINT i = 0; i < lights.size(); ++i)
+	{
+		if (memcmp(&lights[i], &mLights[i], sizeof(Light)) == 0)
+			continue;
+
+		bool sampled = IsSampled(lights[i]);
+		if (sampled != IsSampled(mLights[i]) || (sampled && lights[i].type != mLights[i].type))
+		{
+			Build(lights);
+			return true;
+		}
+
+		if (sampled)
+			changed.push_back(i);
+	}
+
+	mLights = lights;
+	if (changed.empty())
+		return false;
+
+	// Every ancestor of a changed leaf, refit deepest first
+	vector<UINT> dirtyNodes;
+	for (UINT light : changed)
+	{
+		UINT leaf = mLightLeaves[light];
+		mArea -= SurfaceArea(mNodes[leaf]);
+		mNodes[leaf] = CreateLeaf(lights[light], light);
+		mArea += SurfaceArea(mNodes[leaf]);
+
+		for (UINT node = mParents[leaf]; node != UINT_MAX; node = mParents[node])
+			dirtyNodes.push_back(node);
+	}
+
+	sort(dirtyNodes.begin(), dirtyNodes.end(), greater<UINT>());
+	dirtyNodes.erase(unique(dirtyNodes.begin(), dirtyNodes.end()), dirtyNodes.end());
+
+	for (UINT i : dirtyNodes)
+	{
+		LightBVHNode& node = mNodes[i];
+		mArea -= SurfaceArea(node);
+		Merge(node, mNodes[node.LeftFirst], mNodes[node.LeftFirst + 1]);
+		mArea += SurfaceArea(node);
+	}
+	mRefitCount++;
+
+	// Lights that moved far apart leave large overlapping nodes behind, which makes the importance estimates useless
+	if (mArea > mRebuildAreaRatio * mBuildArea)
+		Build(lights);
+
+	return true;
+}
+
+float LightBVH::Importance(const LightBVHNode& node, const XMFLOAT3& position, const XMFLOAT3& normal)
+{
+	XMVECTOR boundsMin = XMLoadFloat3(&node.BoundsMin);
+	XMVECTOR boundsMax = XMLoadFloat3(&node.BoundsMax);
+	XMVECTOR p = XMLoadFloat3(&position);
+
+	// Nothing below the node reaches past its range
+	XMVECTOR outside = XMVectorMax(XMVectorMax(XMVectorSubtract(boundsMin, p), XMVectorSubtract(p, boundsMax)), XMVectorZero());
+	float outsideDistance2 = XMVectorGetX(XMVector3LengthSq(outside));
+	if (node.Range < FLT_MAX && outsideDistance2 > node.Range * node.Range)
+		return 0.0f;
+
+	XMVECTOR center = XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f);
+	float radius2 = XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(boundsMax, center)));
+	XMVECTOR toPoint = XMVectorSubtract(p, center);
+	float distance2 = XMVectorGetX(XMVector3LengthSq(toPoint));
+
+	// Angle the bounds subtend seen from the shading point, everything when the point is inside
+	float cosThetaB = -1.0f;
+	if (outsideDistance2 > 0.0f && distance2 > radius2)
+		cosThetaB = SafeSqrt(1.0f - radius2 / distance2);
+	float sinThetaB = SafeSqrt(1.0f - cosThetaB * cosThetaB);
+
+	XMVECTOR wi = distance2 > 0.0f ? XMVectorScale(toPoint, 1.0f / sqrtf(distance2)) : XMVectorZero();
+
+	// Smallest angle between the emission cone and the direction towards the point
+	float cosThetaW = distance2 > 0.0f ? XMVectorGetX(XMVector3Dot(XMLoadFloat3(&node.Axis), wi)) : 1.0f;
+	float sinThetaW = SafeSqrt(1.0f - cosThetaW * cosThetaW);
+	float sinThetaO = SafeSqrt(1.0f - node.CosThetaO * node.CosThetaO);
+	float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, node.CosThetaO);
+	float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, node.CosThetaO);
+	float cosThetaP = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+	if (cosThetaP <= node.CosThetaE)
+		return 0.0f;
+
+	// Close to or inside the bounds the distance is no longer meaningful, the node size takes over
+	float importance = node.Flux * cosThetaP / max(distance2, radius2);
+
+	// Smallest angle between the surface normal and any direction towards the bounds, both sides count
+	XMVECTOR n = XMLoadFloat3(&normal);
+	if (XMVectorGetX(XMVector3LengthSq(n)) > 0.0f)
+	{
+		float cosThetaI = fabsf(XMVectorGetX(XMVector3Dot(wi, n)));
+		float sinThetaI = SafeSqrt(1.0f - cosThetaI * cosThetaI);
+		importance *= CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+	}
+
+	return max(importance, 0.0f);
+}
+
+LightSample LightBVH::Sample(const XMFLOAT3& position, const XMFLOAT3& normal, float u) const
+{
+	if (mNodes.empty() || Importance(mNodes[0], position, normal) == 0.0f)
+		return {};
+
+	UINT index = 0;
+	float pdf = 1.0f;
+	while (mNodes[index].Count == 0)
+	{
+		UINT left = mNodes[index].LeftFirst;
+		float leftImportance = Importance(mNodes[left], position, normal);
+		float rightImportance = Importance(mNodes[left + 1], position, normal);
+		if (leftImportance == 0.0f && rightImportance == 0.0f)
+			return {};
+
+		// u is stretched back to [0, 1) after each choice so one number serves the whole descent
+		float leftProbability = leftImportance / (leftImportance + rightImportance);
+		if (u < leftProbability)
+		{
+			index = left;
+			pdf *= leftProbability;
+			u = min(u / leftProbability, kOneMinusEpsilon);
+		}
+		else
+		{
+			index = left + 1;
+			pdf *= 1.0f - leftProbability;
+			u = min((u - leftProbability) / (1.0f - leftProbability), kOneMinusEpsilon);
+		}
+	}
+
+	return { mNodes[index].LeftFirst, pdf };
+}
+
+float LightBVH::Pdf(UINT lightIndex, const XMFLOAT3& position, const XMFLOAT3& normal) const
+{
+	if (lightIndex >= mLightLeaves.size() || mLightLeaves[lightIndex] == UINT_MAX)
+		return 0.0f;
+
+	if (Importance(mNodes[0], position, normal) == 0.0f)
+		return 0.0f;
+
+	// The same choices Sample makes, collected from the leaf up
+	float pdf = 1.0f;
+	for (UINT node = mLightLeaves[lightIndex]; node != 0; node = mParents[node])
+	{
+		UINT left = mNodes[mParents[node]].LeftFirst;
+		float leftImportance = Importance(mNodes[left], position, normal);
+		float rightImportance = Importance(mNodes[left + 1], position, normal);
+		if (leftImportance == 0.0f && rightImportance == 0.0f)
+			return 0.0f;
+
+		float leftProbability = leftImportance / (leftImportance + rightImportance);
+		pdf *= node == left ? leftProbability : 1.0f - leftProbability;
+	}
+	return pdf;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "stdafx.h"
+#include "Light.h"
+
+// Same layout as LightBVHNode in Shaders/LightBVH.hlsli.
+// Bounds every light below the node in space, in emitted direction and in power, so a shading point
+// can estimate how much the subtree may contribute without looking at the lights themselves.
+struct LightBVHNode
+{
+	XMFLOAT3 BoundsMin;
+	UINT LeftFirst;		// First child when Count is 0, index into the light array otherwise. Children are stored adjacently.
+	XMFLOAT3 BoundsMax;
+	UINT Count;			// 1 for leaves, every leaf holds exactly one light.
+	XMFLOAT3 Axis;
+	float Flux;
+	float CosThetaO;	// Every light emits within ThetaO of Axis,
+	float CosThetaE;	// and falls off to zero within ThetaE past that.
+	float Range;		// Largest light range below the node, FLT_MAX when any of them is unbounded.
+	UINT Pad;
+};
+
+struct LightSample
+{
+	UINT LightIndex = UINT_MAX;		// UINT_MAX when no light can reach the shading point.
+	float Pdf = 0.0f;
+};
+
+// Binary BVH over the point and spot lights, for picking one light per shading point in proportion to an
+// estimate of its contribution (Conty Estevez and Kulla, Importance Sampling of Many Lights with Adaptive Tree Splitting).
+// Directional and inactive lights are left out, they are shaded separately.
+class LightBVH
+{
+public:
+	LightBVH() = default;
+	~LightBVH() = default;
+
+	void Build(const vector<Light>& lights);
+
+	// Rebuilds when lights were added, removed, switched on or off or changed type, and when refitting has let the tree
+	// degrade too far. Otherwise only the ancestors of lights that changed are refit.
+	// Returns true when the nodes changed and have to be uploaded again.
+	bool Update(const vector<Light>& lights);
+
+	// Walks from the root choosing a child in proportion to its importance. normal may be zero for points
+	// that are not on a surface. u in [0, 1) is the only random number used.
+	LightSample Sample(const XMFLOAT3& position, const XMFLOAT3& normal, float u) const;
+
+	// Probability of Sample picking lightIndex at the same shading point.
+	float Pdf(UINT lightIndex, const XMFLOAT3& position, const XMFLOAT3& normal) const;
+
+	// Upper bound estimate of what the lights below node contribute at position, zero only when none of them can.
+	static float Importance(const LightBVHNode& node, const XMFLOAT3& position, const XMFLOAT3& normal);
+
+	// Active point and spot lights.
+	static bool IsSampled(const Light& light);
+
+	const vector<LightBVHNode>& GetNodes() const { return mNodes; }
+	UINT GetLightCount() const { return mLightCount; }
+	UINT GetRebuildCount() const { return mRebuildCount; }
+	UINT GetRefitCount() const { return mRefitCount; }
+
+private:
+	static LightBVHNode CreateLeaf(const Light& light, UINT lightIndex);
+	static void Merge(LightBVHNode& node, const LightBVHNode& left, const LightBVHNode& right);
+	static float SurfaceArea(const LightBVHNode& node);
+
+	static const UINT mBinCount = 12;
+	static const UINT mMaxDepth = 64;
+	// Rebuild once refits have grown the summed surface area of the tree past this factor of the built one.
+	static constexpr float mRebuildAreaRatio = 2.0f;
+
+	vector<LightBVHNode> mNodes;
+	vector<UINT> mParents;
+	vector<UINT> mLightLeaves;		// Leaf of every light, UINT_MAX for lights that are not in the tree.
+
+	vector<Light> mLights;			// What the tree was last built or refit from, to find the lights that changed.
+	UINT mLightCount = 0;
+
+	float mBuildArea = 0.0f;
+	float mArea = 0.0f;
+
+	UINT mRebuildCount = 0;
+	UINT mRefitCount = 0;
+};
@@ -0,0 +1,190 @@
+#include "LightGrid.h"
+#include "LightBVH.h"
+
+namespace
+{
+	const float kCellPadding = 1e-3f;
+}
+
+bool LightGrid::Overlaps(const Light& light, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax)
+{
+	XMVECTOR position = XMLoadFloat3(&light.position);
+	XMVECTOR minV = XMLoadFloat3(&boxMin);
+	XMVECTOR maxV = XMLoadFloat3(&boxMax);
+
+	// Range sphere against the box, the window in LocalLightRadiance is zero from range on
+	if (light.range > 0.0f)
+	{
+		XMVECTOR outside = XMVectorMax(XMVectorMax(XMVectorSubtract(minV, position), XMVectorSubtract(position, maxV)), XMVectorZero());
+		if (XMVectorGetX(XMVector3LengthSq(outside)) >= light.range * light.range)
+			return false;
+	}
+
+	if (light.type != LightType::SPOT_LIGHT)
+		return true;
+
+	// Spot cone against the bounding sphere of the box, nothing is lit beyond the outer angle
+	XMVECTOR center = XMVectorScale(XMVectorAdd(minV, maxV), 0.5f);
+	float radius = XMVectorGetX(XMVector3Length(XMVectorSubtract(maxV, center)));
+
+	XMVECTOR axis = XMVector3Normalize(XMLoadFloat3(&light.direction));
+	XMVECTOR toCenter = XMVectorSubtract(center, position);
+	float lengthSq = XMVectorGetX(XMVector3LengthSq(toCenter));
+	float alongAxis = XMVectorGetX(XMVector3Dot(toCenter, axis));
+
+	float cosAngle = clamp(light.outerCosine, -1.0f, 1.0f);
+	float sinAngle = sqrtf(1.0f - cosAngle * cosAngle);
+
+	// Signed distance from the center to the cone's side, never more than the true distance
+	float distance = cosAngle * sqrtf(max(lengthSq - alongAxis * alongAxis, 0.0f)) - alongAxis * sinAngle;
+	if (distance > radius)
+		return false;
+
+	// Behind the apex only matters for cones narrower than a hemisphere
+	if (cosAngle >= 0.0f && alongAxis < -radius)
+		return false;
+
+	return true;
+}
+
+void LightGrid::Build(const vector<Light>& lights)
+{
+	mHeader = {};
+	mCells.clear();
+	mLightIndices.clear();
+	mMaxCellCount = 0;
+
+	// Bounds of everything the lights with a range can reach
+	vector<UINT> bounded;
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	for (UINT i = 0; i < lights.size(); ++i)
+	{
+		if (!LightBVH::IsSampled(lights[i]))
+			continue;
+
+		if (lights[i].range <= 0.0f)
+		{
+			mLightIndices.push_back(i);
+			continue;
+		}
+
+		XMVECTOR position = XMLoadFloat3(&lights[i].position);
+		XMVECTOR range = XMVectorReplicate(lights[i].range);
+		boundsMin = XMVectorMin(boundsMin, XMVectorSubtract(position, range));
+		boundsMax = XMVectorMax(boundsMax, XMVectorAdd(position, range));
+		bounded.push_back(i);
+	}
+	mHeader.GlobalCount = static_cast<UINT>(mLightIndices.size());
+
+	if (bounded.empty())
+	{
+		// A single empty cell keeps the shader's lookups valid
+		mHeader.Dimensions = XMUINT3(1, 1, 1);
+		mHeader.CellCount = 1;
+		mCells.push_back({ mHeader.GlobalCount, 0 });
+		mHeader.IndexCount = static_cast<UINT>(mLightIndices.size());
+		return;
+	}
+
+	XMFLOAT3 extent;
+	XMStoreFloat3(&extent, XMVectorSubtract(boundsMax, boundsMin));
+	XMStoreFloat3(&mHeader.BoundsMin, boundsMin);
+
+	// Roughly cubic cells, grown until the cell count fits
+	float maxExtent = max(extent.x, max(extent.y, extent.z));
+	float cellSize = max(cbrtf(extent.x * extent.y * extent.z / mMaxCells), maxExtent / mMaxCellsPerAxis);
+	auto cellsAlong = [&](float e) { return clamp(static_cast<UINT>(ceilf(e / cellSize)), 1u, mMaxCellsPerAxis); };
+	while (true)
+	{
+		mHeader.Dimensions = XMUINT3(cellsAlong(extent.x), cellsAlong(extent.y), cellsAlong(extent.z));
+		mHeader.CellCount = mHeader.Dimensions.x * mHeader.Dimensions.y * mHeader.Dimensions.z;
+		if (mHeader.CellCount <= mMaxCells)
+			break;
+		cellSize *= 1.1f;
+	}
+
+	// Cells are cut from the whole extent, so the grid covers the bounds exactly
+	XMFLOAT3 cellExtent(extent.x / mHeader.Dimensions.x, extent.y / mHeader.Dimensions.y, extent.z / mHeader.Dimensions.z);
+	mHeader.InvCellSize = XMFLOAT3(1.0f / cellExtent.x, 1.0f / cellExtent.y, 1.0f / cellExtent.z);
+
+	const XMUINT3& dims = mHeader.Dimensions;
+	auto cellBounds = [&](UINT x, UINT y, UINT z, XMFLOAT3& cellMin, XMFLOAT3& cellMax)
+	{
+		// Padded a little, points on a face may round into either cell
+		cellMin = XMFLOAT3(mHeader.BoundsMin.x + (x - kCellPadding) * cellExtent.x, mHeader.BoundsMin.y + (y - kCellPadding) * cellExtent.y,
+			mHeader.BoundsMin.z + (z - kCellPadding) * cellExtent.z);
+		cellMax = XMFLOAT3(cellMin.x + (1.0f + 2.0f * kCellPadding) * cellExtent.x, cellMin.y + (1.0f + 2.0f * kCellPadding) * cellExtent.y,
+			cellMin.z + (1.0f + 2.0f * kCellPadding) * cellExtent.z);
+	};
+
+	// Visits the cells a light may reach, clamped to the grid
+	auto forEachCell = [&](const Light& light, auto&& visit)
+	{
+		auto cellOf = [&](float v, float boundsMin, float invCellSize, UINT count)
+		{
+			return static_cast<UINT>(clamp((v - boundsMin) * invCellSize, 0.0f, static_cast<float>(count - 1)));
+		};
+
+		XMUINT3 first(cellOf(light.position.x - light.range, mHeader.BoundsMin.x, mHeader.InvCellSize.x, dims.x),
+			cellOf(light.position.y - light.range, mHeader.BoundsMin.y, mHeader.InvCellSize.y, dims.y),
+			cellOf(light.position.z - light.range, mHeader.BoundsMin.z, mHeader.InvCellSize.z, dims.z));
+		XMUINT3 last(cellOf(light.position.x + light.range, mHeader.BoundsMin.x, mHeader.InvCellSize.x, dims.x),
+			cellOf(light.position.y + light.range, mHeader.BoundsMin.y, mHeader.InvCellSize.y, dims.y),
+			cellOf(light.position.z + light.range, mHeader.BoundsMin.z, mHeader.InvCellSize.z, dims.z));
+
+		XMFLOAT3 cellMin, cellMax;
+		for (UINT z = first.z; z <= last.z; ++z)
+			for (UINT y = first.y; y <= last.y; ++y)
+				for (UINT x = first.x; x <= last.x; ++x)
+				{
+					cellBounds(x, y, z, cellMin, cellMax);
+					if (Overlaps(light, cellMin, cellMax))
+						visit((z * dims.y + y) * dims.x + x);
+				}
+	};
+
+	// Overlap tests run once, then a counting sort by cell keeps every list in light order
+	vector<pair<UINT, UINT>> references;
+	for (UINT i : bounded)
+		forEachCell(lights[i], [&](UINT cell) { references.emplace_back(cell, i); });
+
+	mCells.assign(mHeader.CellCount, { 0, 0 });
+	for (const auto& [cell, light] : references)
+		mCells[cell].Count++;
+
+	UINT offset = mHeader.GlobalCount;
+	for (LightGridCell& cell : mCells)
+	{
+		cell.Offset = offset;
+		offset += cell.Count;
+		mMaxCellCount = max(mMaxCellCount, cell.Count);
+		cell.Count = 0;
+	}
+
+	mLightIndices.resize(offset);
+	for (const auto& [cell, light] : references)
+		mLightIndices[mCells[cell].Offset + mCells[cell].Count++] = light;
+
+	mHeader.IndexCount = static_cast<UINT>(mLightIndices.size());
+}
+
+LightGridCell LightGrid::FindCell(const XMFLOAT3& position) const
+{
+	float x = (position.x - mHeader.BoundsMin.x) * mHeader.InvCellSize.x;
+	float y = (position.y - mHeader.BoundsMin.y) * mHeader.InvCellSize.y;
+	float z = (position.z - mHeader.BoundsMin.z) * mHeader.InvCellSize.z;
+	const XMUINT3& dims = mHeader.Dimensions;
+	if (mCells.empty() || !(x >= 0.0f && y >= 0.0f && z >= 0.0f && x < dims.x && y < dims.y && z < dims.z))
+		return { mHeader.GlobalCount, 0 };
+
+	return mCells[(static_cast<UINT>(z) * dims.y + static_cast<UINT>(y)) * dims.x + static_cast<UINT>(x)];
+}
+
+UINT LightGrid::GetLights(const XMFLOAT3& position, vector<UINT>& lightIndices) const
+{
+	LightGridCell cell = FindCell(position);
+	lightIndices.assign(mLightIndices.begin(), mLightIndices.begin() + mHeader.GlobalCount);
+	lightIndices.insert(lightIndices.end(), mLightIndices.begin() + cell.Offset, mLightIndices.begin() + cell.Offset + cell.Count);
+	return static_cast<UINT>(lightIndices.size());
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "stdafx.h"
+#include "Light.h"
+
+// Same layout as LightGridHeader in Shaders/LightGrid.hlsli.
+struct LightGridHeader
+{
+	XMFLOAT3 BoundsMin;
+	UINT GlobalCount;		// Lights without a range, they come first in the index list and reach every cell.
+	XMFLOAT3 InvCellSize;
+	UINT CellCount;
+	XMUINT3 Dimensions;
+	UINT IndexCount;
+};
+
+// Same layout as LightGridCell in Shaders/LightGrid.hlsli.
+struct LightGridCell
+{
+	UINT Offset;			// Into the index list, past the global lights.
+	UINT Count;
+};
+
+// World space grid over the reach of the point and spot lights. Every cell lists the lights whose range sphere
+// and cone may touch it, so shading a point only has to look at the lights of its cell.
+// The lights without a range come first, then the cell's list sorted by light index. Shading it adds the lights up in the
+// same order as a loop over the global lights followed by all the others, so culling alone cannot change the sum.
+class LightGrid
+{
+public:
+	LightGrid() = default;
+	~LightGrid() = default;
+
+	// Bins the lights LightBVH::IsSampled accepts, directional and inactive lights are left out.
+	void Build(const vector<Light>& lights);
+
+	// Same lookup as FindLightGridCell in Shaders/LightGrid.hlsli, a cell without lights when position is outside the grid.
+	LightGridCell FindCell(const XMFLOAT3& position) const;
+
+	// The lights that may reach position, global lights first. Positions outside the grid only see the global lights.
+	// Returns the number of indices written, at most GetMaxLightsPerPoint.
+	UINT GetLights(const XMFLOAT3& position, vector<UINT>& lightIndices) const;
+
+	// True unless the light certainly contributes nothing inside the box.
+	static bool Overlaps(const Light& light, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax);
+
+	const LightGridHeader& GetHeader() const { return mHeader; }
+	const vector<LightGridCell>& GetCells() const { return mCells; }
+	const vector<UINT>& GetLightIndices() const { return mLightIndices; }
+	UINT GetMaxLightsPerPoint() const { return mHeader.GlobalCount + mMaxCellCount; }
+
+	// Upper bound on the cell count, the GPU cell buffer is allocated once at this size.
+	static const UINT mMaxCells = 16384;
+
+private:
+	// Cells per axis, the grid is cut into roughly cubic cells within this limit.
+	static const UINT mMaxCellsPerAxis = 64;
+
+	LightGridHeader mHeader = {};
+	vector<LightGridCell> mCells;
+	vector<UINT> mLightIndices;
+	UINT mMaxCellCount = 0;
+};
@@ -2,20 +2,196 @@
 
 void LightManager::Init(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker, AssetManager& assetMgr, UINT lightReserve)
 {
-	mNumReservedLights = lightReserve;
-	mLights.reserve(mNumReservedLights);
-	mLightSB = std::make_shared<UploadBuffer<Light>>(device, cmdList, mNumReservedLights, alloc, tracker, assetMgr, false);
+	mDevice = device;
+	mCmdList = cmdList;
+	mAllocator = alloc;
+	mTracker = &tracker;
+	mAssetMgr = &assetMgr;
+
+	mLightIndex = assetMgr.GetCurrentHeapIndex();
+	for (UINT i = 0; i < 5; ++i)
+		assetMgr.AddCurrentHeapIndex();
+
+	// The cell count is bounded, only the index list grows with the lights
+	mLightGrid.Build(mLights);
+	mLightGridHeaderSB = std::make_shared<UploadBuffer<LightGridHeader>>(mDevice, mCmdList, 1, mAllocator, *mTracker, *mAssetMgr, false);
+	mLightGridCellSB = std::make_shared<UploadBuffer<LightGridCell>>(mDevice, mCmdList, LightGrid::mMaxCells, mAllocator, *mTracker, *mAssetMgr, false);
+	mLightGridIndexSB = std::make_shared<UploadBuffer<UINT>>(mDevice, mCmdList, max(1u, lightReserve), mAllocator, *mTracker, *mAssetMgr, false);
+
+	mLights.reserve(lightReserve);
+	Reserve(max(1u, lightReserve));
+	UploadLightGrid();
+}
+
+void LightManager::Reserve(UINT lightCount)
+{
+	mNumReservedLights = lightCount;
+	mLightSB = std::make_shared<UploadBuffer<Light>>(mDevice, mCmdList, mNumReservedLights, mAllocator, *mTracker, *mAssetMgr, false);
+
+	// One light per leaf, so the tree never has more than 2n - 1 nodes
+	mLightBVHSB = std::make_shared<UploadBuffer<LightBVHNode>>(mDevice, mCmdList, 2 * mNumReservedLights - 1, mAllocator, *mTracker, *mAssetMgr, false);
+
+	CreateViews();
+
+	// The new buffers start out empty
+	for (UINT i = 0; i < mLights.size(); ++i)
+		MarkDirty(i);
+	if (!mLightBVH.GetNodes().empty())
+		mLightBVHSB->CopyData(0, mLightBVH.GetNodes().data(), static_cast<UINT>(mLightBVH.GetNodes().size()));
+}
+
+void LightManager::CreateViews()
+{
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+
+	// Views cover the whole buffer, lights added later are indexed by the light BVH without a new descriptor
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = mLightSB->GetCount();
+	srvDesc.Buffer.StructureByteStride = sizeof(Light);
+	srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+	mDevice->CreateShaderResourceView(mLightSB->GetUploadAllocation()->GetResource(), &srvDesc, mAssetMgr->GetIndexedCPUHandle(GetLightIndex()));
+
+	srvDesc.Buffer.NumElements = mLightBVHSB->GetCount();
+	srvDesc.Buffer.StructureByteStride = sizeof(LightBVHNode);
+	mDevice->CreateShaderResourceView(mLightBVHSB->GetUploadAllocation()->GetResource(), &srvDesc, mAssetMgr->GetIndexedCPUHandle(GetLightBVHIndex()));
+
+	srvDesc.Buffer.NumElements = mLightGridHeaderSB->GetCount();
+	srvDesc.Buffer.StructureByteStride = sizeof(LightGridHeader);
+	mDevice->CreateShaderResourceView(mLightGridHeaderSB->GetUploadAllocation()->GetResource(), &srvDesc, mAssetMgr->GetIndexedCPUHandle(GetLightGridIndex()));
+
+	srvDesc.Buffer.NumElements = mLightGridCellSB->GetCount();
+	srvDesc.Buffer.StructureByteStride = sizeof(LightGridCell);
+	mDevice->CreateShaderResourceView(mLightGridCellSB->GetUploadAllocation()->GetResource(), &srvDesc, mAssetMgr->GetIndexedCPUHandle(GetLightGridIndex() + 1));
+
+	srvDesc.Buffer.NumElements = mLightGridIndexSB->GetCount();
+	srvDesc.Buffer.StructureByteStride = sizeof(UINT);
+	mDevice->CreateShaderResourceView(mLightGridIndexSB->GetUploadAllocation()->GetResource(), &srvDesc, mAssetMgr->GetIndexedCPUHandle(GetLightGridIndex() + 2));
 }
 
-void LightManager::AddLight(XMFLOAT3 position, XMFLOAT3 direction, XMFLOAT3 color, bool active, float range, LightType type, float outerCosine, float innerCosine, bool castShadows)
+void LightManager::UploadLightGrid()
 {
-	mLights.emplace_back(position, active, direction, range, color, type, outerCosine, innerCosine, castShadows);
+	const LightGridHeader& header = mLightGrid.GetHeader();
+	if (header.IndexCount > mLightGridIndexSB->GetCount())
+	{
+		mLightGridIndexSB = std::make_shared<UploadBuffer<UINT>>(mDevice, mCmdList, max(header.IndexCount, mLightGridIndexSB->GetCount() * 2),
+			mAllocator, *mTracker, *mAssetMgr, false);
+		CreateViews();
+	}
+
+	mLightGridHeaderSB->CopyData(0, header);
+	mLightGridCellSB->CopyData(0, mLightGrid.GetCells().data(), header.CellCount);
+	if (header.IndexCount > 0)
+		mLightGridIndexSB->CopyData(0, mLightGrid.GetLightIndices().data(), header.IndexCount);
 }
 
-void LightManager::Update()
+LightHandle LightManager::AddLight(const Light& light)
 {
-	for (int i = 0; i < mLights.size(); ++i)
+	UINT index;
+	if (!mFreeSlots.empty())
+	{
+		index = mFreeSlots.back();
+		mFreeSlots.pop_back();
+		mLights[index] = light;
+	}
+	else
 	{
-		mLightSB->CopyData(i, mLights[i]);
+		index = static_cast<UINT>(mLights.size());
+		mLights.push_back(light);
+		mGenerations.push_back(0);
+		mDirty.push_back(false);
 	}
+
+	MarkDirty(index);
+	return { index, mGenerations[index] };
+}
+
+LightHandle LightManager::AddLight(XMFLOAT3 position, XMFLOAT3 direction, XMFLOAT3 color, bool active, float range, LightType type, float outerCosine, float innerCosine, bool castShadows)
+{
+	return AddLight(Light{ position, active, direction, range, color, type, outerCosine, innerCosine, castShadows });
+}
+
+void LightManager::RemoveLight(LightHandle handle)
+{
+	if (!IsValid(handle))
+		return;
+
+	// The slot stays in the buffer as an inactive light until a new light reuses it
+	mLights[handle.Index] = Light{};
+	mGenerations[handle.Index]++;
+	mFreeSlots.push_back(handle.Index);
+	MarkDirty(handle.Index);
+}
+
+bool LightManager::IsValid(LightHandle handle) const
+{
+	return handle.Index < mLights.size() && mGenerations[handle.Index] == handle.Generation;
+}
+
+const Light& LightManager::GetLight(LightHandle handle) const
+{
+	assert(IsValid(handle));
+	return mLights[handle.Index];
+}
+
+void LightManager::SetLight(LightHandle handle, const Light& light)
+{
+	if (!IsValid(handle))
+		return;
+
+	mLights[handle.Index] = light;
+	MarkDirty(handle.Index);
+}
+
+void LightManager::MarkDirty(UINT index)
+{
+	mDirty[index] = true;
+	mAnyDirty = true;
+}
+
+bool LightManager::Update()
+{
+	if (!mAnyDirty)
+		return false;
+
+	if (mLights.size() > mNumReservedLights)
+		Reserve(max(static_cast<UINT>(mLights.size()), mNumReservedLights * 2));
+
+	// Dirty runs separated by a short clean gap are merged, one larger copy beats several small ones
+	const UINT count = static_cast<UINT>(mLights.size());
+	UINT first = 0;
+	while (first < count)
+	{
+		if (!mDirty[first])
+		{
+			++first;
+			continue;
+		}
+
+		UINT end = first + 1;
+		for (UINT next = end; next < count && next - end <= mMaxCoalesceGap; ++next)
+		{
+			if (mDirty[next])
+				end = next + 1;
+		}
+
+		mLightSB->CopyData(first, &mLights[first], end - first);
+		fill(mDirty.begin() + first, mDirty.begin() + end, false);
+		first = end;
+	}
+	mAnyDirty = false;
+
+	if (!mLightBVH.Update(mLights))
+		return false;
+
+	const vector<LightBVHNode>& nodes = mLightBVH.GetNodes();
+	if (!nodes.empty())
+		mLightBVHSB->CopyData(0, nodes.data(), static_cast<UINT>(nodes.size()));
+
+	// Same lights as the BVH, so it only changes when the BVH does
+	mLightGrid.Build(mLights);
+	UploadLightGrid();
+	return true;
 }
@@ -1,28 +1,16 @@
 #pragma once
 #include "stdafx.h"
 #include "UploadBuffer.h"
+#include "Light.h"
+#include "LightBVH.h"
+#include "LightGrid.h"
 
-enum class LightType : UINT
+// Stable reference to a light, it keeps pointing at the same light while others are added and removed.
+// The generation tells a handle to a removed light apart from a new light that reused its slot.
+struct LightHandle
 {
-    DIRECTIONAL_LIGHT = 0,
-    SPOT_LIGHT,
-    POINT_LIGHT,
-};
-
-struct Light
-{
-    XMFLOAT3 position;
-    int active;
-
-    XMFLOAT3 direction;
-    float range;
-
-    XMFLOAT3 color;
-    LightType type = LightType::DIRECTIONAL_LIGHT;
-
-    float outerCosine;
-    float innerCosine;
-    int castShadows;
+    UINT Index = UINT_MAX;
+    UINT Generation = 0;
 };
 
 class LightManager
@@ -31,23 +19,73 @@ public:
     LightManager() = default;
     ~LightManager() = default;
 
+    // Reserves five consecutive descriptors: lights, light BVH, light grid header, cells and indices.
+    // The views stay at those indices when the buffers grow.
     void Init(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList,
         ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker, AssetManager& assetMgr, UINT lightReserve);
 
-    shared_ptr<UploadBuffer<Light>> GetLightSB() { return mLightSB; }
-    vector<Light> GetLights() { return mLights; }
-    void AddLight(Light light) { mLights.push_back(light); }
-    void AddLight(XMFLOAT3 position, XMFLOAT3 direction, XMFLOAT3 color,
+    LightHandle AddLight(const Light& light);
+    LightHandle AddLight(XMFLOAT3 position, XMFLOAT3 direction, XMFLOAT3 color,
         bool active, float range, LightType type, float outerCosine, float innerCosine, bool castShadows);
+    void RemoveLight(LightHandle handle);
+
+    bool IsValid(LightHandle handle) const;
+    const Light& GetLight(LightHandle handle) const;
+    void SetLight(LightHandle handle, const Light& light);
+
+    // Indexed by LightHandle::Index, removed lights leave an inactive slot behind.
+    const vector<Light>& GetLights() const { return mLights; }
+    const LightBVH& GetLightBVH() const { return mLightBVH; }
+    const LightGrid& GetLightGrid() const { return mLightGrid; }
+    UINT GetLightCapacity() const { return mNumReservedLights; }
+
+    UINT GetLightIndex() const { return mLightIndex; }
+    UINT GetLightBVHIndex() const { return mLightIndex + 1; }
+    // The cell and index views follow the header at the next two indices.
+    UINT GetLightGridIndex() const { return mLightIndex + 2; }
 
     void SetControlableLight(Light light) { mControlableLight = light; }
 
-    void Update();
+    // Uploads the lights changed since the last call, consecutive changes go out as one copy.
+    // Returns true when the light BVH and grid changed, i.e. a point or spot light was added, removed or modified.
+    bool Update();
 
 private:
-    UINT mNumReservedLights;
+    void MarkDirty(UINT index);
+    // Replaces both buffers with ones that hold at least lightCount lights and points the views at them.
+    // The old buffers are released right away, so the GPU must not be using them.
+    void Reserve(UINT lightCount);
+    void CreateViews();
+    // Grows the index buffer when the grid no longer fits.
+    void UploadLightGrid();
+
+    // Clean lights between two dirty ones are copied along when the gap is at most this long.
+    static const UINT mMaxCoalesceGap = 8;
+
+    ID3D12Device5* mDevice = nullptr;
+    ID3D12GraphicsCommandList4* mCmdList = nullptr;
+    ComPtr<D3D12MA::Allocator> mAllocator;
+    ResourceStateTracker* mTracker = nullptr;
+    AssetManager* mAssetMgr = nullptr;
+
+    UINT mNumReservedLights = 0;
+    UINT mLightIndex = UINT_MAX;
 
     Light mControlableLight;
     vector<Light> mLights;
+    vector<UINT> mGenerations;
+    vector<UINT> mFreeSlots;
+
+    vector<bool> mDirty;
+    bool mAnyDirty = false;
+
     shared_ptr<UploadBuffer<Light>> mLightSB;
-};
\ No newline at end of file
+
+    LightBVH mLightBVH;
+    shared_ptr<UploadBuffer<LightBVHNode>> mLightBVHSB;
+
+    LightGrid mLightGrid;
+    shared_ptr<UploadBuffer<LightGridHeader>> mLightGridHeaderSB;
+    shared_ptr<UploadBuffer<LightGridCell>> mLightGridCellSB;
+    shared_ptr<UploadBuffer<UINT>> mLightGridIndexSB;
+};
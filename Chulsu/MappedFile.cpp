@@ -0,0 +1,54 @@
+#include "MappedFile.h"
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const wstring& path)
+{
+	Close();
+
+	mFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	mData = static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (mData == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	mSize = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData)
+		UnmapViewOfFile(mData);
+	if (mMapping)
+		CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+
+	mFile = INVALID_HANDLE_VALUE;
+	mMapping = nullptr;
+	mData = nullptr;
+	mSize = 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "stdafx.h"
+
+// Read only view of a whole file mapped into the address space.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const wstring& path);
+	void Close();
+
+	const uint8_t* GetData() const { return mData; }
+	size_t GetSize() const { return mSize; }
+
+private:
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+
+	const uint8_t* mData = nullptr;
+	size_t mSize = 0;
+};
@@ -0,0 +1,14 @@
+#include "Material.h"
+
+// Only four byte fields, so the bytes of equal materials are equal too
+static_assert(sizeof(Material) == 12 * sizeof(UINT), "Material has padding");
+
+UINT MaterialTable::Add(const Material& material)
+{
+	string key(reinterpret_cast<const char*>(&material), sizeof(Material));
+	auto [found, inserted] = mIndices.try_emplace(std::move(key), static_cast<UINT>(mMaterials.size()));
+	if (inserted)
+		mMaterials.push_back(material);
+
+	return found->second;
+}
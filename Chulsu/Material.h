@@ -1,9 +1,49 @@
 #pragma once
 #include "stdafx.h"
-#include "Texture.h"
 
-class Material
+enum MATERIAL_ALPHA_MODE
 {
+	ALPHA_MODE_OPAQUE,
+	ALPHA_MODE_MASK		// Texels of the opacity map below AlphaCutoff are discarded by the any-hit shader.
+};
+
+// Cutoff of alpha tested materials that do not bring their own.
+const float DefaultAlphaCutoff = 0.35f;
+
+// Same layout as Material in DefaultRayTrace.hlsl, one entry of the scene's material table.
+// The scalars stand in for their texture when its index is UINT_MAX.
+struct Material
+{
+	XMFLOAT3 BaseColor = { 1.0f, 1.0f, 1.0f };
+	UINT AlbedoTextureIndex = UINT_MAX;
+
+	float Metalic = 0.0f;
+	float Roughness = 1.0f;
+	UINT MetalicTextureIndex = UINT_MAX;
+	UINT RoughnessTextureIndex = UINT_MAX;
+
+	UINT NormalMapTextureIndex = UINT_MAX;
+	UINT OpacityMapTextureIndex = UINT_MAX;
+	UINT AlphaMode = ALPHA_MODE_OPAQUE;		// MATERIAL_ALPHA_MODE
+	float AlphaCutoff = DefaultAlphaCutoff;
+};
+
+// Every distinct material of the scene once, meshes refer to them by their index.
+// Materials are compared bit for bit, so two assimp materials pointing at the same textures with the same factors share an entry.
+class MaterialTable
+{
+public:
+	MaterialTable() = default;
+	~MaterialTable() = default;
+
+	// Index of the equal material already in the table, or of the material appended for it.
+	UINT Add(const Material& material);
+
+	const Material& Get(UINT index) const { return mMaterials[index]; }
+	const vector<Material>& GetMaterials() const { return mMaterials; }
+	UINT GetCount() const { return static_cast<UINT>(mMaterials.size()); }
+
 private:
-	map<aiTextureType, Texture> mTextureMap;
-};
\ No newline at end of file
+	vector<Material> mMaterials;
+	unordered_map<string, UINT> mIndices;	// Bytes of the material to its index.
+};
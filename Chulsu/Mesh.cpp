@@ -34,6 +34,43 @@ void Mesh::InitializeBuffers(
 	}
 }
 
+void Mesh::InitializeTriangleLODBuffer(
+	ID3D12Device5* device,
+	ID3D12GraphicsCommandList4* cmdList,
+	ComPtr<D3D12MA::Allocator> alloc,
+	ResourceStateTracker& tracker,
+	AssetManager& assetMgr,
+	const vector<float>& triangleLOD)
+{
+	mTriangleCount = static_cast<UINT>(triangleLOD.size());
+	if (mTriangleCount == 0)
+		return;
+
+	mTriangleLODBufferAlloc = assetMgr.CreateResource(device, cmdList, alloc, tracker, triangleLOD.data(), mTriangleCount * sizeof(float), 1,
+		D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_DIMENSION_BUFFER, DXGI_FORMAT_UNKNOWN, D3D12_TEXTURE_LAYOUT_ROW_MAJOR, D3D12_RESOURCE_FLAG_NONE);
+}
+
+void Mesh::BuildGeometryInfo(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker, AssetManager& assetMgr)
+{
+	mGeometrySB = std::make_shared<UploadBuffer<GeometryInfo>>(device, cmdList, GetSubMeshCount(), alloc, tracker, assetMgr, false);
+
+	for (UINT i = 0; i < mSubMeshes.size(); ++i)
+		mGeometrySB->CopyData(i, GeometryInfo{ mSubMeshes[i].GetVertexOffset(), mSubMeshes[i].GetIndexOffset(), mSubMeshes[i].GetMaterialIndex() });
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = GetSubMeshCount();
+	srvDesc.Buffer.StructureByteStride = sizeof(GeometryInfo);
+	srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+
+	mGeometryInfoIndex = assetMgr.SetShaderResource(device, cmdList, mGeometrySB->GetUploadAllocation(), srvDesc);
+	assetMgr.AddCurrentHeapIndex();
+}
+
 const D3D12_SHADER_RESOURCE_VIEW_DESC Mesh::VertexShaderResourceView()
 {
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
@@ -64,5 +101,23 @@ const D3D12_SHADER_RESOURCE_VIEW_DESC Mesh::IndexShaderResourceView()
 	srvDesc.Buffer.StructureByteStride = sizeof(UINT);
 	srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
 
+	return srvDesc;
+}
+
+const D3D12_SHADER_RESOURCE_VIEW_DESC Mesh::TriangleLODShaderResourceView()
+{
+	if (mTriangleCount == 0)
+		return D3D12_SHADER_RESOURCE_VIEW_DESC();
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = mTriangleCount;
+	srvDesc.Buffer.StructureByteStride = sizeof(float);
+	srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+
 	return srvDesc;
 }
\ No newline at end of file
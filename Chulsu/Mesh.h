@@ -1,6 +1,16 @@
 #pragma once
 #include "stdafx.h"
 #include "SubMesh.h"
+#include "UploadBuffer.h"
+
+// Same layout as GeometryInfo in DefaultRayTrace.hlsl, one per submesh indexed by GeometryIndex().
+// Shared by every instance of the mesh.
+struct GeometryInfo
+{
+	UINT VertexOffset;
+	UINT IndexOffset;
+	UINT MaterialIndex;		// Into the material table of the AssetManager.
+};
 
 class Mesh
 {
@@ -15,34 +25,60 @@ public:
 	vector<SubMesh>& GetSubMeshes() { return mSubMeshes; }
 	void SetVertexAttribIndex(UINT attribIndex) { mVertexAttribIndex = attribIndex; }
 	void SetIndexBufferIndex(UINT attribIndex) { mIndexBufferIndex = attribIndex; }
+	void SetTriangleLODIndex(UINT attribIndex) { mTriangleLODIndex = attribIndex; }
 
 	UINT GetVertexAttribIndex() { return mVertexAttribIndex; }
 	UINT GetIndexBufferIndex() { return mIndexBufferIndex; }
+	UINT GetTriangleLODIndex() { return mTriangleLODIndex; }
+	UINT GetGeometryInfoIndex() { return mGeometryInfoIndex; }
 
 	ComPtr<D3D12MA::Allocation> GetVertexBufferAlloc() { return mVertexBufferAlloc; }
 	ComPtr<D3D12MA::Allocation> GetIndexBufferAlloc() { return mIndexBufferAlloc; }
+	ComPtr<D3D12MA::Allocation> GetTriangleLODBufferAlloc() { return mTriangleLODBufferAlloc; }
 
 	const UINT GetSubMeshCount() { return mSubMeshes.size(); }
 
+	void SetGeometry(vector<Vertex>&& vertices, vector<UINT>&& indices) { mVertices = std::move(vertices); mIndices = std::move(indices); }
+	const vector<Vertex>& GetVertices() const { return mVertices; }
+	const vector<UINT>& GetIndices() const { return mIndices; }
+
 	void InitializeBuffers(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList,
 		ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker, AssetManager& assetMgr,
 		UINT vbStride, UINT ibStride, D3D12_PRIMITIVE_TOPOLOGY topology, const void* vbData, UINT vbCount,
 		const void* ibData, UINT ibCount);
 
+	// One float per triangle from ComputeTriangleLOD, read by the hit shaders to pick texture mips.
+	void InitializeTriangleLODBuffer(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList,
+		ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker, AssetManager& assetMgr, const vector<float>& triangleLOD);
+
+	// Uploads the GeometryInfo of every submesh and creates its view at the current heap index.
+	void BuildGeometryInfo(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList,
+		ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker, AssetManager& assetMgr);
+
 	const D3D12_SHADER_RESOURCE_VIEW_DESC VertexShaderResourceView();
 
 	const D3D12_SHADER_RESOURCE_VIEW_DESC IndexShaderResourceView();
 
+	const D3D12_SHADER_RESOURCE_VIEW_DESC TriangleLODShaderResourceView();
+
 
 private:
 	vector<SubMesh> mSubMeshes;
 	AccelerationStructureBuffers mBLAS;
 
+	// CPU copy of the uploaded geometry.
+	vector<Vertex> mVertices;
+	vector<UINT> mIndices;
+
 	UINT mVertexAttribIndex = UINT_MAX;
 	UINT mIndexBufferIndex = UINT_MAX;
+	UINT mTriangleLODIndex = UINT_MAX;
+	UINT mGeometryInfoIndex = UINT_MAX;
 
 	ComPtr<D3D12MA::Allocation> mVertexBufferAlloc;
 	ComPtr<D3D12MA::Allocation> mIndexBufferAlloc;
+	ComPtr<D3D12MA::Allocation> mTriangleLODBufferAlloc;
+	shared_ptr<UploadBuffer<GeometryInfo>> mGeometrySB;
 
 	D3D12_PRIMITIVE_TOPOLOGY mPrimitiveTopology = {};
 
@@ -50,4 +86,5 @@ private:
 	UINT mVerticesCount = 0;
 	UINT mVertexStride = 0;
 	UINT mIndexCount = 0;
+	UINT mTriangleCount = 0;
 };
\ No newline at end of file
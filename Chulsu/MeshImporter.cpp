@@ -0,0 +1,143 @@
+#include "MeshImporter.h"
+#include "Profiler.h"
+
+bool ImportAssimpMesh(const string& path, ImportedMesh& mesh)
+{
+	PROFILE_ZONE("Import");
+
+	// Texture paths in the material are relative to the model file.
+	wstring dirPath = filesystem::path(path).parent_path().wstring();
+
+	Assimp::Importer Importer;
+	constexpr uint32_t ImporterFlags =
+		aiProcess_ConvertToLeftHanded |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_Triangulate |
+		aiProcess_SortByPType |
+		aiProcess_GenNormals |
+		aiProcess_GenUVCoords |
+		aiProcess_OptimizeMeshes |
+		aiProcess_ValidateDataStructure |
+		aiProcess_CalcTangentSpace;
+
+	const aiScene* pAiScene = Importer.ReadFile(path.data(), ImporterFlags);
+
+	if (!pAiScene || !pAiScene->HasMeshes())
+		return false;
+
+	UINT vertexOffset = 0;
+	UINT IndexOffset = 0;
+
+	mesh.SubMeshes.reserve(pAiScene->mNumMeshes);
+	for (unsigned m = 0; m < pAiScene->mNumMeshes; ++m)
+	{
+		// Assimp object
+		const aiMesh* pAiMesh = pAiScene->mMeshes[m];
+
+		for (unsigned int v = 0; v < pAiMesh->mNumVertices; ++v)
+		{
+			Vertex& vertex = mesh.Vertices.emplace_back();
+			vertex.position = { pAiMesh->mVertices[v].x, pAiMesh->mVertices[v].y, pAiMesh->mVertices[v].z };
+
+			if (pAiMesh->HasTextureCoords(0))
+			{
+				vertex.texCoord = { pAiMesh->mTextureCoords[0][v].x, pAiMesh->mTextureCoords[0][v].y };
+			}
+
+			if (pAiMesh->HasNormals())
+			{
+				vertex.normal = { pAiMesh->mNormals[v].x, pAiMesh->mNormals[v].y, pAiMesh->mNormals[v].z };
+			}
+
+			if (pAiMesh->HasTangentsAndBitangents())
+			{
+				vertex.biTangent = { pAiMesh->mBitangents[v].x, pAiMesh->mBitangents[v].y, pAiMesh->mBitangents[v].z };
+				vertex.tangent = { pAiMesh->mTangents[v].x, pAiMesh->mTangents[v].y, pAiMesh->mTangents[v].z };
+			}
+		}
+
+		mesh.Indices.reserve(mesh.Indices.size() + static_cast<size_t>(pAiMesh->mNumFaces) * 3);
+		std::span Faces = { pAiMesh->mFaces, pAiMesh->mNumFaces };
+		for (const auto& Face : Faces)
+		{
+			mesh.Indices.push_back(Face.mIndices[0]);
+			mesh.Indices.push_back(Face.mIndices[1]);
+			mesh.Indices.push_back(Face.mIndices[2]);
+		}
+
+		auto matIndex = pAiMesh->mMaterialIndex;
+		if (mesh.Materials.find(matIndex) == mesh.Materials.end())
+		{
+			ImportedMaterial& material = mesh.Materials[matIndex];
+			aiMaterial* pAiMaterial = pAiScene->mMaterials[matIndex];
+
+			for (int i = 1; i < aiTextureType_UNKNOWN + 1; ++i)
+			{
+				aiString texturePath;
+				if (pAiMaterial->GetTexture((aiTextureType)i, 0, &texturePath) == AI_SUCCESS)
+				{
+					wstring wPath = (filesystem::path(dirPath) / stringTowstring(string(texturePath.C_Str()))).wstring();
+
+					switch (aiTextureType(i))
+					{
+					case aiTextureType_DIFFUSE:
+						material.AlbedoTexturePath = wPath;
+						break;
+
+					case aiTextureType_AMBIENT:
+						material.MetalicTexturePath = wPath;
+						break;
+
+					case aiTextureType_HEIGHT:
+						material.NormalMapTexturePath = wPath;
+						break;
+
+					case aiTextureType_SHININESS:
+						material.RoughnessTexturePath = wPath;
+						break;
+
+					case aiTextureType_OPACITY:
+						material.OpacityMapTexturePath = wPath;
+						break;
+					}
+				}
+			}
+
+			// PBR factors where the format has them (glTF, recent FBX exporters), the diffuse color otherwise
+			aiColor4D baseColor;
+			aiColor3D diffuseColor;
+			if (pAiMaterial->Get(AI_MATKEY_BASE_COLOR, baseColor) == AI_SUCCESS)
+				material.BaseColor = { baseColor.r, baseColor.g, baseColor.b };
+			else if (pAiMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, diffuseColor) == AI_SUCCESS)
+				material.BaseColor = { diffuseColor.r, diffuseColor.g, diffuseColor.b };
+
+			pAiMaterial->Get(AI_MATKEY_METALLIC_FACTOR, material.Metalic);
+			pAiMaterial->Get(AI_MATKEY_ROUGHNESS_FACTOR, material.Roughness);
+
+			// The any-hit shader tests the opacity map, materials without one are opaque whatever their alpha mode says
+			if (!material.OpacityMapTexturePath.empty())
+			{
+				material.AlphaMode = ALPHA_MODE_MASK;
+				pAiMaterial->Get("$mat.gltf.alphaCutoff", 0, 0, material.AlphaCutoff);
+			}
+		}
+
+		SubMesh subMesh;
+		subMesh.SetMaterialIndex(matIndex);
+		subMesh.SetAlphaTested(mesh.Materials[matIndex].AlphaMode == ALPHA_MODE_MASK);
+		subMesh.SetName(pAiMesh->mName.C_Str());
+
+		subMesh.SetVertexOffset(vertexOffset);
+		subMesh.SetIndexOffset(IndexOffset);
+
+		subMesh.SetVertexCount(pAiMesh->mNumVertices);
+		subMesh.SetIndexCount(pAiMesh->mNumFaces * 3);
+
+		mesh.SubMeshes.push_back(subMesh);
+
+		vertexOffset = mesh.Vertices.size();
+		IndexOffset = mesh.Indices.size();
+	}
+
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "stdafx.h"
+#include "SubMesh.h"
+#include "Material.h"
+
+// Texture paths of a single assimp material, resolved against the model directory,
+// and the factors that stand in for missing textures.
+struct ImportedMaterial
+{
+	wstring AlbedoTexturePath;
+	wstring MetalicTexturePath;
+	wstring RoughnessTexturePath;
+	wstring NormalMapTexturePath;
+	wstring OpacityMapTexturePath;
+
+	XMFLOAT3 BaseColor = { 1.0f, 1.0f, 1.0f };
+	float Metalic = 0.0f;
+	float Roughness = 1.0f;
+	MATERIAL_ALPHA_MODE AlphaMode = ALPHA_MODE_OPAQUE;	// ALPHA_MODE_MASK with an opacity map.
+	float AlphaCutoff = DefaultAlphaCutoff;
+};
+
+// Device independent result of an assimp import.
+// The renderer uploads it, the CPU ray tracer consumes it directly.
+struct ImportedMesh
+{
+	vector<Vertex> Vertices;
+	vector<UINT> Indices;
+	vector<SubMesh> SubMeshes;
+	map<UINT, ImportedMaterial> Materials;
+	// 0.5 * log2(UV area / world area) per triangle, indexed by the triangle's first index / 3. Filled by ComputeTriangleLOD.
+	vector<float> TriangleLOD;
+};
+
+bool ImportAssimpMesh(const string& path, ImportedMesh& mesh);
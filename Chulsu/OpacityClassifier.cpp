@@ -0,0 +1,148 @@
+#include "OpacityClassifier.h"
+#include "CpuTexture.h"
+
+TRIANGLE_OPACITY ClassifyTriangleOpacity(const CpuTexture& opacityMap,
+	const XMFLOAT2& uv0, const XMFLOAT2& uv1, const XMFLOAT2& uv2, float cutoff)
+{
+	const UINT width = opacityMap.GetWidth();
+	const UINT height = opacityMap.GetHeight();
+	if (width == 0 || height == 0)
+		return OPACITY_MIXED;
+
+	// Texel space with texel centers on integer coordinates.
+	// A bilinear sample at q reads every texel center closer than one texel on both axes.
+	const XMFLOAT2 p[3] = {
+		{ uv0.x * width - 0.5f, uv0.y * height - 0.5f },
+		{ uv1.x * width - 0.5f, uv1.y * height - 0.5f },
+		{ uv2.x * width - 0.5f, uv2.y * height - 0.5f } };
+
+	const int x0 = static_cast<int>(floorf(min(min(p[0].x, p[1].x), p[2].x)));
+	const int x1 = static_cast<int>(ceilf(max(max(p[0].x, p[1].x), p[2].x)));
+	const int y0 = static_cast<int>(floorf(min(min(p[0].y, p[1].y), p[2].y)));
+	const int y1 = static_cast<int>(ceilf(max(max(p[0].y, p[1].y), p[2].y)));
+
+	// Triangles repeating the texture many times are not worth the scan.
+	if (static_cast<int64_t>(x1 - x0 + 1) * (y1 - y0 + 1) > 4ll * width * height)
+		return OPACITY_MIXED;
+
+	// Edge normals for the separating axis test against the texel footprint squares.
+	XMFLOAT2 normals[3];
+	float triMin[3], triMax[3];
+	for (int e = 0; e < 3; ++e)
+	{
+		const XMFLOAT2& a = p[e];
+		const XMFLOAT2& b = p[(e + 1) % 3];
+		normals[e] = { a.y - b.y, b.x - a.x };
+
+		float d0 = normals[e].x * p[0].x + normals[e].y * p[0].y;
+		float d1 = normals[e].x * p[1].x + normals[e].y * p[1].y;
+		float d2 = normals[e].x * p[2].x + normals[e].y * p[2].y;
+		triMin[e] = min(min(d0, d1), d2);
+		triMax[e] = max(max(d0, d1), d2);
+	}
+
+	bool anyOpaque = false;
+	bool anyTransparent = false;
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			// Square of half size 1 around the texel center, the bounding box axes are already covered by the loop range.
+			bool separated = false;
+			for (int e = 0; e < 3 && !separated; ++e)
+			{
+				float center = normals[e].x * x + normals[e].y * y;
+				float extent = fabsf(normals[e].x) + fabsf(normals[e].y);
+				separated = center + extent < triMin[e] || center - extent > triMax[e];
+			}
+			if (separated)
+				continue;
+
+			if (XMVectorGetX(opacityMap.Load(x, y)) >= cutoff)
+				anyOpaque = true;
+			else
+				anyTransparent = true;
+
+			if (anyOpaque && anyTransparent)
+				return OPACITY_MIXED;
+		}
+	}
+
+	// Bilinear filtering only blends the texels above, so every sample stays on the same side of the cutoff.
+	return anyTransparent ? OPACITY_TRANSPARENT : OPACITY_OPAQUE;
+}
+
+void ClassifyOpacity(ImportedMesh& mesh, const function<shared_ptr<CpuTexture>(const wstring&)>& loadTexture)
+{
+	auto start = chrono::steady_clock::now();
+
+	vector<UINT> indices;
+	indices.reserve(mesh.Indices.size());
+	vector<SubMesh> subMeshes;
+	subMeshes.reserve(mesh.SubMeshes.size() * 2);
+
+	UINT counts[3] = {};
+
+	auto appendPart = [&](const SubMesh& source, const UINT* partIndices, size_t indexCount, bool alphaTested)
+	{
+		if (indexCount == 0)
+			return;
+
+		SubMesh part = source;
+		part.SetIndexOffset(static_cast<UINT>(indices.size()));
+		part.SetIndexCount(static_cast<UINT>(indexCount));
+		part.SetAlphaTested(alphaTested);
+		indices.insert(indices.end(), partIndices, partIndices + indexCount);
+		subMeshes.push_back(part);
+	};
+
+	for (auto& subMesh : mesh.SubMeshes)
+	{
+		const UINT* subMeshIndices = mesh.Indices.data() + subMesh.GetIndexOffset();
+
+		shared_ptr<CpuTexture> opacityMap;
+		float cutoff = DefaultAlphaCutoff;
+		auto material = mesh.Materials.find(subMesh.GetMaterialIndex());
+		if (subMesh.IsAlphaTested() && material != mesh.Materials.end())
+		{
+			opacityMap = loadTexture(material->second.OpacityMapTexturePath);
+			cutoff = material->second.AlphaCutoff;
+		}
+
+		// Nothing to classify against, keep the submesh as it is.
+		if (!opacityMap)
+		{
+			appendPart(subMesh, subMeshIndices, subMesh.GetIndexCount(), subMesh.IsAlphaTested());
+			continue;
+		}
+
+		const Vertex* vertices = mesh.Vertices.data() + subMesh.GetVertexOffset();
+
+		vector<UINT> opaque, mixed;
+		for (UINT i = 0; i + 2 < subMesh.GetIndexCount(); i += 3)
+		{
+			const UINT* tri = subMeshIndices + i;
+			TRIANGLE_OPACITY opacity = ClassifyTriangleOpacity(*opacityMap,
+				vertices[tri[0]].texCoord, vertices[tri[1]].texCoord, vertices[tri[2]].texCoord, cutoff);
+
+			if (opacity == OPACITY_OPAQUE)
+				opaque.insert(opaque.end(), tri, tri + 3);
+			else if (opacity == OPACITY_MIXED)
+				mixed.insert(mixed.end(), tri, tri + 3);
+
+			counts[opacity]++;
+		}
+
+		appendPart(subMesh, opaque.data(), opaque.size(), false);
+		appendPart(subMesh, mixed.data(), mixed.size(), true);
+	}
+
+	mesh.Indices = std::move(indices);
+	mesh.SubMeshes = std::move(subMeshes);
+
+	auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	DebugLog("Opacity classification: " + to_string(counts[OPACITY_OPAQUE]) + " opaque, "
+		+ to_string(counts[OPACITY_TRANSPARENT]) + " transparent, " + to_string(counts[OPACITY_MIXED]) + " mixed triangles in "
+		+ to_string(elapsed) + " ms");
+}
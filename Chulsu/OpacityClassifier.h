@@ -0,0 +1,20 @@
+#pragma once
+#include "stdafx.h"
+#include "MeshImporter.h"
+
+class CpuTexture;
+
+enum TRIANGLE_OPACITY
+{
+	OPACITY_OPAQUE,
+	OPACITY_TRANSPARENT,
+	OPACITY_MIXED
+};
+
+// Classifies a triangle by every texel its UV footprint can reach with bilinear filtering of the top mip.
+TRIANGLE_OPACITY ClassifyTriangleOpacity(const CpuTexture& opacityMap,
+	const XMFLOAT2& uv0, const XMFLOAT2& uv1, const XMFLOAT2& uv2, float cutoff = DefaultAlphaCutoff);
+
+// Splits every alpha tested submesh into an opaque part and an alpha tested part that only keeps the mixed triangles.
+// Fully transparent triangles are dropped, the any-hit shader would ignore every hit on them anyway.
+void ClassifyOpacity(ImportedMesh& mesh, const function<shared_ptr<CpuTexture>(const wstring&)>& loadTexture);
@@ -0,0 +1,237 @@
+#include "Parallel.h"
+#include "Profiler.h"
+
+namespace
+{
+	// Below this many values per block the second pass costs more than it saves.
+	const size_t kMinScanBlock = 4096;
+
+	// Remaining indices [begin, end) of one worker packed into a single word, begin in the low half.
+	// The owner takes from the front and thieves from the back, both with a compare exchange on the whole range.
+	struct alignas(64) WorkRange
+	{
+		atomic<uint64_t> Range = 0;
+	};
+
+	uint64_t PackRange(UINT begin, UINT end) { return static_cast<uint64_t>(end) << 32 | begin; }
+	UINT RangeBegin(uint64_t range) { return static_cast<UINT>(range); }
+	UINT RangeEnd(uint64_t range) { return static_cast<UINT>(range >> 32); }
+
+	bool PopFront(WorkRange& work, UINT& index)
+	{
+		uint64_t range = work.Range.load();
+		while (RangeBegin(range) < RangeEnd(range))
+		{
+			if (work.Range.compare_exchange_weak(range, PackRange(RangeBegin(range) + 1, RangeEnd(range))))
+			{
+				index = RangeBegin(range);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Moves the back half of the fullest other range to the empty range of self, false once every range is empty.
+	bool Steal(vector<WorkRange>& work, UINT self)
+	{
+		for (;;)
+		{
+			UINT victim = UINT_MAX;
+			UINT largest = 0;
+			uint64_t victimRange = 0;
+			for (UINT i = 0; i < work.size(); ++i)
+			{
+				uint64_t range = work[i].Range.load();
+				UINT size = RangeEnd(range) - RangeBegin(range);
+				if (i != self && size > largest)
+				{
+					victim = i;
+					largest = size;
+					victimRange = range;
+				}
+			}
+			if (victim == UINT_MAX)
+				return false;
+
+			// Retried when the owner or another thief changed the range in between
+			UINT split = RangeEnd(victimRange) - (largest + 1) / 2;
+			if (work[victim].Range.compare_exchange_strong(victimRange, PackRange(RangeBegin(victimRange), split)))
+			{
+				work[self].Range.store(PackRange(split, RangeEnd(victimRange)));
+				return true;
+			}
+		}
+	}
+
+	// Workers started once and parked between jobs. A job is published by bumping the generation under the lock,
+	// the caller takes share 0 and waits until every worker with a share has run out of work.
+	class WorkerPool
+	{
+	public:
+		// Never destroyed, the parked workers end with the process instead of depending on static destruction order.
+		static WorkerPool& Get()
+		{
+			static WorkerPool* pool = new WorkerPool;
+			return *pool;
+		}
+
+		UINT GetThreadCount() const { return static_cast<UINT>(mWork.size()); }
+
+		// Set on pool threads and on the thread running a job, nested calls from there run serially.
+		static bool& InsideJob()
+		{
+			thread_local bool inside = false;
+			return inside;
+		}
+
+		void Run(UINT threadCount, UINT count, const function<void(UINT)>& func)
+		{
+			// One job at a time, a second caller waits for the pool
+			lock_guard<mutex> submitLock(mSubmitMutex);
+			InsideJob() = true;
+
+			// Contiguous shares keep neighbouring items on one core until someone runs out of work
+			for (UINT i = 0; i < mWork.size(); ++i)
+			{
+				UINT begin = i < threadCount ? static_cast<UINT>(static_cast<uint64_t>(count) * i / threadCount) : 0;
+				UINT end = i < threadCount ? static_cast<UINT>(static_cast<uint64_t>(count) * (i + 1) / threadCount) : 0;
+				mWork[i].Range.store(PackRange(begin, end));
+			}
+
+			{
+				lock_guard<mutex> lock(mMutex);
+				mFunc = &func;
+				mJobThreadCount = threadCount;
+				mPendingWorkers = threadCount - 1;
+				++mGeneration;
+			}
+			mWake.notify_all();
+
+			Work(0);
+
+			unique_lock<mutex> lock(mMutex);
+			mDone.wait(lock, [this]() { return mPendingWorkers == 0; });
+			mFunc = nullptr;
+			InsideJob() = false;
+		}
+
+	private:
+		WorkerPool() : mWork(max(1u, thread::hardware_concurrency()))
+		{
+			for (UINT i = 1; i < mWork.size(); ++i)
+				thread([this, i]() { WorkerLoop(i); }).detach();
+		}
+
+		void Work(UINT self)
+		{
+			PROFILE_ZONE("Parallel For");
+			do
+			{
+				UINT index;
+				while (PopFront(mWork[self], index))
+					(*mFunc)(index);
+			} while (Steal(mWork, self));
+		}
+
+		void WorkerLoop(UINT self)
+		{
+			Profiler::SetThreadName("Worker Pool");
+			InsideJob() = true;
+
+			uint64_t generation = 0;
+			unique_lock<mutex> lock(mMutex);
+			for (;;)
+			{
+				mWake.wait(lock, [&]() { return mGeneration != generation; });
+
+				// A worker without a share sits the job out, it may wake after the job is over and skip it
+				generation = mGeneration;
+				if (self >= mJobThreadCount)
+					continue;
+
+				lock.unlock();
+				Work(self);
+				lock.lock();
+
+				if (--mPendingWorkers == 0)
+					mDone.notify_one();
+			}
+		}
+
+		vector<WorkRange> mWork;
+
+		mutex mSubmitMutex;
+		mutex mMutex;
+		condition_variable mWake;
+		condition_variable mDone;
+		uint64_t mGeneration = 0;
+
+		const function<void(UINT)>* mFunc = nullptr;
+		UINT mJobThreadCount = 0;
+		UINT mPendingWorkers = 0;
+	};
+}
+
+UINT ParallelFor(UINT count, const function<void(UINT)>& func)
+{
+	if (count == 0)
+		return 1;
+
+	if (WorkerPool::InsideJob())
+	{
+		for (UINT i = 0; i < count; ++i)
+			func(i);
+		return 1;
+	}
+
+	WorkerPool& pool = WorkerPool::Get();
+	UINT threadCount = min(pool.GetThreadCount(), count);
+	pool.Run(threadCount, count, func);
+	return threadCount;
+}
+
+double ParallelPrefixSum(span<const float> values, span<float> prefix)
+{
+	assert(prefix.size() == values.size() + 1);
+
+	const size_t count = values.size();
+	const size_t targetBlocks = max(1u, thread::hardware_concurrency()) * 4;
+	const size_t blockSize = max(kMinScanBlock, (count + targetBlocks - 1) / targetBlocks);
+	const UINT blockCount = static_cast<UINT>((count + blockSize - 1) / blockSize);
+
+	// Sums are kept in double, the last entries of a long float scan lose the small values
+	vector<double> blockSums(blockCount + 1, 0.0);
+	auto sumBlock = [&](UINT block)
+	{
+		double sum = 0.0;
+		for (size_t i = block * blockSize; i < min(count, (block + 1) * blockSize); ++i)
+			sum += values[i];
+		blockSums[block + 1] = sum;
+	};
+
+	auto scanBlock = [&](UINT block)
+	{
+		double sum = blockSums[block];
+		for (size_t i = block * blockSize; i < min(count, (block + 1) * blockSize); ++i)
+		{
+			prefix[i] = static_cast<float>(sum);
+			sum += values[i];
+		}
+	};
+
+	if (blockCount > 1)
+		ParallelFor(blockCount, sumBlock);
+	else if (blockCount == 1)
+		sumBlock(0);
+
+	for (UINT block = 0; block < blockCount; ++block)
+		blockSums[block + 1] += blockSums[block];
+
+	if (blockCount > 1)
+		ParallelFor(blockCount, scanBlock);
+	else if (blockCount == 1)
+		scanBlock(0);
+
+	prefix[count] = static_cast<float>(blockSums[blockCount]);
+	return blockSums[blockCount];
+}
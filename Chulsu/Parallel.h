@@ -0,0 +1,12 @@
+#pragma once
+#include "stdafx.h"
+
+// Runs func for every index in [0, count) on all cores. Every thread starts on a contiguous share of the indices
+// and steals half of the largest remaining share when its own runs out, so uneven items do not leave cores idle.
+// The threads belong to a pool started on first use, a call from inside a running job runs serially on its thread.
+// Returns the number of threads used.
+UINT ParallelFor(UINT count, const function<void(UINT)>& func);
+
+// Exclusive prefix sum, prefix[i] is the sum of values before i and prefix[values.size()] the total.
+// prefix must hold values.size() + 1 elements. Blocks are summed in parallel, then offset in parallel.
+double ParallelPrefixSum(span<const float> values, span<float> prefix);
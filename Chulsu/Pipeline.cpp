@@ -1,117 +1,237 @@
 #include "Pipeline.h"
 #include "SubObject.h"
+#include "PipelineLayout.h"
 #include "AssetManager.h"
 #include "Instance.h"
+#include "SubMesh.h"
+#include "ShaderPermutation.h"
+#include "Profiler.h"
 
 using namespace SubObject;
 
-void Pipeline::CreatePipelineState(ComPtr<ID3D12Device5> device, const WCHAR* filename)
+void Pipeline::CreatePipelineState(ComPtr<ID3D12Device5> device, const WCHAR* filename, AssetManager& assetMgr, UINT globalFeatures)
 {
-    std::array<D3D12_STATE_SUBOBJECT, 11> subobjects;
-    uint32_t index = 0;
+    mGlobalFeatures = globalFeatures;
+
+    // One library per feature set the scene uses, compiled in parallel
+    std::vector<UINT> features = { globalFeatures };
+    for (auto& instance : assetMgr.GetInstances())
+    {
+        for (auto& subMesh : instance->GetMesh()->GetSubMeshes())
+            features.push_back(GetHitGroupFeatures(assetMgr, subMesh));
+    }
+
+    if (!CreatePipelineState(device, filename, EnumeratePermutations(features), globalFeatures))
+        ThrowIfFailed(E_FAIL);
+}
 
-    // Create the DXIL library
+bool Pipeline::CreatePipelineState(ComPtr<ID3D12Device5> device, const WCHAR* filename, const std::vector<UINT>& permutations, UINT globalFeatures)
+{
+    std::vector<std::future<ComPtr<IDxcBlob>>> compiles;
+    for (UINT permutation : permutations)
+    {
+        compiles.push_back(std::async(std::launch::async, [filename, permutation]()
+            {
+                Profiler::SetThreadName("Shader Compile Worker");
+                PROFILE_ZONE("Shader Compile");
+                return CompileLibrary(filename, L"lib_6_6", GetFeatureDefines(permutation));
+            }));
+    }
 
-    const WCHAR* entryPoints[] = { kAnyHitShader, kRayGenShader, kMissShader, kClosestHitShader, kShadowClosestHitShader, kShadowMissShader };
-    DxilLibrary dxilLib = CreateDxilLibrary(filename, entryPoints, arraysize(entryPoints));
-    subobjects[index++] = dxilLib.stateSubobject; // 0 Library
+    // The shader cache has already logged the diagnostics of a failed compile
+    std::vector<ComPtr<IDxcBlob>> blobs;
+    for (auto& compile : compiles)
+        blobs.push_back(compile.get());
 
-    HitProgram hitProgram(kAnyHitShader, kClosestHitShader, kHitGroup);
-    subobjects[index++] = hitProgram.subObject; // 1 Hit Group
+    if (std::find(blobs.begin(), blobs.end(), nullptr) != blobs.end())
+        return false;
 
-    HitProgram shadowHitProgram(kAnyHitShader, kShadowClosestHitShader, kShadowHitGroup);
-    subobjects[index++] = shadowHitProgram.subObject; // 2 Hit Group
+    // Everything about the subobjects that does not need a device, see PipelineLayout
+    PipelineLayout layout(permutations);
 
-    // Create the miss root-signature and association
+    // Create the empty local root signature, the hit shaders find their instance through InstanceID()
     D3D12_ROOT_SIGNATURE_DESC emptyDesc = {};
     emptyDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
     LocalRootSignature emptyRootSignature(device, emptyDesc);
-    subobjects[index] = emptyRootSignature.subobject; // 3 Miss Root Sig
-
-    uint32_t emptyRootIndex = index++; // 3
-    const WCHAR* emptyRootSigExports[] = { kMissShader, kRayGenShader, kShadowMissShader };
-    ExportAssociation emptyRootAssociation(emptyRootSigExports, arraysize(emptyRootSigExports), &(subobjects[emptyRootIndex]));
-    subobjects[index++] = emptyRootAssociation.subobject; // 4 Associate Miss Root Sig to Miss Shader
-
-    // Create the hit root-signature and association
-    LocalRootSignature hitRootSignature(device, CreateHitRootDesc().desc);
-    subobjects[index] = hitRootSignature.subobject; // 5 Hit Root Sig
-
-    uint32_t hitRootIndex = index++; // 6
-    const WCHAR* hitRootSigExports[] = { kAnyHitShader, kClosestHitShader };
-    ExportAssociation hitRootAssociation(hitRootSigExports, 2, &(subobjects[hitRootIndex]));
-    subobjects[index++] = hitRootAssociation.subobject; // 7 Associate Hit Root Sig to Hit Group
 
     // Bind the payload size to the programs
-    ShaderConfig shaderConfig(sizeof(float) * 2, sizeof(float) * 3);
-    subobjects[index] = shaderConfig.subobject; // 7 Shader Config
-
-    uint32_t shaderConfigIndex = index++; // 8
-    const WCHAR* shaderExports[] = { kAnyHitShader, kMissShader, kClosestHitShader, kRayGenShader, kShadowMissShader, kShadowClosestHitShader };
-    ExportAssociation configAssociation(shaderExports, arraysize(shaderExports), &(subobjects[shaderConfigIndex]));
-    subobjects[index++] = configAssociation.subobject;
+    ShaderConfig shaderConfig(sizeof(float) * 2, sizeof(float) * 5);
 
     // Create the pipeline config
     PipelineConfig config(3);
-    subobjects[index++] = config.subobject; // 9
 
-    // Create the global root signature and store the empty signature
+    // Create the global root signature
     GlobalRootSignature root(device, CreateGlobalRootDesc().desc);
-    mGlobalRootSig = root.pRootSig;
-    subobjects[index++] = root.subobject; // 10
+
+    std::vector<const WCHAR*> associatedExports;
+    for (const std::wstring& name : layout.GetAssociatedExports())
+        associatedExports.push_back(name.c_str());
+
+    // The descs point into these, so they must not move until the state object is created
+    std::deque<DxilLibrary> libraries;
+    std::deque<HitProgram> hitPrograms;
+    std::deque<ExportAssociation> associations;
+
+    std::vector<D3D12_STATE_SUBOBJECT> subobjects;
+    subobjects.reserve(layout.GetSubobjects().size());
+    for (const PipelineLayout::Subobject& subobject : layout.GetSubobjects())
+    {
+        switch (subobject.Type)
+        {
+        case PipelineLayout::SubobjectType::Library:
+        {
+            // Libraries follow the order of the permutations, like the blobs
+            const PipelineLayout::Library& library = layout.GetLibraries()[subobject.Index];
+            libraries.emplace_back(blobs[subobject.Index], library.ExportNames, library.ExportToRename);
+            subobjects.push_back(libraries.back().stateSubobject);
+            break;
+        }
+        case PipelineLayout::SubobjectType::HitGroup:
+        {
+            const PipelineLayout::HitGroup& hitGroup = layout.GetHitGroups()[subobject.Index];
+            hitPrograms.emplace_back(hitGroup.AnyHit.empty() ? nullptr : hitGroup.AnyHit.c_str(),
+                hitGroup.ClosestHit.empty() ? nullptr : hitGroup.ClosestHit.c_str(), hitGroup.Name);
+            subobjects.push_back(hitPrograms.back().subObject);
+            break;
+        }
+        case PipelineLayout::SubobjectType::LocalRootSignature:
+            subobjects.push_back(emptyRootSignature.subobject);
+            break;
+        case PipelineLayout::SubobjectType::ExportAssociation:
+            // Resolved below, the associated subobject's address is only final once the array is complete
+            associations.emplace_back(associatedExports.data(), (uint32_t)associatedExports.size(), nullptr);
+            subobjects.push_back(associations.back().subobject);
+            break;
+        case PipelineLayout::SubobjectType::ShaderConfig:
+            subobjects.push_back(shaderConfig.subobject);
+            break;
+        case PipelineLayout::SubobjectType::PipelineConfig:
+            subobjects.push_back(config.subobject);
+            break;
+        case PipelineLayout::SubobjectType::GlobalRootSignature:
+            subobjects.push_back(root.subobject);
+            break;
+        }
+    }
+
+    // The copies in the array share the association descs
+    auto association = associations.begin();
+    for (const PipelineLayout::Subobject& subobject : layout.GetSubobjects())
+    {
+        if (subobject.Type == PipelineLayout::SubobjectType::ExportAssociation)
+            (association++)->association.pSubobjectToAssociate = &subobjects[subobject.Index];
+    }
+    assert(subobjects.size() == layout.GetSubobjects().size());
 
     // Create the state
     D3D12_STATE_OBJECT_DESC desc;
-    desc.NumSubobjects = index;
+    desc.NumSubobjects = (UINT)subobjects.size();
     desc.pSubobjects = subobjects.data();
     desc.Type = D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE;
 
-    ThrowIfFailed(device->CreateStateObject(&desc, IID_PPV_ARGS(&mPipelineState)));
+    // Exports that no longer match the source only fail here, the pipeline is left as it was
+    ComPtr<ID3D12StateObject> pipelineState;
+    HRESULT hr = device->CreateStateObject(&desc, IID_PPV_ARGS(&pipelineState));
+    if (FAILED(hr))
+    {
+        char code[16];
+        snprintf(code, sizeof(code), "0x%08X", static_cast<unsigned>(hr));
+        DebugLog("Pipeline: CreateStateObject failed for " + wstringTostring(filename) + ", HRESULT " + code);
+        return false;
+    }
+
+    mFilename = filename;
+    mGlobalFeatures = globalFeatures;
+    mPermutations = permutations;
+    mLayout = std::move(layout);
+    mPipelineState = pipelineState;
+    mGlobalRootSig = root.pRootSig;
+    return true;
 }
 
-void Pipeline::CreateShaderTable(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc,
+bool Pipeline::CreateShaderTable(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc,
     ResourceStateTracker& tracker, AssetManager& assetMgr)
 {
-    // Calculate the size and create the buffer
-    mShaderTableEntrySize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-    mShaderTableEntrySize += 8; // The ray-gen's descriptor table
-    mShaderTableEntrySize = align_to(D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT, mShaderTableEntrySize);
-    uint32_t shaderTableSize = mShaderTableEntrySize * 11;
+    mShaderTable = ShaderTable();
+    return UpdateShaderTable(device, cmdList, alloc, tracker, assetMgr);
+}
 
-    mShaderTable = assetMgr.CreateResource(device, cmdList, alloc, tracker, NULL,
-        shaderTableSize, 1, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_DIMENSION_BUFFER,
-        DXGI_FORMAT_UNKNOWN, D3D12_TEXTURE_LAYOUT_ROW_MAJOR, D3D12_RESOURCE_FLAG_NONE, D3D12_HEAP_TYPE_UPLOAD);
+bool Pipeline::UpdateShaderTable(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc,
+    ResourceStateTracker& tracker, AssetManager& assetMgr)
+{
+    const std::vector<std::shared_ptr<Instance>>& instances = assetMgr.GetInstances();
+
+    // Assets loaded after the pipeline was created can need feature sets it has no hit groups for,
+    // the pipeline is then rebuilt with them added and every record points at the new state object
+    std::vector<UINT> features = mPermutations;
+    for (auto& instance : instances)
+    {
+        for (auto& subMesh : instance->GetMesh()->GetSubMeshes())
+            features.push_back(GetHitGroupFeatures(assetMgr, subMesh));
+    }
 
-    // Map the buffer
-    uint8_t* pData;
-    mShaderTable->GetResource()->Map(0, nullptr, (void**)&pData);
+    bool rebuilt = false;
+    if (std::any_of(features.begin(), features.end(), [this](UINT f) { return !mLayout.HasPermutation(f); }))
+    {
+        // A set that failed is not recompiled every frame, a hot reload brings a fresh pipeline to retry with
+        std::vector<UINT> permutations = EnumeratePermutations(features);
+        if (permutations == mFailedPermutations)
+            return false;
+
+        if (!CreatePipelineState(device, mFilename.c_str(), permutations, mGlobalFeatures))
+        {
+            DebugLog("Pipeline: rebuild for new material feature sets failed, keeping the previous shader table");
+            mFailedPermutations = permutations;
+            return false;
+        }
+        rebuilt = true;
+    }
+
+    // One record per ray type for every geometry of every instance, the records are shader identifiers only
+    std::vector<UINT> geometryCounts(instances.size());
+    for (uint32_t i = 0; i < instances.size(); i++)
+        geometryCounts[i] = instances[i]->GetMesh()->GetSubMeshCount();
+
+    ShaderTableLayout layout(2, RAY_TYPE_COUNT, geometryCounts, 0);
+    mShaderTable.SetLayout(device, cmdList, alloc, tracker, assetMgr, layout);
+    if (rebuilt)
+    {
+        for (uint32_t i = 0; i < instances.size(); i++)
+            mShaderTable.MarkInstanceDirty(i);
+    }
 
     ComPtr<ID3D12StateObjectProperties> pRtsoProps;
     mPipelineState->QueryInterface(IID_PPV_ARGS(&pRtsoProps));
 
-    memcpy(pData, pRtsoProps->GetShaderIdentifier(kRayGenShader), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    uint64_t heapStart = assetMgr.GetIndexedGPUHandle(0).ptr;
-    *(uint64_t*)(pData + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES) = heapStart;
-
-    memcpy(pData + mShaderTableEntrySize, pRtsoProps->GetShaderIdentifier(kMissShader), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+    mShaderTable.WriteRayGenRecord(pRtsoProps->GetShaderIdentifier(kRayGenShader));
+    mShaderTable.WriteMissRecord(0, pRtsoProps->GetShaderIdentifier(kMissShader));
+    mShaderTable.WriteMissRecord(1, pRtsoProps->GetShaderIdentifier(kShadowMissShader));
 
-    memcpy(pData + mShaderTableEntrySize * 2 , pRtsoProps->GetShaderIdentifier(kShadowMissShader), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-
-    const std::vector<std::shared_ptr<Instance>> instances = assetMgr.GetInstances();
     for (uint32_t i = 0; i < instances.size(); i++)
-    {       
-        uint8_t* pHitEntry = pData + mShaderTableEntrySize * ((i * 2) + 3);
-        memcpy(pHitEntry, pRtsoProps->GetShaderIdentifier(kHitGroup), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-        uint8_t* pCbDesc = pHitEntry + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-        assert(((uint64_t)pCbDesc % 8) == 0);
-        *(D3D12_GPU_VIRTUAL_ADDRESS*)pCbDesc = instances[i]->GetInstanceCB()->GetGPUVirtualAddress(0);
-
-        memcpy(pHitEntry + mShaderTableEntrySize, pRtsoProps->GetShaderIdentifier(kShadowHitGroup), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-        uint8_t* pShadowCbDesc = pHitEntry + mShaderTableEntrySize + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-        assert(((uint64_t)pShadowCbDesc % 8) == 0);
-        *(D3D12_GPU_VIRTUAL_ADDRESS*)pShadowCbDesc = instances[i]->GetInstanceCB()->GetGPUVirtualAddress(0);
+    {
+        if (!mShaderTable.IsInstanceDirty(i))
+            continue;
+
+        // The TLAS and the shader table have to agree on where the instance's records start
+        assert(layout.GetInstanceHitGroupIndex(i) == instances[i]->GetHitGroupIndex());
+
+        // Geometry index in the BLAS is the submesh index, pick the hit groups by its material features
+        auto& subMeshes = instances[i]->GetMesh()->GetSubMeshes();
+        for (uint32_t j = 0; j < subMeshes.size(); j++)
+        {
+            const auto& hitGroups = mLayout.GetHitGroupNames(GetHitGroupFeatures(assetMgr, subMeshes[j]));
+
+            for (uint32_t k = 0; k < RAY_TYPE_COUNT; k++)
+                mShaderTable.WriteHitGroupRecord(i, j, k, pRtsoProps->GetShaderIdentifier(hitGroups[k].c_str()));
+        }
     }
 
-    // Unmap
-    mShaderTable->GetResource()->Unmap(0, nullptr);
-}
\ No newline at end of file
+    mShaderTable.ClearDirty();
+    return true;
+}
+
+UINT Pipeline::GetHitGroupFeatures(AssetManager& assetMgr, SubMesh& subMesh)
+{
+    UINT features = GetMaterialFeatures(assetMgr.GetMaterial(subMesh.GetMaterialIndex()), subMesh.IsAlphaTested());
+    return ReduceShaderFeatures(features | mGlobalFeatures);
+}
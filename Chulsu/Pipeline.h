@@ -1,25 +1,54 @@
 #pragma once
 #include "stdafx.h"
+#include "ShaderTable.h"
+#include "PipelineLayout.h"
 
 class AssetManager;
+class SubMesh;
 
 class Pipeline
 {
 public:
-	void CreatePipelineState(ComPtr<ID3D12Device5> device, const WCHAR* filename);
-	void CreateShaderTable(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList,
+	// Compiles a permutation of the library for every material feature set in assetMgr,
+	// globalFeatures are SHADER_FEATURE bits applied to all of them such as FEATURE_PBR.
+	void CreatePipelineState(ComPtr<ID3D12Device5> device, const WCHAR* filename, AssetManager& assetMgr, UINT globalFeatures = 0);
+	// Builds the given permutations, e.g. those of an existing pipeline after its source changed.
+	// Returns false and leaves the pipeline as it was when a library fails to compile or the state object is rejected.
+	bool CreatePipelineState(ComPtr<ID3D12Device5> device, const WCHAR* filename, const std::vector<UINT>& permutations, UINT globalFeatures);
+	bool CreateShaderTable(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList,
 		ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker, AssetManager& assetMgr);
+	// Follows the instances of assetMgr, rewriting only the records of new instances and those marked dirty.
+	// Rebuilds the pipeline when an instance needs a feature set it was not compiled for, so the GPU must not be using it.
+	// Returns false when that rebuild fails, the table is then left as it was.
+	bool UpdateShaderTable(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList,
+		ComPtr<D3D12MA::Allocator> alloc, ResourceStateTracker& tracker, AssetManager& assetMgr);
+	void MarkInstanceDirty(UINT instance) { mShaderTable.MarkInstanceDirty(instance); }
+	// True when UpdateShaderTable has records to write, for instances marked dirty or added since the last update.
+	bool IsShaderTableDirty(UINT instanceCount) const
+	{
+		return mShaderTable.HasDirtyInstances() || instanceCount != mShaderTable.GetLayout().GetInstanceCount();
+	}
 
-	ComPtr<D3D12MA::Allocation> GetShaderTable() { return mShaderTable; }
+	ShaderTable& GetShaderTable() { return mShaderTable; }
 	ComPtr<ID3D12RootSignature> GetGlobalRootSignature() { return mGlobalRootSig; }
 	ComPtr<ID3D12StateObject> GetStateObject() { return mPipelineState; }
-
-	UINT GetShaderTableEntrySize() { return mShaderTableEntrySize; }
+	const std::vector<UINT>& GetPermutations() const { return mPermutations; }
+	UINT GetGlobalFeatures() const { return mGlobalFeatures; }
+	const PipelineLayout& GetLayout() const { return mLayout; }
 
 protected:
-	UINT mShaderTableEntrySize = NULL;
+	UINT GetHitGroupFeatures(AssetManager& assetMgr, SubMesh& subMesh);
+
+	std::wstring mFilename;
+	UINT mGlobalFeatures = 0;
+	std::vector<UINT> mPermutations;
+	// Permutations of the last rebuild that failed
+	std::vector<UINT> mFailedPermutations;
+
+	// Exports and hit groups of the state object, hit group names per permutation
+	PipelineLayout mLayout;
 
-	ComPtr<D3D12MA::Allocation> mShaderTable = NULL;
+	ShaderTable mShaderTable;
 
 	ComPtr<ID3D12StateObject> mPipelineState = NULL;
 	ComPtr<ID3D12RootSignature> mGlobalRootSig = NULL;
@@ -0,0 +1,70 @@
+#include "PipelineLayout.h"
+#include "ShaderPermutation.h"
+
+PipelineLayout::PipelineLayout(const vector<UINT>& permutations)
+{
+	// Every permutation defines the same entry points, so its hit shaders are exported with a suffix.
+	// Ray generation and miss do not depend on the material and come from the first library only.
+	for (size_t i = 0; i < permutations.size(); i++)
+	{
+		UINT permutation = permutations[i];
+		wstring suffix = GetPermutationSuffix(permutation);
+		bool opacity = (permutation & FEATURE_OPACITY) != 0;
+
+		Library library = { permutation };
+		if (i == 0)
+		{
+			library.ExportNames = { kRayGenShader, kMissShader, kShadowMissShader };
+			library.ExportToRename = { nullptr, nullptr, nullptr };
+		}
+
+		wstring closestHit = kClosestHitShader + suffix;
+		library.ExportNames.push_back(closestHit);
+		library.ExportToRename.push_back(kClosestHitShader);
+
+		wstring anyHit, shadowAnyHit;
+		if (opacity)
+		{
+			anyHit = kAnyHitShader + suffix;
+			library.ExportNames.push_back(anyHit);
+			library.ExportToRename.push_back(kAnyHitShader);
+
+			shadowAnyHit = kShadowAnyHitShader + suffix;
+			library.ExportNames.push_back(shadowAnyHit);
+			library.ExportToRename.push_back(kShadowAnyHitShader);
+		}
+
+		mAssociatedExports.insert(mAssociatedExports.end(), library.ExportNames.begin(), library.ExportNames.end());
+		mLibraries.push_back(std::move(library));
+		AddSubobject(SubobjectType::Library, static_cast<UINT>(mLibraries.size() - 1));
+
+		// Opaque geometry never runs any-hit, only alpha tested geometry pays for it
+		wstring hitGroup = kHitGroup + suffix;
+		mHitGroups.push_back({ hitGroup, anyHit, closestHit });
+		AddSubobject(SubobjectType::HitGroup, static_cast<UINT>(mHitGroups.size() - 1));
+
+		wstring shadowHitGroup = kShadowHitGroup;
+		if (opacity)
+		{
+			shadowHitGroup += suffix;
+			mHitGroups.push_back({ shadowHitGroup, shadowAnyHit, L"" });
+			AddSubobject(SubobjectType::HitGroup, static_cast<UINT>(mHitGroups.size() - 1));
+		}
+
+		mHitGroupNames[permutation] = { hitGroup, shadowHitGroup };
+	}
+
+	// Shared by all opaque geometry, shadow rays skip closest hit
+	mHitGroups.push_back({ kShadowHitGroup, L"", L"" });
+	AddSubobject(SubobjectType::HitGroup, static_cast<UINT>(mHitGroups.size() - 1));
+
+	// The hit shaders find their instance through InstanceID(), so every export shares an empty local root signature
+	AddSubobject(SubobjectType::LocalRootSignature, 0);
+	AddSubobject(SubobjectType::ExportAssociation, static_cast<UINT>(mSubobjects.size() - 1));
+
+	AddSubobject(SubobjectType::ShaderConfig, 0);
+	AddSubobject(SubobjectType::ExportAssociation, static_cast<UINT>(mSubobjects.size() - 1));
+
+	AddSubobject(SubobjectType::PipelineConfig, 0);
+	AddSubobject(SubobjectType::GlobalRootSignature, 0);
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "stdafx.h"
+
+static const WCHAR* kRayGenShader = L"RayGen";
+
+static const WCHAR* kMissShader = L"Miss";
+static const WCHAR* kClosestHitShader = L"ClosestHit";
+static const WCHAR* kAnyHitShader = L"AnyHit";
+static const WCHAR* kHitGroup = L"HitGroup";
+
+// Shadow rays skip closest hit, so the opaque shadow hit group has no shaders at all.
+static const WCHAR* kShadowMissShader = L"ShadowMiss";
+static const WCHAR* kShadowAnyHitShader = L"ShadowAnyHit";
+static const WCHAR* kShadowHitGroup = L"ShadowHitGroup";
+
+// Subobjects of the ray tracing state object for a set of shader permutations, free of any device object.
+//   Library and hit groups of every permutation, the first library also exports ray generation and miss
+//   Shadow hit group shared by opaque geometry
+//   Local root signature, shader config and their associations to every export
+//   Pipeline config, global root signature
+// Pipeline::CreatePipelineState turns every entry into one D3D12_STATE_SUBOBJECT in the same order.
+class PipelineLayout
+{
+public:
+	enum class SubobjectType
+	{
+		Library,
+		HitGroup,
+		LocalRootSignature,
+		ExportAssociation,
+		ShaderConfig,
+		PipelineConfig,
+		GlobalRootSignature,
+	};
+
+	// Index is the library or hit group of the entry, for an association the subobject it associates.
+	struct Subobject
+	{
+		SubobjectType Type;
+		UINT Index;
+	};
+
+	// Exports ExportToRename[i] of the permutation's blob as ExportNames[i], nullptr keeps the entry point's own name.
+	struct Library
+	{
+		UINT Permutation;
+		vector<wstring> ExportNames;
+		vector<const WCHAR*> ExportToRename;
+	};
+
+	// Empty names import no shader.
+	struct HitGroup
+	{
+		wstring Name;
+		wstring AnyHit;
+		wstring ClosestHit;
+	};
+
+	PipelineLayout() = default;
+	explicit PipelineLayout(const vector<UINT>& permutations);
+
+	const vector<Subobject>& GetSubobjects() const { return mSubobjects; }
+	const vector<Library>& GetLibraries() const { return mLibraries; }
+	const vector<HitGroup>& GetHitGroups() const { return mHitGroups; }
+
+	// Every export of every library, both associations cover all of them.
+	const vector<wstring>& GetAssociatedExports() const { return mAssociatedExports; }
+
+	bool HasPermutation(UINT permutation) const { return mHitGroupNames.count(permutation) != 0; }
+	// Hit group export per ray type for records of geometry with the given reduced features.
+	const array<wstring, RAY_TYPE_COUNT>& GetHitGroupNames(UINT permutation) const { return mHitGroupNames.at(permutation); }
+
+private:
+	void AddSubobject(SubobjectType type, UINT index) { mSubobjects.push_back({ type, index }); }
+
+	vector<Subobject> mSubobjects;
+	vector<Library> mLibraries;
+	vector<HitGroup> mHitGroups;
+	vector<wstring> mAssociatedExports;
+
+	map<UINT, array<wstring, RAY_TYPE_COUNT>> mHitGroupNames;
+};
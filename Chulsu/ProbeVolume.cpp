@@ -0,0 +1,193 @@
+#include "ProbeVolume.h"
+#include "CpuRayTracer.h"
+#include "Parallel.h"
+#include "Profiler.h"
+
+void ProbeVolume::Place(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, float spacing)
+{
+	const float minimum[3] = { boundsMin.x, boundsMin.y, boundsMin.z };
+	const float maximum[3] = { boundsMax.x, boundsMax.y, boundsMax.z };
+	UINT dimensions[3];
+	float spacings[3];
+	for (UINT axis = 0; axis < 3; ++axis)
+	{
+		// Spread evenly so the last probe lands on the upper bound, a flat axis gets a single layer
+		float extent = max(maximum[axis] - minimum[axis], 0.0f);
+		dimensions[axis] = min(static_cast<UINT>(ceilf(extent / spacing)) + 1, mMaxProbesPerAxis);
+		spacings[axis] = dimensions[axis] > 1 ? extent / (dimensions[axis] - 1) : 1.0f;
+	}
+
+	mHeader = {};
+	mHeader.BoundsMin = boundsMin;
+	mHeader.Spacing = XMFLOAT3(spacings[0], spacings[1], spacings[2]);
+	mHeader.Dimensions = XMUINT3(dimensions[0], dimensions[1], dimensions[2]);
+	mHeader.ProbeCount = dimensions[0] * dimensions[1] * dimensions[2];
+	mProbes.assign(mHeader.ProbeCount, AmbientSHConstants{});
+}
+
+double ProbeVolume::Bake(const CpuRayTracer& tracer, UINT rayCount)
+{
+	PROFILE_ZONE("Probe Bake");
+
+	// Spherical Fibonacci directions, the same evenly spread set from every probe so each ray stands for 4 PI / rayCount
+	vector<XMFLOAT3> directions(rayCount);
+	vector<array<float, 9>> basis(rayCount);
+	const float goldenAngle = PI * (3.0f - sqrtf(5.0f));
+	for (UINT i = 0; i < rayCount; ++i)
+	{
+		float y = 1.0f - (2.0f * i + 1.0f) / rayCount;
+		float radius = sqrtf(max(1.0f - y * y, 0.0f));
+		float phi = goldenAngle * i;
+		directions[i] = XMFLOAT3(radius * cosf(phi), y, radius * sinf(phi));
+		EvaluateSH9Basis(directions[i], basis[i].data());
+	}
+
+	// Each ray stands for a cone of about the same solid angle, its textures are read at the matching mips
+	const RayCone cone = { 0.0f, sqrtf(4.0f * PI / rayCount) };
+
+	auto start = chrono::steady_clock::now();
+
+	ParallelFor(mHeader.ProbeCount, [&](UINT probe)
+		{
+			UINT x = probe % mHeader.Dimensions.x;
+			UINT y = probe / mHeader.Dimensions.x % mHeader.Dimensions.y;
+			UINT z = probe / (mHeader.Dimensions.x * mHeader.Dimensions.y);
+
+			RayDesc ray;
+			ray.Origin = XMFLOAT3(mHeader.BoundsMin.x + mHeader.Spacing.x * x, mHeader.BoundsMin.y + mHeader.Spacing.y * y,
+				mHeader.BoundsMin.z + mHeader.Spacing.z * z);
+			ray.TMin = 0.0f;
+			ray.TMax = 100000;
+
+			double sums[3][9] = {};
+			UINT backFaces = 0;
+			for (UINT i = 0; i < rayCount; ++i)
+			{
+				ray.Direction = directions[i];
+
+				// The probe and ray index seed the hit's random numbers like the pixel of a primary ray
+				bool backFace = false;
+				XMFLOAT3 radiance;
+				XMStoreFloat3(&radiance, tracer.TraceRadiance(ray, XMUINT2(probe, i), cone, &backFace));
+				backFaces += backFace ? 1 : 0;
+
+				for (UINT k = 0; k < 9; ++k)
+				{
+					sums[0][k] += radiance.x * basis[i][k];
+					sums[1][k] += radiance.y * basis[i][k];
+					sums[2][k] += radiance.z * basis[i][k];
+				}
+			}
+
+			SH9Color radiance;
+			const double weight = 4.0 * PI / rayCount;
+			for (UINT k = 0; k < 9; ++k)
+				radiance.Coefficients[k] = XMFLOAT3(static_cast<float>(sums[0][k] * weight), static_cast<float>(sums[1][k] * weight),
+					static_cast<float>(sums[2][k] * weight));
+
+			AmbientSHConstants& result = mProbes[probe];
+			result = ComputeAmbientSHConstants(radiance);
+			result.Coefficients[0].w = backFaces <= mMaxBackFaceRatio * rayCount ? 1.0f : 0.0f;
+		});
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return seconds > 0.0 ? mHeader.ProbeCount / seconds : 0.0;
+}
+
+bool ProbeVolume::Save(const wstring& path) const
+{
+	ProbeVolumeFileHeader header = {};
+	header.Magic = ProbeVolumeMagic;
+	header.Version = ProbeVolumeVersion;
+	header.Volume = mHeader;
+
+	// Written under a temporary name so an interrupted bake never leaves a truncated file behind.
+	filesystem::path tempPath = path + L".tmp";
+	{
+		ofstream file(tempPath, ios::binary | ios::trunc);
+		if (!file)
+			return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(mProbes.data()), mProbes.size() * sizeof(AmbientSHConstants));
+
+		if (!file)
+			return false;
+	}
+
+	error_code ec;
+	filesystem::rename(tempPath, path, ec);
+	return !ec;
+}
+
+bool ProbeVolume::Load(const wstring& path)
+{
+	ifstream file(filesystem::path(path), ios::binary);
+	if (!file)
+		return false;
+
+	ProbeVolumeFileHeader header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.Magic != ProbeVolumeMagic || header.Version != ProbeVolumeVersion)
+		return false;
+
+	const XMUINT3& dimensions = header.Volume.Dimensions;
+	if (dimensions.x == 0 || dimensions.y == 0 || dimensions.z == 0 || dimensions.x > mMaxProbesPerAxis || dimensions.y > mMaxProbesPerAxis
+		|| dimensions.z > mMaxProbesPerAxis || header.Volume.ProbeCount != dimensions.x * dimensions.y * dimensions.z)
+		return false;
+
+	vector<AmbientSHConstants> probes(header.Volume.ProbeCount);
+	file.read(reinterpret_cast<char*>(probes.data()), probes.size() * sizeof(AmbientSHConstants));
+	if (!file || file.peek() != ifstream::traits_type::eof())
+		return false;
+
+	mHeader = header.Volume;
+	mProbes = std::move(probes);
+	return true;
+}
+
+XMVECTOR ProbeVolume::Sample(FXMVECTOR position, FXMVECTOR normal) const
+{
+	if (mProbes.empty())
+		return XMVectorZero();
+
+	// Grid coordinates, clamped so surfaces outside the volume use its border probes
+	XMFLOAT3 cell;
+	XMStoreFloat3(&cell, XMVectorDivide(XMVectorSubtract(position, XMLoadFloat3(&mHeader.BoundsMin)), XMLoadFloat3(&mHeader.Spacing)));
+	const float coordinates[3] = { cell.x, cell.y, cell.z };
+	const UINT dimensions[3] = { mHeader.Dimensions.x, mHeader.Dimensions.y, mHeader.Dimensions.z };
+
+	UINT base[3];
+	float fraction[3];
+	for (UINT axis = 0; axis < 3; ++axis)
+	{
+		float c = clamp(coordinates[axis], 0.0f, static_cast<float>(dimensions[axis] - 1));
+		base[axis] = min(static_cast<UINT>(c), dimensions[axis] > 1 ? dimensions[axis] - 2 : 0);
+		fraction[axis] = c - base[axis];
+	}
+
+	// Trilinear blend of the valid probes around the position
+	XMVECTOR sum = XMVectorZero();
+	float weightSum = 0.0f;
+	for (UINT corner = 0; corner < 8; ++corner)
+	{
+		UINT index[3];
+		float weight = 1.0f;
+		for (UINT axis = 0; axis < 3; ++axis)
+		{
+			UINT offset = (corner >> axis) & 1;
+			index[axis] = min(base[axis] + offset, dimensions[axis] - 1);
+			weight *= offset ? fraction[axis] : 1.0f - fraction[axis];
+		}
+
+		const AmbientSHConstants& probe = mProbes[GetProbeIndex(index[0], index[1], index[2])];
+		weight *= probe.Coefficients[0].w;
+		if (weight > 0.0f)
+		{
+			sum = XMVectorAdd(sum, XMVectorScale(EvaluateAmbientSH(probe, normal), weight));
+			weightSum += weight;
+		}
+	}
+
+	return weightSum > 0.0f ? XMVectorScale(sum, 1.0f / weightSum) : XMVectorZero();
+}
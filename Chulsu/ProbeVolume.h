@@ -0,0 +1,74 @@
+#pragma once
+#include "stdafx.h"
+#include "SphericalHarmonics.h"
+
+class CpuRayTracer;
+
+// Written by --bake-probes and loaded by DX12Renderer and the software renderer when present.
+const wchar_t* const DefaultProbeVolumePath = L"Contents/Sponza/Sponza.probes";
+
+// Same layout as ProbeVolumeHeader in Shaders/ProbeVolume.hlsli.
+struct ProbeVolumeHeader
+{
+	XMFLOAT3 BoundsMin;		// Position of probe (0, 0, 0).
+	UINT ProbeCount;
+	XMFLOAT3 Spacing;		// Distance between neighbouring probes along each axis.
+	UINT Padding0;
+	XMUINT3 Dimensions;
+	UINT Padding1;
+};
+
+// On disk probe volume:
+//   ProbeVolumeFileHeader
+//   AmbientSHConstants[Volume.ProbeCount]
+struct ProbeVolumeFileHeader
+{
+	UINT Magic;
+	UINT Version;
+	ProbeVolumeHeader Volume;
+};
+
+const UINT ProbeVolumeMagic = 0x424F5250;		// "PROB" in the file.
+
+// Bump whenever ProbeVolumeHeader, AmbientSHConstants or the bake changes.
+const UINT ProbeVolumeVersion = 1;
+
+// Grid of irradiance probes over the scene for indirect diffuse light without per pixel GI rays.
+// Every probe holds the light arriving from all directions as SH, in the same form as the SH ambient of the sky,
+// so a surface between them reflects albedo times the trilinear blend of the eight around it.
+// Probes that mostly see back faces are inside geometry, they are marked invalid through the w of their first
+// coefficient and left out of the blend.
+class ProbeVolume
+{
+public:
+	ProbeVolume() = default;
+	~ProbeVolume() = default;
+
+	// Probes at most spacing apart with one on every corner of the bounds, capped at mMaxProbesPerAxis per axis.
+	void Place(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, float spacing);
+
+	// Traces rayCount rays from every probe through the tracer's BVH, shading hits like primary rays and misses with the sky.
+	// The tracer must not have a probe volume set. Probes run on the ParallelFor pool, returns probes per second.
+	double Bake(const CpuRayTracer& tracer, UINT rayCount);
+
+	bool Save(const wstring& path) const;
+	// Fails if the file is missing, truncated or from another version.
+	bool Load(const wstring& path);
+
+	// Same as SampleProbeVolume in Shaders/ProbeVolume.hlsli, normal must be unit length.
+	XMVECTOR Sample(FXMVECTOR position, FXMVECTOR normal) const;
+
+	bool IsLoaded() const { return !mProbes.empty(); }
+	const ProbeVolumeHeader& GetHeader() const { return mHeader; }
+	const vector<AmbientSHConstants>& GetProbes() const { return mProbes; }
+
+private:
+	UINT GetProbeIndex(UINT x, UINT y, UINT z) const { return (z * mHeader.Dimensions.y + y) * mHeader.Dimensions.x + x; }
+
+	static constexpr UINT mMaxProbesPerAxis = 64;
+	// Probes with more back face hits than this share of their rays are inside geometry.
+	static constexpr float mMaxBackFaceRatio = 0.25f;
+
+	ProbeVolumeHeader mHeader = {};
+	vector<AmbientSHConstants> mProbes;
+};
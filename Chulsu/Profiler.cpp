@@ -0,0 +1,374 @@
+#include "Profiler.h"
+
+namespace
+{
+	struct ProfilerRegistry
+	{
+		mutex Mutex;
+		vector<unique_ptr<ProfileThreadBuffer>> Buffers;
+		vector<ProfileThreadBuffer*> FreeThreadLanes;
+	};
+
+	// Buffers are kept until exit so events of finished threads still show up in the report.
+	ProfilerRegistry& GetRegistry()
+	{
+		static ProfilerRegistry registry;
+		return registry;
+	}
+
+	// Name of a lane until its thread names itself.
+	string GetDefaultLaneName(UINT laneId)
+	{
+		return "Thread " + to_string(laneId);
+	}
+
+	// Free lane last owned by a thread of that name, nullptr when there is none. Takes it out of the free list.
+	ProfileThreadBuffer* TakeFreeLane(ProfilerRegistry& registry, const function<bool(const ProfileThreadBuffer*)>& matches)
+	{
+		auto it = find_if(registry.FreeThreadLanes.begin(), registry.FreeThreadLanes.end(), matches);
+		if (it == registry.FreeThreadLanes.end())
+			return nullptr;
+
+		ProfileThreadBuffer* buffer = *it;
+		registry.FreeThreadLanes.erase(it);
+		return buffer;
+	}
+
+	// Separate from the registry lock, events are decoded while it is held.
+	struct ZoneNameTable
+	{
+		mutex Mutex;
+		vector<const char*> Names;
+		unordered_map<string, UINT> Ids;
+	};
+
+	ZoneNameTable& GetZoneNameTable()
+	{
+		static ZoneNameTable table;
+		return table;
+	}
+
+	// Reference point for converting timestamps, taken before the first zone can close.
+	struct ProfilerClockOrigin
+	{
+		uint64_t Ticks = Profiler::Timestamp();
+		chrono::steady_clock::time_point Time = chrono::steady_clock::now();
+	};
+
+	const ProfilerClockOrigin& GetClockOrigin()
+	{
+		static ProfilerClockOrigin origin;
+		return origin;
+	}
+
+	const ProfilerClockOrigin& gClockOrigin = GetClockOrigin();
+
+	// Nearest rank on sorted durations.
+	double Percentile(const vector<double>& sorted, double percentile)
+	{
+		size_t rank = static_cast<size_t>(ceil(percentile / 100.0 * sorted.size()));
+		return sorted[min(max(rank, size_t(1)), sorted.size()) - 1];
+	}
+
+	string EscapeJson(const string& str)
+	{
+		string escaped;
+		for (char c : str)
+		{
+			if (c == '"' || c == '\\')
+			{
+				escaped += '\\';
+				escaped += c;
+			}
+			else if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char code[8];
+				snprintf(code, sizeof(code), "\\u%04x", c);
+				escaped += code;
+			}
+			else
+			{
+				escaped += c;
+			}
+		}
+		return escaped;
+	}
+}
+
+ProfileThreadBuffer::~ProfileThreadBuffer()
+{
+	ProfileChunk* chunk = mHead.Next.load();
+	while (chunk != nullptr)
+	{
+		ProfileChunk* next = chunk->Next.load();
+		delete chunk;
+		chunk = next;
+	}
+}
+
+void ProfileThreadBuffer::ForEach(const function<void(const ProfileEvent&)>& func) const
+{
+	size_t count = mCount.load(memory_order_acquire);
+
+	// Every id in the buffer was registered before its event was pushed, so a snapshot taken now covers them
+	vector<const char*> names;
+	{
+		ZoneNameTable& table = GetZoneNameTable();
+		lock_guard<mutex> lock(table.Mutex);
+		names = table.Names;
+	}
+
+	const ProfileChunk* chunk = &mHead;
+	while (count > 0)
+	{
+		size_t chunkCount = min(count, size_t(ChunkSize));
+		for (size_t i = 0; i < chunkCount; ++i)
+		{
+			const PackedEvent& packed = chunk->Events[i];
+			uint64_t duration = packed.DurationAndName & MaxDuration;
+			UINT nameId = static_cast<UINT>(packed.DurationAndName >> DurationBits);
+			func({ names[nameId], packed.Start, packed.Start + duration });
+		}
+
+		count -= chunkCount;
+		if (count > 0)
+			chunk = chunk->Next.load(memory_order_acquire);
+	}
+}
+
+UINT Profiler::RegisterZoneName(const char* name)
+{
+	ZoneNameTable& table = GetZoneNameTable();
+	lock_guard<mutex> lock(table.Mutex);
+
+	auto [it, inserted] = table.Ids.try_emplace(name, static_cast<UINT>(table.Names.size()));
+	if (inserted)
+	{
+		assert(it->second <= ProfileThreadBuffer::MaxNameId);
+		table.Names.push_back(name);
+	}
+	return it->second;
+}
+
+ProfileThreadBuffer* Profiler::CreateLane(const string& name)
+{
+	ProfilerRegistry& registry = GetRegistry();
+	lock_guard<mutex> lock(registry.Mutex);
+
+	UINT laneId = static_cast<UINT>(registry.Buffers.size());
+	registry.Buffers.push_back(make_unique<ProfileThreadBuffer>(laneId));
+	registry.Buffers.back()->SetName(name.empty() ? GetDefaultLaneName(laneId) : name);
+	return registry.Buffers.back().get();
+}
+
+// Hands the lane of an exiting thread back to the registry, the next thread of the same name appends to it.
+struct Profiler::ThreadLaneGuard
+{
+	ProfileThreadBuffer* Buffer = nullptr;
+	// The lane holds events of an earlier thread, so it must not be renamed.
+	bool Reused = false;
+
+	~ThreadLaneGuard()
+	{
+		if (Buffer == nullptr)
+			return;
+
+		ThreadBufferSlot() = nullptr;
+
+		ProfilerRegistry& registry = GetRegistry();
+		lock_guard<mutex> lock(registry.Mutex);
+		registry.FreeThreadLanes.push_back(Buffer);
+	}
+};
+
+Profiler::ThreadLaneGuard& Profiler::GetThreadLaneGuard()
+{
+	thread_local ThreadLaneGuard guard;
+	return guard;
+}
+
+ProfileThreadBuffer* Profiler::AcquireThreadLane()
+{
+	// A new thread has no name yet, it only takes over lanes of threads that never named themselves either.
+	// The registry lock orders the previous owner's pushes before ours.
+	ProfileThreadBuffer* buffer = nullptr;
+	{
+		ProfilerRegistry& registry = GetRegistry();
+		lock_guard<mutex> lock(registry.Mutex);
+		buffer = TakeFreeLane(registry, [](const ProfileThreadBuffer* lane) { return lane->GetName() == GetDefaultLaneName(lane->GetLaneId()); });
+	}
+
+	ThreadLaneGuard& guard = GetThreadLaneGuard();
+	guard.Reused = buffer != nullptr;
+	guard.Buffer = buffer != nullptr ? buffer : CreateLane("");
+	return guard.Buffer;
+}
+
+void Profiler::SetThreadName(const string& name)
+{
+	ProfileThreadBuffer* buffer = GetThreadBuffer();
+	ThreadLaneGuard& guard = GetThreadLaneGuard();
+
+	ProfileThreadBuffer* named = nullptr;
+	{
+		ProfilerRegistry& registry = GetRegistry();
+		lock_guard<mutex> lock(registry.Mutex);
+		if (buffer->GetName() == name)
+			return;
+
+		// Renaming a lane an earlier thread wrote to would show its events under this name,
+		// so the thread moves to the lane of an exited thread of that name or to a new one
+		named = TakeFreeLane(registry, [&name](const ProfileThreadBuffer* lane) { return lane->GetName() == name; });
+		if (named == nullptr && !guard.Reused)
+		{
+			buffer->SetName(name);
+			return;
+		}
+
+		// Events pushed so far stay on the old lane under the old name
+		registry.FreeThreadLanes.push_back(buffer);
+	}
+
+	guard.Reused = named != nullptr;
+	guard.Buffer = named != nullptr ? named : CreateLane(name);
+	ThreadBufferSlot() = guard.Buffer;
+}
+
+double Profiler::GetTicksPerSecond()
+{
+#if PROFILER_USE_RDTSC
+	// The TSC rate is measured against steady_clock over the run so far, at least 100 ms for a stable value.
+	const ProfilerClockOrigin& origin = GetClockOrigin();
+	auto elapsed = chrono::steady_clock::now() - origin.Time;
+	if (elapsed < chrono::milliseconds(100))
+	{
+		this_thread::sleep_for(chrono::milliseconds(100) - elapsed);
+		elapsed = chrono::steady_clock::now() - origin.Time;
+	}
+
+	uint64_t ticks = Profiler::Timestamp() - origin.Ticks;
+	return ticks / chrono::duration<double>(elapsed).count();
+#else
+	return static_cast<double>(chrono::steady_clock::period::den) / chrono::steady_clock::period::num;
+#endif
+}
+
+double Profiler::TicksToMilliseconds(uint64_t ticks)
+{
+	return ticks * 1000.0 / GetTicksPerSecond();
+}
+
+vector<ProfileZoneStats> Profiler::GetZoneStats()
+{
+	// Durations are grouped by name pointer first, registration already gives equal names the same pointer
+	unordered_map<const char*, vector<uint64_t>> ticksByZone;
+	{
+		ProfilerRegistry& registry = GetRegistry();
+		lock_guard<mutex> lock(registry.Mutex);
+
+		for (const auto& buffer : registry.Buffers)
+		{
+			buffer->ForEach([&](const ProfileEvent& event)
+				{
+					ticksByZone[event.Name].push_back(event.End - event.Start);
+				});
+		}
+	}
+
+	double msPerTick = 1000.0 / GetTicksPerSecond();
+
+	map<string, vector<double>> durationsByName;
+	for (const auto& [name, ticks] : ticksByZone)
+	{
+		vector<double>& durations = durationsByName[name];
+		for (uint64_t t : ticks)
+			durations.push_back(t * msPerTick);
+	}
+
+	vector<ProfileZoneStats> stats;
+	for (auto& [name, durations] : durationsByName)
+	{
+		sort(durations.begin(), durations.end());
+
+		ProfileZoneStats zone;
+		zone.Name = name;
+		zone.Count = static_cast<UINT>(durations.size());
+		zone.Min = durations.front();
+		zone.Max = durations.back();
+		zone.Avg = accumulate(durations.begin(), durations.end(), 0.0) / durations.size();
+		zone.P95 = Percentile(durations, 95.0);
+		zone.P99 = Percentile(durations, 99.0);
+		stats.push_back(zone);
+	}
+
+	sort(stats.begin(), stats.end(), [](const ProfileZoneStats& a, const ProfileZoneStats& b)
+		{
+			return a.Avg * a.Count > b.Avg * b.Count;
+		});
+
+	return stats;
+}
+
+void Profiler::Report()
+{
+	vector<ProfileZoneStats> stats = GetZoneStats();
+	if (stats.empty())
+		return;
+
+	DebugLog("Profiler: zone, count, min / avg / p95 / p99 / max ms");
+	for (const auto& zone : stats)
+	{
+		ostringstream line;
+		line << fixed << setprecision(3) << "Profiler: " << zone.Name << ", " << zone.Count << ", "
+			<< zone.Min << " / " << zone.Avg << " / " << zone.P95 << " / " << zone.P99 << " / " << zone.Max;
+		DebugLog(line.str());
+	}
+}
+
+bool Profiler::ExportChromeTrace(const filesystem::path& path)
+{
+	ofstream file(path, ios::trunc);
+	if (!file)
+	{
+		DebugLog("Profiler: failed to open " + path.string());
+		return false;
+	}
+
+	uint64_t origin = GetClockOrigin().Ticks;
+	double usPerTick = 1000000.0 / GetTicksPerSecond();
+
+	// Complete ("X") events with microsecond times, each lane is a thread of a single process
+	file << fixed << setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Chulsu\"}}";
+
+	ProfilerRegistry& registry = GetRegistry();
+	lock_guard<mutex> lock(registry.Mutex);
+
+	for (const auto& buffer : registry.Buffers)
+	{
+		UINT tid = buffer->GetLaneId();
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+			<< ",\"args\":{\"name\":\"" << EscapeJson(buffer->GetName()) << "\"}}";
+		file << ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+			<< ",\"args\":{\"sort_index\":" << tid << "}}";
+
+		buffer->ForEach([&](const ProfileEvent& event)
+			{
+				// GPU lanes are converted from another clock and may start marginally before the origin
+				double start = static_cast<int64_t>(event.Start - origin) * usPerTick;
+				double duration = (event.End - event.Start) * usPerTick;
+				file << ",\n{\"name\":\"" << EscapeJson(event.Name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+					<< ",\"ts\":" << start << ",\"dur\":" << duration << "}";
+			});
+	}
+
+	file << "\n]}\n";
+	if (!file)
+	{
+		DebugLog("Profiler: failed to write " + path.string());
+		return false;
+	}
+
+	DebugLog("Profiler: trace written to " + path.string());
+	return true;
+}
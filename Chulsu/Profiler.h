@@ -0,0 +1,184 @@
+#pragma once
+#include "stdafx.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PROFILER_USE_RDTSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#define PROFILER_USE_RDTSC 0
+#endif
+
+// One closed zone, times are raw Profiler::Timestamp ticks.
+struct ProfileEvent
+{
+	const char* Name;
+	uint64_t Start;
+	uint64_t End;
+};
+
+// Per zone summary in milliseconds.
+struct ProfileZoneStats
+{
+	string Name;
+	UINT Count = 0;
+	double Min = 0.0;
+	double Avg = 0.0;
+	double P95 = 0.0;
+	double P99 = 0.0;
+	double Max = 0.0;
+};
+
+// Append only event storage of one trace lane, usually a thread. Events go into fixed size chunks that are never moved,
+// so the single writer pushes without locks and a reader sees every event published before its count.
+class ProfileThreadBuffer
+{
+public:
+	static const UINT ChunkSize = 4096;
+	static const UINT DurationBits = 40;
+	static const UINT MaxNameId = (1u << (64 - DurationBits)) - 1;
+
+	ProfileThreadBuffer(UINT laneId) : mTail(&mHead), mLaneId(laneId) {}
+	~ProfileThreadBuffer();
+
+	// Name ids come from Profiler::RegisterZoneName.
+	void Push(UINT nameId, uint64_t start, uint64_t end)
+	{
+		if (mTailCount == ChunkSize)
+		{
+			ProfileChunk* chunk = new ProfileChunk;
+			mTail->Next.store(chunk, memory_order_release);
+			mTail = chunk;
+			mTailCount = 0;
+		}
+
+		// Durations past the 40 bit range (minutes) saturate, a clock that went backwards records zero
+		uint64_t duration = end > start ? min(end - start, MaxDuration) : 0;
+		mTail->Events[mTailCount++] = { start, duration | (static_cast<uint64_t>(nameId) << DurationBits) };
+
+		// Only this thread writes the count, so the increment needs no atomic read back
+		mCount.store(++mPushed, memory_order_release);
+	}
+
+	// Safe to call from any thread while the owner keeps pushing.
+	void ForEach(const function<void(const ProfileEvent&)>& func) const;
+
+	UINT GetLaneId() const { return mLaneId; }
+
+	// Only touched under the profiler registry lock.
+	void SetName(const string& name) { mName = name; }
+	const string& GetName() const { return mName; }
+
+private:
+	static constexpr uint64_t MaxDuration = (uint64_t(1) << DurationBits) - 1;
+
+	// Stored form of a ProfileEvent, the name id shares a word with the duration to keep events at 16 bytes.
+	struct PackedEvent
+	{
+		uint64_t Start;
+		uint64_t DurationAndName;
+	};
+
+	struct ProfileChunk
+	{
+		array<PackedEvent, ChunkSize> Events;
+		atomic<ProfileChunk*> Next = nullptr;
+	};
+
+	ProfileChunk mHead;
+	ProfileChunk* mTail;
+	UINT mTailCount = 0;
+	size_t mPushed = 0;
+	atomic<size_t> mCount = 0;
+
+	UINT mLaneId;
+	string mName;
+};
+
+// Scoped CPU profiler. Zones are recorded into a buffer per thread and only merged when stats are requested,
+// so a zone costs two timestamp reads and a 16 byte store. Zone names must outlive the profiler, use string literals.
+class Profiler
+{
+public:
+	// Id of a zone name, equal names share an id. Takes a lock, PROFILE_ZONE calls it once per call site.
+	static UINT RegisterZoneName(const char* name);
+
+	static uint64_t Timestamp()
+	{
+#if PROFILER_USE_RDTSC
+		return __rdtsc();
+#else
+		return static_cast<uint64_t>(chrono::steady_clock::now().time_since_epoch().count());
+#endif
+	}
+
+	static void Record(UINT nameId, uint64_t start, uint64_t end)
+	{
+		GetThreadBuffer()->Push(nameId, start, end);
+	}
+
+	// Names the lane of the calling thread in exported traces. A thread on a lane inherited from an exited thread
+	// moves to a lane of its new name instead, so the earlier events keep the name they were recorded under.
+	static void SetThreadName(const string& name);
+
+	// Lane for events that do not happen on a CPU thread, e.g. GPU queue timestamps converted to profiler ticks.
+	// Only one thread may push to it. An empty name is replaced by "Thread <lane id>".
+	static ProfileThreadBuffer* CreateLane(const string& name);
+
+	static double GetTicksPerSecond();
+	static double TicksToMilliseconds(uint64_t ticks);
+
+	// Sorted by total time spent in the zone, most expensive first.
+	static vector<ProfileZoneStats> GetZoneStats();
+	static void Report();
+
+	// Writes every recorded zone in the Chrome trace event format, one lane per thread,
+	// for chrome://tracing or ui.perfetto.dev. Times are relative to program start.
+	static bool ExportChromeTrace(const filesystem::path& path);
+
+private:
+	struct ThreadLaneGuard;
+
+	static ProfileThreadBuffer*& ThreadBufferSlot()
+	{
+		thread_local ProfileThreadBuffer* buffer = nullptr;
+		return buffer;
+	}
+
+	static ProfileThreadBuffer* GetThreadBuffer()
+	{
+		ProfileThreadBuffer*& buffer = ThreadBufferSlot();
+		if (buffer == nullptr)
+			buffer = AcquireThreadLane();
+
+		return buffer;
+	}
+
+	// Lanes of exited threads are reused by threads of the same name, so threads started per task do not grow
+	// the registry without bound.
+	static ProfileThreadBuffer* AcquireThreadLane();
+	static ThreadLaneGuard& GetThreadLaneGuard();
+};
+
+class ProfileZone
+{
+public:
+	ProfileZone(UINT nameId) : mNameId(nameId), mStart(Profiler::Timestamp()) {}
+	~ProfileZone() { Profiler::Record(mNameId, mStart, Profiler::Timestamp()); }
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	UINT mNameId;
+	uint64_t mStart;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) \
+	static const UINT PROFILE_CONCAT(profileZoneName, __LINE__) = Profiler::RegisterZoneName(name); \
+	ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(PROFILE_CONCAT(profileZoneName, __LINE__))
@@ -1,5 +1,6 @@
 #pragma once
 #include "stdafx.h"
+#include "CameraPath.h"
 
 class Renderer
 {
@@ -17,6 +18,9 @@ public:
 
 	virtual void SetDeltaTime(float elapsedTime) { mDeltaTime = elapsedTime; }
 
+	// The camera follows the path by the accumulated delta time instead of the keyboard and mouse.
+	void PlayCameraPath(shared_ptr<const CameraPath> path) { mCameraPath = path; mCameraPathTime = 0.0f; }
+
 protected:
 	virtual void OnResize() = 0;
 
@@ -31,4 +35,8 @@ protected:
 	XMFLOAT2 mSwapChainSize = {0, 0};
 	float mDeltaTime;
 	POINT mLastMousePos{};
+
+	shared_ptr<const CameraPath> mCameraPath;
+	float mCameraPathTime = 0.0f;
+	CameraPathRecorder mCameraPathRecorder;
 };
\ No newline at end of file
@@ -0,0 +1,931 @@
+#include "SelfTest.h"
+#include "CpuTexture.h"
+#include "OpacityClassifier.h"
+#include "ShaderTable.h"
+#include "PipelineLayout.h"
+#include "ShaderPermutation.h"
+#include "Material.h"
+#include "Camera.h"
+#include "LightBVH.h"
+#include "EnvironmentMap.h"
+#include "SphericalHarmonics.h"
+#include "TextureLOD.h"
+
+namespace
+{
+	// Counts the checks of one test and logs the failed ones.
+	class SelfTestContext
+	{
+	public:
+		void Expect(bool condition, const string& message)
+		{
+			++mChecks;
+			if (condition)
+				return;
+
+			// The first few are enough to see the pattern
+			if (++mFailures <= mMaxLoggedFailures)
+				DebugLog("    FAILED: " + message);
+		}
+
+		UINT GetChecks() const { return mChecks; }
+		UINT GetFailures() const { return mFailures; }
+
+	private:
+		static constexpr UINT mMaxLoggedFailures = 10;
+
+		UINT mChecks = 0;
+		UINT mFailures = 0;
+	};
+
+	// Random UV triangles against a blocky random opacity map. Dense bilinear samples inside the triangle are the reference:
+	// a triangle classified opaque or transparent must not have a sample on the other side of the cutoff,
+	// and one with samples on both sides must be mixed.
+	void TestOpacityClassification(SelfTestContext& test)
+	{
+		const UINT textureSize = 32;
+		const UINT blockSize = 4;
+		const float cutoff = 0.5f;
+		const UINT steps = 48;
+
+		mt19937 random(29);
+		uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		// Blocks of texels on one side so small triangles can be uniform, ClassifyTriangleOpacity reads the red channel
+		vector<XMUBYTEN4> texels(textureSize * textureSize);
+		vector<float> blocks((textureSize / blockSize) * (textureSize / blockSize));
+		for (float& block : blocks)
+			block = unit(random) < 0.5f ? 0.0f : 1.0f;
+		for (UINT y = 0; y < textureSize; ++y)
+		{
+			for (UINT x = 0; x < textureSize; ++x)
+			{
+				float opacity = blocks[(y / blockSize) * (textureSize / blockSize) + x / blockSize];
+				XMStoreUByteN4(&texels[y * textureSize + x], XMVectorReplicate(opacity));
+			}
+		}
+
+		CpuTexture opacityMap;
+		opacityMap.Create(textureSize, textureSize, std::move(texels));
+
+		const float extents[] = { 0.01f, 0.05f, 0.2f };
+		UINT counts[3] = {};
+		for (UINT i = 0; i < 3000; ++i)
+		{
+			float extent = extents[i % size(extents)];
+			XMFLOAT2 center(unit(random), unit(random));
+			XMFLOAT2 uv[3];
+			for (XMFLOAT2& corner : uv)
+				corner = XMFLOAT2(center.x + (unit(random) - 0.5f) * extent, center.y + (unit(random) - 0.5f) * extent);
+
+			TRIANGLE_OPACITY opacity = ClassifyTriangleOpacity(opacityMap, uv[0], uv[1], uv[2], cutoff);
+			counts[opacity]++;
+
+			bool anyOpaque = false;
+			bool anyTransparent = false;
+			for (UINT a = 0; a <= steps; ++a)
+			{
+				for (UINT b = 0; a + b <= steps; ++b)
+				{
+					float w1 = static_cast<float>(a) / steps;
+					float w2 = static_cast<float>(b) / steps;
+					float w0 = 1.0f - w1 - w2;
+					XMFLOAT2 p(w0 * uv[0].x + w1 * uv[1].x + w2 * uv[2].x, w0 * uv[0].y + w1 * uv[1].y + w2 * uv[2].y);
+
+					if (XMVectorGetX(opacityMap.Sample(p)) >= cutoff)
+						anyOpaque = true;
+					else
+						anyTransparent = true;
+				}
+			}
+
+			string triangle = "triangle " + to_string(i);
+			if (opacity == OPACITY_OPAQUE)
+				test.Expect(!anyTransparent, triangle + " classified opaque has transparent samples");
+			else if (opacity == OPACITY_TRANSPARENT)
+				test.Expect(!anyOpaque, triangle + " classified transparent has opaque samples");
+
+			if (anyOpaque && anyTransparent)
+				test.Expect(opacity == OPACITY_MIXED, triangle + " has samples on both sides but is not mixed");
+		}
+
+		// Otherwise the checks above would pass trivially
+		test.Expect(counts[OPACITY_OPAQUE] > 0 && counts[OPACITY_TRANSPARENT] > 0 && counts[OPACITY_MIXED] > 0,
+			"expected every class, got " + to_string(counts[OPACITY_OPAQUE]) + " opaque, "
+			+ to_string(counts[OPACITY_TRANSPARENT]) + " transparent, " + to_string(counts[OPACITY_MIXED]) + " mixed");
+	}
+
+	// Record offsets of ShaderTableLayout against the addressing DispatchRays does: every table starts aligned,
+	// records of a table are one stride apart and hit group record i is at i * stride from the table start, where
+	// i = InstanceContributionToHitGroupIndex + geometry * ray type count + ray type.
+	void TestShaderTableLayout(SelfTestContext& test)
+	{
+		const UINT localRootDataSizes[] = { 0, 8, 40 };
+		const vector<UINT> geometryCounts = { 3, 1, 0, 4, 2 };
+		for (UINT localRootDataSize : localRootDataSizes)
+		{
+			ShaderTableLayout layout(2, RAY_TYPE_COUNT, geometryCounts, localRootDataSize);
+			string name = "local root data of " + to_string(localRootDataSize) + " bytes: ";
+
+			UINT stride = layout.GetRecordSize();
+			test.Expect(stride % D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT == 0, name + "stride " + to_string(stride) + " is not aligned");
+			test.Expect(stride >= D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + localRootDataSize, name + "stride " + to_string(stride) + " is too small");
+			test.Expect(stride < D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + localRootDataSize + D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT,
+				name + "stride " + to_string(stride) + " has more padding than the alignment needs");
+
+			test.Expect(layout.GetRayGenOffset() == 0, name + "ray generation record is not first");
+			test.Expect(layout.GetMissTableOffset() % D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT == 0, name + "miss table is not aligned");
+			test.Expect(layout.GetHitGroupTableOffset() % D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT == 0, name + "hit group table is not aligned");
+			test.Expect(layout.GetMissTableOffset() >= stride, name + "miss table overlaps the ray generation record");
+			test.Expect(layout.GetHitGroupTableOffset() >= layout.GetMissTableOffset() + layout.GetMissCount() * stride,
+				name + "hit group table overlaps the miss table");
+
+			for (UINT miss = 0; miss < layout.GetMissCount(); ++miss)
+				test.Expect(layout.GetMissRecordOffset(miss) == layout.GetMissTableOffset() + miss * stride, name + "miss record " + to_string(miss));
+
+			// Every record once, in the order DispatchRays indexes them, and nothing past the end
+			UINT expectedIndex = 0;
+			for (UINT instance = 0; instance < layout.GetInstanceCount(); ++instance)
+			{
+				UINT hitGroupIndex = layout.GetInstanceHitGroupIndex(instance);
+				test.Expect(hitGroupIndex == expectedIndex, name + "instance " + to_string(instance) + " starts at record "
+					+ to_string(hitGroupIndex) + " instead of " + to_string(expectedIndex));
+
+				for (UINT geometry = 0; geometry < geometryCounts[instance]; ++geometry)
+				{
+					for (UINT rayType = 0; rayType < RAY_TYPE_COUNT; ++rayType)
+					{
+						UINT record = hitGroupIndex + geometry * RAY_TYPE_COUNT + rayType;
+						test.Expect(layout.GetHitGroupRecordOffset(instance, geometry, rayType) == layout.GetHitGroupTableOffset() + record * stride,
+							name + "hit group record of instance " + to_string(instance) + ", geometry " + to_string(geometry) + ", ray type " + to_string(rayType));
+					}
+				}
+				expectedIndex += geometryCounts[instance] * RAY_TYPE_COUNT;
+			}
+
+			test.Expect(layout.GetHitGroupRecordCount() == expectedIndex, name + "hit group record count");
+			test.Expect(layout.GetSize() == layout.GetHitGroupTableOffset() + expectedIndex * stride, name + "table size");
+		}
+	}
+
+	// Subobjects of PipelineLayout against the state object D3D12 expects: one library and hit group per permutation
+	// plus a shadow hit group for alpha tested ones, each export named once and covered by both associations, and the
+	// hit groups of every permutation importing the shaders compiled with its features.
+	void TestPipelineSubobjects(SelfTestContext& test)
+	{
+		using Type = PipelineLayout::SubobjectType;
+		const UINT featureSetCount = 1u << ShaderFeatureCount;
+
+		mt19937 random(30);
+		vector<UINT> allFeatures(featureSetCount);
+		iota(allFeatures.begin(), allFeatures.end(), 0);
+
+		// Single opaque and alpha tested permutations, every reduced feature set and random scenes
+		vector<vector<UINT>> permutationSets = { { 0 }, { FEATURE_OPACITY }, EnumeratePermutations(allFeatures) };
+		for (UINT trial = 0; trial < 50; ++trial)
+		{
+			vector<UINT> features(1 + random() % 12);
+			for (UINT& feature : features)
+				feature = random() % featureSetCount;
+			permutationSets.push_back(EnumeratePermutations(features));
+		}
+
+		for (const vector<UINT>& permutations : permutationSets)
+		{
+			PipelineLayout layout(permutations);
+			const vector<PipelineLayout::Subobject>& subobjects = layout.GetSubobjects();
+			string name = to_string(permutations.size()) + " permutations: ";
+
+			UINT opacityCount = static_cast<UINT>(count_if(permutations.begin(), permutations.end(), [](UINT p) { return (p & FEATURE_OPACITY) != 0; }));
+			test.Expect(subobjects.size() == permutations.size() * 2 + opacityCount + 7, name + to_string(subobjects.size()) + " subobjects");
+			test.Expect(layout.GetLibraries().size() == permutations.size(), name + to_string(layout.GetLibraries().size()) + " libraries");
+			test.Expect(layout.GetHitGroups().size() == permutations.size() + opacityCount + 1, name + to_string(layout.GetHitGroups().size()) + " hit groups");
+
+			map<Type, UINT> typeCounts;
+			set<UINT> libraryIndices, hitGroupIndices;
+			for (UINT i = 0; i < subobjects.size(); ++i)
+			{
+				typeCounts[subobjects[i].Type]++;
+				if (subobjects[i].Type == Type::Library)
+					libraryIndices.insert(subobjects[i].Index);
+				if (subobjects[i].Type == Type::HitGroup)
+					hitGroupIndices.insert(subobjects[i].Index);
+
+				// An association refers to a subobject that an association can carry
+				if (subobjects[i].Type == Type::ExportAssociation)
+				{
+					UINT target = subobjects[i].Index;
+					test.Expect(target < subobjects.size() && (subobjects[target].Type == Type::LocalRootSignature || subobjects[target].Type == Type::ShaderConfig),
+						name + "association " + to_string(i) + " points at subobject " + to_string(target));
+				}
+			}
+			test.Expect(libraryIndices.size() == layout.GetLibraries().size() && (libraryIndices.empty() || *libraryIndices.rbegin() < layout.GetLibraries().size()),
+				name + "libraries are not each in the state object once");
+			test.Expect(hitGroupIndices.size() == layout.GetHitGroups().size() && *hitGroupIndices.rbegin() < layout.GetHitGroups().size(),
+				name + "hit groups are not each in the state object once");
+			test.Expect(typeCounts[Type::LocalRootSignature] == 1 && typeCounts[Type::ShaderConfig] == 1 && typeCounts[Type::ExportAssociation] == 2
+				&& typeCounts[Type::PipelineConfig] == 1 && typeCounts[Type::GlobalRootSignature] == 1, name + "expected one of each config subobject and two associations");
+
+			// Each export once over all libraries, ray generation and miss only from the first
+			set<wstring> exports;
+			UINT exportCount = 0;
+			for (UINT i = 0; i < layout.GetLibraries().size(); ++i)
+			{
+				const PipelineLayout::Library& library = layout.GetLibraries()[i];
+				test.Expect(library.Permutation == permutations[i], name + "library " + to_string(i) + " is not compiled for permutation " + to_string(i));
+				test.Expect(library.ExportNames.size() == library.ExportToRename.size(), name + "library " + to_string(i) + " renames another export count");
+				exports.insert(library.ExportNames.begin(), library.ExportNames.end());
+				exportCount += static_cast<UINT>(library.ExportNames.size());
+
+				bool hasRayGen = find(library.ExportNames.begin(), library.ExportNames.end(), kRayGenShader) != library.ExportNames.end();
+				test.Expect(hasRayGen == (i == 0), name + "library " + to_string(i) + (hasRayGen ? " exports" : " does not export") + " ray generation");
+			}
+			test.Expect(exports.size() == exportCount, name + "an export is named twice");
+			for (const WCHAR* shader : { kRayGenShader, kMissShader, kShadowMissShader })
+				test.Expect(exports.count(shader) == 1, name + wstringTostring(shader) + " is not exported");
+
+			const vector<wstring>& associated = layout.GetAssociatedExports();
+			test.Expect(set<wstring>(associated.begin(), associated.end()) == exports && associated.size() == exports.size(),
+				name + "the associations do not cover every export exactly once");
+
+			// Imports of every hit group are exports, and no two hit groups share a name
+			set<wstring> hitGroupNames;
+			for (const PipelineLayout::HitGroup& hitGroup : layout.GetHitGroups())
+			{
+				hitGroupNames.insert(hitGroup.Name);
+				test.Expect(hitGroup.AnyHit.empty() || exports.count(hitGroup.AnyHit), name + wstringTostring(hitGroup.Name) + " imports a missing any-hit shader");
+				test.Expect(hitGroup.ClosestHit.empty() || exports.count(hitGroup.ClosestHit), name + wstringTostring(hitGroup.Name) + " imports a missing closest hit shader");
+			}
+			test.Expect(hitGroupNames.size() == layout.GetHitGroups().size(), name + "two hit groups share a name");
+
+			for (UINT permutation : permutations)
+			{
+				string permutationName = name + "permutation " + to_string(permutation) + ": ";
+				test.Expect(layout.HasPermutation(permutation), permutationName + "has no hit groups");
+				if (!layout.HasPermutation(permutation))
+					continue;
+
+				wstring suffix = GetPermutationSuffix(permutation);
+				bool opacity = (permutation & FEATURE_OPACITY) != 0;
+				const array<wstring, RAY_TYPE_COUNT>& names = layout.GetHitGroupNames(permutation);
+
+				auto findHitGroup = [&](const wstring& hitGroupName) -> const PipelineLayout::HitGroup*
+				{
+					for (const PipelineLayout::HitGroup& hitGroup : layout.GetHitGroups())
+					{
+						if (hitGroup.Name == hitGroupName)
+							return &hitGroup;
+					}
+					return nullptr;
+				};
+
+				const PipelineLayout::HitGroup* primary = findHitGroup(names[0]);
+				test.Expect(primary && primary->ClosestHit == kClosestHitShader + suffix && primary->AnyHit == (opacity ? kAnyHitShader + suffix : L""),
+					permutationName + "primary rays do not run its own hit shaders");
+
+				// Opaque geometry shares the shadow hit group without shaders
+				const PipelineLayout::HitGroup* shadow = findHitGroup(names[1]);
+				test.Expect(shadow && shadow->ClosestHit.empty() && shadow->AnyHit == (opacity ? kShadowAnyHitShader + suffix : L""),
+					permutationName + "shadow rays do not run its own any-hit shader");
+				test.Expect((names[1] == kShadowHitGroup) != opacity, permutationName + "uses the wrong shadow hit group");
+			}
+
+			for (UINT features = 0; features < featureSetCount; ++features)
+			{
+				bool listed = find(permutations.begin(), permutations.end(), features) != permutations.end();
+				test.Expect(layout.HasPermutation(features) == listed, name + "feature set " + to_string(features) + (listed ? " is missing" : " was not asked for"));
+			}
+		}
+	}
+
+	// Hit group records of every instance start where the TLAS puts them, and IsInstanceUnchanged only keeps
+	// the records of instances that are at the same offsets after the scene changed.
+	void TestShaderTableInstances(SelfTestContext& test)
+	{
+		const vector<UINT> geometryCounts = { 3, 1, 4, 2 };
+		ShaderTableLayout layout(2, RAY_TYPE_COUNT, geometryCounts, 0);
+
+		// Same running sum BuildTLAS uses for InstanceContributionToHitGroupIndex
+		UINT hitGroupIndex = 0;
+		for (UINT i = 0; i < geometryCounts.size(); ++i)
+		{
+			test.Expect(layout.GetInstanceHitGroupIndex(i) == hitGroupIndex, "instance " + to_string(i) + " does not start where the TLAS expects");
+			test.Expect(layout.IsInstanceUnchanged(layout, i), "instance " + to_string(i) + " changed against its own layout");
+			hitGroupIndex += geometryCounts[i] * RAY_TYPE_COUNT;
+		}
+		test.Expect(!layout.IsInstanceUnchanged(layout, static_cast<UINT>(geometryCounts.size())), "instance past the end is unchanged");
+
+		// A new instance at the end leaves the others where they are
+		vector<UINT> appended = geometryCounts;
+		appended.push_back(5);
+		ShaderTableLayout appendedLayout(2, RAY_TYPE_COUNT, appended, 0);
+		for (UINT i = 0; i < geometryCounts.size(); ++i)
+			test.Expect(appendedLayout.IsInstanceUnchanged(layout, i), "appending moved instance " + to_string(i));
+		test.Expect(!appendedLayout.IsInstanceUnchanged(layout, static_cast<UINT>(geometryCounts.size())), "the appended instance is unchanged");
+
+		// Another mesh on instance 1 moves its records and those of every later instance
+		vector<UINT> remeshed = geometryCounts;
+		remeshed[1] = 2;
+		ShaderTableLayout remeshedLayout(2, RAY_TYPE_COUNT, remeshed, 0);
+		test.Expect(remeshedLayout.IsInstanceUnchanged(layout, 0), "instance 0 moved although it comes first");
+		for (UINT i = 1; i < geometryCounts.size(); ++i)
+			test.Expect(!remeshedLayout.IsInstanceUnchanged(layout, i), "instance " + to_string(i) + " kept its records after instance 1 grew");
+
+		// Local root data changes the stride of every record, and another miss count can move the hit group table
+		ShaderTableLayout strideLayout(2, RAY_TYPE_COUNT, geometryCounts, 8);
+		ShaderTableLayout missLayout(3, RAY_TYPE_COUNT, geometryCounts, 0);
+		for (UINT i = 0; i < geometryCounts.size(); ++i)
+		{
+			test.Expect(!strideLayout.IsInstanceUnchanged(layout, i), "instance " + to_string(i) + " kept its records with another stride");
+			test.Expect(missLayout.IsInstanceUnchanged(layout, i) == (missLayout.GetHitGroupTableOffset() == layout.GetHitGroupTableOffset()),
+				"instance " + to_string(i) + " with another miss count");
+		}
+	}
+
+	// EnumeratePermutations against a brute force reduction of every feature set, in shuffled orders,
+	// and the defines and export suffixes that make each permutation its own library.
+	void TestPermutationEnumeration(SelfTestContext& test)
+	{
+		const UINT featureSetCount = 1u << ShaderFeatureCount;
+
+		mt19937 random(31);
+		for (UINT trial = 0; trial < 200; ++trial)
+		{
+			// Random multiset of feature sets, duplicates included
+			vector<UINT> features(random() % 40);
+			for (UINT& feature : features)
+				feature = random() % featureSetCount;
+
+			set<UINT> expected;
+			for (UINT feature : features)
+			{
+				UINT reduced = feature;
+				if (!(reduced & FEATURE_PBR))
+					reduced &= ~(FEATURE_METALIC | FEATURE_ROUGHNESS | FEATURE_NORMALMAP);
+				expected.insert(reduced);
+			}
+
+			vector<UINT> permutations = EnumeratePermutations(features);
+			test.Expect(permutations == vector<UINT>(expected.begin(), expected.end()),
+				"trial " + to_string(trial) + ": " + to_string(permutations.size()) + " permutations instead of " + to_string(expected.size()));
+
+			shuffle(features.begin(), features.end(), random);
+			test.Expect(EnumeratePermutations(features) == permutations, "trial " + to_string(trial) + " depends on the order of the feature sets");
+		}
+
+		set<wstring> suffixes;
+		for (UINT features = 0; features < featureSetCount; ++features)
+		{
+			vector<ShaderDefine> defines = GetFeatureDefines(features);
+			test.Expect(defines.size() == ShaderFeatureCount, "feature set " + to_string(features) + " has " + to_string(defines.size()) + " defines");
+
+			set<wstring> names;
+			for (UINT i = 0; i < defines.size(); ++i)
+			{
+				names.insert(defines[i].Name);
+				test.Expect(defines[i].Value == ((features & (1u << i)) ? L"1" : L"0"),
+					"feature set " + to_string(features) + " defines " + wstringTostring(defines[i].Name) + " as " + wstringTostring(defines[i].Value));
+			}
+			test.Expect(names.size() == ShaderFeatureCount, "feature set " + to_string(features) + " repeats a define");
+
+			suffixes.insert(GetPermutationSuffix(features));
+		}
+		test.Expect(suffixes.size() == featureSetCount, "two permutations share an export suffix");
+
+		// Only alpha tested masked geometry with an opacity map needs the any-hit shaders
+		Material material;
+		material.AlbedoTextureIndex = 1;
+		material.OpacityMapTextureIndex = 2;
+		material.AlphaMode = ALPHA_MODE_MASK;
+		test.Expect(GetMaterialFeatures(material, true) == (FEATURE_ALBEDO | FEATURE_OPACITY), "masked alpha tested material");
+		test.Expect(GetMaterialFeatures(material, false) == FEATURE_ALBEDO, "masked material classified opaque");
+		material.AlphaMode = ALPHA_MODE_OPAQUE;
+		test.Expect(GetMaterialFeatures(material, true) == FEATURE_ALBEDO, "opaque material with an opacity map");
+	}
+
+	bool MatricesNear(const XMFLOAT4X4& a, const XMFLOAT4X4& b, float epsilon)
+	{
+		for (UINT row = 0; row < 4; ++row)
+		{
+			for (UINT col = 0; col < 4; ++col)
+			{
+				if (fabsf(a(row, col) - b(row, col)) > epsilon * max(1.0f, fabsf(b(row, col))))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	// Random moves, turns and lens changes with Update in between only some of them. After every Update the cached
+	// matrices must match ones derived from the current camera axes and lens, HasChanged must tell whether anything
+	// was set since the Update before, and the previous frame's matrices must be the ones cached back then.
+	void TestCameraMatrixCache(SelfTestContext& test)
+	{
+		mt19937 random(39);
+		uniform_real_distribution<float> unit(0.0f, 1.0f);
+		auto randomPoint = [&](float range)
+		{
+			return XMFLOAT3((unit(random) - 0.5f) * range, (unit(random) - 0.5f) * range, (unit(random) - 0.5f) * range);
+		};
+
+		Camera camera;
+		camera.SetLens(0.25f * PI, 16.0f / 9.0f, 1.0f, 1000.0f);
+		camera.Update(0.0f);
+
+		XMFLOAT4X4 previousView = camera.GetView();
+		XMFLOAT4X4 previousViewProj = camera.GetViewProj();
+		bool changed = false;
+		for (UINT step = 0; step < 2000; ++step)
+		{
+			switch (random() % 8)
+			{
+			case 0: camera.SetPosition(randomPoint(200.0f)); changed = true; break;
+			case 1: camera.Move(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f); changed = true; break;
+			case 2: camera.Pitch((unit(random) - 0.5f) * 20.0f); changed = true; break;
+			case 3: camera.RotateY((unit(random) - 0.5f) * 90.0f); changed = true; break;
+			case 4: camera.SetLens((0.2f + unit(random)) * 0.5f * PI, 0.5f + unit(random) * 2.0f, 0.1f + unit(random), 500.0f + unit(random) * 1000.0f); changed = true; break;
+			case 5: camera.LookAt(randomPoint(200.0f), randomPoint(10.0f), XMFLOAT3(0.0f, 1.0f, 0.0f)); changed = true; break;
+			case 6:
+			{
+				XMVECTOR axis = XMVector3Normalize(XMVectorSet(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f, 0.0f));
+				XMFLOAT4 orientation;
+				XMStoreFloat4(&orientation, XMQuaternionRotationAxis(axis, unit(random) * 2.0f * PI));
+				camera.SetOrientation(orientation);
+				changed = true;
+				break;
+			}
+			default: break;
+			}
+
+			// Several changes before one Update on purpose
+			if (unit(random) < 0.6f)
+				continue;
+
+			camera.Update(1.0f / 60.0f);
+			string name = "step " + to_string(step) + ": ";
+
+			test.Expect(camera.HasChanged() == changed, name + (changed ? "changes not reported" : "reported a change without one"));
+			test.Expect(MatricesNear(camera.GetOldView(), previousView, 1e-6f), name + "old view is not the view of the frame before");
+			test.Expect(MatricesNear(camera.GetOldViewProj(), previousViewProj, 1e-6f), name + "old view projection is not the one of the frame before");
+
+			// View space coordinates are the offsets from the camera along its axes
+			XMVECTOR position = XMLoadFloat3(&camera.GetPosition());
+			XMMATRIX view = XMLoadFloat4x4(&camera.GetView());
+			for (UINT i = 0; i < 4; ++i)
+			{
+				XMFLOAT3 point = randomPoint(400.0f);
+				XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&point), position);
+				XMFLOAT3 expected(XMVectorGetX(XMVector3Dot(offset, XMLoadFloat3(&camera.GetRight()))),
+					XMVectorGetX(XMVector3Dot(offset, XMLoadFloat3(&camera.GetUp()))),
+					XMVectorGetX(XMVector3Dot(offset, XMLoadFloat3(&camera.GetLook()))));
+
+				XMFLOAT3 viewPoint;
+				XMStoreFloat3(&viewPoint, XMVector3TransformCoord(XMLoadFloat3(&point), view));
+				test.Expect(Vector3::Length(Vector3::Subtract(viewPoint, expected)) < 1e-3f, name + "view matrix does not match the camera axes");
+			}
+
+			XMFLOAT4X4 viewProj;
+			XMStoreFloat4x4(&viewProj, XMMatrixMultiply(view, XMLoadFloat4x4(&camera.GetProj())));
+			test.Expect(MatricesNear(camera.GetViewProj(), viewProj, 1e-5f), name + "view projection is stale");
+
+			XMFLOAT4X4 inverse;
+			XMStoreFloat4x4(&inverse, XMMatrixInverse(nullptr, XMLoadFloat4x4(&viewProj)));
+			test.Expect(MatricesNear(camera.GetInverseViewProj(), inverse, 1e-3f), name + "inverse view projection is stale");
+			XMStoreFloat4x4(&inverse, XMMatrixInverse(nullptr, view));
+			test.Expect(MatricesNear(camera.GetInverseView(), inverse, 1e-4f), name + "inverse view is stale");
+
+			// Planes follow the matrices, halfway down the view direction is inside and behind the camera is not
+			float depth = 0.5f * (camera.GetNearZ() + camera.GetFarZ());
+			XMVECTOR look = XMLoadFloat3(&camera.GetLook());
+			test.Expect(camera.GetFrustumPlanes().IntersectsSphere(XMVectorMultiplyAdd(look, XMVectorReplicate(depth), position), 0.0f),
+				name + "point ahead of the camera is culled");
+			test.Expect(!camera.GetFrustumPlanes().IntersectsSphere(XMVectorMultiplyAdd(look, XMVectorReplicate(-depth), position), 0.0f),
+				name + "point behind the camera is not culled");
+
+			previousView = camera.GetView();
+			previousViewProj = camera.GetViewProj();
+			changed = false;
+		}
+	}
+
+	// Stratified u over [0, 1) at random shading points of a random light set. Every choice of Sample splits the interval
+	// of u it was given, so each light owns one interval and is picked Pdf * sampleCount times up to rounding.
+	// Inactive and directional lights must never be picked, the Pdf Sample reports must be the one Pdf computes, and
+	// samples that pick no light must be the share the pdfs do not cover.
+	void TestLightBVHSampling(SelfTestContext& test)
+	{
+		const UINT lightCount = 64;
+		const UINT sampleCount = 100000;
+
+		mt19937 random(41);
+		uniform_real_distribution<float> unit(0.0f, 1.0f);
+		auto randomDirection = [&]()
+		{
+			XMFLOAT3 direction(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f);
+			return Vector3::Normalize(direction);
+		};
+
+		vector<Light> lights(lightCount);
+		for (UINT i = 0; i < lightCount; ++i)
+		{
+			Light& light = lights[i];
+			light.position = XMFLOAT3((unit(random) - 0.5f) * 100.0f, unit(random) * 20.0f, (unit(random) - 0.5f) * 100.0f);
+			light.direction = randomDirection();
+			light.range = 5.0f + unit(random) * 40.0f;
+			light.color = XMFLOAT3(unit(random) * 10.0f, unit(random) * 10.0f, unit(random) * 10.0f);
+			light.type = i % 3 == 0 ? LightType::SPOT_LIGHT : LightType::POINT_LIGHT;
+			light.outerCosine = 0.5f + unit(random) * 0.3f;
+			light.innerCosine = light.outerCosine + 0.1f;
+			light.active = i % 7 != 0;
+			light.castShadows = 1;
+		}
+		lights[5].type = LightType::DIRECTIONAL_LIGHT;
+
+		LightBVH bvh;
+		bvh.Build(lights);
+
+		UINT reachedPoints = 0;
+		for (UINT point = 0; point < 16; ++point)
+		{
+			XMFLOAT3 position((unit(random) - 0.5f) * 100.0f, unit(random) * 20.0f, (unit(random) - 0.5f) * 100.0f);
+			XMFLOAT3 normal = point % 4 == 0 ? XMFLOAT3(0.0f, 0.0f, 0.0f) : randomDirection();
+			string name = "point " + to_string(point) + ": ";
+
+			vector<UINT> counts(lightCount, 0);
+			UINT misses = 0;
+			for (UINT i = 0; i < sampleCount; ++i)
+			{
+				LightSample sample = bvh.Sample(position, normal, (i + 0.5f) / sampleCount);
+				if (sample.LightIndex == UINT_MAX)
+				{
+					misses++;
+					continue;
+				}
+
+				counts[sample.LightIndex]++;
+				if (counts[sample.LightIndex] == 1)
+				{
+					float pdf = bvh.Pdf(sample.LightIndex, position, normal);
+					test.Expect(fabsf(sample.Pdf - pdf) <= 1e-5f * pdf, name + "Sample reports pdf " + to_string(sample.Pdf)
+						+ " for light " + to_string(sample.LightIndex) + ", Pdf gives " + to_string(pdf));
+				}
+			}
+
+			float pdfSum = 0.0f;
+			for (UINT light = 0; light < lightCount; ++light)
+			{
+				float pdf = bvh.Pdf(light, position, normal);
+				pdfSum += pdf;
+
+				if (!LightBVH::IsSampled(lights[light]))
+					test.Expect(pdf == 0.0f && counts[light] == 0, name + "light " + to_string(light) + " is not sampled but was picked");
+
+				float expected = pdf * sampleCount;
+				test.Expect(fabsf(counts[light] - expected) <= 2.0f + 1e-3f * expected, name + "light " + to_string(light)
+					+ " picked " + to_string(counts[light]) + " times, Pdf expects " + to_string(expected));
+			}
+
+			// A descent ends without a light where the bounds of a node reach the point but those of neither child do,
+			// the pdfs leave out exactly that share
+			float expectedMisses = (1.0f - pdfSum) * sampleCount;
+			test.Expect(fabsf(misses - expectedMisses) <= 2.0f + 1e-3f * sampleCount, name + to_string(misses)
+				+ " samples picked no light, the pdfs leave " + to_string(expectedMisses));
+			if (misses < sampleCount)
+				reachedPoints++;
+		}
+
+		test.Expect(reachedPoints > 0, "no shading point is reached by any light");
+	}
+
+	// Histogram of SampleDirection over coarse uv cells of a random sky with a bright spot and a black row, against
+	// the mass Pdf integrates to over each cell. Pdf is a solid angle density, so each uv cell weighs it by the
+	// 2 pi^2 sin(theta) the mapping stretches it with. Every sample must also report the density Pdf gives its direction.
+	void TestEnvironmentMapSampling(SelfTestContext& test)
+	{
+		const UINT width = 64;
+		const UINT height = 32;
+		const UINT cellSize = 8;
+		const UINT cellsX = width / cellSize;
+		const UINT cellsY = height / cellSize;
+		const UINT sampleCount = 400000;
+
+		mt19937 random(44);
+		uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		vector<XMFLOAT4> texels(width * height);
+		for (UINT y = 0; y < height; ++y)
+		{
+			for (UINT x = 0; x < width; ++x)
+			{
+				float radiance = y == 20 ? 0.0f : unit(random);
+				if (x >= 40 && x < 43 && y >= 9 && y < 11)
+					radiance = 500.0f;
+				texels[y * width + x] = XMFLOAT4(radiance, radiance * unit(random), radiance, 1.0f);
+			}
+		}
+
+		EnvironmentMap map;
+		map.SetTexels(width, height, std::move(texels));
+
+		// Midpoint rule per texel, exact for a density that is constant over each texel in uv
+		const UINT steps = 4;
+		vector<double> expected(cellsX * cellsY, 0.0);
+		double total = 0.0;
+		for (UINT y = 0; y < height * steps; ++y)
+		{
+			for (UINT x = 0; x < width * steps; ++x)
+			{
+				XMFLOAT2 uv((x + 0.5f) / (width * steps), (y + 0.5f) / (height * steps));
+				double mass = map.Pdf(EnvironmentMap::UVToDirection(uv)) * 2.0 * PI * PI * sin(PI * uv.y) / (width * steps * height * steps);
+				expected[(y / steps / cellSize) * cellsX + x / steps / cellSize] += mass;
+				total += mass;
+			}
+		}
+		test.Expect(fabs(total - 1.0) < 1e-3, "Pdf integrates to " + to_string(total) + " over the sphere");
+
+		vector<UINT> counts(cellsX * cellsY, 0);
+		UINT mismatches = 0;
+		UINT blackRowSamples = 0;
+		for (UINT i = 0; i < sampleCount; ++i)
+		{
+			EnvironmentSample sample = map.SampleDirection(unit(random), unit(random));
+			if (sample.Pdf <= 0.0f)
+				continue;
+
+			XMFLOAT2 uv = EnvironmentMap::DirectionToUV(sample.Direction);
+			UINT x = min(static_cast<UINT>(uv.x * width), width - 1);
+			UINT y = min(static_cast<UINT>(uv.y * height), height - 1);
+			counts[(y / cellSize) * cellsX + x / cellSize]++;
+
+			if (y == 20)
+				blackRowSamples++;
+
+			// Directions right on a texel edge can round into the neighbour, so only the share is checked
+			float pdf = map.Pdf(sample.Direction);
+			if (fabsf(sample.Pdf - pdf) > 1e-3f * pdf)
+				mismatches++;
+		}
+
+		test.Expect(blackRowSamples == 0, to_string(blackRowSamples) + " samples in the black row");
+		test.Expect(mismatches < sampleCount / 1000, to_string(mismatches) + " samples report another density than Pdf");
+
+		// Five standard deviations of the binomial count, one extra sample for the cells close to empty
+		for (UINT cell = 0; cell < counts.size(); ++cell)
+		{
+			double mean = expected[cell] * sampleCount;
+			double sigma = sqrt(mean * (1.0 - expected[cell]));
+			test.Expect(fabs(counts[cell] - mean) <= 5.0 * sigma + 1.0, "cell " + to_string(cell) + " got "
+				+ to_string(counts[cell]) + " samples, Pdf expects " + to_string(mean));
+		}
+	}
+
+	float MaxCoefficientError(const SH9Color& a, const SH9Color& b)
+	{
+		float error = 0.0f;
+		for (UINT k = 0; k < 9; ++k)
+		{
+			XMVECTOR difference = XMVectorAbs(XMVectorSubtract(XMLoadFloat3(&a.Coefficients[k]), XMLoadFloat3(&b.Coefficients[k])));
+			error = max(error, max(XMVectorGetX(difference), max(XMVectorGetY(difference), XMVectorGetZ(difference))));
+		}
+		return error;
+	}
+
+	// ProjectSH9 against the scalar reference on noisy HDR skies whose widths are not a multiple of the SIMD lanes,
+	// and the reference itself on skies made from known coefficients, which the projection has to give back.
+	// A constant sky must light every normal with exactly its radiance.
+	void TestSH9Projection(SelfTestContext& test)
+	{
+		mt19937 random(45);
+		uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		const UINT sizes[][2] = { { 203, 97 }, { 64, 32 }, { 17, 9 } };
+		for (const auto& [width, height] : sizes)
+		{
+			vector<XMFLOAT4> texels(width * height);
+			for (XMFLOAT4& texel : texels)
+			{
+				float scale = unit(random) < 0.01f ? 1000.0f : 1.0f;
+				texel = XMFLOAT4(scale * unit(random), scale * unit(random), scale * unit(random), 1.0f);
+			}
+
+			EnvironmentMap map;
+			map.SetTexels(width, height, std::move(texels));
+
+			// Relative to the DC term like RunSHBenchmark reports it
+			SH9Color reference = ProjectSH9Reference(map);
+			XMFLOAT3 dc = reference.Coefficients[0];
+			float error = MaxCoefficientError(ProjectSH9(map), reference) / max(dc.x, max(dc.y, dc.z));
+			test.Expect(error < 1e-5f, to_string(width) + "x" + to_string(height) + ": ProjectSH9 is " + to_string(error) + " off the reference");
+		}
+
+		for (UINT trial = 0; trial < 4; ++trial)
+		{
+			const UINT width = 256;
+			const UINT height = 128;
+
+			// Positive DC so the sky stays mostly positive, the projection is linear either way
+			SH9Color expected;
+			for (UINT k = 0; k < 9; ++k)
+			{
+				float offset = k == 0 ? 4.0f : 0.0f;
+				expected.Coefficients[k] = XMFLOAT3(offset + unit(random) - 0.5f, offset + unit(random) - 0.5f, offset + unit(random) - 0.5f);
+			}
+
+			vector<XMFLOAT4> texels(width * height);
+			for (UINT y = 0; y < height; ++y)
+			{
+				for (UINT x = 0; x < width; ++x)
+				{
+					float basis[9];
+					EvaluateSH9Basis(EnvironmentMap::UVToDirection(XMFLOAT2((x + 0.5f) / width, (y + 0.5f) / height)), basis);
+
+					XMVECTOR radiance = XMVectorZero();
+					for (UINT k = 0; k < 9; ++k)
+						radiance = XMVectorMultiplyAdd(XMLoadFloat3(&expected.Coefficients[k]), XMVectorReplicate(basis[k]), radiance);
+					XMStoreFloat4(&texels[y * width + x], XMVectorSetW(radiance, 1.0f));
+				}
+			}
+
+			EnvironmentMap map;
+			map.SetTexels(width, height, std::move(texels));
+
+			// Left is the error of integrating over texels instead of the sphere
+			float error = MaxCoefficientError(ProjectSH9Reference(map), expected);
+			test.Expect(error < 2e-3f, "trial " + to_string(trial) + ": band limited sky projects " + to_string(error) + " off its coefficients");
+		}
+
+		EnvironmentMap constant;
+		constant.SetTexels(64, 32, vector<XMFLOAT4>(64 * 32, XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f)));
+		AmbientSHConstants ambient = ComputeAmbientSHConstants(ProjectSH9(constant));
+		for (UINT i = 0; i < 32; ++i)
+		{
+			XMVECTOR normal = XMVector3Normalize(XMVectorSet(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f, 0.0f));
+			float irradiance = XMVectorGetX(EvaluateAmbientSH(ambient, normal));
+			test.Expect(fabsf(irradiance - 1.0f) < 1e-3f, "constant sky of radiance 1 gives " + to_string(irradiance));
+		}
+	}
+
+	// A square of side size facing the camera at distance d, mapped once over a texture of width texels: a pixel cone of
+	// spread angle a covers a * d of it, so it has to pick lod = log2(a * d / texel size), plus log2(1 / cos) when tilted.
+	// On a checkerboard of single texels that LOD must read the texel itself at 0 and the gray of the box filtered mips above.
+	void TestRayConeTextureLOD(SelfTestContext& test)
+	{
+		mt19937 random(48);
+		uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		// Right triangles with legs of a by b in world space and u by v in UV, rotated anywhere in world space
+		for (UINT i = 0; i < 64; ++i)
+		{
+			float a = 0.01f + 10.0f * unit(random);
+			float b = 0.01f + 10.0f * unit(random);
+			float u = 0.001f + 4.0f * unit(random);
+			float v = 0.001f + 4.0f * unit(random);
+
+			XMMATRIX rotation = XMMatrixRotationRollPitchYaw(XM_2PI * unit(random), XM_2PI * unit(random), XM_2PI * unit(random));
+			XMFLOAT3 p0(unit(random), unit(random), unit(random));
+			XMFLOAT3 p1, p2;
+			XMStoreFloat3(&p1, XMVectorAdd(XMLoadFloat3(&p0), XMVector3TransformNormal(XMVectorSet(a, 0.0f, 0.0f, 0.0f), rotation)));
+			XMStoreFloat3(&p2, XMVectorAdd(XMLoadFloat3(&p0), XMVector3TransformNormal(XMVectorSet(0.0f, b, 0.0f, 0.0f), rotation)));
+			XMFLOAT2 uv0(unit(random), unit(random));
+			XMFLOAT2 uv1(uv0.x + u, uv0.y);
+			XMFLOAT2 uv2(uv0.x, uv0.y - v);
+
+			float expected = 0.5f * log2f(u * v / (a * b));
+			float lod = ComputeTriangleLOD(p0, p1, p2, uv0, uv1, uv2);
+			test.Expect(fabsf(lod - expected) < 1e-3f, "triangle LOD is " + to_string(lod) + ", its areas give " + to_string(expected));
+		}
+
+		XMFLOAT3 origin(0.0f, 0.0f, 0.0f);
+		test.Expect(ComputeTriangleLOD(origin, XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT3(2.0f, 0.0f, 0.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT2(0.0f, 1.0f)) == MinTriangleLOD,
+			"a triangle without world area is not at MinTriangleLOD");
+		test.Expect(ComputeTriangleLOD(origin, XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT2(0.5f, 0.5f), XMFLOAT2(0.5f, 0.5f), XMFLOAT2(0.5f, 0.5f)) == MinTriangleLOD,
+			"a triangle without UV area is not at MinTriangleLOD");
+
+		for (float scale : { 0.25f, 1.0f, 3.0f })
+		{
+			XMFLOAT4X4 world;
+			XMStoreFloat4x4(&world, XMMatrixScaling(scale, scale, scale) * XMMatrixRotationY(1.0f) * XMMatrixTranslation(5.0f, -2.0f, 7.0f));
+			float bias = ComputeInstanceLODBias(world);
+			test.Expect(fabsf(bias + log2f(scale)) < 1e-4f, "uniform scale " + to_string(scale) + " biases the LOD by " + to_string(bias));
+		}
+
+		const float fovY = XMConvertToRadians(60.0f);
+		const UINT screenHeight = 512;
+		XMFLOAT4X4 proj;
+		XMStoreFloat4x4(&proj, XMMatrixPerspectiveFovLH(fovY, 16.0f / 9.0f, 0.1f, 1000.0f));
+		float spreadAngle = ComputePixelSpreadAngle(proj, screenHeight);
+		float expectedSpread = atanf(2.0f * tanf(fovY / 2.0f) / screenHeight);
+		test.Expect(fabsf(spreadAngle - expectedSpread) < 1e-6f, "pixel spread angle is " + to_string(spreadAngle) + ", the field of view gives " + to_string(expectedSpread));
+
+		// Squares of random size, distance and tilt with non square textures, which have a texel of side size / sqrt(w * h)
+		for (UINT i = 0; i < 64; ++i)
+		{
+			float size = 0.1f + 20.0f * unit(random);
+			float distance = 0.5f + 200.0f * unit(random);
+			float tilt = 1.4f * unit(random);
+			UINT width = 1u << (random() % 12);
+			UINT height = 1u << (random() % 12);
+
+			// The square is two triangles with the same density, one is enough
+			float triangleLOD = ComputeTriangleLOD(origin, XMFLOAT3(size, 0.0f, 0.0f), XMFLOAT3(0.0f, size, 0.0f),
+				XMFLOAT2(0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT2(0.0f, 1.0f));
+			RayCone cone = PropagateRayCone({ 0.0f, spreadAngle }, distance);
+			float lod = ComputeTextureLOD(ComputeRayConeLOD(triangleLOD, cone, -cosf(tilt)), width, height);
+
+			float texelSize = size / sqrtf(static_cast<float>(width) * height);
+			float expected = log2f(spreadAngle * distance / texelSize / cosf(tilt));
+			test.Expect(fabsf(lod - expected) < 1e-3f, to_string(width) + "x" + to_string(height) + " texture at distance " + to_string(distance)
+				+ ": LOD is " + to_string(lod) + ", the cone footprint gives " + to_string(expected));
+		}
+
+		// Full chains down to 1x1 like the reserved mips of the WIC loader
+		const UINT sizes[][2] = { { 1, 1 }, { 64, 64 }, { 256, 16 }, { 37, 5 }, { 3, 100 } };
+		for (const auto& [width, height] : sizes)
+		{
+			CpuTexture texture;
+			texture.Create(width, height, vector<XMUBYTEN4>(width * height, XMUBYTEN4(0.5f, 0.5f, 0.5f, 1.0f)));
+			UINT expected = static_cast<UINT>(floor(log2(max(width, height)))) + 1;
+			test.Expect(texture.GetMipCount() == expected, to_string(width) + "x" + to_string(height) + " texture has "
+				+ to_string(texture.GetMipCount()) + " mips instead of " + to_string(expected));
+		}
+
+		const UINT checkerSize = 64;
+		vector<XMUBYTEN4> checker(checkerSize * checkerSize);
+		for (UINT y = 0; y < checkerSize; ++y)
+		{
+			for (UINT x = 0; x < checkerSize; ++x)
+			{
+				float value = (x + y) % 2 ? 1.0f : 0.0f;
+				checker[y * checkerSize + x] = XMUBYTEN4(value, value, value, 1.0f);
+			}
+		}
+
+		CpuTexture texture;
+		texture.Create(checkerSize, checkerSize, std::move(checker));
+
+		// Distances at which the square of side 4 needs lod 0, 1, 2 and 3
+		const float size = 4.0f;
+		for (UINT level = 0; level < 4; ++level)
+		{
+			float distance = (1u << level) * size / checkerSize / spreadAngle;
+			float triangleLOD = ComputeTriangleLOD(origin, XMFLOAT3(size, 0.0f, 0.0f), XMFLOAT3(0.0f, size, 0.0f),
+				XMFLOAT2(0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT2(0.0f, 1.0f));
+			float lod = ComputeTextureLOD(ComputeRayConeLOD(triangleLOD, PropagateRayCone({ 0.0f, spreadAngle }, distance), 1.0f), checkerSize, checkerSize);
+			test.Expect(fabsf(lod - level) < 1e-3f, "square at distance " + to_string(distance) + " has LOD " + to_string(lod) + " instead of " + to_string(level));
+
+			// Texel centers of the top mip, the upper mips are gray everywhere
+			UINT wrongTexels = 0;
+			for (UINT y = 0; y < checkerSize; ++y)
+			{
+				for (UINT x = 0; x < checkerSize; ++x)
+				{
+					float expected = level == 0 ? ((x + y) % 2 ? 1.0f : 0.0f) : 0.5f;
+					float value = XMVectorGetX(texture.SampleLevel(XMFLOAT2((x + 0.5f) / checkerSize, (y + 0.5f) / checkerSize), max(lod, 0.0f)));
+					if (fabsf(value - expected) > 2.0f / 255.0f)
+						wrongTexels++;
+				}
+			}
+			test.Expect(wrongTexels == 0, "LOD " + to_string(level) + ": " + to_string(wrongTexels) + " checker texels off their expected value");
+		}
+	}
+
+	struct SelfTest
+	{
+		const char* Name;
+		void (*Run)(SelfTestContext&);
+	};
+
+	const SelfTest kSelfTests[] =
+	{
+		{ "Opacity classification", TestOpacityClassification },
+		{ "Shader table layout", TestShaderTableLayout },
+		{ "Pipeline subobjects", TestPipelineSubobjects },
+		{ "Shader table instances", TestShaderTableInstances },
+		{ "Permutation enumeration", TestPermutationEnumeration },
+		{ "Camera matrix cache", TestCameraMatrixCache },
+		{ "Light BVH sampling", TestLightBVHSampling },
+		{ "Environment map sampling", TestEnvironmentMapSampling },
+		{ "SH9 projection", TestSH9Projection },
+		{ "Ray cone texture LOD", TestRayConeTextureLOD },
+	};
+}
+
+bool RunSelfTests()
+{
+	UINT failedTests = 0;
+	for (const SelfTest& selfTest : kSelfTests)
+	{
+		SelfTestContext test;
+		selfTest.Run(test);
+
+		bool passed = test.GetFailures() == 0;
+		if (!passed)
+			failedTests++;
+
+		DebugLog(string("Self test: ") + selfTest.Name + (passed ? " passed, " : " FAILED, ")
+			+ to_string(test.GetChecks() - test.GetFailures()) + " / " + to_string(test.GetChecks()) + " checks");
+	}
+
+	DebugLog("Self test: " + to_string(size(kSelfTests) - failedTests) + " / " + to_string(size(kSelfTests)) + " tests passed");
+	return failedTests == 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "stdafx.h"
+
+// Checks of the CPU side algorithms against brute force or analytic references, run by --self-test.
+// Every test logs its failed checks and a summary line. Returns true when all of them passed.
+bool RunSelfTests();
@@ -0,0 +1,262 @@
+#include "ShaderCache.h"
+
+namespace
+{
+	void HashBytes(uint64_t& hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+
+	void HashString(uint64_t& hash, const wstring& str)
+	{
+		// Length first so "ab" + "c" and "a" + "bc" hash differently
+		size_t length = str.size();
+		HashBytes(hash, &length, sizeof(length));
+		HashBytes(hash, str.data(), str.size() * sizeof(wchar_t));
+	}
+
+	// Name between the quotes or angle brackets of an #include line, empty for any other line.
+	string ParseInclude(const string& line)
+	{
+		size_t pos = line.find_first_not_of(" \t");
+		if (pos == string::npos || line[pos] != '#')
+			return "";
+
+		pos = line.find_first_not_of(" \t", pos + 1);
+		if (pos == string::npos || line.compare(pos, 7, "include") != 0)
+			return "";
+
+		size_t open = line.find_first_of("\"<", pos + 7);
+		if (open == string::npos)
+			return "";
+
+		size_t close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+		if (close == string::npos)
+			return "";
+
+		return line.substr(open + 1, close - open - 1);
+	}
+
+	// Hashes the file and, depth first, every file it includes. Includes are resolved next to the including
+	// file like the default DXC include handler does, files that cannot be opened only contribute their name.
+	void HashSourceTree(uint64_t& hash, const filesystem::path& path, set<filesystem::path>& visited)
+	{
+		error_code ec;
+		filesystem::path canonical = filesystem::weakly_canonical(path, ec);
+		if (!visited.insert(ec ? path : canonical).second)
+			return;
+
+		HashString(hash, path.filename().wstring());
+
+		ifstream file(path, ios::binary);
+		if (!file)
+			return;
+
+		string source((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+		HashBytes(hash, source.data(), source.size());
+
+		istringstream lines(source);
+		string line;
+		while (getline(lines, line))
+		{
+			string include = ParseInclude(line);
+			if (!include.empty())
+				HashSourceTree(hash, path.parent_path() / include, visited);
+		}
+	}
+
+	// There is no way to ask DXC for its version without loading it, so the dxcompiler.dll that
+	// LoadLibrary would pick up is identified by its path, size and timestamp instead.
+	uint64_t HashCompiler()
+	{
+		uint64_t hash = 14695981039346656037ull;
+
+		WCHAR dllPath[MAX_PATH] = {};
+		if (SearchPathW(nullptr, L"dxcompiler.dll", nullptr, MAX_PATH, dllPath, nullptr) == 0)
+			return hash;
+
+		error_code ec;
+		uintmax_t size = filesystem::file_size(dllPath, ec);
+		auto time = filesystem::last_write_time(dllPath, ec).time_since_epoch().count();
+
+		HashString(hash, dllPath);
+		HashBytes(hash, &size, sizeof(size));
+		HashBytes(hash, &time, sizeof(time));
+		return hash;
+	}
+
+	// IDxcBlob over DXIL read from the cache, so a hit does not need DxcLibrary to create the blob.
+	class CachedDxilBlob : public Microsoft::WRL::RuntimeClass<Microsoft::WRL::RuntimeClassFlags<Microsoft::WRL::ClassicCom>, IDxcBlob>
+	{
+	public:
+		CachedDxilBlob(vector<char>&& data) : mData(std::move(data)) {}
+
+		LPVOID STDMETHODCALLTYPE GetBufferPointer() override { return mData.data(); }
+		SIZE_T STDMETHODCALLTYPE GetBufferSize() override { return mData.size(); }
+
+	private:
+		vector<char> mData;
+	};
+}
+
+ShaderCache::ShaderCache(const wstring& directory) : mDirectory(directory)
+{
+}
+
+ComPtr<IDxcBlob> ShaderCache::CompileLibrary(const WCHAR* filename, const WCHAR* target, const vector<ShaderDefine>& defines)
+{
+	auto start = chrono::steady_clock::now();
+
+	filesystem::path source = filename;
+	uint64_t key = ComputeKey(source, target, defines);
+
+	wstringstream name;
+	name << source.stem().wstring() << L"_" << hex << setw(16) << setfill(L'0') << key << L".dxil";
+	filesystem::path cachePath = mDirectory / name.str();
+
+	ComPtr<IDxcBlob> blob = Load(cachePath);
+	bool hit = blob != nullptr;
+	UINT hitCount = hit ? ++mHitCount : mHitCount.load();
+	UINT missCount = hit ? mMissCount.load() : ++mMissCount;
+	if (!hit)
+	{
+		blob = Compile(source, target, defines);
+		if (blob == nullptr)
+			return nullptr;
+
+		if (!Save(cachePath, blob.Get()))
+			DebugLog("ShaderCache: failed to write " + wstringTostring(cachePath.wstring()));
+	}
+
+	auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	DebugLog("ShaderCache: " + string(hit ? "loaded " : "compiled ") + wstringTostring(source.filename().wstring()) + " " + wstringTostring(target)
+		+ " in " + to_string(elapsed) + " ms (hits " + to_string(hitCount) + ", misses " + to_string(missCount) + ")");
+
+	return blob;
+}
+
+uint64_t ShaderCache::ComputeKey(const filesystem::path& source, const WCHAR* target, const vector<ShaderDefine>& defines) const
+{
+	static const uint64_t compilerHash = HashCompiler();
+
+	uint64_t hash = 14695981039346656037ull;
+	HashBytes(hash, &ShaderCacheVersion, sizeof(ShaderCacheVersion));
+	HashBytes(hash, &compilerHash, sizeof(compilerHash));
+	HashString(hash, target);
+
+	for (const auto& define : defines)
+	{
+		HashString(hash, define.Name);
+		HashString(hash, define.Value);
+	}
+
+	set<filesystem::path> visited;
+	HashSourceTree(hash, source, visited);
+
+	return hash;
+}
+
+ComPtr<IDxcBlob> ShaderCache::Compile(const filesystem::path& source, const WCHAR* target, const vector<ShaderDefine>& defines) const
+{
+	ComPtr<IDxcCompiler> compiler;
+	ComPtr<IDxcLibrary> library;
+	{
+		// Loading the dll is not thread safe, the compiler objects themselves are used by one thread each
+		static mutex dxcMutex;
+		lock_guard<mutex> lock(dxcMutex);
+
+		ThrowIfFailed(gDxcDllSupport.Initialize());
+		ThrowIfFailed(gDxcDllSupport.CreateInstance(CLSID_DxcCompiler, compiler.GetAddressOf()));
+		ThrowIfFailed(gDxcDllSupport.CreateInstance(CLSID_DxcLibrary, library.GetAddressOf()));
+	}
+
+	// Open and read the file
+	ifstream shaderFile(source, ios::binary);
+	if (shaderFile.good() == false)
+	{
+		DebugLog("ShaderCache: failed to open " + wstringTostring(source.wstring()));
+		return nullptr;
+	}
+	string shader((istreambuf_iterator<char>(shaderFile)), istreambuf_iterator<char>());
+
+	// Create blob from the string
+	ComPtr<IDxcBlobEncoding> textBlob;
+	ThrowIfFailed(library->CreateBlobWithEncodingFromPinned((LPBYTE)shader.c_str(), (uint32_t)shader.size(), 0, &textBlob));
+
+	ComPtr<IDxcIncludeHandler> includeHandler;
+	ThrowIfFailed(library->CreateIncludeHandler(&includeHandler));
+
+	vector<DxcDefine> dxcDefines(defines.size());
+	for (size_t i = 0; i < defines.size(); ++i)
+		dxcDefines[i] = { defines[i].Name.c_str(), defines[i].Value.c_str() };
+
+	// Compile, a failure of the call itself leaves no result to read the diagnostics from
+	ComPtr<IDxcOperationResult> result;
+	HRESULT hr = compiler->Compile(textBlob.Get(), source.c_str(), L"", target, nullptr, 0,
+		dxcDefines.data(), (UINT32)dxcDefines.size(), includeHandler.Get(), &result);
+	if (FAILED(hr) || !result)
+	{
+		char code[16];
+		snprintf(code, sizeof(code), "0x%08X", static_cast<unsigned>(hr));
+		DebugLog("ShaderCache: DXC could not compile " + wstringTostring(source.wstring()) + ", HRESULT " + code);
+		return nullptr;
+	}
+
+	// Verify the result
+	HRESULT resultCode = E_FAIL;
+	if (FAILED(result->GetStatus(&resultCode)) || FAILED(resultCode))
+	{
+		ComPtr<IDxcBlobEncoding> pError;
+		string errors = SUCCEEDED(result->GetErrorBuffer(&pError)) && pError ? ConvertBlobToString(pError.Get()) : string();
+		DebugLog("ShaderCache: failed to compile " + wstringTostring(source.wstring()) + "\n" + errors);
+		return nullptr;
+	}
+
+	ComPtr<IDxcBlob> blob;
+	if (FAILED(result->GetResult(&blob)))
+		return nullptr;
+
+	return blob;
+}
+
+ComPtr<IDxcBlob> ShaderCache::Load(const filesystem::path& path) const
+{
+	ifstream file(path, ios::binary);
+	if (!file)
+		return nullptr;
+
+	vector<char> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+	// Every DXIL container starts with the DXBC four character code
+	if (data.size() < 4 || memcmp(data.data(), "DXBC", 4) != 0)
+		return nullptr;
+
+	return Microsoft::WRL::Make<CachedDxilBlob>(std::move(data));
+}
+
+bool ShaderCache::Save(const filesystem::path& path, IDxcBlob* blob) const
+{
+	error_code ec;
+	filesystem::create_directories(mDirectory, ec);
+
+	// Written under a temporary name so an interrupted run never leaves a truncated blob behind.
+	filesystem::path tempPath = path;
+	tempPath += L".tmp";
+	{
+		ofstream file(tempPath, ios::binary | ios::trunc);
+		if (!file)
+			return false;
+
+		file.write(static_cast<const char*>(blob->GetBufferPointer()), blob->GetBufferSize());
+		if (!file)
+			return false;
+	}
+
+	filesystem::rename(tempPath, path, ec);
+	return !ec;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "stdafx.h"
+
+struct ShaderDefine
+{
+	wstring Name;
+	wstring Value;
+};
+
+// Bump whenever the way shaders are compiled changes without the key noticing, e.g. new compiler arguments.
+const UINT ShaderCacheVersion = 1;
+
+// DXIL blobs compiled through DXC, stored on disk under a hash of everything that affects the output:
+// the source, every file it includes, the target profile, the defines and the dxcompiler.dll binary.
+// A hit is read straight from the file without loading DXC. Libraries may be compiled from several threads at once.
+class ShaderCache
+{
+public:
+	ShaderCache(const wstring& directory = L"ShaderCache");
+	~ShaderCache() = default;
+
+	// Returns nullptr when the shader fails to compile, the compiler output is logged.
+	ComPtr<IDxcBlob> CompileLibrary(const WCHAR* filename, const WCHAR* target, const vector<ShaderDefine>& defines = {});
+
+	UINT GetHitCount() const { return mHitCount; }
+	UINT GetMissCount() const { return mMissCount; }
+
+private:
+	uint64_t ComputeKey(const filesystem::path& source, const WCHAR* target, const vector<ShaderDefine>& defines) const;
+	ComPtr<IDxcBlob> Compile(const filesystem::path& source, const WCHAR* target, const vector<ShaderDefine>& defines) const;
+
+	ComPtr<IDxcBlob> Load(const filesystem::path& path) const;
+	bool Save(const filesystem::path& path, IDxcBlob* blob) const;
+
+	filesystem::path mDirectory;
+
+	atomic<UINT> mHitCount = 0;
+	atomic<UINT> mMissCount = 0;
+};
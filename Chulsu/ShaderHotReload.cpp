@@ -0,0 +1,84 @@
+#include "ShaderHotReload.h"
+#include "Profiler.h"
+
+void ShaderHotReload::Start(ComPtr<ID3D12Device5> device, const wstring& shaderPath, const Pipeline& current)
+{
+	Stop();
+
+	mDevice = device;
+	mShaderPath = shaderPath;
+	mPermutations = current.GetPermutations();
+	mGlobalFeatures = current.GetGlobalFeatures();
+
+	mWatcher.Watch(filesystem::path(shaderPath).parent_path());
+
+	mStop = false;
+	mThread = thread(&ShaderHotReload::Run, this);
+}
+
+void ShaderHotReload::Stop()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mStop = true;
+	}
+	mStopCondition.notify_all();
+
+	if (mThread.joinable())
+		mThread.join();
+}
+
+bool ShaderHotReload::TakePipeline(Pipeline& pipeline)
+{
+	lock_guard<mutex> lock(mMutex);
+	if (mPending == nullptr)
+		return false;
+
+	pipeline = std::move(*mPending);
+	mPending = nullptr;
+	return true;
+}
+
+void ShaderHotReload::Run()
+{
+	Profiler::SetThreadName("Shader Hot Reload");
+
+	unique_lock<mutex> lock(mMutex);
+	while (!mStopCondition.wait_for(lock, mPollInterval, [this] { return mStop; }))
+	{
+		lock.unlock();
+
+		if (mWatcher.PollChanges())
+		{
+			// Editors often write a file in several steps, wait until it stops changing
+			do
+			{
+				this_thread::sleep_for(mPollInterval);
+			} while (mWatcher.PollChanges());
+
+			Rebuild();
+		}
+
+		lock.lock();
+	}
+}
+
+void ShaderHotReload::Rebuild()
+{
+	DebugLog("ShaderHotReload: " + wstringTostring(mShaderPath) + " changed, rebuilding");
+	auto start = chrono::steady_clock::now();
+	PROFILE_ZONE("Shader Rebuild");
+
+	auto pipeline = make_unique<Pipeline>();
+	if (!pipeline->CreatePipelineState(mDevice, mShaderPath.c_str(), mPermutations, mGlobalFeatures))
+	{
+		DebugLog("ShaderHotReload: build failed, keeping the previous pipeline");
+		return;
+	}
+
+	auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	DebugLog("ShaderHotReload: rebuilt " + to_string(mPermutations.size()) + " permutations in " + to_string(elapsed) + " ms");
+
+	lock_guard<mutex> lock(mMutex);
+	mPending = std::move(pipeline);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "stdafx.h"
+#include "FileWatcher.h"
+#include "Pipeline.h"
+
+// Rebuilds a ray tracing pipeline on a worker thread whenever a file in the shader's directory changes.
+// The renderer picks the result up with TakePipeline between frames, a failed build keeps the old pipeline.
+class ShaderHotReload
+{
+public:
+	ShaderHotReload() = default;
+	~ShaderHotReload() { Stop(); }
+
+	// Rebuilds use the permutations and global features of current.
+	void Start(ComPtr<ID3D12Device5> device, const wstring& shaderPath, const Pipeline& current);
+	void Stop();
+
+	// Hands over a pipeline rebuilt since the last call, its shader table still has to be created by the caller.
+	bool TakePipeline(Pipeline& pipeline);
+
+private:
+	void Run();
+	void Rebuild();
+
+	static constexpr chrono::milliseconds mPollInterval{ 250 };
+
+	ComPtr<ID3D12Device5> mDevice;
+	wstring mShaderPath;
+	vector<UINT> mPermutations;
+	UINT mGlobalFeatures = 0;
+
+	FileWatcher mWatcher;
+	thread mThread;
+
+	mutex mMutex;
+	condition_variable mStopCondition;
+	bool mStop = false;
+	unique_ptr<Pipeline> mPending;
+};
@@ -0,0 +1,62 @@
+#include "ShaderPermutation.h"
+#include "AssetManager.h"
+
+namespace
+{
+	const WCHAR* FeatureDefines[ShaderFeatureCount] =
+	{
+		L"HAS_ALBEDO", L"HAS_METALIC", L"HAS_ROUGHNESS", L"HAS_NORMALMAP", L"HAS_OPACITY", L"PBR_ENABLED"
+	};
+}
+
+UINT GetMaterialFeatures(const Material& material, bool alphaTested)
+{
+	UINT features = 0;
+	if (material.AlbedoTextureIndex != UINT_MAX)
+		features |= FEATURE_ALBEDO;
+	if (material.MetalicTextureIndex != UINT_MAX)
+		features |= FEATURE_METALIC;
+	if (material.RoughnessTextureIndex != UINT_MAX)
+		features |= FEATURE_ROUGHNESS;
+	if (material.NormalMapTextureIndex != UINT_MAX)
+		features |= FEATURE_NORMALMAP;
+
+	// Opacity maps of geometry classified as opaque never discard anything, so they need no any-hit
+	if (alphaTested && material.AlphaMode == ALPHA_MODE_MASK && material.OpacityMapTextureIndex != UINT_MAX)
+		features |= FEATURE_OPACITY;
+
+	return features;
+}
+
+UINT ReduceShaderFeatures(UINT features)
+{
+	if (!(features & FEATURE_PBR))
+		features &= ~(FEATURE_METALIC | FEATURE_ROUGHNESS | FEATURE_NORMALMAP);
+
+	return features;
+}
+
+vector<UINT> EnumeratePermutations(const vector<UINT>& features)
+{
+	vector<UINT> permutations(features.size());
+	transform(features.begin(), features.end(), permutations.begin(), ReduceShaderFeatures);
+
+	sort(permutations.begin(), permutations.end());
+	permutations.erase(unique(permutations.begin(), permutations.end()), permutations.end());
+
+	return permutations;
+}
+
+vector<ShaderDefine> GetFeatureDefines(UINT features)
+{
+	vector<ShaderDefine> defines(ShaderFeatureCount);
+	for (UINT i = 0; i < ShaderFeatureCount; ++i)
+		defines[i] = { FeatureDefines[i], (features & (1 << i)) ? L"1" : L"0" };
+
+	return defines;
+}
+
+wstring GetPermutationSuffix(UINT features)
+{
+	return L"_" + to_wstring(features);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "stdafx.h"
+#include "ShaderCache.h"
+
+struct Material;
+
+// Material features the hit shaders are compiled for, each one maps to a define in DefaultRayTrace.hlsl.
+enum SHADER_FEATURE
+{
+	FEATURE_ALBEDO = 1 << 0,		// HAS_ALBEDO
+	FEATURE_METALIC = 1 << 1,		// HAS_METALIC
+	FEATURE_ROUGHNESS = 1 << 2,		// HAS_ROUGHNESS
+	FEATURE_NORMALMAP = 1 << 3,		// HAS_NORMALMAP
+	FEATURE_OPACITY = 1 << 4,		// HAS_OPACITY, alpha tested geometry only
+	FEATURE_PBR = 1 << 5,			// PBR_ENABLED, set for the whole pipeline rather than per material
+};
+
+const UINT ShaderFeatureCount = 6;
+
+UINT GetMaterialFeatures(const Material& material, bool alphaTested);
+
+// Drops the features that do not change the compiled shaders, e.g. metalic and roughness maps are
+// only read by the PBR path, so materials that differ only in those share one permutation.
+UINT ReduceShaderFeatures(UINT features);
+
+// Reduced, deduplicated and sorted so the state object does not depend on scene order.
+vector<UINT> EnumeratePermutations(const vector<UINT>& features);
+
+vector<ShaderDefine> GetFeatureDefines(UINT features);
+
+// Appended to the exports of a permutation so all of them can live in one state object.
+wstring GetPermutationSuffix(UINT features);
@@ -0,0 +1,114 @@
+#include "ShaderTable.h"
+#include "AssetManager.h"
+
+ShaderTableLayout::ShaderTableLayout(UINT missCount, UINT rayTypeCount, const vector<UINT>& geometryCounts, UINT localRootDataSize)
+	: mMissCount(missCount), mRayTypeCount(rayTypeCount), mGeometryCounts(geometryCounts)
+{
+	mRecordSize = align_to(D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + localRootDataSize);
+
+	mInstanceHitGroupIndices.resize(geometryCounts.size());
+	for (size_t i = 0; i < geometryCounts.size(); ++i)
+	{
+		mInstanceHitGroupIndices[i] = mHitGroupRecordCount;
+		mHitGroupRecordCount += geometryCounts[i] * rayTypeCount;
+	}
+
+	mMissTableOffset = align_to(D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT, mRecordSize);
+	mHitGroupTableOffset = align_to(D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT, mMissTableOffset + mMissCount * mRecordSize);
+	mSize = mHitGroupTableOffset + mHitGroupRecordCount * mRecordSize;
+}
+
+bool ShaderTableLayout::IsInstanceUnchanged(const ShaderTableLayout& other, UINT instance) const
+{
+	if (instance >= GetInstanceCount() || instance >= other.GetInstanceCount())
+		return false;
+
+	return mRecordSize == other.mRecordSize &&
+		mRayTypeCount == other.mRayTypeCount &&
+		mHitGroupTableOffset == other.mHitGroupTableOffset &&
+		mGeometryCounts[instance] == other.mGeometryCounts[instance] &&
+		mInstanceHitGroupIndices[instance] == other.mInstanceHitGroupIndices[instance];
+}
+
+void ShaderTable::SetLayout(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc,
+	ResourceStateTracker& tracker, AssetManager& assetMgr, const ShaderTableLayout& layout)
+{
+	uint8_t* oldData = mMappedData;
+	ComPtr<D3D12MA::Allocation> oldBuffer = mBuffer;
+
+	if (layout.GetSize() > mCapacity)
+	{
+		// Grow by half again so adding a few instances at a time does not reallocate every time
+		mCapacity = max(layout.GetSize(), mCapacity + mCapacity / 2);
+
+		mBuffer = assetMgr.CreateResource(device, cmdList, alloc, tracker, NULL,
+			mCapacity, 1, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_DIMENSION_BUFFER,
+			DXGI_FORMAT_UNKNOWN, D3D12_TEXTURE_LAYOUT_ROW_MAJOR, D3D12_RESOURCE_FLAG_NONE, D3D12_HEAP_TYPE_UPLOAD);
+
+		// Upload heaps can stay mapped for the lifetime of the resource
+		mBuffer->GetResource()->Map(0, nullptr, (void**)&mMappedData);
+	}
+
+	mDirtyInstances.assign(layout.GetInstanceCount(), true);
+	for (UINT i = 0; i < layout.GetInstanceCount(); ++i)
+	{
+		if (oldData == nullptr || !layout.IsInstanceUnchanged(mLayout, i))
+			continue;
+
+		mDirtyInstances[i] = false;
+		if (oldData != mMappedData)
+		{
+			UINT offset = layout.GetHitGroupRecordOffset(i, 0, 0);
+			memcpy(mMappedData + offset, oldData + offset, layout.GetGeometryCount(i) * layout.GetRayTypeCount() * layout.GetRecordSize());
+		}
+	}
+
+	if (oldData != nullptr && oldData != mMappedData)
+		oldBuffer->GetResource()->Unmap(0, nullptr);
+
+	mLayout = layout;
+}
+
+void ShaderTable::WriteRecord(UINT offset, const void* identifier, const void* localRootData, UINT localRootDataSize)
+{
+	assert(offset + mLayout.GetRecordSize() <= mCapacity);
+	assert(D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + localRootDataSize <= mLayout.GetRecordSize());
+
+	uint8_t* record = mMappedData + offset;
+	memcpy(record, identifier, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+	if (localRootDataSize > 0)
+		memcpy(record + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES, localRootData, localRootDataSize);
+}
+
+void ShaderTable::WriteRayGenRecord(const void* identifier, const void* localRootData, UINT localRootDataSize)
+{
+	WriteRecord(mLayout.GetRayGenOffset(), identifier, localRootData, localRootDataSize);
+}
+
+void ShaderTable::WriteMissRecord(UINT missIndex, const void* identifier, const void* localRootData, UINT localRootDataSize)
+{
+	WriteRecord(mLayout.GetMissRecordOffset(missIndex), identifier, localRootData, localRootDataSize);
+}
+
+void ShaderTable::WriteHitGroupRecord(UINT instance, UINT geometry, UINT rayType,
+	const void* identifier, const void* localRootData, UINT localRootDataSize)
+{
+	WriteRecord(mLayout.GetHitGroupRecordOffset(instance, geometry, rayType), identifier, localRootData, localRootDataSize);
+}
+
+void ShaderTable::FillDispatchRaysDesc(D3D12_DISPATCH_RAYS_DESC& desc) const
+{
+	D3D12_GPU_VIRTUAL_ADDRESS start = mBuffer->GetResource()->GetGPUVirtualAddress();
+	UINT recordSize = mLayout.GetRecordSize();
+
+	desc.RayGenerationShaderRecord.StartAddress = start + mLayout.GetRayGenOffset();
+	desc.RayGenerationShaderRecord.SizeInBytes = recordSize;
+
+	desc.MissShaderTable.StartAddress = start + mLayout.GetMissTableOffset();
+	desc.MissShaderTable.StrideInBytes = recordSize;
+	desc.MissShaderTable.SizeInBytes = recordSize * mLayout.GetMissCount();
+
+	desc.HitGroupTable.StartAddress = start + mLayout.GetHitGroupTableOffset();
+	desc.HitGroupTable.StrideInBytes = recordSize;
+	desc.HitGroupTable.SizeInBytes = recordSize * mLayout.GetHitGroupRecordCount();
+}
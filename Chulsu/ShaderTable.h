@@ -0,0 +1,94 @@
+#pragma once
+#include "stdafx.h"
+
+class AssetManager;
+
+// Byte offsets of every record in the shader binding table, free of any device object.
+//   RayGen
+//   Miss[missCount]
+//   HitGroup[instance][geometry][rayType]
+// Hit records of an instance start at its hit group index, the value TLAS instances use for
+// InstanceContributionToHitGroupIndex, and TraceRay uses the ray type count as geometry multiplier.
+class ShaderTableLayout
+{
+public:
+	ShaderTableLayout() = default;
+	ShaderTableLayout(UINT missCount, UINT rayTypeCount, const vector<UINT>& geometryCounts, UINT localRootDataSize);
+
+	UINT GetRecordSize() const { return mRecordSize; }
+	UINT GetMissCount() const { return mMissCount; }
+	UINT GetRayTypeCount() const { return mRayTypeCount; }
+	UINT GetInstanceCount() const { return static_cast<UINT>(mGeometryCounts.size()); }
+	UINT GetGeometryCount(UINT instance) const { return mGeometryCounts[instance]; }
+	UINT GetInstanceHitGroupIndex(UINT instance) const { return mInstanceHitGroupIndices[instance]; }
+	UINT GetHitGroupRecordCount() const { return mHitGroupRecordCount; }
+
+	// Each table starts on D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT.
+	UINT GetRayGenOffset() const { return 0; }
+	UINT GetMissTableOffset() const { return mMissTableOffset; }
+	UINT GetHitGroupTableOffset() const { return mHitGroupTableOffset; }
+	UINT GetSize() const { return mSize; }
+
+	UINT GetMissRecordOffset(UINT missIndex) const { return mMissTableOffset + missIndex * mRecordSize; }
+	UINT GetHitGroupRecordOffset(UINT instance, UINT geometry, UINT rayType) const
+	{
+		return mHitGroupTableOffset + (mInstanceHitGroupIndices[instance] + geometry * mRayTypeCount + rayType) * mRecordSize;
+	}
+
+	// True when every record of the instance is at the same offset in both layouts.
+	bool IsInstanceUnchanged(const ShaderTableLayout& other, UINT instance) const;
+
+private:
+	UINT mRecordSize = 0;
+	UINT mMissCount = 0;
+	UINT mRayTypeCount = 0;
+	UINT mHitGroupRecordCount = 0;
+
+	UINT mMissTableOffset = 0;
+	UINT mHitGroupTableOffset = 0;
+	UINT mSize = 0;
+
+	vector<UINT> mGeometryCounts;
+	vector<UINT> mInstanceHitGroupIndices;
+};
+
+// Shader binding table in a persistently mapped upload buffer.
+// Records are written in place, so only the records of instances marked dirty have to be rewritten.
+class ShaderTable
+{
+public:
+	ShaderTable() = default;
+	~ShaderTable() = default;
+
+	// Reallocates with headroom when the layout does not fit the current buffer. Records of instances whose
+	// offsets did not change are carried over, every other instance is marked dirty.
+	// The old buffer is released right away, so the GPU must not be using it.
+	void SetLayout(ID3D12Device5* device, ID3D12GraphicsCommandList4* cmdList, ComPtr<D3D12MA::Allocator> alloc,
+		ResourceStateTracker& tracker, AssetManager& assetMgr, const ShaderTableLayout& layout);
+
+	void WriteRayGenRecord(const void* identifier, const void* localRootData = nullptr, UINT localRootDataSize = 0);
+	void WriteMissRecord(UINT missIndex, const void* identifier, const void* localRootData = nullptr, UINT localRootDataSize = 0);
+	void WriteHitGroupRecord(UINT instance, UINT geometry, UINT rayType,
+		const void* identifier, const void* localRootData = nullptr, UINT localRootDataSize = 0);
+
+	// Instances past the current layout are new, SetLayout marks them when it takes them in.
+	void MarkInstanceDirty(UINT instance) { if (instance < mDirtyInstances.size()) mDirtyInstances[instance] = true; }
+	bool IsInstanceDirty(UINT instance) const { return mDirtyInstances[instance]; }
+	bool HasDirtyInstances() const { return find(mDirtyInstances.begin(), mDirtyInstances.end(), true) != mDirtyInstances.end(); }
+	void ClearDirty() { fill(mDirtyInstances.begin(), mDirtyInstances.end(), false); }
+
+	void FillDispatchRaysDesc(D3D12_DISPATCH_RAYS_DESC& desc) const;
+
+	const ShaderTableLayout& GetLayout() const { return mLayout; }
+	ComPtr<D3D12MA::Allocation> GetBuffer() { return mBuffer; }
+
+private:
+	void WriteRecord(UINT offset, const void* identifier, const void* localRootData, UINT localRootDataSize);
+
+	ShaderTableLayout mLayout;
+	vector<bool> mDirtyInstances;
+
+	ComPtr<D3D12MA::Allocation> mBuffer = NULL;
+	uint8_t* mMappedData = nullptr;
+	UINT mCapacity = 0;
+};
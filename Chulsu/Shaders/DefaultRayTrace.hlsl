@@ -1,10 +1,45 @@
 #define PI 3.1415926535f
 #define UINT_MAX 0xffffffff
 
+#include "LightBVH.hlsli"
+#include "LightGrid.hlsli"
+#include "EnvironmentMap.hlsli"
+#include "SphericalHarmonics.hlsli"
+#include "ProbeVolume.hlsli"
+#include "TextureLOD.hlsli"
+
 #define DIRECTIONAL_LIGHT 0
 #define SPOT_LIGHT 1
 #define POINT_LIGHT 2
 
+// Hit group records are laid out per geometry, one for each ray type
+#define PRIMARY_RAY 0
+#define SHADOW_RAY 1
+#define RAY_TYPE_COUNT 2
+
+// Grid cells with more lights than this pick one from the light BVH instead of shading them all
+#define LIGHT_GRID_MAX_SHADED 16
+
+// Material features, the hit shaders are compiled once for every combination the scene uses
+#ifndef HAS_ALBEDO
+#define HAS_ALBEDO 0
+#endif
+#ifndef HAS_METALIC
+#define HAS_METALIC 0
+#endif
+#ifndef HAS_ROUGHNESS
+#define HAS_ROUGHNESS 0
+#endif
+#ifndef HAS_NORMALMAP
+#define HAS_NORMALMAP 0
+#endif
+#ifndef HAS_OPACITY
+#define HAS_OPACITY 0
+#endif
+#ifndef PBR_ENABLED
+#define PBR_ENABLED 0
+#endif
+
 struct Light
 {
     float3 position;
@@ -25,12 +60,27 @@ struct GeometryInfo
 {
     uint VertexOffset;
     uint IndexOffset;
-    
+    uint MaterialIndex;
+};
+
+#define ALPHA_MODE_OPAQUE 0
+#define ALPHA_MODE_MASK 1
+
+// The scalars stand in for their texture when its index is UINT_MAX
+struct Material
+{
+    float3 BaseColor;
     uint AlbedoTextureIndex;
+
+    float Metalic;
+    float Roughness;
     uint MetalicTextureIndex;
     uint RoughnessTextureIndex;
+
     uint NormalMapTextureIndex;
     uint OpacityMapTextureIndex;
+    uint AlphaMode;
+    float AlphaCutoff;
 };
 
 struct Vertex
@@ -40,6 +90,7 @@ struct Vertex
     float2 texCoord;
     float3 tangent;
     float3 biTangent;
+    float occlusion; // Baked at import, 1 where nothing is close
 };
 
 SamplerState gAnisotropicWrap : register(s0);
@@ -134,23 +185,45 @@ cbuffer FrameCB : register(b0)
     float3 gCameraPos : packoffset(c5);
     uint gNumLights : packoffset(c5.w);
     float3 gSunDirection : packoffset(c6);
+    uint gFrameIndex : packoffset(c6.w);
+    uint AccumulationTextureIndex : packoffset(c7.x);
+    uint gLightBVHIndex : packoffset(c7.y);
+    uint gNumBVHLights : packoffset(c7.z);
+    uint gLightGridIndex : packoffset(c7.w);
+    uint gEnvironmentMapIndex : packoffset(c8.x); // UINT_MAX without an environment map
+    uint gEnvironmentDistributionIndex : packoffset(c8.y);
+    uint gAmbientSHIndex : packoffset(c8.z); // UINT_MAX without an environment map
+    uint gTraceSky : packoffset(c8.w); // Shadowed sky samples instead of the SH ambient or the probe volume
+    uint gProbeVolumeIndex : packoffset(c9.x); // Header, the probes follow it. UINT_MAX without a baked probe volume
+    float gPixelSpreadAngle : packoffset(c9.y); // Spread angle of the primary ray cones
+    uint gMaterialTableIndex : packoffset(c9.z);
+    uint gInstanceBufferIndex : packoffset(c9.w); // InstanceData of every TLAS instance, indexed by InstanceID()
 }
 
-cbuffer InstanceCB : register(b1)
+struct InstanceData
 {
-    uint GeometryInfoIndex : packoffset(c0.x);
-    uint VertexAttribIndex : packoffset(c0.y);
-    uint IndexBufferIndex : packoffset(c0.z);
+    uint GeometryInfoIndex;
+    uint VertexAttribIndex;
+    uint IndexBufferIndex;
+    uint TriangleLODIndex;
+};
+
+InstanceData GetInstanceData()
+{
+    StructuredBuffer<InstanceData> instances = ResourceDescriptorHeap[gInstanceBufferIndex];
+    return instances[InstanceID()];
 }
-// Tempolar method, apply normal mapping later.
-float3 UnpackNormalMap(Vertex v)
+float3 UnpackNormalMap(Vertex v, Material material, float rayConeLOD)
 {
-    float3 normal = v.normal;
-    float3 tangeent = v.tangent;
-    float3 biTangent = v.biTangent;
-    
-    return normal;
-    
+#if HAS_NORMALMAP
+    Texture2D<float3> normalMap = ResourceDescriptorHeap[material.NormalMapTextureIndex];
+    uint width, height;
+    normalMap.GetDimensions(width, height);
+    float3 n = normalMap.SampleLevel(gAnisotropicWrap, v.texCoord, TextureLOD(rayConeLOD, width, height)).xyz * 2.0f - 1.0f;
+    return normalize(n.x * v.tangent + n.y * v.biTangent + n.z * v.normal);
+#else
+    return v.normal;
+#endif
 }
 
 float BarycentricLerp(in float v0, in float v1, in float v2, in float3 barycentrics)
@@ -181,16 +254,17 @@ Vertex VertexBarycentricLerp(in Vertex v0, in Vertex v1, in Vertex v2, in float3
     vtx.texCoord = BarycentricLerp(v0.texCoord, v1.texCoord, v2.texCoord, barycentrics);
     vtx.tangent = normalize(BarycentricLerp(v0.tangent, v1.tangent, v2.tangent, barycentrics));
     vtx.biTangent = normalize(BarycentricLerp(v0.biTangent, v1.biTangent, v2.biTangent, barycentrics));
+    vtx.occlusion = BarycentricLerp(v0.occlusion, v1.occlusion, v2.occlusion, barycentrics);
     
     return vtx;
 }
 
-Vertex GetHitSurface(in BuiltInTriangleIntersectionAttributes attr, in uint vertexOffset, in uint indexOffset)
+Vertex GetHitSurface(in BuiltInTriangleIntersectionAttributes attr, in InstanceData instance, in uint vertexOffset, in uint indexOffset)
 {
     float3 barycentrics = float3(1 - attr.barycentrics.x - attr.barycentrics.y, attr.barycentrics.x, attr.barycentrics.y);
 
-    StructuredBuffer<Vertex> VertexBuffer = ResourceDescriptorHeap[VertexAttribIndex];
-    Buffer<uint> IndexBuffer = ResourceDescriptorHeap[IndexBufferIndex];
+    StructuredBuffer<Vertex> VertexBuffer = ResourceDescriptorHeap[instance.VertexAttribIndex];
+    Buffer<uint> IndexBuffer = ResourceDescriptorHeap[instance.IndexBufferIndex];
     
     uint primIndex = PrimitiveIndex();
     
@@ -214,9 +288,74 @@ float3 linearToSrgb(float3 c)
     return srgb;
 }
 
-inline RayDesc GenerateCameraRay(uint2 index, in float3 cameraPosition, in float4x4 invViewProj)
+// PCG hash, also used to seed the per pixel random numbers
+uint PcgHash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+uint InitRandom(uint2 pixel, uint frameIndex)
+{
+    return PcgHash(pixel.x + PcgHash(pixel.y + PcgHash(frameIndex)));
+}
+
+// Uniform in [0, 1)
+float NextRandom(inout uint state)
+{
+    state = PcgHash(state);
+    return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+// Radiance arriving at position from a point or spot light, L points towards the light
+float3 LocalLightRadiance(Light light, float3 position, out float3 L, out float distance)
+{
+    float3 toLight = light.position - position;
+    distance = length(toLight);
+    L = toLight / max(distance, 0.0001f);
+
+    float attenuation = 1.0f / max(distance * distance, 0.0001f);
+
+    // Smooth window that reaches zero at the range, so the light BVH can skip lights out of range
+    if (light.range > 0.0f)
+    {
+        float r = distance / light.range;
+        float window = saturate(1.0f - r * r * r * r);
+        attenuation *= window * window;
+    }
+
+    if (light.type == SPOT_LIGHT)
+        attenuation *= smoothstep(light.outerCosine, light.innerCosine, dot(-L, normalize(light.direction)));
+
+    return light.color * attenuation;
+}
+
+// Radical inverse of index in the given base, the Halton sequence starts at index 1
+float Halton(uint index, uint base)
 {
-    float2 xy = index + 0.5f; // center in the middle of the pixel.
+    float f = 1.0f;
+    float result = 0.0f;
+    while (index > 0)
+    {
+        f /= base;
+        result += f * (index % base);
+        index /= base;
+    }
+    return result;
+}
+
+// Sub-pixel offset of an accumulated frame, the first frame samples the pixel center
+float2 PixelJitter(uint frameIndex)
+{
+    if (frameIndex == 0)
+        return float2(0.5f, 0.5f);
+    return float2(Halton(frameIndex, 2), Halton(frameIndex, 3));
+}
+
+inline RayDesc GenerateCameraRay(uint2 index, float2 jitter, in float3 cameraPosition, in float4x4 invViewProj)
+{
+    float2 xy = index + jitter;
     float2 screenPos = xy / DispatchRaysDimensions().xy * 2.0 - 1.0;
 
     // Invert Y for DirectX-style coordinates.
@@ -236,6 +375,8 @@ inline RayDesc GenerateCameraRay(uint2 index, in float3 cameraPosition, in float
 struct RayPayload
 {
     float3 color;
+    float coneWidth; // Ray cone at the ray origin, the hit shaders pick texture mips from it
+    float coneSpreadAngle;
 };
 
 [shader("raygeneration")]
@@ -244,19 +385,28 @@ void RayGen()
     uint3 launchIndex = DispatchRaysIndex();
     uint3 launchDim = DispatchRaysDimensions();
     
-    RayDesc ray = GenerateCameraRay(launchIndex.xy, gCameraPos, gInvViewProj);
+    RayDesc ray = GenerateCameraRay(launchIndex.xy, PixelJitter(gFrameIndex), gCameraPos, gInvViewProj);
 
     ray.TMin = 0;
     ray.TMax = 100000;
 
     RayPayload payload;
     payload.color = float3(0, 0, 0);
+    payload.coneWidth = 0.0f;
+    payload.coneSpreadAngle = gPixelSpreadAngle;
     
     RWTexture2D<float4> output = ResourceDescriptorHeap[OutputTextureIndex];
     
-    TraceRay(gRtScene, 0, 0xFFFFFFFF, 0, 0, 0, ray, payload);
+    TraceRay(gRtScene, 0, 0xFFFFFFFF, PRIMARY_RAY, RAY_TYPE_COUNT, PRIMARY_RAY, ray, payload);
 
-    float3 col = linearToSrgb(payload.color);
+    // Running average of every frame since the last reset, kept in linear HDR
+    RWTexture2D<float4> accumulation = ResourceDescriptorHeap[AccumulationTextureIndex];
+    float3 color = payload.color;
+    if (gFrameIndex > 0)
+        color = lerp(accumulation[launchIndex.xy].rgb, color, 1.0f / (gFrameIndex + 1));
+    accumulation[launchIndex.xy] = float4(color, 1);
+
+    float3 col = linearToSrgb(color);
     output[launchIndex.xy] = float4(col, 1);
 
 }
@@ -269,18 +419,58 @@ struct ShadowPayload
 [shader("miss")]
 void Miss(inout RayPayload payload)
 {
-    payload.color = float3(0.4, 0.6, 0.2);
+    if (gEnvironmentMapIndex == UINT_MAX)
+    {
+        payload.color = float3(0.4, 0.6, 0.2);
+        return;
+    }
+
+    Texture2D<float3> environmentMap = ResourceDescriptorHeap[gEnvironmentMapIndex];
+    payload.color = environmentMap.SampleLevel(gAnisotropicWrap, EnvironmentDirectionToUV(WorldRayDirection()), 0.0f);
+}
+
+// Lambertian response to one point or spot light at posW, shadow ray included, albedo left out
+float3 ShadeLocalLight(Light light, float3 posW, float3 N)
+{
+    float3 L;
+    float distance;
+    float3 radiance = LocalLightRadiance(light, posW, L, distance);
+    float NdotL = saturate(dot(N, L));
+    if (NdotL <= 0.0f || all(radiance <= 0.0f))
+        return float3(0, 0, 0);
+
+    if (light.castShadows)
+    {
+        RayDesc lightRay;
+        lightRay.Origin = posW;
+        lightRay.Direction = L;
+        lightRay.TMin = 0.01;
+        lightRay.TMax = distance - 0.01;
+
+        ShadowPayload lightPayload;
+        lightPayload.hit = true;
+        uint traceRayFlags = RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_SKIP_CLOSEST_HIT_SHADER;
+        TraceRay(gRtScene, traceRayFlags, 0xFFFFFFFF, SHADOW_RAY, RAY_TYPE_COUNT, SHADOW_RAY, lightRay, lightPayload);
+        if (lightPayload.hit)
+            return float3(0, 0, 0);
+    }
+
+    return radiance * NdotL / PI;
 }
 
 [shader("closesthit")]
 void ClosestHit(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attribs)
 {
     uint geometryIndex = GeometryIndex();
+    InstanceData instance = GetInstanceData();
     
-    StructuredBuffer<GeometryInfo> geoInfoBuffer = ResourceDescriptorHeap[GeometryInfoIndex];
+    StructuredBuffer<GeometryInfo> geoInfoBuffer = ResourceDescriptorHeap[instance.GeometryInfoIndex];
     GeometryInfo geoInfo = geoInfoBuffer[geometryIndex];
+
+    StructuredBuffer<Material> materials = ResourceDescriptorHeap[gMaterialTableIndex];
+    Material material = materials[geoInfo.MaterialIndex];
     
-    Vertex v = GetHitSurface(attribs, geoInfo.VertexOffset, geoInfo.IndexOffset);
+    Vertex v = GetHitSurface(attribs, instance, geoInfo.VertexOffset, geoInfo.IndexOffset);
     
     float hitT = RayTCurrent();
     float3 rayDirW = WorldRayDirection();
@@ -288,6 +478,11 @@ void ClosestHit(inout RayPayload payload, in BuiltInTriangleIntersectionAttribut
     
     // Find the world-space hit position
     float3 posW = rayOriginW + hitT * rayDirW;
+
+    // Footprint of the ray cone against the texel density of the triangle, every texture adds its own size
+    StructuredBuffer<float> triangleLODs = ResourceDescriptorHeap[instance.TriangleLODIndex];
+    float triangleLOD = triangleLODs[geoInfo.IndexOffset / 3 + PrimitiveIndex()] + InstanceLODBias((float3x3)ObjectToWorld3x4());
+    float rayConeLOD = RayConeLOD(triangleLOD, payload.coneWidth + payload.coneSpreadAngle * hitT, dot(rayDirW, v.normal));
     
     RayDesc ray;
     ray.Origin = posW;
@@ -295,67 +490,164 @@ void ClosestHit(inout RayPayload payload, in BuiltInTriangleIntersectionAttribut
     ray.TMin = 0.01;
     ray.TMax = 100000;
     
+    // Any accepted hit occludes, only ShadowMiss clears the flag so closest hit can be skipped
     ShadowPayload shadowPayload;
-    uint traceRayFlags = RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH;
-    TraceRay(gRtScene, traceRayFlags, 0xFFFFFFFF, 1, 0, 1, ray, shadowPayload);
+    shadowPayload.hit = true;
+    uint traceRayFlags = RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_SKIP_CLOSEST_HIT_SHADER;
+    TraceRay(gRtScene, traceRayFlags, 0xFFFFFFFF, SHADOW_RAY, RAY_TYPE_COUNT, SHADOW_RAY, ray, shadowPayload);
     
     float factor = shadowPayload.hit ? 0.1f : 1.0f;
-    
-    float3 albedo;
-    if (geoInfo.AlbedoTextureIndex != UINT_MAX)
+
+    // Point and spot lights, every light of the grid cell when there are few, otherwise one picked from the light BVH
+    float3 N = dot(v.normal, rayDirW) > 0.0f ? -v.normal : v.normal;
+    float3 localLight = float3(0, 0, 0);
+    uint rng = InitRandom(DispatchRaysIndex().xy, gFrameIndex);
+    if (gNumBVHLights > 0)
+    {
+        StructuredBuffer<Light> lights = ResourceDescriptorHeap[gLightIndex];
+        StructuredBuffer<LightGridHeader> gridHeader = ResourceDescriptorHeap[gLightGridIndex];
+        StructuredBuffer<LightGridCell> gridCells = ResourceDescriptorHeap[gLightGridIndex + 1];
+        StructuredBuffer<uint> gridIndices = ResourceDescriptorHeap[gLightGridIndex + 2];
+
+        LightGridHeader grid = gridHeader[0];
+        LightGridCell cell = FindLightGridCell(grid, gridCells, posW);
+        if (grid.globalCount + cell.count <= LIGHT_GRID_MAX_SHADED)
+        {
+            for (uint i = 0; i < grid.globalCount; ++i)
+                localLight += ShadeLocalLight(lights[gridIndices[i]], posW, N);
+            for (uint j = 0; j < cell.count; ++j)
+                localLight += ShadeLocalLight(lights[gridIndices[cell.offset + j]], posW, N);
+        }
+        else
+        {
+            StructuredBuffer<LightBVHNode> lightNodes = ResourceDescriptorHeap[gLightBVHIndex];
+            float lightPdf;
+            uint localLightIndex = SampleLightBVH(lightNodes, posW, N, NextRandom(rng), lightPdf);
+            if (localLightIndex != UINT_MAX)
+                localLight = ShadeLocalLight(lights[localLightIndex], posW, N) / lightPdf;
+        }
+    }
+
+    // Sky, the baked probes or the unshadowed SH ambient darkened by the baked vertex occlusion by default,
+    // or one traced direction picked in proportion to the environment map's luminance
+    float3 skyLight = float3(0, 0, 0);
+    if (!gTraceSky && gProbeVolumeIndex != UINT_MAX)
     {
-        Texture2D<float3> albedoMap = ResourceDescriptorHeap[geoInfo.AlbedoTextureIndex];
-        albedo = albedoMap.SampleLevel(gAnisotropicWrap, v.texCoord, 0.0f).xyz;
+        StructuredBuffer<ProbeVolumeHeader> probeHeader = ResourceDescriptorHeap[gProbeVolumeIndex];
+        StructuredBuffer<AmbientSH> probes = ResourceDescriptorHeap[gProbeVolumeIndex + 1];
+        skyLight = SampleProbeVolume(probeHeader[0], probes, posW, N) * v.occlusion;
     }
-    
-    float metalic;
-    if (geoInfo.MetalicTextureIndex != UINT_MAX)
+    else if (!gTraceSky && gAmbientSHIndex != UINT_MAX)
     {
-        Texture2D<float> metalicMap = ResourceDescriptorHeap[geoInfo.MetalicTextureIndex];
-        metalic = metalicMap.SampleLevel(gAnisotropicWrap, v.texCoord, 0.0f).x;
+        ConstantBuffer<AmbientSH> ambient = ResourceDescriptorHeap[gAmbientSHIndex];
+        skyLight = EvaluateAmbientSH(ambient, N) * v.occlusion;
     }
-    
-    float roughness;
-    if (geoInfo.RoughnessTextureIndex != UINT_MAX)
+    else if (gTraceSky && gEnvironmentMapIndex != UINT_MAX)
     {
-        Texture2D<float> roughnessMap = ResourceDescriptorHeap[geoInfo.RoughnessTextureIndex];
-        roughness = roughnessMap.SampleLevel(gAnisotropicWrap, v.texCoord, 0.0f).x;
+        Texture2D<float3> environmentMap = ResourceDescriptorHeap[gEnvironmentMapIndex];
+        StructuredBuffer<float> environmentDistribution = ResourceDescriptorHeap[gEnvironmentDistributionIndex];
+        uint width, height;
+        environmentMap.GetDimensions(width, height);
+
+        float u1 = NextRandom(rng);
+        float u2 = NextRandom(rng);
+        EnvironmentSample skySample = SampleEnvironmentMap(environmentDistribution, width, height, u1, u2);
+        float NdotL = dot(N, skySample.direction);
+        if (skySample.pdf > 0.0f && NdotL > 0.0f)
+        {
+            RayDesc skyRay;
+            skyRay.Origin = posW;
+            skyRay.Direction = skySample.direction;
+            skyRay.TMin = 0.01;
+            skyRay.TMax = 100000;
+
+            ShadowPayload skyPayload;
+            skyPayload.hit = true;
+            TraceRay(gRtScene, traceRayFlags, 0xFFFFFFFF, SHADOW_RAY, RAY_TYPE_COUNT, SHADOW_RAY, skyRay, skyPayload);
+            if (!skyPayload.hit)
+            {
+                float3 radiance = environmentMap.SampleLevel(gAnisotropicWrap, EnvironmentDirectionToUV(skySample.direction), 0.0f);
+                skyLight = radiance * NdotL / (PI * skySample.pdf);
+            }
+        }
     }
     
+    // The permutation guarantees the texture index is valid when its feature is defined
+    float3 albedo = material.BaseColor;
+#if HAS_ALBEDO
+    Texture2D<float3> albedoMap = ResourceDescriptorHeap[material.AlbedoTextureIndex];
+    uint albedoWidth, albedoHeight;
+    albedoMap.GetDimensions(albedoWidth, albedoHeight);
+    albedo = albedoMap.SampleLevel(gAnisotropicWrap, v.texCoord, TextureLOD(rayConeLOD, albedoWidth, albedoHeight)).xyz;
+#endif
+    
     float3 color = albedo;
     
-    //if(gNumLights > 0)
-    //{
-    //    StructuredBuffer<Light> light = ResourceDescriptorHeap[gLightIndex];
-    //    color = DirectionalLightPBR(light[0], UnpackNormalMap(v), normalize(0.0f.xxx - WorldRayOrigin()), albedo, metalic, roughness);
-    //}
-    payload.color = color * factor;
+#if PBR_ENABLED
+    float metalic = material.Metalic;
+#if HAS_METALIC
+    Texture2D<float> metalicMap = ResourceDescriptorHeap[material.MetalicTextureIndex];
+    uint metalicWidth, metalicHeight;
+    metalicMap.GetDimensions(metalicWidth, metalicHeight);
+    metalic = metalicMap.SampleLevel(gAnisotropicWrap, v.texCoord, TextureLOD(rayConeLOD, metalicWidth, metalicHeight)).x;
+#endif
+    
+    float roughness = material.Roughness;
+#if HAS_ROUGHNESS
+    Texture2D<float> roughnessMap = ResourceDescriptorHeap[material.RoughnessTextureIndex];
+    uint roughnessWidth, roughnessHeight;
+    roughnessMap.GetDimensions(roughnessWidth, roughnessHeight);
+    roughness = roughnessMap.SampleLevel(gAnisotropicWrap, v.texCoord, TextureLOD(rayConeLOD, roughnessWidth, roughnessHeight)).x;
+#endif
+    
+    if (gNumLights > 0)
+    {
+        StructuredBuffer<Light> light = ResourceDescriptorHeap[gLightIndex];
+        color = DirectionalLightPBR(light[0], UnpackNormalMap(v, material, rayConeLOD), -rayDirW, albedo, metalic, roughness);
+    }
+#endif
+    payload.color = color * factor + albedo * (localLight + skyLight);
 }
 
-[shader("anyhit")]
-void AnyHit(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attribs)
+// Alpha test shared by the any-hit shaders, only exported from HAS_OPACITY permutations.
+// It stays on the top mip, the one ClassifyOpacity splits the triangles by, and shadow rays carry no cone.
+bool IsTransparent(in BuiltInTriangleIntersectionAttributes attribs)
 {
+#if HAS_OPACITY
     const uint geometryIndex = GeometryIndex();
+    const InstanceData instance = GetInstanceData();
     
-    StructuredBuffer<GeometryInfo> geoInfoBuffer = ResourceDescriptorHeap[GeometryInfoIndex];
+    StructuredBuffer<GeometryInfo> geoInfoBuffer = ResourceDescriptorHeap[instance.GeometryInfoIndex];
     const GeometryInfo geoInfo = geoInfoBuffer[geometryIndex];
     
-    const Vertex v = GetHitSurface(attribs, geoInfo.VertexOffset, geoInfo.IndexOffset);
+    StructuredBuffer<Material> materials = ResourceDescriptorHeap[gMaterialTableIndex];
+    const Material material = materials[geoInfo.MaterialIndex];
     
-    if (geoInfo.OpacityMapTextureIndex != UINT_MAX)
+    const Vertex v = GetHitSurface(attribs, instance, geoInfo.VertexOffset, geoInfo.IndexOffset);
+    
+    Texture2D opacityMap = ResourceDescriptorHeap[material.OpacityMapTextureIndex];
+    return opacityMap.SampleLevel(gAnisotropicWrap, v.texCoord, 0.0f).x < material.AlphaCutoff;
+#else
+    return false;
+#endif
+}
+
+[shader("anyhit")]
+void AnyHit(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attribs)
+{
+    if (IsTransparent(attribs))
     {
-        Texture2D opacityMap = ResourceDescriptorHeap[geoInfo.OpacityMapTextureIndex];
-        if (opacityMap.SampleLevel(gAnisotropicWrap, v.texCoord, 0.0f).x < 0.35f)
-        {
-            IgnoreHit();
-        }
+        IgnoreHit();
     }
 }
 
-[shader("closesthit")]
-void ShadowClosestHit(inout ShadowPayload payload, in BuiltInTriangleIntersectionAttributes attribs)
+[shader("anyhit")]
+void ShadowAnyHit(inout ShadowPayload payload, in BuiltInTriangleIntersectionAttributes attribs)
 {
-    payload.hit = true;
+    if (IsTransparent(attribs))
+    {
+        IgnoreHit();
+    }
 }
 
 [shader("miss")]
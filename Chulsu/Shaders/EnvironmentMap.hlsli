@@ -0,0 +1,82 @@
+#ifndef ENVIRONMENT_MAP_HLSLI
+#define ENVIRONMENT_MAP_HLSLI
+
+// Equirectangular sky and its sampling tables, the same math as EnvironmentMap.cpp.
+// The distribution holds height rows of width + 1 conditional CDF values, then height + 1 marginal CDF values.
+
+#define ENVIRONMENT_PI 3.1415926535f
+#define ENVIRONMENT_ONE_MINUS_EPSILON 0.99999994f
+
+struct EnvironmentSample
+{
+    float3 direction;
+    float pdf; // Solid angle density, zero when the sample has to be skipped
+};
+
+float2 EnvironmentDirectionToUV(float3 direction)
+{
+    float u = atan2(direction.z, direction.x) / (2.0f * ENVIRONMENT_PI);
+    if (u < 0.0f)
+        u += 1.0f;
+    float v = acos(clamp(direction.y, -1.0f, 1.0f)) / ENVIRONMENT_PI;
+    return float2(u, v);
+}
+
+float3 EnvironmentUVToDirection(float2 uv)
+{
+    float phi = uv.x * 2.0f * ENVIRONMENT_PI;
+    float theta = uv.y * ENVIRONMENT_PI;
+    float sinTheta = sin(theta);
+    return float3(sinTheta * cos(phi), cos(theta), sinTheta * sin(phi));
+}
+
+// The last i in [0, count) with cdf[first + i] <= u, empty intervals are never returned for u < 1
+uint FindInterval(StructuredBuffer<float> cdf, uint first, uint count, float u)
+{
+    uint low = 0;
+    uint high = count;
+    while (low + 1 < high)
+    {
+        uint middle = (low + high) / 2;
+        if (cdf[first + middle] <= u)
+            low = middle;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+float IntervalOffset(StructuredBuffer<float> cdf, uint first, uint index, float u)
+{
+    float width = cdf[first + index + 1] - cdf[first + index];
+    return width > 0.0f ? min((u - cdf[first + index]) / width, ENVIRONMENT_ONE_MINUS_EPSILON) : 0.5f;
+}
+
+// u1 picks the row, u2 the texel within it
+EnvironmentSample SampleEnvironmentMap(StructuredBuffer<float> distribution, uint width, uint height, float u1, float u2)
+{
+    EnvironmentSample result;
+    result.direction = float3(0, 0, 0);
+    result.pdf = 0.0f;
+
+    uint marginal = height * (width + 1);
+    uint y = FindInterval(distribution, marginal, height, u1);
+    float v = (y + IntervalOffset(distribution, marginal, y, u1)) / height;
+
+    uint conditional = y * (width + 1);
+    uint x = FindInterval(distribution, conditional, width, u2);
+    float u = (x + IntervalOffset(distribution, conditional, x, u2)) / width;
+
+    // Constant density over the texel in uv, divided by the area the uv to sphere mapping stretches it to
+    float pdfUV = (distribution[conditional + x + 1] - distribution[conditional + x]) * width
+        * (distribution[marginal + y + 1] - distribution[marginal + y]) * height;
+    float sinTheta = sin(v * ENVIRONMENT_PI);
+    if (pdfUV <= 0.0f || sinTheta <= 0.0f)
+        return result;
+
+    result.direction = EnvironmentUVToDirection(float2(u, v));
+    result.pdf = pdfUV / (2.0f * ENVIRONMENT_PI * ENVIRONMENT_PI * sinTheta);
+    return result;
+}
+
+#endif
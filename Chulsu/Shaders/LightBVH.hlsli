@@ -0,0 +1,117 @@
+#ifndef LIGHT_BVH_HLSLI
+#define LIGHT_BVH_HLSLI
+
+// Light BVH traversal, the same math as LightBVH.cpp so CPU and GPU pick lights with the same probabilities.
+
+#define LIGHT_BVH_FLT_MAX 3.402823466e+38f
+#define LIGHT_BVH_ONE_MINUS_EPSILON 0.99999994f
+
+struct LightBVHNode
+{
+    float3 boundsMin;
+    uint leftFirst; // First child when count is 0, index into the light buffer otherwise
+    float3 boundsMax;
+    uint count;
+    float3 axis;
+    float flux;
+    float cosThetaO;
+    float cosThetaE;
+    float range;
+    uint pad;
+};
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+float CosSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    return cosA > cosB ? 1.0f : cosA * cosB + sinA * sinB;
+}
+
+float SinSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    return cosA > cosB ? 0.0f : sinA * cosB - cosA * sinB;
+}
+
+float SafeSqrt(float x)
+{
+    return sqrt(max(x, 0.0f));
+}
+
+// Upper bound estimate of what the lights below the node contribute at position, normal may be zero
+float LightBVHImportance(LightBVHNode node, float3 position, float3 normal)
+{
+    float3 outside = max(max(node.boundsMin - position, position - node.boundsMax), 0.0f);
+    float outsideDistance2 = dot(outside, outside);
+    if (node.range < LIGHT_BVH_FLT_MAX && outsideDistance2 > node.range * node.range)
+        return 0.0f;
+
+    float3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+    float radius2 = dot(node.boundsMax - center, node.boundsMax - center);
+    float3 toPoint = position - center;
+    float distance2 = dot(toPoint, toPoint);
+
+    float cosThetaB = -1.0f;
+    if (outsideDistance2 > 0.0f && distance2 > radius2)
+        cosThetaB = SafeSqrt(1.0f - radius2 / distance2);
+    float sinThetaB = SafeSqrt(1.0f - cosThetaB * cosThetaB);
+
+    float3 wi = distance2 > 0.0f ? toPoint / sqrt(distance2) : float3(0, 0, 0);
+
+    float cosThetaW = distance2 > 0.0f ? dot(node.axis, wi) : 1.0f;
+    float sinThetaW = SafeSqrt(1.0f - cosThetaW * cosThetaW);
+    float sinThetaO = SafeSqrt(1.0f - node.cosThetaO * node.cosThetaO);
+    float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    float cosThetaP = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= node.cosThetaE)
+        return 0.0f;
+
+    float importance = node.flux * cosThetaP / max(distance2, radius2);
+
+    if (dot(normal, normal) > 0.0f)
+    {
+        float cosThetaI = abs(dot(wi, normal));
+        float sinThetaI = SafeSqrt(1.0f - cosThetaI * cosThetaI);
+        importance *= CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+    }
+
+    return max(importance, 0.0f);
+}
+
+// Picks a light in proportion to the importance of the subtrees on the way down.
+// Returns UINT_MAX when no light can reach the point, pdf is the probability of the light returned.
+uint SampleLightBVH(StructuredBuffer<LightBVHNode> nodes, float3 position, float3 normal, float u, out float pdf)
+{
+    pdf = 0.0f;
+    if (LightBVHImportance(nodes[0], position, normal) == 0.0f)
+        return UINT_MAX;
+
+    uint index = 0;
+    float probability = 1.0f;
+    while (nodes[index].count == 0)
+    {
+        uint left = nodes[index].leftFirst;
+        float leftImportance = LightBVHImportance(nodes[left], position, normal);
+        float rightImportance = LightBVHImportance(nodes[left + 1], position, normal);
+        if (leftImportance == 0.0f && rightImportance == 0.0f)
+            return UINT_MAX;
+
+        float leftProbability = leftImportance / (leftImportance + rightImportance);
+        if (u < leftProbability)
+        {
+            index = left;
+            probability *= leftProbability;
+            u = min(u / leftProbability, LIGHT_BVH_ONE_MINUS_EPSILON);
+        }
+        else
+        {
+            index = left + 1;
+            probability *= 1.0f - leftProbability;
+            u = min((u - leftProbability) / (1.0f - leftProbability), LIGHT_BVH_ONE_MINUS_EPSILON);
+        }
+    }
+
+    pdf = probability;
+    return nodes[index].leftFirst;
+}
+
+#endif
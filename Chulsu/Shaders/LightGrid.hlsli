@@ -0,0 +1,37 @@
+#ifndef LIGHT_GRID_HLSLI
+#define LIGHT_GRID_HLSLI
+
+// World space light grid built by LightGrid.cpp, every cell lists the point and spot lights that may reach it.
+
+struct LightGridHeader
+{
+    float3 boundsMin;
+    uint globalCount; // Lights without a range, they come first in the index list and reach every cell
+    float3 invCellSize;
+    uint cellCount;
+    uint3 dimensions;
+    uint indexCount;
+};
+
+struct LightGridCell
+{
+    uint offset; // Into the index list, past the global lights
+    uint count;
+};
+
+// The cell around position, or a cell without lights when position is outside the grid
+LightGridCell FindLightGridCell(LightGridHeader header, StructuredBuffer<LightGridCell> cells, float3 position)
+{
+    float3 cell = (position - header.boundsMin) * header.invCellSize;
+
+    LightGridCell empty;
+    empty.offset = header.globalCount;
+    empty.count = 0;
+    if (any(cell < 0.0f) || any(cell >= float3(header.dimensions)))
+        return empty;
+
+    uint3 index = uint3(cell);
+    return cells[(index.z * header.dimensions.y + index.y) * header.dimensions.x + index.x];
+}
+
+#endif
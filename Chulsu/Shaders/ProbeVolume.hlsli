@@ -0,0 +1,47 @@
+#ifndef PROBE_VOLUME_HLSLI
+#define PROBE_VOLUME_HLSLI
+
+#include "SphericalHarmonics.hlsli"
+
+// Irradiance probes baked by ProbeVolume.cpp, the same math as ProbeVolume::Sample.
+// Every probe is an AmbientSH, the w of its first coefficient is zero for probes inside geometry.
+
+struct ProbeVolumeHeader
+{
+    float3 boundsMin; // Position of probe (0, 0, 0)
+    uint probeCount;
+    float3 spacing;
+    uint padding0;
+    uint3 dimensions;
+    uint padding1;
+};
+
+// Irradiance / PI around the unit normal n, blended trilinearly from the valid probes around position
+float3 SampleProbeVolume(ProbeVolumeHeader header, StructuredBuffer<AmbientSH> probes, float3 position, float3 n)
+{
+    // Grid coordinates, clamped so surfaces outside the volume use its border probes
+    float3 cell = clamp((position - header.boundsMin) / header.spacing, 0.0f, float3(header.dimensions - 1));
+    uint3 base = min(uint3(cell), max(header.dimensions, 2) - 2);
+    float3 fraction = cell - float3(base);
+
+    float3 sum = float3(0, 0, 0);
+    float weightSum = 0.0f;
+    for (uint corner = 0; corner < 8; ++corner)
+    {
+        uint3 offset = uint3(corner, corner >> 1, corner >> 2) & 1;
+        uint3 index = min(base + offset, header.dimensions - 1);
+        float3 weights = lerp(1.0f - fraction, fraction, float3(offset));
+
+        AmbientSH probe = probes[(index.z * header.dimensions.y + index.y) * header.dimensions.x + index.x];
+        float weight = weights.x * weights.y * weights.z * probe.coefficients[0].w;
+        if (weight > 0.0f)
+        {
+            sum += EvaluateAmbientSH(probe, n) * weight;
+            weightSum += weight;
+        }
+    }
+
+    return weightSum > 0.0f ? sum / weightSum : float3(0, 0, 0);
+}
+
+#endif
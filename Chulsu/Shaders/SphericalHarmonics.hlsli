@@ -0,0 +1,29 @@
+#ifndef SPHERICAL_HARMONICS_HLSLI
+#define SPHERICAL_HARMONICS_HLSLI
+
+// Ambient light of the environment map as nine SH coefficients, projected on the CPU by SphericalHarmonics.cpp.
+// The coefficients are already convolved with the cosine lobe and divided by PI.
+
+struct AmbientSH
+{
+    float4 coefficients[9]; // rgb, w unused
+};
+
+// Irradiance / PI around the unit normal n, the light a white Lambertian surface reflects
+float3 EvaluateAmbientSH(AmbientSH sh, float3 n)
+{
+    float3 result = sh.coefficients[0].rgb * 0.282095f
+        + sh.coefficients[1].rgb * (0.488603f * n.y)
+        + sh.coefficients[2].rgb * (0.488603f * n.z)
+        + sh.coefficients[3].rgb * (0.488603f * n.x)
+        + sh.coefficients[4].rgb * (1.092548f * n.x * n.y)
+        + sh.coefficients[5].rgb * (1.092548f * n.y * n.z)
+        + sh.coefficients[6].rgb * (0.315392f * (3.0f * n.z * n.z - 1.0f))
+        + sh.coefficients[7].rgb * (1.092548f * n.x * n.z)
+        + sh.coefficients[8].rgb * (0.546274f * (n.x * n.x - n.y * n.y));
+
+    // Ringing of the truncated series can dip below zero on the dark side of bright skies
+    return max(result, 0.0f);
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef TEXTURE_LOD_HLSLI
+#define TEXTURE_LOD_HLSLI
+
+// Ray cone texture LOD, the per triangle densities are computed at import by TextureLOD.cpp which mirrors these functions.
+//   lod = triangleLOD + 0.5 * log2(width * height) + log2(coneWidth / |cos|)
+
+// Grazing hits push the LOD towards the smallest mip, the clamp only keeps log2 finite
+#define MIN_CONE_COSINE 1e-4f
+
+// Texture independent part of the LOD at a hit. triangleLOD is 0.5 * log2(UV area / world area) of the triangle in world space,
+// cosine the dot product of the ray direction and the surface normal
+float RayConeLOD(float triangleLOD, float coneWidth, float cosine)
+{
+    return triangleLOD + log2(abs(coneWidth) / max(abs(cosine), MIN_CONE_COSINE));
+}
+
+// Model space triangle LOD of an instance, the area scales with the determinant of the transform to the power 2/3
+float InstanceLODBias(float3x3 objectToWorld)
+{
+    float det = abs(determinant(objectToWorld));
+    return det > 0.0f ? -log2(det) / 3.0f : 0.0f;
+}
+
+// Mip level of a width x height texture, the sampler clamps it to the mip chain
+float TextureLOD(float rayConeLOD, uint width, uint height)
+{
+    return rayConeLOD + 0.5f * log2(float(width) * float(height));
+}
+
+#endif
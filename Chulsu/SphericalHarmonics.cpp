@@ -0,0 +1,244 @@
+#include "SphericalHarmonics.h"
+#include "EnvironmentMap.h"
+#include "Parallel.h"
+#include "Profiler.h"
+
+namespace
+{
+	// Lanes over the texels of a row, picked at compile time like the packet kernels in WideBVH.cpp.
+	// Loads are unaligned, the lanes read straight from the per column tables.
+#if defined(__AVX512F__)
+	typedef __m512 vfloat;
+	const UINT kLanes = 16;
+
+	inline vfloat Load(const float* p) { return _mm512_loadu_ps(p); }
+	inline void Store(float* p, vfloat v) { _mm512_storeu_ps(p, v); }
+	inline vfloat Set1(float f) { return _mm512_set1_ps(f); }
+	inline vfloat Zero() { return _mm512_setzero_ps(); }
+	inline vfloat Add(vfloat a, vfloat b) { return _mm512_add_ps(a, b); }
+	inline vfloat Sub(vfloat a, vfloat b) { return _mm512_sub_ps(a, b); }
+	inline vfloat Mul(vfloat a, vfloat b) { return _mm512_mul_ps(a, b); }
+#elif defined(__AVX2__)
+	typedef __m256 vfloat;
+	const UINT kLanes = 8;
+
+	inline vfloat Load(const float* p) { return _mm256_loadu_ps(p); }
+	inline void Store(float* p, vfloat v) { _mm256_storeu_ps(p, v); }
+	inline vfloat Set1(float f) { return _mm256_set1_ps(f); }
+	inline vfloat Zero() { return _mm256_setzero_ps(); }
+	inline vfloat Add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+	inline vfloat Sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+	inline vfloat Mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+#else
+	typedef __m128 vfloat;
+	const UINT kLanes = 4;
+
+	inline vfloat Load(const float* p) { return _mm_loadu_ps(p); }
+	inline void Store(float* p, vfloat v) { _mm_storeu_ps(p, v); }
+	inline vfloat Set1(float f) { return _mm_set1_ps(f); }
+	inline vfloat Zero() { return _mm_setzero_ps(); }
+	inline vfloat Add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+	inline vfloat Sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+	inline vfloat Mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+#endif
+
+	const float kY0 = 0.282095f;	// 1 / (2 sqrt(pi))
+	const float kY1 = 0.488603f;	// sqrt(3) / (2 sqrt(pi))
+	const float kY2 = 1.092548f;	// sqrt(15) / (2 sqrt(pi))
+	const float kY3 = 0.315392f;	// sqrt(5) / (4 sqrt(pi))
+	const float kY4 = 0.546274f;	// sqrt(15) / (4 sqrt(pi))
+
+	// Cosine lobe convolution per band, A_l / PI.
+	const float kBandScale[3] = { 1.0f, 2.0f / 3.0f, 1.0f / 4.0f };
+
+	// Texel centers and the exact solid angle of the row, the same directions EnvironmentMap::UVToDirection gives.
+	struct RowGeometry
+	{
+		double SinTheta;
+		double CosTheta;
+		double SolidAngle;
+	};
+
+	RowGeometry GetRowGeometry(UINT y, UINT width, UINT height)
+	{
+		double theta = PI * (y + 0.5) / height;
+		double theta0 = PI * static_cast<double>(y) / height;
+		double theta1 = PI * (y + 1.0) / height;
+		return { sin(theta), cos(theta), 2.0 * PI / width * (cos(theta0) - cos(theta1)) };
+	}
+
+	template<typename T>
+	void EvaluateBasis(T x, T y, T z, T basis[9])
+	{
+		basis[0] = T(kY0);
+		basis[1] = T(kY1) * y;
+		basis[2] = T(kY1) * z;
+		basis[3] = T(kY1) * x;
+		basis[4] = T(kY2) * x * y;
+		basis[5] = T(kY2) * y * z;
+		basis[6] = T(kY3) * (T(3) * z * z - T(1));
+		basis[7] = T(kY2) * x * z;
+		basis[8] = T(kY4) * (x * x - y * y);
+	}
+
+	// Per row sums of radiance times basis, 27 values in channel major order so rows can be added up in a fixed order.
+	typedef array<double, 27> RowSums;
+
+	SH9Color ToColor(const vector<RowSums>& rows)
+	{
+		array<double, 27> total = {};
+		for (const RowSums& row : rows)
+			for (UINT i = 0; i < 27; ++i)
+				total[i] += row[i];
+
+		SH9Color result;
+		for (UINT k = 0; k < 9; ++k)
+			result.Coefficients[k] = XMFLOAT3(static_cast<float>(total[k]), static_cast<float>(total[9 + k]), static_cast<float>(total[18 + k]));
+		return result;
+	}
+}
+
+SH9Color ProjectSH9(const EnvironmentMap& environmentMap)
+{
+	PROFILE_ZONE("SH Projection");
+
+	const UINT width = environmentMap.GetWidth();
+	const UINT height = environmentMap.GetHeight();
+	const vector<XMFLOAT4>& texels = environmentMap.GetTexels();
+	if (texels.empty())
+		return SH9Color();
+
+	// The azimuth only depends on the column, the lanes read cos and sin phi from these for every row.
+	// Padded columns have no texel and are skipped through a zero radiance.
+	const UINT paddedWidth = (width + kLanes - 1) / kLanes * kLanes;
+	vector<float> cosPhi(paddedWidth, 0.0f);
+	vector<float> sinPhi(paddedWidth, 0.0f);
+	for (UINT x = 0; x < width; ++x)
+	{
+		double phi = 2.0 * PI * (x + 0.5) / width;
+		cosPhi[x] = static_cast<float>(cos(phi));
+		sinPhi[x] = static_cast<float>(sin(phi));
+	}
+
+	vector<RowSums> rows(height);
+	ParallelFor(height, [&](UINT y)
+		{
+			RowGeometry geometry = GetRowGeometry(y, width, height);
+			vfloat sinTheta = Set1(static_cast<float>(geometry.SinTheta));
+			vfloat cosTheta = Set1(static_cast<float>(geometry.CosTheta));
+			const XMFLOAT4* row = &texels[static_cast<size_t>(y) * width];
+
+			vfloat sums[27];
+			for (vfloat& sum : sums)
+				sum = Zero();
+
+			for (UINT x = 0; x < paddedWidth; x += kLanes)
+			{
+				// Transpose the RGBA texels into one register per channel
+				alignas(64) float r[kLanes], g[kLanes], b[kLanes];
+				for (UINT i = 0; i < kLanes; ++i)
+				{
+					bool inside = x + i < width;
+					r[i] = inside ? row[x + i].x : 0.0f;
+					g[i] = inside ? row[x + i].y : 0.0f;
+					b[i] = inside ? row[x + i].z : 0.0f;
+				}
+
+				vfloat dirX = Mul(sinTheta, Load(&cosPhi[x]));
+				vfloat dirZ = Mul(sinTheta, Load(&sinPhi[x]));
+
+				vfloat basis[9];
+				basis[0] = Set1(kY0);
+				basis[1] = Mul(Set1(kY1), cosTheta);
+				basis[2] = Mul(Set1(kY1), dirZ);
+				basis[3] = Mul(Set1(kY1), dirX);
+				basis[4] = Mul(Set1(kY2), Mul(dirX, cosTheta));
+				basis[5] = Mul(Set1(kY2), Mul(cosTheta, dirZ));
+				basis[6] = Mul(Set1(kY3), Sub(Mul(Set1(3.0f), Mul(dirZ, dirZ)), Set1(1.0f)));
+				basis[7] = Mul(Set1(kY2), Mul(dirX, dirZ));
+				basis[8] = Mul(Set1(kY4), Sub(Mul(dirX, dirX), Mul(cosTheta, cosTheta)));
+
+				vfloat color[3] = { Load(r), Load(g), Load(b) };
+				for (UINT c = 0; c < 3; ++c)
+					for (UINT k = 0; k < 9; ++k)
+						sums[c * 9 + k] = Add(sums[c * 9 + k], Mul(color[c], basis[k]));
+			}
+
+			// Every texel of the row covers the same solid angle, it is applied once to the lane totals
+			for (UINT i = 0; i < 27; ++i)
+			{
+				alignas(64) float lanes[kLanes];
+				Store(lanes, sums[i]);
+
+				double sum = 0.0;
+				for (float lane : lanes)
+					sum += lane;
+				rows[y][i] = sum * geometry.SolidAngle;
+			}
+		});
+
+	return ToColor(rows);
+}
+
+SH9Color ProjectSH9Reference(const EnvironmentMap& environmentMap)
+{
+	const UINT width = environmentMap.GetWidth();
+	const UINT height = environmentMap.GetHeight();
+	const vector<XMFLOAT4>& texels = environmentMap.GetTexels();
+
+	vector<RowSums> rows(height);
+	for (UINT y = 0; y < height; ++y)
+	{
+		RowGeometry geometry = GetRowGeometry(y, width, height);
+		rows[y] = {};
+
+		for (UINT x = 0; x < width; ++x)
+		{
+			double phi = 2.0 * PI * (x + 0.5) / width;
+			double basis[9];
+			EvaluateBasis(geometry.SinTheta * cos(phi), geometry.CosTheta, geometry.SinTheta * sin(phi), basis);
+
+			const XMFLOAT4& texel = texels[static_cast<size_t>(y) * width + x];
+			const double color[3] = { texel.x, texel.y, texel.z };
+			for (UINT c = 0; c < 3; ++c)
+				for (UINT k = 0; k < 9; ++k)
+					rows[y][c * 9 + k] += color[c] * basis[k] * geometry.SolidAngle;
+		}
+	}
+
+	return ToColor(rows);
+}
+
+AmbientSHConstants ComputeAmbientSHConstants(const SH9Color& radiance)
+{
+	AmbientSHConstants constants = {};
+	for (UINT k = 0; k < 9; ++k)
+	{
+		// Band 0 is coefficient 0, band 1 coefficients 1 to 3, band 2 the rest
+		float scale = kBandScale[k == 0 ? 0 : k < 4 ? 1 : 2];
+		const XMFLOAT3& c = radiance.Coefficients[k];
+		constants.Coefficients[k] = XMFLOAT4(c.x * scale, c.y * scale, c.z * scale, 0.0f);
+	}
+	return constants;
+}
+
+XMVECTOR EvaluateAmbientSH(const AmbientSHConstants& constants, FXMVECTOR normal)
+{
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, normal);
+
+	float basis[9];
+	EvaluateSH9Basis(n, basis);
+
+	XMVECTOR result = XMVectorZero();
+	for (UINT k = 0; k < 9; ++k)
+		result = XMVectorMultiplyAdd(XMLoadFloat4(&constants.Coefficients[k]), XMVectorReplicate(basis[k]), result);
+
+	// Ringing of the truncated series can dip below zero on the dark side of bright skies
+	return XMVectorSetW(XMVectorMax(result, XMVectorZero()), 0.0f);
+}
+
+void EvaluateSH9Basis(const XMFLOAT3& direction, float basis[9])
+{
+	EvaluateBasis(direction.x, direction.y, direction.z, basis);
+}
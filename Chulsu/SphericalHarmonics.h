@@ -0,0 +1,34 @@
+#pragma once
+#include "stdafx.h"
+
+class EnvironmentMap;
+
+// Order 2 (L2) spherical harmonics, nine RGB coefficients in the usual l, m order:
+// 1, y, z, x, xy, yz, 3z^2 - 1, xz, x^2 - y^2.
+struct SH9Color
+{
+	XMFLOAT3 Coefficients[9] = {};
+};
+
+// Same layout as AmbientSH in Shaders/SphericalHarmonics.hlsli. Irradiance divided by PI, already convolved
+// with the cosine lobe, so a Lambertian surface reflects albedo times the evaluated sum.
+struct AmbientSHConstants
+{
+	XMFLOAT4 Coefficients[9];
+};
+
+// Integrates the environment map's radiance against the basis, texel by texel with the exact solid angle of each texel.
+// Rows run in parallel and each row in SIMD lanes.
+SH9Color ProjectSH9(const EnvironmentMap& environmentMap);
+
+// Scalar double precision version of the same integral, the reference ProjectSH9 is tested against.
+SH9Color ProjectSH9Reference(const EnvironmentMap& environmentMap);
+
+// Radiance coefficients to AmbientSHConstants (Ramamoorthi and Hanrahan, An Efficient Representation for Irradiance Environment Maps).
+AmbientSHConstants ComputeAmbientSHConstants(const SH9Color& radiance);
+
+// Same as EvaluateAmbientSH in Shaders/SphericalHarmonics.hlsli, normal must be unit length.
+XMVECTOR EvaluateAmbientSH(const AmbientSHConstants& constants, FXMVECTOR normal);
+
+// The nine basis functions at a unit direction.
+void EvaluateSH9Basis(const XMFLOAT3& direction, float basis[9]);
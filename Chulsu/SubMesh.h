@@ -10,6 +10,7 @@ public:
 	XMFLOAT2 texCoord = { 0, 0 };
 	XMFLOAT3 tangent = { 0, 0, 0 };
 	XMFLOAT3 biTangent = { 0, 0, 0 };
+	float occlusion = 1.0f;		// Unoccluded share of the hemisphere, baked by BakeVertexOcclusion.
 };
 
 class SubMesh
@@ -36,6 +37,9 @@ public:
 	void SetMaterialIndex(UINT materialIndex) { mMaterialIndex = materialIndex; }
 	UINT GetMaterialIndex() { return mMaterialIndex; }
 
+	void SetAlphaTested(bool alphaTested) { mAlphaTested = alphaTested; }
+	bool IsAlphaTested() { return mAlphaTested; }
+
 	string GetName() { return mName; }
 	void SetName(string name) { mName = name; }
 
@@ -55,4 +59,7 @@ private:
 	UINT mIndexOffset = 0;
 
 	UINT mMaterialIndex = UINT_MAX;
+
+	// Needs the any-hit shader, built without D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE.
+	bool mAlphaTested = false;
 };
\ No newline at end of file
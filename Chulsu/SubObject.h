@@ -1,4 +1,5 @@
 #pragma once
+#include "ShaderCache.h"
 
 namespace SubObject
 {
@@ -63,31 +64,22 @@ namespace SubObject
         return desc;
     }
 
-    RootSignatureDesc CreateHitRootDesc()
-    {
-        RootSignatureDesc desc;
-        desc.rootParams.resize(1);
-        desc.rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-        desc.rootParams[0].Constants.RegisterSpace = 0;
-        desc.rootParams[0].Constants.ShaderRegister = 1;
-
-        desc.desc.NumParameters = 1;
-        desc.desc.pParameters = desc.rootParams.data();
-        desc.desc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
-
-        return desc;
-    }
-
     struct DxilLibrary
     {
-        DxilLibrary(ComPtr<IDxcBlob> pBlob, const WCHAR* entryPoint[], uint32_t entryPointCount) : pShaderBlob(pBlob)
+        DxilLibrary(ComPtr<IDxcBlob> pBlob, const WCHAR* entryPoint[], uint32_t entryPointCount)
+            : DxilLibrary(pBlob, std::vector<std::wstring>(entryPoint, entryPoint + entryPointCount), std::vector<const WCHAR*>(entryPointCount, nullptr)) {}
+
+        // Exports exportToRename[i] of the blob as exportNames[i], nullptr keeps the entry point's own name
+        DxilLibrary(ComPtr<IDxcBlob> pBlob, const std::vector<std::wstring>& exportNames, const std::vector<const WCHAR*>& exportToRename) : pShaderBlob(pBlob)
         {
             stateSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY;
             stateSubobject.pDesc = &dxilLibDesc;
 
+            uint32_t entryPointCount = (uint32_t)exportNames.size();
+
             dxilLibDesc = {};
             exportDesc.resize(entryPointCount);
-            exportName.resize(entryPointCount);
+            exportName = exportNames;
             if (pBlob)
             {
                 dxilLibDesc.DXILLibrary.pShaderBytecode = pBlob->GetBufferPointer();
@@ -97,10 +89,9 @@ namespace SubObject
 
                 for (uint32_t i = 0; i < entryPointCount; i++)
                 {
-                    exportName[i] = entryPoint[i];
                     exportDesc[i].Name = exportName[i].c_str();
                     exportDesc[i].Flags = D3D12_EXPORT_FLAG_NONE;
-                    exportDesc[i].ExportToRename = nullptr;
+                    exportDesc[i].ExportToRename = exportToRename[i];
                 }
             }
         };
@@ -114,63 +105,11 @@ namespace SubObject
         std::vector<std::wstring> exportName;
     };
 
-    static const WCHAR* kRayGenShader = L"RayGen";
-
-    static const WCHAR* kMissShader = L"Miss";
-    static const WCHAR* kClosestHitShader = L"ClosestHit";
-    static const WCHAR* kAnyHitShader = L"AnyHit";
-    static const WCHAR* kHitGroup = L"HitGroup";
-
-    static const WCHAR* kShadowMissShader = L"ShadowMiss";
-    static const WCHAR* kShadowClosestHitShader = L"ShadowClosestHit";
-    static const WCHAR* kShadowHitGroup = L"ShadowHitGroup";
-
-    ComPtr<IDxcBlob> CompileLibrary(const WCHAR* filename, const WCHAR* targetString)
+    ComPtr<IDxcBlob> CompileLibrary(const WCHAR* filename, const WCHAR* targetString, const std::vector<ShaderDefine>& defines = {})
     {
-        // Initialize the helper
-        ThrowIfFailed(gDxcDllSupport.Initialize());
-        IDxcCompiler* compiler;
-        IDxcLibrary* library;
-
-        ThrowIfFailed(gDxcDllSupport.CreateInstance(CLSID_DxcCompiler, &compiler));
-        ThrowIfFailed(gDxcDllSupport.CreateInstance(CLSID_DxcLibrary, &library));
-
-        // Open and read the file
-        std::ifstream shaderFile(filename);
-        if (shaderFile.good() == false)
-        {
-            return nullptr;
-        }
-        std::stringstream strStream;
-        strStream << shaderFile.rdbuf();
-        std::string shader = strStream.str();
-
-        // Create blob from the string
-        ComPtr<IDxcBlobEncoding> textBlob;
-        ThrowIfFailed(library->CreateBlobWithEncodingFromPinned((LPBYTE)shader.c_str(), (uint32_t)shader.size(), 0, &textBlob));
-
-        // Compile
-        ComPtr<IDxcOperationResult> result;
-        compiler->Compile(textBlob.Get(), filename, L"", targetString, nullptr, 0, nullptr, 0, nullptr, &result);
-
-        compiler->Release();
-        library->Release();
-
-        // Verify the result
-        HRESULT resultCode;
-        result->GetStatus(&resultCode);
-        if (FAILED(resultCode))
-        {
-            ComPtr<IDxcBlobEncoding> pError;
-            result->GetErrorBuffer(&pError);
-            std::string log = ConvertBlobToString(pError.Get());
-            return nullptr;
-        }
-
-        ComPtr<IDxcBlob> blob;
-        result->GetResult(&blob);
-
-        return blob;
+        // DXIL is reused across runs until the source, an include or the compiler changes
+        static ShaderCache shaderCache;
+        return shaderCache.CompileLibrary(filename, targetString, defines);
     }
 
     DxilLibrary CreateDxilLibrary(const WCHAR* filename, const WCHAR* entryPoints[], uint32_t arraySize)
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "texture.h"
 #include "AssetManager.h"
+#include "CpuTexture.h"
 
 void Texture::LoadTextureFromDDS(
 	ID3D12Device5* device,
@@ -67,15 +68,39 @@ void Texture::LoadTextureFromWIC(
 
 	mName = wstringTostring(filePath);
 
+	// The loader only reserves the mips, they are filled from the chain CpuTexture builds for the same file
 	ComPtr<D3D12MA::Allocation> textureAlloc = NULL;
 	ThrowIfFailed(LoadWICTextureFromFileEx(
 		device, filePath.c_str(), 0,
-		D3D12_RESOURCE_FLAG_NONE, WIC_LOADER_DEFAULT,
+		D3D12_RESOURCE_FLAG_NONE, WIC_LOADER_MIP_RESERVE,
 		&textureAlloc, alloc, wicData, subresource));
 
 	mTextureBufferAlloc = textureAlloc;
 
-	UINT64 bytes = GetRequiredIntermediateSize(mTextureBufferAlloc->GetResource(), 0, 1);
+	D3D12_RESOURCE_DESC textureDesc = mTextureBufferAlloc->GetResource()->GetDesc();
+	Image topMip = {};
+	topMip.width = static_cast<size_t>(textureDesc.Width);
+	topMip.height = textureDesc.Height;
+	topMip.format = textureDesc.Format;
+	topMip.rowPitch = static_cast<size_t>(subresource.RowPitch);
+	topMip.slicePitch = static_cast<size_t>(subresource.SlicePitch);
+	topMip.pixels = static_cast<uint8_t*>(const_cast<void*>(subresource.pData));
+
+	ScratchImage mipChain;
+	ThrowIfFailed(GenerateMipChain(topMip, mipChain));
+	assert(mipChain.GetImageCount() == textureDesc.MipLevels);
+
+	std::vector<D3D12_SUBRESOURCE_DATA> subresources(mipChain.GetImageCount());
+	for (size_t level = 0; level < subresources.size(); ++level)
+	{
+		const Image* image = mipChain.GetImage(level, 0, 0);
+		subresources[level].pData = image->pixels;
+		subresources[level].RowPitch = static_cast<LONG_PTR>(image->rowPitch);
+		subresources[level].SlicePitch = static_cast<LONG_PTR>(image->slicePitch);
+	}
+
+	const UINT subresourcesCount = (UINT)subresources.size();
+	UINT64 bytes = GetRequiredIntermediateSize(mTextureBufferAlloc->GetResource(), 0, subresourcesCount);
 
 	ComPtr<D3D12MA::Allocation> uploadAlloc;
 	D3D12MA::ALLOCATION_DESC allocationDesc = {};
@@ -94,7 +119,7 @@ void Texture::LoadTextureFromWIC(
 		IID_NULL, NULL);
 
 	UpdateSubresources(cmdList, mTextureBufferAlloc->GetResource(), uploadAlloc->GetResource(),
-		0, 0, 1, &subresource);
+		0, 0, subresourcesCount, subresources.data());
 
 	assetMgr.PushUploadBuffer(uploadAlloc);
 
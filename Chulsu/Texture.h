@@ -30,6 +30,9 @@ public:
 	void SetSRVDescriptorHeapInfo(D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle, UINT DescriptorHeapIndex);
 	void SetUAVDescriptorHeapInfo(D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle, UINT DescriptorHeapIndex);
 
+	UINT GetSRVDescriptorHeapIndex() const { return mSRVDescriptorHeapIndex; }
+	UINT GetUAVDescriptorHeapIndex() const { return mUAVDescriptorHeapIndex; }
+
 	void SetSRVDimension(D3D12_SRV_DIMENSION dimension) { mSRVDimension = dimension; }
 	void SetUAVDimension(D3D12_UAV_DIMENSION dimension) { mUAVDimension = dimension; }
 
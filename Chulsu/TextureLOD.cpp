@@ -0,0 +1,67 @@
+#include "TextureLOD.h"
+
+namespace
+{
+	// Grazing hits push the LOD towards the smallest mip, the clamp only keeps log2 finite.
+	const float kMinConeCosine = 1e-4f;
+}
+
+void ComputeTriangleLOD(ImportedMesh& mesh)
+{
+	mesh.TriangleLOD.assign(mesh.Indices.size() / 3, MinTriangleLOD);
+
+	// Indexed by the first index of the triangle over 3, the GPU reads it with IndexOffset / 3 + PrimitiveIndex()
+	for (SubMesh& subMesh : mesh.SubMeshes)
+	{
+		const Vertex* vertices = mesh.Vertices.data() + subMesh.GetVertexOffset();
+		const UINT* indices = mesh.Indices.data() + subMesh.GetIndexOffset();
+		float* triangleLOD = mesh.TriangleLOD.data() + subMesh.GetIndexOffset() / 3;
+
+		for (UINT prim = 0; prim < subMesh.GetIndexCount() / 3; ++prim)
+		{
+			const Vertex& v0 = vertices[indices[prim * 3 + 0]];
+			const Vertex& v1 = vertices[indices[prim * 3 + 1]];
+			const Vertex& v2 = vertices[indices[prim * 3 + 2]];
+			triangleLOD[prim] = ComputeTriangleLOD(v0.position, v1.position, v2.position, v0.texCoord, v1.texCoord, v2.texCoord);
+		}
+	}
+}
+
+float ComputeTriangleLOD(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2,
+	const XMFLOAT2& uv0, const XMFLOAT2& uv1, const XMFLOAT2& uv2)
+{
+	// Both areas are twice the real ones, the factor cancels in the ratio
+	float worldArea = Vector3::Length(Vector3::Cross(Vector3::Subtract(p1, p0), Vector3::Subtract(p2, p0)));
+	float uvArea = fabsf((uv1.x - uv0.x) * (uv2.y - uv0.y) - (uv2.x - uv0.x) * (uv1.y - uv0.y));
+	if (!(worldArea > 0.0f) || !(uvArea > 0.0f))
+		return MinTriangleLOD;
+
+	return max(0.5f * log2f(uvArea / worldArea), MinTriangleLOD);
+}
+
+float ComputePixelSpreadAngle(const XMFLOAT4X4& proj, UINT height)
+{
+	// _22 is 1 / tan(fovY / 2), one pixel spans 2 / height of the near plane at unit distance
+	return atanf(2.0f / (proj._22 * max(height, 1u)));
+}
+
+float ComputeInstanceLODBias(const XMFLOAT4X4& world)
+{
+	float determinant = fabsf(XMVectorGetX(XMMatrixDeterminant(XMLoadFloat4x4(&world))));
+	return determinant > 0.0f ? -log2f(determinant) / 3.0f : 0.0f;
+}
+
+RayCone PropagateRayCone(const RayCone& cone, float hitT)
+{
+	return { cone.Width + cone.SpreadAngle * hitT, cone.SpreadAngle };
+}
+
+float ComputeRayConeLOD(float triangleLOD, const RayCone& cone, float cosine)
+{
+	return triangleLOD + log2f(fabsf(cone.Width) / max(fabsf(cosine), kMinConeCosine));
+}
+
+float ComputeTextureLOD(float rayConeLOD, UINT width, UINT height)
+{
+	return rayConeLOD + 0.5f * log2f(static_cast<float>(width) * height);
+}
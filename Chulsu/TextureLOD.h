@@ -0,0 +1,44 @@
+#pragma once
+#include "stdafx.h"
+#include "MeshImporter.h"
+
+// Ray cone texture LOD (Akenine-Moller et al., Improved Shader and Texture Level of Detail Using Ray Cones).
+// Every ray carries a cone that starts at the pixel footprint and widens by its spread angle per unit of distance.
+// At a hit the footprint of the cone is compared with the texel density of the triangle to pick the mip:
+//   lod = triangleLOD + 0.5 * log2(width * height) + log2(coneWidth / |cos|)
+// where triangleLOD is 0.5 * log2(UV area / world area) of the hit triangle and cos is the angle between the ray and the surface.
+// Shaders/TextureLOD.hlsli has the same functions for the hit shaders.
+
+// Stands for triangles without UV or world area, far enough below zero that they always read the top mip.
+const float MinTriangleLOD = -64.0f;
+
+// Same layout as the cone fields of RayPayload in DefaultRayTrace.hlsl.
+struct RayCone
+{
+	float Width = 0.0f;			// Footprint at the ray origin, zero for a pinhole camera.
+	float SpreadAngle = 0.0f;	// Widening per unit of distance, zero keeps the cone at its width.
+};
+
+// Fills mesh.TriangleLOD with the texel density of every triangle in model space.
+// Run it after ClassifyOpacity, which reorders the triangles of alpha tested submeshes.
+void ComputeTriangleLOD(ImportedMesh& mesh);
+
+// 0.5 * log2(UV area / world area) of one triangle, MinTriangleLOD when either area is zero.
+float ComputeTriangleLOD(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2,
+	const XMFLOAT2& uv0, const XMFLOAT2& uv1, const XMFLOAT2& uv2);
+
+// Angle one pixel covers at the center of the screen, from the projection matrix so lens zoom is included.
+float ComputePixelSpreadAngle(const XMFLOAT4X4& proj, UINT height);
+
+// Triangle LOD of a model space triangle seen through a world transform. The area scales with the transform's
+// determinant to the power 2/3, exact for uniform scales and the geometric mean of the axes otherwise.
+float ComputeInstanceLODBias(const XMFLOAT4X4& world);
+
+// The cone after travelling hitT along the ray.
+RayCone PropagateRayCone(const RayCone& cone, float hitT);
+
+// Texture independent part of the LOD at a hit, cosine is the dot product of the ray direction and the surface normal.
+float ComputeRayConeLOD(float triangleLOD, const RayCone& cone, float cosine);
+
+// Mip level of a width x height texture for the LOD of ComputeRayConeLOD, before the sampler clamps it to the mip chain.
+float ComputeTextureLOD(float rayConeLOD, UINT width, UINT height);
@@ -4,22 +4,27 @@
 Timer::Timer()
 	: mElapsedTime(0.0), mBaseTime(0),
 	mPausedTime(0), mStopTime(0), mFPS(0.0f),
+	mFrameCount(0), mFPSTime(0),
 	mPrevTime(0), mCurrTime(0), mStopped(false)
 {
-	__int64 frequencyPerSec;
-	QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&frequencyPerSec));
-	mSecondsPerCount = 1.0 / static_cast<double>(frequencyPerSec);
+	mSecondsPerCount = static_cast<double>(chrono::steady_clock::period::num) / chrono::steady_clock::period::den;
+}
+
+int64_t Timer::Now()
+{
+	return chrono::steady_clock::now().time_since_epoch().count();
 }
 
 void Timer::Start()
 {
-	__int64 currTime;
-	QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&currTime));
+	int64_t currTime = Now();
 
 	if (mStopped)
 	{
 		mPausedTime += (currTime - mStopTime);
 		mPrevTime = currTime;
+		mFPSTime = currTime;
+		mFrameCount = 0;
 		mStopTime = 0;
 		mStopped = false;
 	}
@@ -29,20 +34,25 @@ void Timer::Stop()
 {
 	if (!mStopped)
 	{
-		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&mStopTime));
+		mStopTime = Now();
 		mStopped = true;
 	}
 }
 
 void Timer::Reset()
 {
-	__int64 currTime;
-	QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&currTime));
+	int64_t currTime = Now();
 
 	mBaseTime = currTime;
 	mPrevTime = currTime;
+	mCurrTime = currTime;
+	mPausedTime = 0;
 	mStopTime = 0;
 	mStopped = false;
+
+	mFPS = 0.0f;
+	mFrameCount = 0;
+	mFPSTime = currTime;
 }
 
 void Timer::Tick()
@@ -53,7 +63,7 @@ void Timer::Tick()
 		return;
 	}
 
-	QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&mCurrTime));
+	mCurrTime = Now();
 
 	mElapsedTime = (mCurrTime - mPrevTime) * mSecondsPerCount;
 	mPrevTime = mCurrTime;
@@ -61,6 +71,16 @@ void Timer::Tick()
 	// Prevent not to be negative
 	if (mElapsedTime < 0.0)
 		mElapsedTime = 0.0;
+
+	// Averaged over a whole second so the value does not jitter with every frame
+	++mFrameCount;
+	double fpsWindow = (mCurrTime - mFPSTime) * mSecondsPerCount;
+	if (fpsWindow >= 1.0)
+	{
+		mFPS = static_cast<float>(mFrameCount / fpsWindow);
+		mFrameCount = 0;
+		mFPSTime = mCurrTime;
+	}
 }
 
 float Timer::TotalTime() const
@@ -78,7 +98,11 @@ float Timer::ElapsedTime() const
 
 float Timer::CurrentTime() const
 {
-	return static_cast<float>(mCurrTime);
+	// Seconds since Reset including paused time, the raw tick count does not fit a float
+	return static_cast<float>((mCurrTime - mBaseTime) * mSecondsPerCount);
 }
 
-
+float Timer::FPS() const
+{
+	return mFPS;
+}
@@ -1,4 +1,8 @@
 #pragma once
+#include <chrono>
+#include <cstdint>
+
+// Frame timer on std::chrono::steady_clock, times are kept as clock ticks and converted to seconds on read.
 class Timer
 {
 public:
@@ -14,17 +18,24 @@ public:
 	float ElapsedTime() const;
 	float CurrentTime() const;
 
+	// Frames per second over the last full second, zero until one has passed.
+	float FPS() const;
+
 private:
+	static int64_t Now();
+
 	double mSecondsPerCount;
 	double mElapsedTime;
 
 	float mFPS;
+	uint32_t mFrameCount;
+	int64_t mFPSTime;
 
-	__int64 mBaseTime;
-	__int64 mPausedTime;
-	__int64 mStopTime;
-	__int64 mCurrTime;
-	__int64 mPrevTime;
+	int64_t mBaseTime;
+	int64_t mPausedTime;
+	int64_t mStopTime;
+	int64_t mCurrTime;
+	int64_t mPrevTime;
 
 	bool mStopped;
-};
\ No newline at end of file
+};
@@ -25,6 +25,7 @@ public:
 			D3D12_RESOURCE_DIMENSION_BUFFER, DXGI_FORMAT_UNKNOWN, D3D12_TEXTURE_LAYOUT_ROW_MAJOR, D3D12_RESOURCE_FLAG_NONE, D3D12_HEAP_TYPE_UPLOAD);
 
 		ThrowIfFailed(mUploadAlloc->GetResource()->Map(0, nullptr, (void**)(&mData)));
+		mCount = count;
 	}
 	UploadBuffer(const UploadBuffer& rhs) = delete;
 	UploadBuffer& operator=(const UploadBuffer& rhs) = delete;
@@ -42,9 +43,29 @@ public:
 
 	void CopyData(int index, const Cnst& data)
 	{
+		assert(index >= 0 && index < static_cast<int>(mCount));
 		memcpy(&mData[index * mByteSize], &data, sizeof(Cnst));
 	}
 
+	// count consecutive elements starting at first, a single copy unless the elements are padded to 256 bytes.
+	void CopyData(int first, const Cnst* data, UINT count)
+	{
+		assert(first >= 0 && first + count <= mCount);
+		if (mByteSize == sizeof(Cnst))
+		{
+			memcpy(&mData[first * mByteSize], data, sizeof(Cnst) * count);
+			return;
+		}
+
+		for (UINT i = 0; i < count; ++i)
+			memcpy(&mData[(first + i) * mByteSize], &data[i], sizeof(Cnst));
+	}
+
+	UINT GetCount() const
+	{
+		return mCount;
+	}
+
 	UINT GetByteSize() const
 	{
 		return mByteSize;
@@ -56,4 +77,5 @@ private:
 	ComPtr<D3D12MA::Allocation> mUploadAlloc = nullptr;
 	BYTE* mData = nullptr;
 	UINT mByteSize = 0;
+	UINT mCount = 0;
 };
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "VertexOcclusion.h"
+#include "BVH.h"
+#include "BVHCache.h"
+#include "WideBVH.h"
+#include "Parallel.h"
+#include "Profiler.h"
+
+namespace
+{
+	// Rays start this far above the vertex, relative to the size of the mesh, so they miss the triangles around it.
+	const float kRayOffsetScale = 1e-4f;
+
+	// Set once from the command line before any import.
+	bool gBakingEnabled = false;
+
+	// Same hash as PcgHash in DefaultRayTrace.hlsl, turns the ray set of every vertex by its own angle.
+	UINT PcgHash(UINT v)
+	{
+		UINT state = v * 747796405u + 2891336453u;
+		UINT word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	float RadicalInverse(UINT bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return bits * 2.3283064365386963e-10f;
+	}
+
+	bool LoadOcclusionCache(const wstring& path, uint64_t geometryHash, UINT vertexCount, const VertexOcclusionSettings& settings, vector<float>& occlusion)
+	{
+		ifstream file(filesystem::path(path), ios::binary);
+		if (!file)
+			return false;
+
+		VertexOcclusionCacheHeader header = {};
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!file || header.Magic != VertexOcclusionCacheMagic || header.Version != VertexOcclusionCacheVersion
+			|| header.GeometryHash != geometryHash || header.VertexCount != vertexCount
+			|| header.RayCount != settings.RayCount || header.MaxDistance != settings.MaxDistance)
+			return false;
+
+		occlusion.resize(vertexCount);
+		file.read(reinterpret_cast<char*>(occlusion.data()), occlusion.size() * sizeof(float));
+		return file && file.peek() == ifstream::traits_type::eof();
+	}
+
+	bool SaveOcclusionCache(const wstring& path, uint64_t geometryHash, const VertexOcclusionSettings& settings, const vector<float>& occlusion)
+	{
+		VertexOcclusionCacheHeader header = {};
+		header.Magic = VertexOcclusionCacheMagic;
+		header.Version = VertexOcclusionCacheVersion;
+		header.GeometryHash = geometryHash;
+		header.VertexCount = static_cast<UINT>(occlusion.size());
+		header.RayCount = settings.RayCount;
+		header.MaxDistance = settings.MaxDistance;
+
+		// Written under a temporary name so an interrupted run never leaves a truncated cache behind.
+		filesystem::path tempPath = path + L".tmp";
+		{
+			ofstream file(tempPath, ios::binary | ios::trunc);
+			if (!file)
+				return false;
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(occlusion.data()), occlusion.size() * sizeof(float));
+
+			if (!file)
+				return false;
+		}
+
+		error_code ec;
+		filesystem::rename(tempPath, path, ec);
+		return !ec;
+	}
+
+	vector<float> TraceOcclusion(const ImportedMesh& mesh, const vector<BVHTriangle>& triangles, const VertexOcclusionSettings& settings)
+	{
+		const UINT vertexCount = static_cast<UINT>(mesh.Vertices.size());
+		vector<float> occlusion(vertexCount, 1.0f);
+		if (triangles.empty() || settings.RayCount == 0)
+			return occlusion;
+
+		// Traversed through the same wide BVH the CPU ray tracer uses
+		BVH bvh;
+		bvh.Build(triangles);
+		NativeWideBVH wideBVH;
+		wideBVH.Build(bvh);
+
+		const BVHNode& root = bvh.GetNodes()[0];
+		const float offset = kRayOffsetScale * Vector3::Distance(root.BoundsMin, root.BoundsMax);
+
+		// Hammersley points warped to a cosine distribution around +z, the tangent frame of each vertex orients them
+		vector<XMFLOAT3> directions(settings.RayCount);
+		for (UINT i = 0; i < settings.RayCount; ++i)
+		{
+			float u1 = (i + 0.5f) / settings.RayCount;
+			float radius = sqrtf(u1);
+			float phi = 2.0f * PI * RadicalInverse(i);
+			directions[i] = XMFLOAT3(radius * cosf(phi), radius * sinf(phi), sqrtf(max(1.0f - u1, 0.0f)));
+		}
+
+		ParallelFor(vertexCount, [&](UINT vertex)
+			{
+				const Vertex& v = mesh.Vertices[vertex];
+				XMVECTOR N = XMLoadFloat3(&v.normal);
+				if (XMVectorGetX(XMVector3LengthSq(N)) < 0.25f)
+					return;
+				N = XMVector3Normalize(N);
+
+				// Tangent frame without branches (Duff et al., Building an Orthonormal Basis, Revisited)
+				XMFLOAT3 n;
+				XMStoreFloat3(&n, N);
+				float sign = copysignf(1.0f, n.z);
+				float a = -1.0f / (sign + n.z);
+				float b = n.x * n.y * a;
+				XMVECTOR T = XMVectorSet(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x, 0.0f);
+				XMVECTOR B = XMVectorSet(b, sign + n.y * n.y * a, -n.y, 0.0f);
+
+				// A different turn per vertex hides the pattern of the shared ray set
+				float angle = 2.0f * PI * (PcgHash(vertex) * 2.3283064365386963e-10f);
+				float c = cosf(angle);
+				float s = sinf(angle);
+
+				RayDesc ray;
+				XMStoreFloat3(&ray.Origin, XMVectorAdd(XMLoadFloat3(&v.position), XMVectorScale(N, offset)));
+				ray.TMin = 0.0f;
+				ray.TMax = settings.MaxDistance;
+
+				UINT hits = 0;
+				for (const XMFLOAT3& d : directions)
+				{
+					float x = c * d.x - s * d.y;
+					float y = s * d.x + c * d.y;
+					XMStoreFloat3(&ray.Direction, XMVectorAdd(XMVectorAdd(XMVectorScale(T, x), XMVectorScale(B, y)), XMVectorScale(N, d.z)));
+
+					RayHit hit;
+					if (wideBVH.TraceRay(ray, hit, true, [](UINT, const XMFLOAT2&, float) { return true; }))
+						++hits;
+				}
+				occlusion[vertex] = 1.0f - static_cast<float>(hits) / settings.RayCount;
+			});
+
+		return occlusion;
+	}
+}
+
+void BakeVertexOcclusion(ImportedMesh& mesh, const wstring& cachePath, const VertexOcclusionSettings& settings)
+{
+	PROFILE_ZONE("Vertex Occlusion");
+	auto start = chrono::steady_clock::now();
+
+	// The triangles of every submesh in model space, they are the occluders and key the cache
+	vector<BVHTriangle> triangles;
+	triangles.reserve(mesh.Indices.size() / 3);
+	for (SubMesh& subMesh : mesh.SubMeshes)
+	{
+		const Vertex* vertices = mesh.Vertices.data() + subMesh.GetVertexOffset();
+		const UINT* indices = mesh.Indices.data() + subMesh.GetIndexOffset();
+		for (UINT prim = 0; prim < subMesh.GetIndexCount() / 3; ++prim)
+			triangles.push_back({ vertices[indices[prim * 3 + 0]].position, vertices[indices[prim * 3 + 1]].position, vertices[indices[prim * 3 + 2]].position });
+	}
+
+	const UINT vertexCount = static_cast<UINT>(mesh.Vertices.size());
+	uint64_t geometryHash = HashTriangles(triangles);
+
+	vector<float> occlusion;
+	bool cached = !cachePath.empty() && LoadOcclusionCache(cachePath, geometryHash, vertexCount, settings, occlusion);
+	if (!cached && !gBakingEnabled)
+	{
+		for (Vertex& v : mesh.Vertices)
+			v.occlusion = 1.0f;
+
+		DebugLog("Vertex occlusion: no cache at " + wstringTostring(cachePath) + ", run with --bake-occlusion to bake it");
+		return;
+	}
+
+	if (!cached)
+	{
+		occlusion = TraceOcclusion(mesh, triangles, settings);
+		if (!cachePath.empty() && !SaveOcclusionCache(cachePath, geometryHash, settings, occlusion))
+			DebugLog("Vertex occlusion: failed to write " + wstringTostring(cachePath));
+	}
+
+	for (UINT i = 0; i < vertexCount; ++i)
+		mesh.Vertices[i].occlusion = occlusion[i];
+
+	auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	DebugLog("Vertex occlusion: " + string(cached ? "loaded cached" : "baked") + " " + to_string(vertexCount) + " vertices, "
+		+ to_string(settings.RayCount) + " rays each, in " + to_string(elapsed) + " ms");
+}
+
+void SetVertexOcclusionBaking(bool enabled)
+{
+	gBakingEnabled = enabled;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "stdafx.h"
+#include "MeshImporter.h"
+
+// How the bake samples the hemisphere of a vertex. Part of the cache key.
+struct VertexOcclusionSettings
+{
+	UINT RayCount = 64;
+	float MaxDistance = 100.0f;		// Occluders further away than this, in model units, do not count.
+};
+
+// On disk occlusion:
+//   VertexOcclusionCacheHeader
+//   float[VertexCount]
+struct VertexOcclusionCacheHeader
+{
+	UINT Magic;
+	UINT Version;
+	uint64_t GeometryHash;		// HashTriangles of the mesh triangles.
+	UINT VertexCount;
+	UINT RayCount;
+	float MaxDistance;
+	UINT Padding;
+};
+
+const UINT VertexOcclusionCacheMagic = 0x4F414F56;		// "VOAO" in the file.
+
+// Bump whenever the bake changes, old files are then baked again.
+const UINT VertexOcclusionCacheVersion = 1;
+
+// Optional import stage for contact shading without rays at run time. Every vertex casts cosine distributed rays over
+// the hemisphere of its normal against a BVH of the mesh's own triangles, in parallel over the vertices, and keeps the
+// unoccluded fraction in Vertex::occlusion. Alpha tested triangles occlude like opaque ones, run it after ClassifyOpacity
+// so fully transparent ones are gone. The result is read from cachePath when it was baked from the same geometry and
+// settings. Otherwise it is baked and written there when baking is enabled, or every vertex is left unoccluded.
+void BakeVertexOcclusion(ImportedMesh& mesh, const wstring& cachePath, const VertexOcclusionSettings& settings = {});
+
+// Off by default so an import only reads the cache, the --bake-occlusion command line flag turns it on.
+void SetVertexOcclusionBaking(bool enabled);
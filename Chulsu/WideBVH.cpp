@@ -0,0 +1,605 @@
+#include "WideBVH.h"
+
+namespace
+{
+	// Lane type of the packet kernels. The widest enabled instruction set is picked at compile time,
+	// a packet is covered by RayPacketSize / kLanes registers.
+#if defined(__AVX512F__)
+	typedef __m512 vfloat;
+	typedef __mmask16 vmask;
+	const UINT kLanes = 16;
+
+	inline vfloat Load(const float* p) { return _mm512_load_ps(p); }
+	inline void Store(float* p, vfloat v) { _mm512_store_ps(p, v); }
+	inline vfloat Set1(float f) { return _mm512_set1_ps(f); }
+	inline vfloat Add(vfloat a, vfloat b) { return _mm512_add_ps(a, b); }
+	inline vfloat Sub(vfloat a, vfloat b) { return _mm512_sub_ps(a, b); }
+	inline vfloat Mul(vfloat a, vfloat b) { return _mm512_mul_ps(a, b); }
+	inline vfloat Div(vfloat a, vfloat b) { return _mm512_div_ps(a, b); }
+	inline vfloat Min(vfloat a, vfloat b) { return _mm512_min_ps(a, b); }
+	inline vfloat Max(vfloat a, vfloat b) { return _mm512_max_ps(a, b); }
+	inline vfloat Abs(vfloat a) { return _mm512_abs_ps(a); }
+	inline vmask CmpLE(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+	inline vmask CmpLT(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	inline vmask And(vmask a, vmask b) { return a & b; }
+	inline UINT Bits(vmask m) { return m; }
+#elif defined(__AVX2__)
+	typedef __m256 vfloat;
+	typedef __m256 vmask;
+	const UINT kLanes = 8;
+
+	inline vfloat Load(const float* p) { return _mm256_load_ps(p); }
+	inline void Store(float* p, vfloat v) { _mm256_store_ps(p, v); }
+	inline vfloat Set1(float f) { return _mm256_set1_ps(f); }
+	inline vfloat Add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+	inline vfloat Sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+	inline vfloat Mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+	inline vfloat Div(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+	inline vfloat Min(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+	inline vfloat Max(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+	inline vfloat Abs(vfloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+	inline vmask CmpLE(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	inline vmask CmpLT(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline vmask And(vmask a, vmask b) { return _mm256_and_ps(a, b); }
+	inline UINT Bits(vmask m) { return _mm256_movemask_ps(m); }
+#else
+	typedef __m128 vfloat;
+	typedef __m128 vmask;
+	const UINT kLanes = 4;
+
+	inline vfloat Load(const float* p) { return _mm_load_ps(p); }
+	inline void Store(float* p, vfloat v) { _mm_store_ps(p, v); }
+	inline vfloat Set1(float f) { return _mm_set1_ps(f); }
+	inline vfloat Add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+	inline vfloat Sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+	inline vfloat Mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+	inline vfloat Div(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+	inline vfloat Min(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+	inline vfloat Max(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+	inline vfloat Abs(vfloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+	inline vmask CmpLE(vfloat a, vfloat b) { return _mm_cmple_ps(a, b); }
+	inline vmask CmpLT(vfloat a, vfloat b) { return _mm_cmplt_ps(a, b); }
+	inline vmask And(vmask a, vmask b) { return _mm_and_ps(a, b); }
+	inline UINT Bits(vmask m) { return _mm_movemask_ps(m); }
+#endif
+
+	const UINT kLaneMask = (1u << kLanes) - 1;
+
+	// Single ray with the per axis plane selection resolved once.
+	// Using the direction sign instead of min/max also makes the inverted bounds of empty slots miss.
+	struct TraversalRay
+	{
+		XMFLOAT3 Origin;
+		XMFLOAT3 InvDirection;
+		bool Positive[3];
+		float TMin;
+	};
+
+	TraversalRay MakeTraversalRay(const RayDesc& ray)
+	{
+		TraversalRay r;
+		r.Origin = ray.Origin;
+		r.InvDirection = XMFLOAT3(1.0f / ray.Direction.x, 1.0f / ray.Direction.y, 1.0f / ray.Direction.z);
+		r.Positive[0] = r.InvDirection.x >= 0.0f;
+		r.Positive[1] = r.InvDirection.y >= 0.0f;
+		r.Positive[2] = r.InvDirection.z >= 0.0f;
+		r.TMin = ray.TMin;
+		return r;
+	}
+
+	// Tests four children, returns the hit mask and writes the entry distances.
+	inline UINT IntersectChildren4(const float* nearX, const float* nearY, const float* nearZ,
+		const float* farX, const float* farY, const float* farZ, const TraversalRay& ray, float tMax, float* tEntry)
+	{
+		__m128 ox = _mm_set1_ps(ray.Origin.x);
+		__m128 oy = _mm_set1_ps(ray.Origin.y);
+		__m128 oz = _mm_set1_ps(ray.Origin.z);
+		__m128 ix = _mm_set1_ps(ray.InvDirection.x);
+		__m128 iy = _mm_set1_ps(ray.InvDirection.y);
+		__m128 iz = _mm_set1_ps(ray.InvDirection.z);
+
+		__m128 tNearX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearX), ox), ix);
+		__m128 tNearY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearY), oy), iy);
+		__m128 tNearZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearZ), oz), iz);
+		__m128 tFarX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farX), ox), ix);
+		__m128 tFarY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farY), oy), iy);
+		__m128 tFarZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farZ), oz), iz);
+
+		__m128 tNear = _mm_max_ps(_mm_max_ps(tNearX, tNearY), _mm_max_ps(tNearZ, _mm_set1_ps(ray.TMin)));
+		__m128 tFar = _mm_min_ps(_mm_min_ps(tFarX, tFarY), _mm_min_ps(tFarZ, _mm_set1_ps(tMax)));
+
+		_mm_storeu_ps(tEntry, tNear);
+		return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+	}
+
+	template<UINT N>
+	UINT IntersectChildren(const WideBVHNode<N>& node, const TraversalRay& ray, float tMax, float* tEntry);
+
+	template<>
+	UINT IntersectChildren<4>(const WideBVHNode<4>& node, const TraversalRay& ray, float tMax, float* tEntry)
+	{
+		return IntersectChildren4(
+			ray.Positive[0] ? node.MinX : node.MaxX, ray.Positive[1] ? node.MinY : node.MaxY, ray.Positive[2] ? node.MinZ : node.MaxZ,
+			ray.Positive[0] ? node.MaxX : node.MinX, ray.Positive[1] ? node.MaxY : node.MinY, ray.Positive[2] ? node.MaxZ : node.MinZ,
+			ray, tMax, tEntry);
+	}
+
+	template<>
+	UINT IntersectChildren<8>(const WideBVHNode<8>& node, const TraversalRay& ray, float tMax, float* tEntry)
+	{
+		const float* nearX = ray.Positive[0] ? node.MinX : node.MaxX;
+		const float* nearY = ray.Positive[1] ? node.MinY : node.MaxY;
+		const float* nearZ = ray.Positive[2] ? node.MinZ : node.MaxZ;
+		const float* farX = ray.Positive[0] ? node.MaxX : node.MinX;
+		const float* farY = ray.Positive[1] ? node.MaxY : node.MinY;
+		const float* farZ = ray.Positive[2] ? node.MaxZ : node.MinZ;
+
+#if defined(__AVX2__)
+		__m256 ox = _mm256_set1_ps(ray.Origin.x);
+		__m256 oy = _mm256_set1_ps(ray.Origin.y);
+		__m256 oz = _mm256_set1_ps(ray.Origin.z);
+		__m256 ix = _mm256_set1_ps(ray.InvDirection.x);
+		__m256 iy = _mm256_set1_ps(ray.InvDirection.y);
+		__m256 iz = _mm256_set1_ps(ray.InvDirection.z);
+
+		__m256 tNearX = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearX), ox), ix);
+		__m256 tNearY = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearY), oy), iy);
+		__m256 tNearZ = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearZ), oz), iz);
+		__m256 tFarX = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farX), ox), ix);
+		__m256 tFarY = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farY), oy), iy);
+		__m256 tFarZ = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farZ), oz), iz);
+
+		__m256 tNear = _mm256_max_ps(_mm256_max_ps(tNearX, tNearY), _mm256_max_ps(tNearZ, _mm256_set1_ps(ray.TMin)));
+		__m256 tFar = _mm256_min_ps(_mm256_min_ps(tFarX, tFarY), _mm256_min_ps(tFarZ, _mm256_set1_ps(tMax)));
+
+		_mm256_storeu_ps(tEntry, tNear);
+#if defined(__AVX512VL__)
+		return _mm256_cmp_ps_mask(tNear, tFar, _CMP_LE_OQ);
+#else
+		return _mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+#endif
+#else
+		// Two SSE halves when AVX2 is not enabled.
+		UINT low = IntersectChildren4(nearX, nearY, nearZ, farX, farY, farZ, ray, tMax, tEntry);
+		UINT high = IntersectChildren4(nearX + 4, nearY + 4, nearZ + 4, farX + 4, farY + 4, farZ + 4, ray, tMax, tEntry + 4);
+		return low | (high << 4);
+#endif
+	}
+
+	// Packet of rays in SoA layout, unused lanes carry an empty [TMin, TMax] interval.
+	struct alignas(64) RayPacket
+	{
+		float OriginX[RayPacketSize];
+		float OriginY[RayPacketSize];
+		float OriginZ[RayPacketSize];
+		float DirectionX[RayPacketSize];
+		float DirectionY[RayPacketSize];
+		float DirectionZ[RayPacketSize];
+		float InvDirectionX[RayPacketSize];
+		float InvDirectionY[RayPacketSize];
+		float InvDirectionZ[RayPacketSize];
+		float TMin[RayPacketSize];
+		float TMax[RayPacketSize];
+	};
+
+	// Tests one child box against every ray of the packet.
+	// Returns the mask of rays that enter it and the smallest entry distance among them.
+	template<UINT N>
+	UINT IntersectPacketBounds(const RayPacket& packet, const WideBVHNode<N>& node, UINT child, float& tEntry)
+	{
+		vfloat minX = Set1(node.MinX[child]);
+		vfloat minY = Set1(node.MinY[child]);
+		vfloat minZ = Set1(node.MinZ[child]);
+		vfloat maxX = Set1(node.MaxX[child]);
+		vfloat maxY = Set1(node.MaxY[child]);
+		vfloat maxZ = Set1(node.MaxZ[child]);
+
+		UINT mask = 0;
+		tEntry = FLT_MAX;
+		for (UINT c = 0; c < RayPacketSize; c += kLanes)
+		{
+			vfloat ox = Load(packet.OriginX + c);
+			vfloat oy = Load(packet.OriginY + c);
+			vfloat oz = Load(packet.OriginZ + c);
+			vfloat ix = Load(packet.InvDirectionX + c);
+			vfloat iy = Load(packet.InvDirectionY + c);
+			vfloat iz = Load(packet.InvDirectionZ + c);
+
+			vfloat tx0 = Mul(Sub(minX, ox), ix);
+			vfloat tx1 = Mul(Sub(maxX, ox), ix);
+			vfloat ty0 = Mul(Sub(minY, oy), iy);
+			vfloat ty1 = Mul(Sub(maxY, oy), iy);
+			vfloat tz0 = Mul(Sub(minZ, oz), iz);
+			vfloat tz1 = Mul(Sub(maxZ, oz), iz);
+
+			vfloat tNear = Max(Max(Min(tx0, tx1), Min(ty0, ty1)), Max(Min(tz0, tz1), Load(packet.TMin + c)));
+			vfloat tFar = Min(Min(Max(tx0, tx1), Max(ty0, ty1)), Min(Max(tz0, tz1), Load(packet.TMax + c)));
+
+			UINT bits = Bits(CmpLE(tNear, tFar));
+			if (bits == 0)
+				continue;
+
+			alignas(64) float t[kLanes];
+			Store(t, tNear);
+			for (UINT b = bits; b != 0; b &= b - 1)
+				tEntry = min(tEntry, t[countr_zero(b)]);
+
+			mask |= bits << c;
+		}
+		return mask;
+	}
+
+	// Moller-Trumbore against every active ray of the packet, same tests as BVH::IntersectTriangle.
+	void IntersectPacketTriangles(RayPacket& packet, RayHit* hits, UINT activeMask,
+		const BVHTriangle* triangles, const UINT* primIndices, UINT first, UINT count, const AnyHitCallback& anyHit)
+	{
+		const vfloat zero = Set1(0.0f);
+		const vfloat one = Set1(1.0f);
+		const vfloat epsilon = Set1(1e-12f);
+
+		for (UINT p = first; p < first + count; ++p)
+		{
+			const BVHTriangle& tri = triangles[p];
+			vfloat v0x = Set1(tri.V0.x);
+			vfloat v0y = Set1(tri.V0.y);
+			vfloat v0z = Set1(tri.V0.z);
+			vfloat e1x = Set1(tri.V1.x - tri.V0.x);
+			vfloat e1y = Set1(tri.V1.y - tri.V0.y);
+			vfloat e1z = Set1(tri.V1.z - tri.V0.z);
+			vfloat e2x = Set1(tri.V2.x - tri.V0.x);
+			vfloat e2y = Set1(tri.V2.y - tri.V0.y);
+			vfloat e2z = Set1(tri.V2.z - tri.V0.z);
+
+			for (UINT c = 0; c < RayPacketSize; c += kLanes)
+			{
+				UINT active = (activeMask >> c) & kLaneMask;
+				if (active == 0)
+					continue;
+
+				vfloat dx = Load(packet.DirectionX + c);
+				vfloat dy = Load(packet.DirectionY + c);
+				vfloat dz = Load(packet.DirectionZ + c);
+
+				vfloat px = Sub(Mul(dy, e2z), Mul(dz, e2y));
+				vfloat py = Sub(Mul(dz, e2x), Mul(dx, e2z));
+				vfloat pz = Sub(Mul(dx, e2y), Mul(dy, e2x));
+				vfloat det = Add(Add(Mul(e1x, px), Mul(e1y, py)), Mul(e1z, pz));
+				vfloat invDet = Div(one, det);
+
+				vfloat sx = Sub(Load(packet.OriginX + c), v0x);
+				vfloat sy = Sub(Load(packet.OriginY + c), v0y);
+				vfloat sz = Sub(Load(packet.OriginZ + c), v0z);
+				vfloat u = Mul(Add(Add(Mul(sx, px), Mul(sy, py)), Mul(sz, pz)), invDet);
+
+				vfloat qx = Sub(Mul(sy, e1z), Mul(sz, e1y));
+				vfloat qy = Sub(Mul(sz, e1x), Mul(sx, e1z));
+				vfloat qz = Sub(Mul(sx, e1y), Mul(sy, e1x));
+				vfloat v = Mul(Add(Add(Mul(dx, qx), Mul(dy, qy)), Mul(dz, qz)), invDet);
+				vfloat t = Mul(Add(Add(Mul(e2x, qx), Mul(e2y, qy)), Mul(e2z, qz)), invDet);
+
+				vmask valid = CmpLE(epsilon, Abs(det));
+				valid = And(valid, And(CmpLE(zero, u), CmpLE(u, one)));
+				valid = And(valid, And(CmpLE(zero, v), CmpLE(Add(u, v), one)));
+				valid = And(valid, And(CmpLE(Load(packet.TMin + c), t), CmpLT(t, Load(packet.TMax + c))));
+
+				UINT bits = Bits(valid) & active;
+				if (bits == 0)
+					continue;
+
+				alignas(64) float hitU[kLanes], hitV[kLanes], hitT[kLanes];
+				Store(hitU, u);
+				Store(hitV, v);
+				Store(hitT, t);
+
+				for (; bits != 0; bits &= bits - 1)
+				{
+					UINT lane = countr_zero(bits);
+					UINT r = c + lane;
+
+					XMFLOAT2 barycentrics(hitU[lane], hitV[lane]);
+					if (!anyHit.Invoke(anyHit.Context, primIndices[p], barycentrics, hitT[lane]))
+						continue;
+
+					packet.TMax[r] = hitT[lane];
+					hits[r].T = hitT[lane];
+					hits[r].Barycentrics = barycentrics;
+					hits[r].PrimitiveIndex = primIndices[p];
+				}
+			}
+		}
+	}
+
+	float SurfaceArea(const BVHNode& node)
+	{
+		float dx = node.BoundsMax.x - node.BoundsMin.x;
+		float dy = node.BoundsMax.y - node.BoundsMin.y;
+		float dz = node.BoundsMax.z - node.BoundsMin.z;
+		return 2.0f * (dx * dy + dy * dz + dz * dx);
+	}
+}
+
+template<UINT N>
+void WideBVH<N>::Build(const BVH& binary)
+{
+	span<const BVHNode> nodes = binary.GetNodes();
+
+	mOwner.reset();
+	mNodeStorage.clear();
+	mPrimIndexStorage.assign(binary.GetPrimitiveIndices().begin(), binary.GetPrimitiveIndices().end());
+	mTriangleStorage.assign(binary.GetTriangles().begin(), binary.GetTriangles().end());
+	mPrimIndices = mPrimIndexStorage;
+	mTriangles = mTriangleStorage;
+	mNodes = {};
+	mDepth = 0;
+
+	if (nodes.empty())
+		return;
+
+	// Empty slots get inverted bounds so the sign based slab test always misses them.
+	WideBVHNode<N> emptyNode;
+	for (UINT i = 0; i < N; ++i)
+	{
+		emptyNode.MinX[i] = emptyNode.MinY[i] = emptyNode.MinZ[i] = FLT_MAX;
+		emptyNode.MaxX[i] = emptyNode.MaxY[i] = emptyNode.MaxZ[i] = -FLT_MAX;
+		emptyNode.Child[i] = UINT_MAX;
+		emptyNode.Count[i] = 0;
+	}
+
+	struct CollapseTask
+	{
+		UINT BinaryNode;
+		UINT WideNode;
+		UINT Depth;
+	};
+	vector<CollapseTask> tasks;
+
+	mNodeStorage.reserve(nodes.size() / (N - 1) + 1);
+	mNodeStorage.push_back(emptyNode);
+	tasks.push_back({ 0, 0, 0 });
+
+	while (!tasks.empty())
+	{
+		CollapseTask task = tasks.back();
+		tasks.pop_back();
+
+		mDepth = max(mDepth, task.Depth);
+
+		UINT children[N];
+		UINT childCount = 0;
+
+		const BVHNode& source = nodes[task.BinaryNode];
+		if (source.Count > 0)
+		{
+			// Only happens when the binary root is a leaf.
+			children[childCount++] = task.BinaryNode;
+		}
+		else
+		{
+			children[childCount++] = source.LeftFirst;
+			children[childCount++] = source.LeftFirst + 1;
+		}
+
+		// Open the largest inner child until the node is full, large boxes are the ones most rays enter.
+		while (childCount < N)
+		{
+			int best = -1;
+			float bestArea = -1.0f;
+			for (UINT i = 0; i < childCount; ++i)
+			{
+				const BVHNode& child = nodes[children[i]];
+				if (child.Count > 0)
+					continue;
+
+				float area = SurfaceArea(child);
+				if (area > bestArea)
+				{
+					bestArea = area;
+					best = i;
+				}
+			}
+
+			if (best < 0)
+				break;
+
+			UINT opened = children[best];
+			children[best] = nodes[opened].LeftFirst;
+			children[childCount++] = nodes[opened].LeftFirst + 1;
+		}
+
+		for (UINT i = 0; i < childCount; ++i)
+		{
+			const BVHNode& child = nodes[children[i]];
+
+			// Fetched per child, push_back below may reallocate.
+			WideBVHNode<N>& wide = mNodeStorage[task.WideNode];
+			wide.MinX[i] = child.BoundsMin.x;
+			wide.MinY[i] = child.BoundsMin.y;
+			wide.MinZ[i] = child.BoundsMin.z;
+			wide.MaxX[i] = child.BoundsMax.x;
+			wide.MaxY[i] = child.BoundsMax.y;
+			wide.MaxZ[i] = child.BoundsMax.z;
+
+			if (child.Count > 0)
+			{
+				wide.Child[i] = child.LeftFirst;
+				wide.Count[i] = child.Count;
+				continue;
+			}
+
+			UINT wideChild = static_cast<UINT>(mNodeStorage.size());
+			wide.Child[i] = wideChild;
+			wide.Count[i] = 0;
+
+			mNodeStorage.push_back(emptyNode);
+			tasks.push_back({ children[i], wideChild, task.Depth + 1 });
+		}
+	}
+
+	mNodes = mNodeStorage;
+}
+
+template<UINT N>
+void WideBVH<N>::Attach(span<const WideBVHNode<N>> nodes, span<const UINT> primIndices, span<const BVHTriangle> triangles,
+	UINT depth, shared_ptr<const void> owner)
+{
+	mNodeStorage.clear();
+	mPrimIndexStorage.clear();
+	mTriangleStorage.clear();
+
+	mOwner = std::move(owner);
+	mNodes = nodes;
+	mPrimIndices = primIndices;
+	mTriangles = triangles;
+	mDepth = depth;
+}
+
+template<UINT N>
+bool WideBVH<N>::TraceRayImpl(const RayDesc& ray, RayHit& hit, bool acceptFirstHit, const AnyHitCallback& anyHit) const
+{
+	if (mNodes.empty())
+		return false;
+
+	TraversalRay traversalRay = MakeTraversalRay(ray);
+	XMVECTOR origin = XMLoadFloat3(&ray.Origin);
+	XMVECTOR direction = XMLoadFloat3(&ray.Direction);
+
+	float tMax = min(ray.TMax, hit.T);
+	bool found = false;
+
+	struct StackEntry
+	{
+		UINT Node;
+		float T;
+	};
+	StackEntry stack[mStackSize];
+	UINT stackSize = 0;
+	stack[stackSize++] = { 0, ray.TMin };
+
+	while (stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		if (entry.T > tMax)
+			continue;
+
+		const WideBVHNode<N>& node = mNodes[entry.Node];
+
+		alignas(32) float tEntry[N];
+		UINT mask = IntersectChildren<N>(node, traversalRay, tMax, tEntry);
+
+		// Leaves are tested right away, inner children are sorted far to near so the nearest is popped first.
+		StackEntry inner[N];
+		UINT innerCount = 0;
+
+		for (; mask != 0; mask &= mask - 1)
+		{
+			UINT i = countr_zero(mask);
+
+			if (node.Count[i] == 0)
+			{
+				UINT j = innerCount++;
+				for (; j > 0 && inner[j - 1].T < tEntry[i]; --j)
+					inner[j] = inner[j - 1];
+				inner[j] = { node.Child[i], tEntry[i] };
+				continue;
+			}
+
+			// A leaf tested earlier in this node may have moved tMax in front of this one.
+			if (tEntry[i] > tMax)
+				continue;
+
+			for (UINT p = node.Child[i]; p < node.Child[i] + node.Count[i]; ++p)
+			{
+				float t;
+				XMFLOAT2 barycentrics;
+				if (!BVH::IntersectTriangle(mTriangles[p], origin, direction, ray.TMin, tMax, t, barycentrics))
+					continue;
+
+				if (!anyHit.Invoke(anyHit.Context, mPrimIndices[p], barycentrics, t))
+					continue;
+
+				tMax = t;
+				hit.T = t;
+				hit.Barycentrics = barycentrics;
+				hit.PrimitiveIndex = mPrimIndices[p];
+				found = true;
+
+				if (acceptFirstHit)
+					return true;
+			}
+		}
+
+		for (UINT i = 0; i < innerCount; ++i)
+			stack[stackSize++] = inner[i];
+	}
+
+	return found;
+}
+
+template<UINT N>
+void WideBVH<N>::TracePacketImpl(const RayDesc* rays, RayHit* hits, UINT count, const AnyHitCallback& anyHit) const
+{
+	if (mNodes.empty() || count == 0)
+		return;
+
+	count = min(count, RayPacketSize);
+
+	RayPacket packet;
+	for (UINT r = 0; r < RayPacketSize; ++r)
+	{
+		const RayDesc& ray = rays[min(r, count - 1)];
+		packet.OriginX[r] = ray.Origin.x;
+		packet.OriginY[r] = ray.Origin.y;
+		packet.OriginZ[r] = ray.Origin.z;
+		packet.DirectionX[r] = ray.Direction.x;
+		packet.DirectionY[r] = ray.Direction.y;
+		packet.DirectionZ[r] = ray.Direction.z;
+		packet.InvDirectionX[r] = 1.0f / ray.Direction.x;
+		packet.InvDirectionY[r] = 1.0f / ray.Direction.y;
+		packet.InvDirectionZ[r] = 1.0f / ray.Direction.z;
+		packet.TMin[r] = ray.TMin;
+		packet.TMax[r] = r < count ? min(ray.TMax, hits[r].T) : -FLT_MAX;
+	}
+
+	struct StackEntry
+	{
+		UINT Node;
+		float T;
+	};
+	StackEntry stack[mStackSize];
+	UINT stackSize = 0;
+	stack[stackSize++] = { 0, 0.0f };
+
+	while (stackSize > 0)
+	{
+		const WideBVHNode<N>& node = mNodes[stack[--stackSize].Node];
+
+		StackEntry inner[N];
+		UINT innerCount = 0;
+
+		// Empty slots are always at the end of a node.
+		for (UINT i = 0; i < N && node.Child[i] != UINT_MAX; ++i)
+		{
+			float tEntry;
+			UINT mask = IntersectPacketBounds(packet, node, i, tEntry);
+			if (mask == 0)
+				continue;
+
+			if (node.Count[i] > 0)
+			{
+				IntersectPacketTriangles(packet, hits, mask, mTriangles.data(), mPrimIndices.data(), node.Child[i], node.Count[i], anyHit);
+				continue;
+			}
+
+			UINT j = innerCount++;
+			for (; j > 0 && inner[j - 1].T < tEntry; --j)
+				inner[j] = inner[j - 1];
+			inner[j] = { node.Child[i], tEntry };
+		}
+
+		for (UINT i = 0; i < innerCount; ++i)
+			stack[stackSize++] = inner[i];
+	}
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
@@ -0,0 +1,117 @@
+#pragma once
+#include "stdafx.h"
+#include "BVH.h"
+#include <immintrin.h>
+
+// Number of rays traced together by TracePacket, one 4x4 pixel block.
+const UINT RayPacketSize = 16;
+
+// Child bounds are stored SoA so all children of a node are tested in one SIMD pass.
+template<UINT N>
+struct alignas(32) WideBVHNode
+{
+	float MinX[N];
+	float MinY[N];
+	float MinZ[N];
+	float MaxX[N];
+	float MaxY[N];
+	float MaxZ[N];
+	UINT Child[N];		// Node index for inner children, first primitive for leaves. UINT_MAX for empty slots.
+	UINT Count[N];		// Primitive count for leaves, 0 for inner children.
+};
+
+// Type erased any-hit callback, keeps the SIMD kernels out of the header without the cost of std::function.
+struct AnyHitCallback
+{
+	const void* Context;
+	bool (*Invoke)(const void* context, UINT primitiveIndex, const XMFLOAT2& barycentrics, float t);
+};
+
+template<typename AnyHit>
+AnyHitCallback MakeAnyHitCallback(const AnyHit& anyHit)
+{
+	return { &anyHit, [](const void* context, UINT primitiveIndex, const XMFLOAT2& barycentrics, float t)
+		{
+			return (*static_cast<const AnyHit*>(context))(primitiveIndex, barycentrics, t);
+		} };
+}
+
+// N-wide BVH collapsed from the binary BVH, N is 4 (SSE) or 8 (AVX2, AVX-512).
+// Single rays test all children of a node at once, packets test one child against all rays at once.
+template<UINT N>
+class WideBVH
+{
+public:
+	static const UINT Width = N;
+
+	WideBVH() = default;
+	~WideBVH() = default;
+
+	// The views may point into the owned storage, copying would leave them dangling.
+	WideBVH(const WideBVH&) = delete;
+	WideBVH& operator=(const WideBVH&) = delete;
+	WideBVH(WideBVH&&) = default;
+	WideBVH& operator=(WideBVH&&) = default;
+
+	void Build(const BVH& binary);
+
+	// Traverses data owned by someone else, e.g. a mapped cache file, without copying it. The primitive order is
+	// the one of the binary BVH the nodes were collapsed from. owner is kept alive for as long as the BVH uses the data.
+	void Attach(span<const WideBVHNode<N>> nodes, span<const UINT> primIndices, span<const BVHTriangle> triangles,
+		UINT depth, shared_ptr<const void> owner);
+
+	// Same semantics as BVH::TraceRay, primitive indices refer to the triangles passed to BVH::Build.
+	template<typename AnyHit>
+	bool TraceRay(const RayDesc& ray, RayHit& hit, bool acceptFirstHit, AnyHit&& anyHit) const
+	{
+		return TraceRayImpl(ray, hit, acceptFirstHit, MakeAnyHitCallback(anyHit));
+	}
+
+	bool TraceRay(const RayDesc& ray, RayHit& hit) const
+	{
+		return TraceRay(ray, hit, false, [](UINT, const XMFLOAT2&, float) { return true; });
+	}
+
+	// Closest hit for up to RayPacketSize rays. Meant for coherent rays such as a block of camera rays,
+	// incoherent rays visit nodes for each other and should use TraceRay instead.
+	template<typename AnyHit>
+	void TracePacket(const RayDesc* rays, RayHit* hits, UINT count, AnyHit&& anyHit) const
+	{
+		TracePacketImpl(rays, hits, count, MakeAnyHitCallback(anyHit));
+	}
+
+	span<const WideBVHNode<N>> GetNodes() const { return mNodes; }
+	span<const UINT> GetPrimitiveIndices() const { return mPrimIndices; }
+	span<const BVHTriangle> GetTriangles() const { return mTriangles; }
+	UINT GetDepth() const { return mDepth; }
+
+private:
+	bool TraceRayImpl(const RayDesc& ray, RayHit& hit, bool acceptFirstHit, const AnyHitCallback& anyHit) const;
+	void TracePacketImpl(const RayDesc* rays, RayHit* hits, UINT count, const AnyHitCallback& anyHit) const;
+
+	// Every wide node consumes at least one binary level and pushes at most N - 1 extra entries.
+	static const UINT mStackSize = BVH::GetMaxDepth() * (N - 1) + 1;
+
+	// Filled by Build, empty when the BVH is attached to external data.
+	vector<WideBVHNode<N>> mNodeStorage;
+	vector<UINT> mPrimIndexStorage;
+	vector<BVHTriangle> mTriangleStorage;
+	shared_ptr<const void> mOwner;
+
+	// What traversal reads, either the storage above or attached data.
+	span<const WideBVHNode<N>> mNodes;
+	span<const UINT> mPrimIndices;
+	span<const BVHTriangle> mTriangles;
+
+	UINT mDepth = 0;
+};
+
+using BVH4 = WideBVH<4>;
+using BVH8 = WideBVH<8>;
+
+// Widest node that fits one register of the instruction set the project is compiled for.
+#if defined(__AVX2__)
+using NativeWideBVH = BVH8;
+#else
+using NativeWideBVH = BVH4;
+#endif
@@ -1,5 +1,8 @@
 #include "stdafx.h"
 #include "Framework.h"
+#include "Profiler.h"
+#include "SelfTest.h"
+#include "VertexOcclusion.h"
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, LPWSTR, int mCmdShow)
 {
@@ -9,7 +12,87 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, LPWSTR, int mCmdShow)
 	try
 	{
 		CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+		int argc = 0;
+		LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+		vector<wstring> args(argv, argv + argc);
+		LocalFree(argv);
+
 		Framework app;
+		Profiler::SetThreadName("Main");
+
+		// --trace <file> writes a Chrome trace of startup and frame timings on exit.
+		auto trace = find(args.begin(), args.end(), L"--trace");
+		if (trace != args.end() && trace + 1 != args.end())
+			app.SetTracePath(*(trace + 1));
+
+		// --bake-occlusion bakes vertex occlusion on import when its cache is missing or stale, otherwise the cache is only read.
+		if (find(args.begin(), args.end(), L"--bake-occlusion") != args.end())
+			SetVertexOcclusionBaking(true);
+
+		// --benchmark <camera path> [--frames N] [--software] plays a recorded path without showing the window and exits.
+		auto benchmark = find(args.begin(), args.end(), L"--benchmark");
+		if (benchmark != args.end() && benchmark + 1 != args.end())
+		{
+			auto frames = find(args.begin(), args.end(), L"--frames");
+			uint32_t frameCount = frames != args.end() && frames + 1 != args.end() ? stoul(*(frames + 1)) : 0;
+			bool software = find(args.begin(), args.end(), L"--software") != args.end();
+
+			if (!software)
+				app.Init("Chulsu Benchmark");
+			return app.RunBenchmark(*(benchmark + 1), frameCount, software) ? 0 : -1;
+		}
+
+		// --software <image> [--samples N] renders one frame, or the average of N jittered frames, on the CPU and exits.
+		// The image format follows the extension, see CpuRayTracer::SaveImage.
+		auto software = find(args.begin(), args.end(), L"--software");
+		if (software != args.end() && software + 1 != args.end())
+		{
+			auto samples = find(args.begin(), args.end(), L"--samples");
+			uint32_t sampleCount = samples != args.end() && samples + 1 != args.end() ? stoul(*(samples + 1)) : 1;
+			return app.RunSoftware(*(software + 1), sampleCount) ? 0 : -1;
+		}
+
+		// --light-culling-test [N] shades N random lights with and without the light grid on the CPU and exits with -1 when they differ.
+		auto lightCulling = find(args.begin(), args.end(), L"--light-culling-test");
+		if (lightCulling != args.end())
+		{
+			// The count is optional, a following flag is not taken for it
+			bool hasCount = lightCulling + 1 != args.end() && (lightCulling + 1)->rfind(L"--", 0) != 0;
+			uint32_t lightCount = hasCount ? stoul(*(lightCulling + 1)) : 256;
+			return app.RunLightCullingTest(lightCount) ? 0 : -1;
+		}
+
+		// --self-test runs the checks of SelfTest.cpp and exits with -1 when one of them failed.
+		if (find(args.begin(), args.end(), L"--self-test") != args.end())
+			return RunSelfTests() ? 0 : -1;
+
+		// --bake-probes [spacing] bakes the irradiance probe volume on the CPU, writes it next to the scene and exits.
+		auto bakeProbes = find(args.begin(), args.end(), L"--bake-probes");
+		if (bakeProbes != args.end())
+		{
+			bool hasSpacing = bakeProbes + 1 != args.end() && (bakeProbes + 1)->rfind(L"--", 0) != 0;
+			float spacing = hasSpacing ? stof(*(bakeProbes + 1)) : 100.0f;
+			return app.RunProbeBake(spacing) ? 0 : -1;
+		}
+
+		// --sh-benchmark [N] projects the sky into spherical harmonics N times on the CPU and exits.
+		auto shBenchmark = find(args.begin(), args.end(), L"--sh-benchmark");
+		if (shBenchmark != args.end())
+		{
+			bool hasCount = shBenchmark + 1 != args.end() && (shBenchmark + 1)->rfind(L"--", 0) != 0;
+			uint32_t repeatCount = hasCount ? stoul(*(shBenchmark + 1)) : 10;
+			app.RunSHBenchmark(repeatCount);
+			return 0;
+		}
+
+		// --bvh-benchmark measures CPU traversal throughput and exits.
+		if (find(args.begin(), args.end(), L"--bvh-benchmark") != args.end())
+		{
+			app.RunBVHBenchmark();
+			return 0;
+		}
+
 		app.Init("Chulsu Renderer");
 		app.Run();
 	}
@@ -8,6 +8,7 @@
 
 #include <Windows.h>
 #include <windowsx.h>
+#include <shellapi.h>
 #include <sdkddkver.h>
 #include <wrl.h>
 #include <comdef.h>
@@ -30,11 +31,13 @@
 #include <array>
 #include <vector>
 #include <stack>
+#include <deque>
 #include <set>
 #include <map>
 #include <unordered_map>
 #include <string>
 #include <sstream>
+#include <iomanip>
 #include <memory>
 #include <fstream>
 #include <iostream>
@@ -47,6 +50,16 @@
 #include <codecvt>
 #include <filesystem>
 #include <span>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <numeric>
+#include <bit>
+#include <random>
+#include <span>
 #include <DXProgrammableCapture.h>
 #include <dstorage.h>
 
@@ -75,6 +88,7 @@ static dxc::DxcDllSupport gDxcDllSupport;
 #define align_to(_alignment, _val) (((_val + _alignment - 1) / _alignment) * _alignment)
 
 #define MAX_TEXTURE_SUBRESOURCE_COUNT 3
+#define RAY_TYPE_COUNT 2 // Primary and shadow, must match DefaultRayTrace.hlsl
 #define PI 3.1415926535f
 
 class ResourceStateTracker
@@ -130,6 +144,14 @@ inline string wstringTostring(const wstring& ws)
 	return s;
 }
 
+inline void DebugLog(const string& msg)
+{
+#ifdef _WIN32
+	OutputDebugStringA((msg + "\n").c_str());
+#endif
+	cerr << msg << endl;
+}
+
 template<class BlotType>
 inline std::string ConvertBlobToString(BlotType* pBlob)
 {